@@ -102,7 +102,7 @@ def doLibc(builddir, inputLibcA, glue_name, pedigree_c_name, ar, cc, strip, libg
     else:
         target = cc.split('-')[0]
         if target in ['x86_64', 'amd64', 'i686']:
-            objs_to_remove.extend(['memcpy',])
+            objs_to_remove.extend(['memcpy', 'memmove', 'memset',])
         elif target in ['arm']:
             objs_to_remove.extend(['access',])
 
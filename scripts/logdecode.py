@@ -0,0 +1,96 @@
+'''
+Copyright (c) 2008-2014, Pedigree Developers
+
+Please see the CONTRIB file in the root of the source tree for a full
+list of contributors.
+
+Permission to use, copy, modify, and distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+'''
+
+# Decodes the kernel log written to serial with --binary-log-to-serial.
+#
+# Each record is 0xFF, then (cpu << 3) | level, then the timestamp (in timer
+# ticks) and the length of the text as little-endian base-128 varints, then
+# the text. Anything else in the capture (e.g. output from before the log
+# was set up) is skipped.
+#
+# Usage: logdecode.py serial.log
+
+import sys
+
+MAGIC = 0xFF
+LEVELS = ['DD', 'NN', 'WW', 'EE', 'FF']
+
+
+class EarlyEof(Exception):
+    pass
+
+
+def varint(data, i):
+    value = 0
+    shift = 0
+    while True:
+        if i >= len(data):
+            raise EarlyEof("early EOF hit (probably truncated file)")
+        b = data[i]
+        i += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not (b & 0x80):
+            return value, i
+
+
+def decode(data, out):
+    i = 0
+    while i < len(data):
+        if data[i] != MAGIC:
+            i += 1
+            continue
+
+        try:
+            if i + 1 >= len(data):
+                raise EarlyEof("early EOF hit (probably truncated file)")
+            cpu = data[i + 1] >> 3
+            level = data[i + 1] & 0x7
+            timestamp, j = varint(data, i + 2)
+            length, j = varint(data, j)
+            if j + length > len(data):
+                raise EarlyEof("early EOF hit (probably truncated file)")
+        except EarlyEof as e:
+            sys.stderr.write("%s\n" % e)
+            break
+
+        text = bytes(data[j:j + length]).decode('ascii', 'replace')
+        if level < len(LEVELS):
+            tag = LEVELS[level]
+        else:
+            tag = 'XX'
+
+        out.write("[%10d] cpu%-2d (%s) %s\n" % (timestamp, cpu, tag, text))
+        i = j + length
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: %s serial.log\n" % sys.argv[0])
+        return 1
+
+    with open(sys.argv[1], 'rb') as f:
+        data = bytearray(f.read())
+
+    decode(data, sys.stdout)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -46,3 +46,28 @@ uint64_t ScsiController::executeRequest(uint64_t p1, uint64_t p2, uint64_t p3, u
     else
         return 0;
 }
+
+size_t ScsiController::takeAdjacent(uint64_t type, ScsiDisk *pDisk, uint64_t location, size_t nMax)
+{
+    if(nMax > MaxRequestPages - 1 - m_nAdjacent)
+        nMax = MaxRequestPages - 1 - m_nAdjacent;
+
+    size_t n = 0;
+    for(; n < nMax; n++)
+    {
+        location += 4096;
+        Request *pReq = takeRequest(type, reinterpret_cast<uint64_t> (pDisk), location);
+        if(!pReq)
+            break;
+        m_pAdjacent[m_nAdjacent++] = pReq;
+    }
+
+    return n;
+}
+
+void ScsiController::completeAdjacent(uint64_t ret)
+{
+    for(size_t i = 0; i < m_nAdjacent; i++)
+        completeRequest(m_pAdjacent[i], ret);
+    m_nAdjacent = 0;
+}
@@ -29,19 +29,42 @@
 #define SCSI_REQUEST_WRITE      2
 #define SCSI_REQUEST_SYNC       3
 
+class ScsiDisk;
+
 /** Generic class for Scsi Controllers */
 class ScsiController: public Controller, public RequestQueue
 {
     public:
 
-        inline ScsiController()
+        inline ScsiController() : m_nAdjacent(0)
         {
             // Start the RequestQueue
             initialise();
         }
         inline virtual ~ScsiController(){}
 
-        virtual bool sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t nCommandSize, uintptr_t pRespBuffer, uint16_t nRespBytes, bool bWrite) =0;
+        virtual bool sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t nCommandSize, uintptr_t pRespBuffer, size_t nRespBytes, bool bWrite) =0;
+
+        /** Largest number of bytes a single command may transfer. */
+        virtual size_t getMaxTransferSize()
+        {
+            return 0x10000;
+        }
+
+        /** Most pages a disk may transfer for a single request, counting the
+         *  requests merged into it. */
+        static const size_t MaxRequestPages = 32;
+
+        /** Called by a disk from the worker thread: takes the waiting requests of
+         *  the given type for the pages directly following location out of the
+         *  queue, so they can be carried out with a single command. The disk then
+         *  calls completeAdjacent().
+         *\param nMax the most requests to take
+         *\return the number of requests (and so pages) taken */
+        size_t takeAdjacent(uint64_t type, ScsiDisk *pDisk, uint64_t location, size_t nMax);
+
+        /** Wakes the callers of the requests taken by takeAdjacent(). */
+        void completeAdjacent(uint64_t ret);
 
         virtual uint64_t executeRequest(uint64_t p1, uint64_t p2, uint64_t p3, uint64_t p4,
                                         uint64_t p5, uint64_t p6, uint64_t p7, uint64_t p8);
@@ -51,6 +74,12 @@ class ScsiController: public Controller, public RequestQueue
         virtual size_t getNumUnits() =0;
 
         void searchDisks();
+
+    private:
+
+        /** Requests taken by takeAdjacent(), only used by the worker thread. */
+        Request *m_pAdjacent[MaxRequestPages - 1];
+        size_t m_nAdjacent;
 };
 
 #endif
@@ -29,12 +29,14 @@
 
 #define delay(n) do{Semaphore semWAIT(0);semWAIT.acquire(1, 0, n*1000);}while(0)
 
-ScsiDisk::ScsiDisk() : Disk(), m_Cache(), m_nAlignPoints(0), m_NumBlocks(0), m_BlockSize(0)
+ScsiDisk::ScsiDisk() : Disk(), m_Cache(), m_nAlignPoints(0), m_NumBlocks(0), m_BlockSize(0),
+    m_NextSequentialRead(~0ULL), m_pBounceBuffer(0)
 {
 }
 
 ScsiDisk::~ScsiDisk()
 {
+    delete [] m_pBounceBuffer;
 }
 
 bool ScsiDisk::initialise(ScsiController *pController, size_t nUnit)
@@ -200,7 +202,7 @@ bool ScsiDisk::getCapacityInternal(size_t *blockNumber, size_t *blockSize)
     return true;
 }
 
-bool ScsiDisk::sendCommand(ScsiCommand *pCommand, uintptr_t pRespBuffer, uint16_t nRespBytes, bool bWrite)
+bool ScsiDisk::sendCommand(ScsiCommand *pCommand, uintptr_t pRespBuffer, size_t nRespBytes, bool bWrite)
 {
     uintptr_t pCommandBuffer = 0;
     size_t nCommandSize = pCommand->serialise(pCommandBuffer);
@@ -308,145 +310,181 @@ void ScsiDisk::align(uint64_t location)
     m_AlignPoints[m_nAlignPoints++] = location;
 }
 
-uint64_t ScsiDisk::doRead(uint64_t location)
+size_t ScsiDisk::maxTransferPages(uint64_t location)
 {
-    // Wait for the unit to be ready before reading
-    bool bReady = false;
-    for(int i = 0; i < 3; i++)
+    size_t nPages = ScsiController::MaxRequestPages;
+    size_t nControllerPages = m_pController->getMaxTransferSize() / 4096;
+    if(nControllerPages < nPages)
+        nPages = nControllerPages;
+
+    // READ(10) and WRITE(10) can only count 65535 blocks.
+    size_t nCommandPages = (0xFFFF * m_BlockSize) / 4096;
+    if(nCommandPages < nPages)
+        nPages = nCommandPages;
+
+    // Don't run off the end of the disk. A partial last page still counts
+    // as a page; transfer() trims it.
+    uint64_t diskSize = static_cast<uint64_t>(m_NumBlocks) * m_BlockSize;
+    if(location < diskSize)
     {
-        if((bReady = unitReady()))
-            break;
+        uint64_t nRemaining = (diskSize - location + 4095) / 4096;
+        if(nRemaining < nPages)
+            nPages = nRemaining;
     }
 
-    if(!bReady)
+    return nPages ? nPages : 1;
+}
+
+bool ScsiDisk::transfer(uint64_t location, uintptr_t buffer, size_t nBytes, bool bWrite)
+{
+    // The last page may run past the end of the disk.
+    uint64_t diskSize = static_cast<uint64_t>(m_NumBlocks) * m_BlockSize;
+    if(location < diskSize && nBytes > diskSize - location)
+        nBytes = diskSize - location;
+
+    uint32_t nLba = location / m_BlockSize;
+    uint32_t nBlocks = nBytes / m_BlockSize;
+
+    // Fall back to the 12- and 16-byte commands if the 10-byte one keeps failing.
+    for(int i = 0; i < 9; i++)
     {
-        ERROR("ScsiDisk::doRead - unit not ready");
-        return 0;
+        // A failure may just mean the unit became not ready, which TEST UNIT READY
+        // also clears any pending unit attention for.
+        if(i && !unitReady())
+            WARNING("ScsiDisk::transfer - unit not ready");
+
+        ScsiCommand *pCommand;
+        if(i < 3)
+        {
+            if(bWrite)
+                pCommand = new ScsiCommands::Write10(nLba, nBlocks);
+            else
+                pCommand = new ScsiCommands::Read10(nLba, nBlocks);
+        }
+        else if(i < 6)
+        {
+            if(bWrite)
+                pCommand = new ScsiCommands::Write12(nLba, nBlocks);
+            else
+                pCommand = new ScsiCommands::Read12(nLba, nBlocks);
+        }
+        else
+        {
+            if(bWrite)
+                pCommand = new ScsiCommands::Write16(nLba, nBlocks);
+            else
+                pCommand = new ScsiCommands::Read16(nLba, nBlocks);
+        }
+
+        bool bOk = sendCommand(pCommand, buffer, nBytes, bWrite);
+        delete pCommand;
+        if(bOk)
+            return true;
     }
 
+    return false;
+}
+
+uint64_t ScsiDisk::doRead(uint64_t location)
+{
     // Handle the case where a read took place while we were waiting in the
-    // RequestQueue - don't double up the cache.
-    uintptr_t buffer = m_Cache.lookup(location);
-    if(buffer)
+    // RequestQueue (or a readahead brought the page in) - don't double up the cache.
+    if(m_Cache.lookup(location))
     {
-        WARNING("ScsiDisk::doRead(" << location << ") - buffer was already in cache");
+        m_Cache.release(location);
         return 0;
     }
-    buffer = m_Cache.insert(location, 4096);
-    if(!buffer)
+
+    // Find how many of the following pages aren't cached yet - these can be read
+    // with the same command.
+    size_t nMax = maxTransferPages(location);
+    size_t nAvailable = 1;
+    for(; nAvailable < nMax; nAvailable++)
     {
-        FATAL("ScsiDisk::doRead - no buffer");
+        uint64_t next = location + (nAvailable * 4096);
+        if(m_Cache.lookup(next))
+        {
+            m_Cache.release(next);
+            break;
+        }
     }
 
-    // Grab our parent.
-    ScsiController *pParent = static_cast<ScsiController*> (m_pParent);
+    // Pick up any reads of those pages waiting in the queue, and read ahead as far
+    // as we can if this read continues the last one.
+    size_t nPages = 1 + m_pController->takeAdjacent(SCSI_REQUEST_READ, this, location, nAvailable - 1);
+    if(location == m_NextSequentialRead)
+        nPages = nAvailable;
 
-    bool bOk;
-    ScsiCommand *pCommand;
-    
-    for(int i = 0; i < 3; i++)
-    {
-        DEBUG_LOG("SCSI: trying read(10)");
-        pCommand = new ScsiCommands::Read10((location / m_BlockSize), 4096 / m_BlockSize);
-        bOk = sendCommand(pCommand, buffer, 4096);
-        delete pCommand;
-        if(bOk)
-            return 0;
-    }
-    for(int i = 0; i < 3; i++)
-    {
-        DEBUG_LOG("SCSI: trying read(12)");
-        pCommand = new ScsiCommands::Read12((location / m_BlockSize), 4096 / m_BlockSize);
-        bOk = sendCommand(pCommand, buffer, 4096);
-        delete pCommand;
-        if(bOk)
-            return 0;
-    }
-    for(int i = 0; i < 3; i++)
+    uintptr_t buffer = m_Cache.insert(location, nPages * 4096);
+    if(!buffer)
     {
-        DEBUG_LOG("SCSI: trying read(16)");
-        pCommand = new ScsiCommands::Read16((location / m_BlockSize), 4096 / m_BlockSize);
-        bOk = sendCommand(pCommand, buffer, 4096);
-        delete pCommand;
-        if(bOk)
-            return 0;
+        FATAL("ScsiDisk::doRead - no buffer");
     }
 
-    ERROR("SCSI: reading failed?");
+    if(!transfer(location, buffer, nPages * 4096, false))
+        ERROR("SCSI: reading failed?");
+
+    m_NextSequentialRead = location + (nPages * 4096);
+    m_pController->completeAdjacent(0);
 
     return 0;
 }
 
 uint64_t ScsiDisk::doWrite(uint64_t location)
 {
-    // Wait for the unit to be ready before writing
-    bool bReady = false;
-    for(int i = 0; i < 3; i++)
-    {
-        if((bReady = unitReady()))
-            break;
-    }
-
-    if(!bReady)
-    {
-        ERROR("ScsiDisk::doWrite - unit not ready");
-        return 0;
-    }
-
-    // Handle the case where a read took place while we were waiting in the
-    // RequestQueue - don't double up the cache.
     uintptr_t buffer = m_Cache.lookup(location);
     if(!buffer)
     {
         WARNING("ScsiDisk::doWrite(" << location << ") - buffer was not in cache");
         return 0;
     }
-
-    // Grab our parent.
-    ScsiController *pParent = static_cast<ScsiController*> (m_pParent);
-
-    bool bOk;
-    ScsiCommand *pCommand;
-
-    for(int i = 0; i < 3; i++)
+    m_Cache.release(location);
+
+    // Find how many of the following pages are in the cache, and whether they
+    // directly follow this one in memory.
+    size_t nMax = maxTransferPages(location);
+    size_t nAvailable = 1;
+    bool bContiguous = true;
+    for(; nAvailable < nMax; nAvailable++)
     {
-        DEBUG_LOG("SCSI: trying write(10)");
-        pCommand = new ScsiCommands::Write10((location / m_BlockSize), 4096 / m_BlockSize);
-        bOk = sendCommand(pCommand, buffer, 4096, true);
-        delete pCommand;
-        if(bOk)
+        uint64_t next = location + (nAvailable * 4096);
+        uintptr_t nextBuffer = m_Cache.lookup(next);
+        if(!nextBuffer)
             break;
+        m_Cache.release(next);
+        if(nextBuffer != buffer + (nAvailable * 4096))
+            bContiguous = false;
     }
-    if(!bOk)
-    {
-        for(int i = 0; i < 3; i++)
-        {
-            DEBUG_LOG("SCSI: trying write(12)");
-            pCommand = new ScsiCommands::Write12((location / m_BlockSize), 4096 / m_BlockSize);
-            bOk = sendCommand(pCommand, buffer, 4096, true);
-            delete pCommand;
-            if(bOk)
-                break;
-        }
-    }
-    if(!bOk)
+
+    // Write out any waiting writes of those pages along with this one.
+    size_t nPages = 1 + m_pController->takeAdjacent(SCSI_REQUEST_WRITE, this, location, nAvailable - 1);
+
+    // Pages that were cached separately are gathered into the bounce buffer.
+    // Only the worker thread gets here, so it can't be in use already.
+    uintptr_t source = buffer;
+    if(nPages > 1 && !bContiguous)
     {
-        for(int i = 0; i < 3; i++)
+        if(!m_pBounceBuffer)
+            m_pBounceBuffer = new uint8_t[ScsiController::MaxRequestPages * 4096];
+
+        for(size_t i = 0; i < nPages; i++)
         {
-            DEBUG_LOG("SCSI: trying write(16)");
-            pCommand = new ScsiCommands::Write16((location / m_BlockSize), 4096 / m_BlockSize);
-            bOk = sendCommand(pCommand, buffer, 4096, true);
-            delete pCommand;
-            if(bOk)
-                break;
+            uint64_t page = location + (i * 4096);
+            uintptr_t pageBuffer = m_Cache.lookup(page);
+            memcpy(m_pBounceBuffer + (i * 4096), reinterpret_cast<void*>(pageBuffer), 4096);
+            m_Cache.release(page);
         }
+
+        source = reinterpret_cast<uintptr_t>(m_pBounceBuffer);
     }
 
-    if(!bOk)
+    if(!transfer(location, source, nPages * 4096, true))
     {
         ERROR("SCSI: writing failed?");
     }
 
+    m_pController->completeAdjacent(0);
+
     return 0;
 }
 
@@ -95,7 +95,14 @@ class ScsiDisk : public Disk
 
         bool readSense(Sense *s);
 
-        bool sendCommand(ScsiCommand *pCommand, uintptr_t pRespBuffer, uint16_t nRespBytes, bool bWrite=false);
+        bool sendCommand(ScsiCommand *pCommand, uintptr_t pRespBuffer, size_t nRespBytes, bool bWrite=false);
+
+        /** Reads or writes nBytes at location, retrying and falling back to the
+         *  longer forms of the command on failure. */
+        bool transfer(uint64_t location, uintptr_t buffer, size_t nBytes, bool bWrite);
+
+        /** Most pages a single command starting at location may transfer. */
+        size_t maxTransferPages(uint64_t location);
 
         bool getCapacityInternal(size_t *blockNumber, size_t *blockSize);
 
@@ -110,6 +117,12 @@ class ScsiDisk : public Disk
         size_t m_NumBlocks;
         size_t m_BlockSize;
 
+        /** Where the last read ended, to detect sequential reads. */
+        uint64_t m_NextSequentialRead;
+
+        /** Gathers writes of pages that aren't contiguous in the cache. */
+        uint8_t *m_pBounceBuffer;
+
         /** Default block size for a device */
         inline size_t defaultBlockSize()
         {
@@ -328,14 +328,15 @@ void Ehci::doDequeue()
             continue;
         }
 
-        // Remove all qTDs
+        // Remove all qTDs. The last one may still point on to the qTDs of
+        // the next transaction on the endpoint.
         size_t nQTDIndex = INDEX_FROM_QTD(pQH->pMetaData->pFirstQTD);
         while(true)
         {
             m_qTDBitmap.clear(nQTDIndex);
 
             qTD *pqTD = &m_pqTDList[nQTDIndex];
-            bool shouldBreak = pqTD->bNextInvalid;
+            bool shouldBreak = pqTD->bNextInvalid || (pqTD == pQH->pMetaData->pLastQTD);
             if(!shouldBreak)
                 nQTDIndex = ((pqTD->pNext << 5) & 0xFFF) / sizeof(qTD);
 
@@ -414,6 +415,10 @@ void Ehci::interrupt(size_t number, InterruptState &state)
         }
     }
 
+    // Callbacks for completed transactions are made once the whole schedule
+    // has been looked at.
+    CompletionBatch completions;
+
     // Because there's no IOC for *every* transfer, we need to handle errors
     // that occur before the last transfer. These will create an error status only.
     if(nStatus & (EHCI_STS_INT | EHCI_STS_ERR))
@@ -466,14 +471,29 @@ void Ehci::interrupt(size_t number, InterruptState &state)
                     // Last qTD or error condition?
                     if((nResult < 0) || (pqTD == pQH->pMetaData->pLastQTD))
                     {
-                        // Valid callback?
-                        if(pQH->pMetaData->pCallback)
-                            pQH->pMetaData->pCallback(pQH->pMetaData->pParam, nResult < 0 ? nResult : pQH->pMetaData->nTotalBytes);
+                        // Interrupt transfers reuse their buffer, so their
+                        // callbacks can't wait.
+                        ssize_t nTransactionResult = nResult < 0 ? nResult : pQH->pMetaData->nTotalBytes;
+                        if(bPeriodic && pQH->pMetaData->pCallback)
+                            pQH->pMetaData->pCallback(pQH->pMetaData->pParam, nTransactionResult);
+                        else if(!bPeriodic)
+                            completions.add(pQH->pMetaData->pCallback, pQH->pMetaData->pParam, nTransactionResult);
 
                         if(!bPeriodic)
                         {
                             // Ensure the list doesn't change as we modify it
                             m_QueueListChangeLock.acquire(); // Atomic operation
+
+                            // The next transaction on this endpoint is chained
+                            // on behind this one - carry on with it on this QH.
+                            if((nResult >= 0) && pQH->pMetaData->pQueued)
+                            {
+                                advanceQueue(pQH);
+                                m_QueueListChangeLock.release();
+
+                                nQTDIndex = INDEX_FROM_QTD(pQH->pMetaData->pFirstQTD);
+                                continue;
+                            }
                             
                             // Was the reclaim head bit set?
                             if(pQH->hrcl)
@@ -503,6 +523,14 @@ void Ehci::interrupt(size_t number, InterruptState &state)
                             
                             // Now ready for dequeue.
                             pQH->pMetaData->bIgnore = true;
+
+                            // This QH halted, so the next transaction on this
+                            // endpoint starts on its own.
+                            if(pQH->pMetaData->pQueued)
+                            {
+                                linkQH(pQH->pMetaData->pQueued);
+                                pQH->pMetaData->pQueued = 0;
+                            }
                             
                             m_QueueListChangeLock.release();
                         }
@@ -526,7 +554,8 @@ void Ehci::interrupt(size_t number, InterruptState &state)
 
                 size_t oldIndex = nQTDIndex;
 
-                if(pqTD->bNextInvalid)
+                // The qTDs after the last belong to the next transaction.
+                if(pqTD->bNextInvalid || (pqTD == pQH->pMetaData->pLastQTD))
                     break;
                 else
                     nQTDIndex = ((pqTD->pNext << 5) & 0xFFF) / sizeof(qTD);
@@ -545,6 +574,8 @@ void Ehci::interrupt(size_t number, InterruptState &state)
         }
     }
 
+    completions.run();
+
     if(nStatus & EHCI_STS_ASYNCADVANCE)
     {
         Thread *pThread = new Thread(Processor::information().getCurrentThread()->getParent(), threadStub, reinterpret_cast<void*>(this));
@@ -700,6 +731,7 @@ uintptr_t Ehci::createTransaction(UsbEndpoint endpointInfo)
     pMetaData->pLastQTD = 0;
     pMetaData->pNext = 0;
     pMetaData->pPrev = 0;
+    pMetaData->pQueued = 0;
     pMetaData->bIgnore = false;
     pMetaData->nTotalBytes = 0;
 
@@ -734,6 +766,90 @@ void Ehci::doAsync(uintptr_t nTransaction, void (*pCallback)(uintptr_t, ssize_t)
     DEBUG_LOG("START #" << Dec << nTransaction << Hex << " " << Dec << pQH->nAddress << ":" << pQH->nEndpoint << Hex);
 #endif
 
+    // Atomic operation - modifying both the housekeeping and the hardware
+    // linked lists
+    LockGuard<Spinlock> listGuard(m_QueueListChangeLock);
+
+    // If a transaction is already in flight on this endpoint, chain our qTDs
+    // on behind the last ones queued on its QH rather than having the
+    // controller alternate between two QHs. It runs straight on into them, and
+    // the IRQ handler hands the QH over to us once those ahead complete.
+    QH *pActive = findActiveQH(pQH);
+    if(pActive)
+    {
+        while(pActive->pMetaData->pQueued)
+            pActive = pActive->pMetaData->pQueued;
+        pActive->pMetaData->pQueued = pQH;
+
+        qTD *pTail = pActive->pMetaData->pLastQTD;
+        pTail->pNext = PHYS_QTD(INDEX_FROM_QTD(pQH->pMetaData->pFirstQTD)) >> 5;
+        pTail->bNextInvalid = 0;
+        return;
+    }
+
+    linkQH(pQH);
+}
+
+void Ehci::advanceQueue(QH *pQH)
+{
+    QH::MetaData *pMetaData = pQH->pMetaData;
+    QH *pNextQH = pMetaData->pQueued;
+    QH::MetaData *pNextMetaData = pNextQH->pMetaData;
+
+    qTD *pOldFirst = pMetaData->pFirstQTD;
+    qTD *pOldLast = pMetaData->pLastQTD;
+
+    // Take on the queued transaction. Its own QH was never linked in.
+    pMetaData->pCallback = pNextMetaData->pCallback;
+    pMetaData->pParam = pNextMetaData->pParam;
+    pMetaData->pFirstQTD = pNextMetaData->pFirstQTD;
+    pMetaData->pLastQTD = pNextMetaData->pLastQTD;
+    pMetaData->nTotalBytes = 0;
+    pMetaData->pQueued = pNextMetaData->pQueued;
+
+    // The finished qTDs go with that QH, to be freed with it by the dequeue
+    // thread after the next async advance.
+    pNextMetaData->pFirstQTD = pOldFirst;
+    pNextMetaData->pLastQTD = pOldLast;
+    pNextMetaData->pQueued = 0;
+    pNextMetaData->bIgnore = true;
+
+    size_t cmdReg = m_pBase->read32(m_nOpRegsOffset + EHCI_CMD);
+    m_pBase->write32(cmdReg | (1 << 6), m_nOpRegsOffset + EHCI_CMD);
+
+    // If the controller fetched the old last qTD before the new ones were
+    // chained on, it has stopped with nothing to follow. The QH is idle, so
+    // it's safe to point the overlay at them.
+    if(!(pQH->overlay.nStatus & 0x80) && pQH->overlay.bNextInvalid &&
+       (pQH->pQTD == (PHYS_QTD(INDEX_FROM_QTD(pOldLast)) >> 5)))
+    {
+        pQH->overlay.pNext = PHYS_QTD(INDEX_FROM_QTD(pMetaData->pFirstQTD)) >> 5;
+        pQH->overlay.bNextInvalid = 0;
+    }
+}
+
+Ehci::QH *Ehci::findActiveQH(QH *pQH)
+{
+    bool bControl = !pQH->nEndpoint;
+    size_t nPid = pQH->pMetaData->pFirstQTD->nPid;
+
+    for(QH *pOther = m_pCurrentQueueHead->pMetaData->pNext; pOther != m_pCurrentQueueHead; pOther = pOther->pMetaData->pNext)
+    {
+        if(pOther->nAddress != pQH->nAddress || pOther->nEndpoint != pQH->nEndpoint)
+            continue;
+
+        // Bulk endpoints are one-way; an IN and an OUT endpoint may share a number
+        if(!bControl && pOther->pMetaData->pFirstQTD->nPid != nPid)
+            continue;
+
+        return pOther;
+    }
+
+    return 0;
+}
+
+void Ehci::linkQH(QH *pQH)
+{
     // Link in to the asynchronous schedule
     if(m_pCurrentQueueTail)
     {
@@ -752,28 +868,23 @@ void Ehci::doAsync(uintptr_t nTransaction, void (*pCallback)(uintptr_t, ssize_t)
 
         QH *pOldTail = m_pCurrentQueueTail;
 
-        {
-            // Atomic operation - modifying both the housekeeping and the
-            // hardware linked lists
-            LockGuard<Spinlock> guard(m_QueueListChangeLock);
-
-            // Update the tail pointer
-            m_pCurrentQueueTail = pQH;
+        // Update the tail pointer
+        m_pCurrentQueueTail = pQH;
 
-            // The current tail needs to point to this QH
-            pOldTail->pNext = (m_pQHListPhys + (nTransaction * sizeof(QH))) >> 5;
-            pOldTail->nNextType = 1; // QH
+        // The current tail needs to point to this QH
+        size_t nIndex = (reinterpret_cast<uintptr_t>(pQH) - reinterpret_cast<uintptr_t>(m_pQHList)) / sizeof(QH);
+        pOldTail->pNext = (m_pQHListPhys + (nIndex * sizeof(QH))) >> 5;
+        pOldTail->nNextType = 1; // QH
 
-            // Finally, fix the linked list
-            pOldTail->pMetaData->pNext = pQH;
-        }
+        // Finally, fix the linked list
+        pOldTail->pMetaData->pNext = pQH;
 
         // No longer reclaiming
         m_pCurrentQueueHead->hrcl = 1;
     }
     else
     {
-        ERROR("EHCI: Queue tail is null!");
+        ERROR_NOLOCK("EHCI: Queue tail is null!");
     }
 }
 
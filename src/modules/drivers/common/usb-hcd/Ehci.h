@@ -131,6 +131,10 @@ class Ehci : public UsbHub,
                 QH *pPrev;
                 QH *pNext;
 
+                /// The next transaction on the same endpoint, whose qTDs are chained
+                /// on after this one's. Its QH is never linked in itself.
+                QH *pQueued;
+
                 bool bIgnore; /// Ignore this QH when iterating over the list - don't look at any of its qTDs
             } *pMetaData;
         } PACKED ALIGN(32);
@@ -144,6 +148,12 @@ class Ehci : public UsbHub,
         virtual uintptr_t createTransaction(UsbEndpoint endpointInfo);
 
         virtual void doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)=0, uintptr_t pParam=0);
+
+        /// A qTD can hold five pages; four of them are always usable.
+        virtual size_t getMaxTransferBytes()
+        {
+            return 0x4000;
+        }
         virtual void addInterruptInHandler(UsbEndpoint endpointInfo, uintptr_t pBuffer, uint16_t nBytes, void (*pCallback)(uintptr_t, ssize_t), uintptr_t pParam=0);
 
         /// IRQ handler
@@ -199,6 +209,18 @@ class Ehci : public UsbHub,
             EHCI_PORTSC_CONN = 0x1,     // Port Connected bit
         };
 
+        /// Links a QH into the asynchronous schedule. m_QueueListChangeLock must be held.
+        void linkQH(QH *pQH);
+
+        /// Finds the QH in the asynchronous schedule with a transaction in flight
+        /// on the same endpoint as the given QH. m_QueueListChangeLock must be held.
+        QH *findActiveQH(QH *pQH);
+
+        /// Hands a linked QH whose transaction has completed over to the next
+        /// transaction queued on it, and frees the old one's qTDs after the next
+        /// async advance. m_QueueListChangeLock must be held.
+        void advanceQueue(QH *pQH);
+
         IoBase *m_pBase;
 
         uint8_t m_nOpRegsOffset;
@@ -450,6 +450,10 @@ void Ohci::interrupt(size_t number, InterruptState &state)
     // A list of EDs that persist in the schedule. Used to repopulate the schedule list.
     List<ED*> persistList;
 
+    // Callbacks for completed transactions are made once the whole schedule
+    // has been looked at.
+    CompletionBatch completions;
+
     if(nStatus & OhciInterruptWbDoneHead)
     {
         ED *pED = 0;
@@ -519,15 +523,36 @@ void Ohci::interrupt(size_t number, InterruptState &state)
                 // Last TD or error condition, if async, otherwise only when it gives no error
                 if(bEndOfTransfer)
                 {
-                    // Valid callback?
-                    if(pED->pMetaData->pCallback)
-                    {
-                        pED->pMetaData->pCallback(pED->pMetaData->pParam, nResult < 0 ? nResult : pED->pMetaData->nTotalBytes);
-                    }
+                    // Interrupt transfers reuse their buffer, so their
+                    // callbacks can't wait.
+                    ssize_t nTransactionResult = nResult < 0 ? nResult : pED->pMetaData->nTotalBytes;
+                    if(bPeriodic && pED->pMetaData->pCallback)
+                        pED->pMetaData->pCallback(pED->pMetaData->pParam, nTransactionResult);
+                    else if(!bPeriodic)
+                        completions.add(pED->pMetaData->pCallback, pED->pMetaData->pParam, nTransactionResult);
 
                     if(!bPeriodic)
                     {
+                        Spinlock &listLock = (pED->pMetaData->edType == ControlList) ? m_ControlListChangeLock : m_BulkListChangeLock;
+                        listLock.acquire();
+
+                        // The next transaction on this endpoint is chained on
+                        // behind this one - carry on with it on this ED.
+                        if((nResult >= 0) && pED->pMetaData->pQueued)
+                        {
+                            advanceQueue(pED);
+                            listLock.release();
+                            continue;
+                        }
+
+                        // This ED halted, so the next transaction on this
+                        // endpoint starts on its own.
+                        ED *pQueued = pED->pMetaData->pQueued;
                         removeED(pED);
+                        if(pQueued)
+                            linkED(pQueued);
+
+                        listLock.release();
                         continue;
                     }
                     else
@@ -572,6 +597,8 @@ void Ohci::interrupt(size_t number, InterruptState &state)
         }
     }
     
+    completions.run();
+
     // Clear the interrupt status now.
     m_pBase->write32(nStatus, OhciInterruptStatus);
     
@@ -634,7 +661,22 @@ void Ohci::addTransferToTransaction(uintptr_t pTransaction, bool bToggle, UsbPid
             physical_uintptr_t phys = 0; size_t flags = 0;
             va.getMapping(reinterpret_cast<void*>(pBuffer), phys, flags);
             pTD->pBufferStart = phys + (pBuffer & 0xFFF);
-            pTD->pBufferEnd = pTD->pBufferStart + nBytes - 1;
+
+            // The buffer may cross into another physical page.
+            uintptr_t pBufferLast = pBuffer + nBytes - 1;
+            if((pBufferLast & ~0xFFF) != (pBuffer & ~0xFFF))
+            {
+                if(!va.isMapped(reinterpret_cast<void*>(pBufferLast)))
+                {
+                    ERROR("OHCI: addTransferToTransaction: Buffer (page " << Dec << pBufferLast << Hex << ") isn't mapped!");
+                    m_TDBitmap.clear(nIndex);
+                    return;
+                }
+                va.getMapping(reinterpret_cast<void*>(pBufferLast), phys, flags);
+                pTD->pBufferEnd = phys + (pBufferLast & 0xFFF);
+            }
+            else
+                pTD->pBufferEnd = pTD->pBufferStart + nBytes - 1;
         }
         else
         {
@@ -751,6 +793,7 @@ uintptr_t Ohci::createTransaction(UsbEndpoint endpointInfo)
     pED->pMetaData->pFirstTD = pED->pMetaData->pLastTD = 0;
     pED->pMetaData->nTotalBytes = 0;
     pED->pMetaData->pPrev = pED->pMetaData->pNext = 0;
+    pED->pMetaData->pQueued = 0;
     pED->pMetaData->bLinked = false;
 
     // Complete
@@ -802,14 +845,109 @@ void Ohci::doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)
     pED->pMetaData->pCallback = pCallback;
     pED->pMetaData->pParam = pParam;
 
-    bool bControl = !pED->pMetaData->endpointInfo.nEndpoint;
-    
-    // Stop the controller as we are modifying the queue.
-    // stop(pED->pMetaData->edType);
-    
     // Lock while we modify the linked lists.
     pLock->acquire();
-    
+
+    // If a transaction is already in flight on this endpoint, chain our TDs
+    // on behind the last ones queued on its ED rather than having the
+    // controller alternate between two EDs. It runs straight on into them, and
+    // the IRQ handler hands the ED over to us once those ahead complete.
+    ED *pActive = findActiveED(pED);
+    if(pActive)
+    {
+        while(pActive->pMetaData->pQueued)
+            pActive = pActive->pMetaData->pQueued;
+        pActive->pMetaData->pQueued = pED;
+
+        TD *pTail = pActive->pMetaData->pLastTD;
+        pTail->pNext = PHYS_TD(pED->pMetaData->pFirstTD->id) >> 4;
+        pTail->nNextTDIndex = pED->pMetaData->pFirstTD->id;
+        pTail->bLast = false;
+    }
+    else
+        linkED(pED);
+
+    pLock->release();
+}
+
+void Ohci::advanceQueue(ED *pED)
+{
+    ED::MetaData *pMetaData = pED->pMetaData;
+    ED *pNextED = pMetaData->pQueued;
+    ED::MetaData *pNextMetaData = pNextED->pMetaData;
+
+    // The finished TDs are done with.
+    for(List<TD*>::Iterator it = pMetaData->completedTdList.begin();
+        it != pMetaData->completedTdList.end();
+        it++)
+    {
+        size_t idx = (*it)->id;
+        memset((*it), 0, sizeof(TD));
+        m_TDBitmap.clear(idx);
+    }
+    pMetaData->completedTdList.clear();
+
+    // Take on the queued transaction. Its own ED was never linked in.
+    pMetaData->pCallback = pNextMetaData->pCallback;
+    pMetaData->pParam = pNextMetaData->pParam;
+    pMetaData->pFirstTD = pNextMetaData->pFirstTD;
+    pMetaData->pLastTD = pNextMetaData->pLastTD;
+    pMetaData->nTotalBytes = 0;
+    pMetaData->pQueued = pNextMetaData->pQueued;
+    for(List<TD*>::Iterator it = pNextMetaData->tdList.begin();
+        it != pNextMetaData->tdList.end();
+        it++)
+        pMetaData->tdList.pushBack(*it);
+    pNextMetaData->tdList.clear();
+    pNextMetaData->pQueued = 0;
+
+    // Reclaim the queued transaction's ED in the next USB frame.
+    {
+        LockGuard<Spinlock> guard(m_DequeueListLock);
+        m_DequeueList.pushBack(pNextED);
+    }
+    m_pBase->write32(OhciInterruptStartOfFrame, OhciInterruptStatus);
+    m_pBase->write32(OhciInterruptStartOfFrame, OhciInterruptEnable);
+
+    // If the controller retired the old last TD before the new ones were
+    // chained on, the ED is empty. The controller skips an empty ED, so it's
+    // safe to point it at them.
+    if(!pED->pHeadTD && !pED->bHalted)
+    {
+        pED->pHeadTD = PHYS_TD(pMetaData->pFirstTD->id) >> 4;
+
+        uint32_t status = m_pBase->read32(OhciCommandStatus);
+        status |= (pMetaData->edType == ControlList) ? OhciCommandControlListFilled : OhciCommandBulkListFilled;
+        m_pBase->write32(status, OhciCommandStatus);
+    }
+}
+
+Ohci::ED *Ohci::findActiveED(ED *pED)
+{
+    bool bControl = !pED->pMetaData->endpointInfo.nEndpoint;
+    size_t nPid = pED->pMetaData->pFirstTD->nPid;
+
+    for(ED *pOther = bControl ? m_pControlQueueHead : m_pBulkQueueHead; pOther; pOther = pOther->pMetaData->pNext)
+    {
+        if(pOther->pMetaData->bIgnore)
+            continue;
+        if(pOther->nAddress != pED->nAddress || pOther->nEndpoint != pED->nEndpoint)
+            continue;
+
+        // Bulk endpoints are one-way; an IN and an OUT endpoint may share a number
+        if(!bControl && pOther->pMetaData->pFirstTD->nPid != nPid)
+            continue;
+
+        return pOther;
+    }
+
+    return 0;
+}
+
+void Ohci::linkED(ED *pED)
+{
+    bool bControl = !pED->pMetaData->endpointInfo.nEndpoint;
+
     // Always at the end of the ED queue. Zero means "no next ED" to OHCI.
     pED->pNext = 0;
     
@@ -898,9 +1036,6 @@ void Ohci::doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)
     pED->bSkip = pED->pMetaData->bIgnore = false;
     pED->pMetaData->bLinked = true;
     
-    // Can now unlock.
-    pLock->release();
-    
     // Add to the housekeeping schedule before we link in proper.
     m_ScheduleChangeLock.acquire();
     m_FullSchedule.pushBack(pED);
@@ -961,6 +1096,7 @@ void Ohci::addInterruptInHandler(UsbEndpoint endpointInfo, uintptr_t pBuffer, ui
     pED->pMetaData->pFirstTD = pED->pMetaData->pLastTD = 0;
     pED->pMetaData->nTotalBytes = 0;
     pED->pMetaData->pPrev = pED->pMetaData->pNext = 0;
+    pED->pMetaData->pQueued = 0;
     pED->pMetaData->bLinked = false;
     
     pED->pMetaData->bPeriodic = true;
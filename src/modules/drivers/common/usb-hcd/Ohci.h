@@ -131,6 +131,10 @@ class Ohci : public UsbHub,
 
                 ED *pPrev;
                 ED *pNext;
+
+                /// The next transaction on the same endpoint, whose TDs are chained
+                /// on after this one's. Its ED is never linked in itself.
+                ED *pQueued;
                 
                 List<TD*> tdList;
                 List<TD*> completedTdList;
@@ -162,6 +166,12 @@ class Ohci : public UsbHub,
         virtual uintptr_t createTransaction(UsbEndpoint endpointInfo);
 
         virtual void doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)=0, uintptr_t pParam=0);
+
+        /// A TD's buffer may cross one page boundary.
+        virtual size_t getMaxTransferBytes()
+        {
+            return 0x1000;
+        }
         virtual void addInterruptInHandler(UsbEndpoint endpointInfo, uintptr_t pBuffer, uint16_t nBytes, void (*pCallback)(uintptr_t, ssize_t), uintptr_t pParam=0);
 
         /// IRQ handler
@@ -187,6 +197,17 @@ class Ohci : public UsbHub,
         
         /// Prepares an ED to be reclaimed.
         void removeED(ED *pED);
+
+        /// Links an ED into the control or bulk list. The list's change lock must be held.
+        void linkED(ED *pED);
+
+        /// Finds the ED in the control or bulk list with a transaction in flight
+        /// on the same endpoint as the given ED. The list's change lock must be held.
+        ED *findActiveED(ED *pED);
+
+        /// Hands a linked ED whose transaction has completed over to the next
+        /// transaction queued on it. The list's change lock must be held.
+        void advanceQueue(ED *pED);
         
         /// Converts a software ED pointer to a physical address.
         inline physical_uintptr_t vtp_ed(ED *pED)
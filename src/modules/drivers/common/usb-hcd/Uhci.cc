@@ -248,6 +248,10 @@ bool Uhci::irq(irq_id_t number, InterruptState &state)
 
     List<QH*> persistList;
 
+    // Callbacks for completed transactions are made once the whole schedule
+    // has been looked at.
+    CompletionBatch completions;
+
     // Because there's no IOC for *every* transfer, we need to handle errors
     // that occur before the last transfer. These will create an error status only.
     if(nStatus & (UHCI_STS_INT | UHCI_STS_ERR))
@@ -334,11 +338,13 @@ bool Uhci::irq(irq_id_t number, InterruptState &state)
                     // Last TD or error condition, if async, otherwise only when it gives no error
                     if(bEndOfTransfer)
                     {
-                        // Valid callback?
-                        if(pQH->pMetaData->pCallback)
-                        {
-                            pQH->pMetaData->pCallback(pQH->pMetaData->pParam, nResult < 0 ? nResult : pQH->pMetaData->nTotalBytes);
-                        }
+                        // Interrupt transfers reuse their buffer, so their
+                        // callbacks can't wait.
+                        ssize_t nTransactionResult = nResult < 0 ? nResult : pQH->pMetaData->nTotalBytes;
+                        if(bPeriodic && pQH->pMetaData->pCallback)
+                            pQH->pMetaData->pCallback(pQH->pMetaData->pParam, nTransactionResult);
+                        else if(!bPeriodic)
+                            completions.add(pQH->pMetaData->pCallback, pQH->pMetaData->pParam, nTransactionResult);
 
                         if(!bPeriodic)
                         {
@@ -349,6 +355,18 @@ bool Uhci::irq(irq_id_t number, InterruptState &state)
                             /// \note language to do the "right" thing ("Do what I mean", not "Do what I say").
                             m_AsyncQueueListChangeLock.acquire(); // Atomic operation
 
+                            // The next transaction on this endpoint is chained
+                            // on behind this one - carry on with it on this QH.
+                            // Not after a short read, though: this
+                            // transaction's remaining TDs are still in the way.
+                            if((nResult >= 0) && (pTD == pQH->pMetaData->pLastTD) && pQH->pMetaData->pQueued)
+                            {
+                                advanceQueue(pQH);
+                                m_AsyncQueueListChangeLock.release();
+                                m_DequeueCount.release();
+                                continue;
+                            }
+
                             // Stop the controller while we dequeue
                             stop();
                             
@@ -373,6 +391,14 @@ bool Uhci::irq(irq_id_t number, InterruptState &state)
 
                             m_DequeueList.pushBack(pQH);
 
+                            // The next transaction on this endpoint starts on
+                            // its own QH.
+                            if(pQH->pMetaData->pQueued)
+                            {
+                                linkQH(pQH->pMetaData->pQueued);
+                                pQH->pMetaData->pQueued = 0;
+                            }
+
                             // Resume the controller, dequeue done.
                             start();
 
@@ -432,6 +458,8 @@ bool Uhci::irq(irq_id_t number, InterruptState &state)
         }
     }
 
+    completions.run();
+
     return true;
 }
 
@@ -545,6 +573,7 @@ uintptr_t Uhci::createTransaction(UsbEndpoint endpointInfo)
     pQH->pMetaData->pFirstTD = pQH->pMetaData->pLastTD = 0;
     pQH->pMetaData->nTotalBytes = 0;
     pQH->pMetaData->pPrev = pQH->pMetaData->pNext = 0;
+    pQH->pMetaData->pQueued = 0;
     pQH->pMetaData->bIgnore = false;
     pQH->pMetaData->id = nIndex;
 
@@ -562,17 +591,109 @@ void Uhci::doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)
         }
     }
     
-    // Stop a running controller. We're modifying the hardware list and we don't
-    // want it to be touched while we're changing it. Hardware doesn't care about
-    // our "change spinlock".
-    stop();
-
     // Configure remaining metadata
     QH *pQH = &m_pQHList[pTransaction];
     pQH->pMetaData->pCallback = pCallback;
     pQH->pMetaData->pParam = pParam;
     pQH->pMetaData->pLastTD->bIoc = 1;
 
+    // Atomic operation - modifying both the housekeeping and the
+    // hardware linked lists
+    m_AsyncQueueListChangeLock.acquire();
+
+    // If a transaction is already in flight on this endpoint, chain our TDs
+    // on behind the last ones queued on its QH rather than having the
+    // controller alternate between two QHs. It runs straight on into them, and
+    // the IRQ handler hands the QH over to us once those ahead complete.
+    QH *pActive = findActiveQH(pQH);
+    if(pActive)
+    {
+        while(pActive->pMetaData->pQueued)
+            pActive = pActive->pMetaData->pQueued;
+        pActive->pMetaData->pQueued = pQH;
+
+        TD *pTail = pActive->pMetaData->pLastTD;
+        pTail->pNext = PHYS_TD(pQH->pMetaData->pFirstTD->id) >> 4;
+        pTail->bNextQH = 0;
+        pTail->bNextInvalid = 0;
+    }
+    else
+    {
+        // Stop a running controller. We're modifying the hardware list and we don't
+        // want it to be touched while we're changing it. Hardware doesn't care about
+        // our "change spinlock".
+        stop();
+        linkQH(pQH);
+        start();
+    }
+
+    m_AsyncQueueListChangeLock.release();
+}
+
+Uhci::QH *Uhci::findActiveQH(QH *pQH)
+{
+    if(pQH->pMetaData->bPeriodic)
+        return 0;
+
+    UsbEndpoint &endpointInfo = pQH->pMetaData->endpointInfo;
+    bool bControl = !endpointInfo.nEndpoint;
+    size_t nPid = pQH->pMetaData->pFirstTD->nPid;
+
+    for(QH *pOther = m_pCurrentAsyncQueueHead->pMetaData->pNext; pOther && (pOther != m_pCurrentAsyncQueueHead); pOther = pOther->pMetaData->pNext)
+    {
+        if(pOther->pMetaData->bPeriodic || pOther->pMetaData->bIgnore)
+            continue;
+        if(pOther->pMetaData->endpointInfo.nAddress != endpointInfo.nAddress || pOther->pMetaData->endpointInfo.nEndpoint != endpointInfo.nEndpoint)
+            continue;
+
+        // Bulk endpoints are one-way; an IN and an OUT endpoint may share a number
+        if(!bControl && pOther->pMetaData->pFirstTD->nPid != nPid)
+            continue;
+
+        return pOther;
+    }
+
+    return 0;
+}
+
+void Uhci::advanceQueue(QH *pQH)
+{
+    QH::MetaData *pMetaData = pQH->pMetaData;
+    QH *pNextQH = pMetaData->pQueued;
+    QH::MetaData *pNextMetaData = pNextQH->pMetaData;
+
+    // Take on the queued transaction. Its own QH was never linked in, and
+    // goes to the dequeue thread with the finished TDs.
+    List<TD*> finished = pMetaData->completedTdList;
+    pMetaData->completedTdList.clear();
+
+    pMetaData->pCallback = pNextMetaData->pCallback;
+    pMetaData->pParam = pNextMetaData->pParam;
+    pMetaData->pFirstTD = pNextMetaData->pFirstTD;
+    pMetaData->pLastTD = pNextMetaData->pLastTD;
+    pMetaData->nTotalBytes = 0;
+    pMetaData->pQueued = pNextMetaData->pQueued;
+    pMetaData->tdList = pNextMetaData->tdList;
+
+    pNextMetaData->tdList.clear();
+    pNextMetaData->completedTdList = finished;
+    pNextMetaData->pQueued = 0;
+    pNextMetaData->bIgnore = true;
+    m_DequeueList.pushBack(pNextQH);
+
+    // If the controller finished the old last TD before the new ones were
+    // chained on, the QH is empty. The controller passes over an empty QH,
+    // so it's safe to point it at them.
+    if(pQH->bElemInvalid)
+    {
+        pQH->pElem = PHYS_TD(pMetaData->pFirstTD->id) >> 4;
+        pQH->bElemQH = 0;
+        pQH->bElemInvalid = 0;
+    }
+}
+
+void Uhci::linkQH(QH *pQH)
+{
     // Do we need to configure the asynchronous schedule?
     if(m_pCurrentAsyncQueueTail)
     {
@@ -582,10 +703,6 @@ void Uhci::doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)
         pQH->bNextInvalid = 0;
         pQH->bNextQH = 1;
 
-        // Atomic operation - modifying both the housekeeping and the
-        // hardware linked lists
-        m_AsyncQueueListChangeLock.acquire();
-
         pQH->pMetaData->bIgnore = true;
         m_AsyncSchedule.pushBack(pQH);
 
@@ -595,7 +712,7 @@ void Uhci::doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)
         m_pCurrentAsyncQueueTail = pQH;
 
         // The current tail needs to point to this QH
-        pOldTail->pNext = (m_pQHListPhys + (pTransaction * sizeof(QH))) >> 4;
+        pOldTail->pNext = (m_pQHListPhys + (pQH->pMetaData->id * sizeof(QH))) >> 4;
         pOldTail->bNextInvalid = 0;
         pOldTail->bNextQH = 1;
 
@@ -609,15 +726,11 @@ void Uhci::doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)
         
         // Ready for IRQs
         pQH->pMetaData->bIgnore = false;
-
-        m_AsyncQueueListChangeLock.release();
     }
     else
     {
-        ERROR("UHCI: Queue tail is null!");
+        ERROR_NOLOCK("UHCI: Queue tail is null!");
     }
-    
-    start();
 }
 
 void Uhci::addInterruptInHandler(UsbEndpoint endpointInfo, uintptr_t pBuffer, uint16_t nBytes, void (*pCallback)(uintptr_t, ssize_t), uintptr_t pParam)
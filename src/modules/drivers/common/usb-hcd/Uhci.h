@@ -119,6 +119,10 @@ class Uhci : public UsbHub, public IrqHandler, public RequestQueue, public Timer
 
                 QH *pPrev;
                 QH *pNext;
+
+                /// The next transaction on the same endpoint, whose TDs are chained
+                /// on after this one's. Its QH is never linked in itself.
+                QH *pQueued;
                 
                 List<TD*> tdList;
                 List<TD*> completedTdList;
@@ -163,6 +167,19 @@ class Uhci : public UsbHub, public IrqHandler, public RequestQueue, public Timer
         /// Starts the UHCI controller
         void start();
 
+        /// Links a QH into the asynchronous schedule. m_AsyncQueueListChangeLock
+        /// must be held and the controller stopped.
+        void linkQH(QH *pQH);
+
+        /// Finds the QH in the asynchronous schedule with a transaction in flight
+        /// on the same endpoint as the given QH. m_AsyncQueueListChangeLock must be held.
+        QH *findActiveQH(QH *pQH);
+
+        /// Hands a linked QH whose transaction has completed over to the next
+        /// transaction queued on it, and passes the old one's TDs to the dequeue
+        /// thread. m_AsyncQueueListChangeLock must be held.
+        void advanceQueue(QH *pQH);
+
         enum UhciConstants {
             UHCI_CMD = 0x00,            // Command register
             UHCI_STS = 0x02,            // Status register
@@ -161,6 +161,11 @@ void UsbHubDevice::doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t,
     m_pHub->doAsync(pTransaction, pCallback, pParam);
 }
 
+size_t UsbHubDevice::getMaxTransferBytes()
+{
+    return m_pHub->getMaxTransferBytes();
+}
+
 void UsbHubDevice::addInterruptInHandler(UsbEndpoint endpointInfo, uintptr_t pBuffer, uint16_t nBytes, void (*pCallback)(uintptr_t, ssize_t), uintptr_t pParam)
 {
     if((m_Speed == HighSpeed) && (endpointInfo.speed != HighSpeed) && (!endpointInfo.nHubAddress))
@@ -41,6 +41,7 @@ class UsbHubDevice : public UsbDevice, public UsbHub
         virtual void addTransferToTransaction(uintptr_t pTransaction, bool bToggle, UsbPid pid, uintptr_t pBuffer, size_t nBytes);
         virtual uintptr_t createTransaction(UsbEndpoint endpointInfo);
         virtual void doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)=0, uintptr_t pParam=0);
+        virtual size_t getMaxTransferBytes();
         virtual void addInterruptInHandler(UsbEndpoint endpointInfo, uintptr_t pBuffer, uint16_t nBytes, void (*pCallback)(uintptr_t, ssize_t), uintptr_t pParam=0);
 
         virtual bool portReset(uint8_t nPort, bool bErrorResponse = false);
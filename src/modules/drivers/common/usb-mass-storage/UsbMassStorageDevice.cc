@@ -87,7 +87,7 @@ bool UsbMassStorageDevice::massStorageReset()
     return controlRequest(MassStorageRequest, MassStorageReset, 0, m_pInterface->nInterface);
 }
 
-bool UsbMassStorageDevice::sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t nCommandSize, uintptr_t pRespBuffer, uint16_t nRespBytes, bool bWrite)
+bool UsbMassStorageDevice::sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t nCommandSize, uintptr_t pRespBuffer, size_t nRespBytes, bool bWrite)
 {
     Cbw *pCbw = new Cbw;
     PointerGuard<Cbw> guard(pCbw);
@@ -99,6 +99,20 @@ bool UsbMassStorageDevice::sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t
     pCbw->nCommandSize = nCommandSize;
     memcpy(pCbw->pCommand, reinterpret_cast<void*>(pCommand), nCommandSize);
 
+    // The data phase is split into chunks small enough for the host controller
+    // to queue at once. A read queues its first chunk along with the CBW: they
+    // use different endpoints, so the device can start sending data as soon as
+    // it has the command.
+    size_t nMaxPacketSize = bWrite ? m_pOutEndpoint->nMaxPacketSize : m_pInEndpoint->nMaxPacketSize;
+    size_t nTransferBytes = m_pHub->getMaxTransferBytes();
+    nTransferBytes -= nTransferBytes % nMaxPacketSize;
+    if(!nTransferBytes)
+        nTransferBytes = nMaxPacketSize;
+    size_t nChunkBytes = nTransferBytes * MaxTransfersPerChunk;
+    uintptr_t pPendingData = 0;
+    if(nRespBytes && !bWrite)
+        pPendingData = startTransfer(m_pInEndpoint, UsbPidIn, pRespBuffer, nRespBytes < nChunkBytes ? nRespBytes : nChunkBytes);
+
     ssize_t nResult = syncOut(m_pOutEndpoint, reinterpret_cast<uintptr_t>(pCbw), 31);
 
     // Handle stall
@@ -108,6 +122,8 @@ bool UsbMassStorageDevice::sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t
         if(!clearEndpointHalt(m_pOutEndpoint))
         {
             // Reset and fail this command
+            if(pPendingData)
+                finishTransfer(pPendingData);
             massStorageReset();
             clearEndpointHalt(m_pInEndpoint);
             clearEndpointHalt(m_pOutEndpoint);
@@ -118,19 +134,48 @@ bool UsbMassStorageDevice::sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t
     }
 
     if(nResult < 0)
+    {
+        if(pPendingData)
+            finishTransfer(pPendingData);
         return false;
+    }
 
     // Handle data or CSW transfer if needed
     if(nRespBytes)
     {
         DEBUG_LOG("USB: MSD: Performing " << Dec << nRespBytes << Hex << " byte " << (bWrite ? "write" : "read"));
-        if(bWrite)
-            nResult = syncOut(m_pOutEndpoint, pRespBuffer, nRespBytes);
-        else
-            nResult = syncIn(m_pInEndpoint, pRespBuffer, nRespBytes);
+        nResult = 0;
+        for(size_t nOffset = 0; nOffset < nRespBytes; nOffset += nChunkBytes)
+        {
+            size_t nBytes = nRespBytes - nOffset;
+            if(nBytes > nChunkBytes)
+                nBytes = nChunkBytes;
+
+            ssize_t nChunkResult;
+            if(pPendingData)
+            {
+                nChunkResult = finishTransfer(pPendingData);
+                pPendingData = 0;
+            }
+            else if(bWrite)
+                nChunkResult = syncOut(m_pOutEndpoint, pRespBuffer + nOffset, nBytes);
+            else
+                nChunkResult = syncIn(m_pInEndpoint, pRespBuffer + nOffset, nBytes);
+
+            if(nChunkResult < 0)
+            {
+                nResult = nChunkResult;
+                break;
+            }
+
+            // A short transfer ends the data phase early.
+            nResult += nChunkResult;
+            if(static_cast<size_t>(nChunkResult) < nBytes)
+                break;
+        }
 
         /// \todo Should probably just be transaction errors and stalls
-        if((nResult < 0) || ((nResult < nRespBytes) && (!bWrite))) // == -Stall)
+        if((nResult < 0) || ((static_cast<size_t>(nResult) < nRespBytes) && (!bWrite))) // == -Stall)
         {
             // STALL, clear the endpoint and attempt CSW read
             bool bClearResult = false;
@@ -34,7 +34,12 @@ class UsbMassStorageDevice : public ScsiController, public UsbDevice
 
         virtual void initialiseDriver();
 
-        virtual bool sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t nCommandSize, uintptr_t pRespBuffer, uint16_t nRespBytes, bool bWrite);
+        virtual bool sendCommand(size_t nUnit, uintptr_t pCommand, uint8_t nCommandSize, uintptr_t pRespBuffer, size_t nRespBytes, bool bWrite);
+
+        virtual size_t getMaxTransferSize()
+        {
+            return 0x20000;
+        }
 
         virtual void getUsbDeviceName(String &str)
         {
@@ -55,6 +60,10 @@ class UsbMassStorageDevice : public ScsiController, public UsbDevice
 
         bool massStorageReset();
 
+        /// Most transfers (packets, unless the host controller takes more at
+        /// once) in one transaction of the data phase.
+        static const size_t MaxTransfersPerChunk = 32;
+
         enum MassStorageRequests
         {
             MassStorageRequest  = UsbRequestType::Class | UsbRequestRecipient::Interface,
@@ -45,41 +45,55 @@ VbeDisplay::VbeDisplay(Device *p, VbeVersion version, List<Display::ScreenMode*>
     Display(p), m_VbeVersion(version), m_ModeList(sms), m_Mode(), m_pFramebuffer(0),
     m_Buffers(), m_SpecialisedMode(Mode_Generic), m_Allocator()
 {
-    String str;
-    str.sprintf("DELETE FROM 'display_modes' where display_id = %d", displayNum);
-    Config::Result *pR = Config::instance().query(str);
-    if(!pR)
+    Config::Cursor *pDelete = Config::instance().prepare("DELETE FROM 'display_modes' where display_id = ?1");
+    if(!pDelete)
     {
-        FATAL("VBE: Couldn't get a result.");
+        FATAL("VBE: Couldn't prepare the display mode delete.");
         return;
     }
-    if (!pR->succeeded())
+    pDelete->bind(1, static_cast<int64_t>(displayNum));
+    pDelete->next();
+    if (!pDelete->succeeded())
     {
-        FATAL("VbeDisplay: Sql error: " << pR->errorMessage());
+        FATAL("VbeDisplay: Sql error: " << pDelete->errorMessage());
         return;
     }
-    delete pR;
+    delete pDelete;
 
   uintptr_t fbAddr = 0;
 
+  // One statement, re-run with new parameters for each mode.
+  Config::Cursor *pInsert = Config::instance().prepare("INSERT INTO 'display_modes' VALUES (NULL, ?1, ?2, ?3, ?4, ?5, ?6)");
+  if (!pInsert)
+  {
+      FATAL("VbeDisplay: Couldn't prepare the display mode insert.");
+      return;
+  }
+
   for (List<Display::ScreenMode*>::Iterator it = m_ModeList.begin();
        it != m_ModeList.end();
        it++)
   {
-      str.sprintf("INSERT INTO 'display_modes' VALUES (NULL, %d,%d,%d,%d,%d,%d)", (*it)->id, displayNum, (*it)->width, (*it)->height, (*it)->pf.nBpp, (*it)->refresh);
-      pR = Config::instance().query(str);
-
-      if (!pR->succeeded())
+      pInsert->bind(1, static_cast<int64_t>((*it)->id));
+      pInsert->bind(2, static_cast<int64_t>(displayNum));
+      pInsert->bind(3, static_cast<int64_t>((*it)->width));
+      pInsert->bind(4, static_cast<int64_t>((*it)->height));
+      pInsert->bind(5, static_cast<int64_t>((*it)->pf.nBpp));
+      pInsert->bind(6, static_cast<int64_t>((*it)->refresh));
+      pInsert->next();
+
+      if (!pInsert->succeeded())
       {
-          FATAL("VbeDisplay: Sql error: " << pR->errorMessage());
+          FATAL("VbeDisplay: Sql error: " << pInsert->errorMessage());
           return;
       }
+      pInsert->reset();
       
       fbAddr = (*it)->framebuffer;
-
-      delete pR;
   }
 
+  delete pInsert;
+
   m_Allocator.free(0, vidMemSz);
 
     // Assumes the same framebuffer for all modes
@@ -317,37 +317,43 @@ bool entry()
   // Does the display already exist in the database?
   bool bDelayedInsert = false;
   size_t mode_id = 0;
-  String str;
-  str.sprintf("SELECT * FROM displays WHERE pointer=%d", reinterpret_cast<uintptr_t>(pDisplay));
-  Config::Result *pResult = Config::instance().query(str);
-  if(!pResult)
+  int64_t pointer = static_cast<int64_t>(reinterpret_cast<uintptr_t>(pDisplay));
+  Config::Cursor *pCursor = Config::instance().prepare("SELECT mode_id FROM displays WHERE pointer=?1");
+  if(!pCursor)
   {
-      ERROR("vbe: Got no result when selecting displays");
-  }
-  else if (pResult->succeeded() && pResult->rows() == 1)
-  {
-      mode_id = pResult->getNum(0, "mode_id");
-      delete pResult;
-      str.sprintf("UPDATE displays SET id=%d WHERE pointer=%d", g_nDisplays, reinterpret_cast<uintptr_t>(pDisplay));
-      pResult = Config::instance().query(str);
-      if (!pResult->succeeded())
-          FATAL("Display update failed: " << pResult->errorMessage());
-      delete pResult;
-  }
-  else if (pResult->succeeded() && pResult->rows() > 1)
-  {
-      delete pResult;
-      FATAL("Multiple displays for pointer `" << reinterpret_cast<uintptr_t>(pDisplay) << "'");
-  }
-  else if (pResult->succeeded())
-  {
-      delete pResult;
-      bDelayedInsert = true;
+      ERROR("vbe: Couldn't prepare the display select");
   }
   else
   {
-      FATAL("Display select failed: " << pResult->errorMessage());
-      delete pResult;
+      pCursor->bind(1, pointer);
+      bool bFound = pCursor->next();
+      if (bFound)
+          mode_id = pCursor->getNum(static_cast<size_t>(0));
+      bool bMultiple = bFound && pCursor->next();
+
+      if (!pCursor->succeeded())
+          FATAL("Display select failed: " << pCursor->errorMessage());
+      else if (bMultiple)
+          FATAL("Multiple displays for pointer `" << reinterpret_cast<uintptr_t>(pDisplay) << "'");
+      else if (bFound)
+      {
+          Config::Cursor *pUpdate = Config::instance().prepare("UPDATE displays SET id=?1 WHERE pointer=?2");
+          if (!pUpdate)
+              FATAL("Display update failed: couldn't prepare the statement");
+          else
+          {
+              pUpdate->bind(1, static_cast<int64_t>(g_nDisplays));
+              pUpdate->bind(2, pointer);
+              pUpdate->next();
+              if (!pUpdate->succeeded())
+                  FATAL("Display update failed: " << pUpdate->errorMessage());
+              delete pUpdate;
+          }
+      }
+      else
+          bDelayedInsert = true;
+
+      delete pCursor;
   }
 
   g_nDisplays++;
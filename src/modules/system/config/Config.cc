@@ -123,12 +123,155 @@ size_t Config::Result::lookupCol(const char *str)
     return ~0UL;
 }
 
-Config::Config()
+Config::Cursor::Cursor(sqlite3_stmt *pStmt, size_t cacheSlot) :
+    m_pStmt(pStmt), m_CacheSlot(cacheSlot), m_Ret(SQLITE_OK), m_Error()
 {
 }
 
+Config::Cursor::~Cursor()
+{
+    Config::instance().release(this);
+}
+
+bool Config::Cursor::bind(size_t n, int64_t value)
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    m_Ret = sqlite3_bind_int64(m_pStmt, n, value);
+    if (m_Ret != SQLITE_OK)
+        setError();
+    return m_Ret == SQLITE_OK;
+}
+
+bool Config::Cursor::bind(size_t n, const char *value)
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    m_Ret = sqlite3_bind_text(m_pStmt, n, value, -1, SQLITE_TRANSIENT);
+    if (m_Ret != SQLITE_OK)
+        setError();
+    return m_Ret == SQLITE_OK;
+}
+
+bool Config::Cursor::bindNull(size_t n)
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    m_Ret = sqlite3_bind_null(m_pStmt, n);
+    if (m_Ret != SQLITE_OK)
+        setError();
+    return m_Ret == SQLITE_OK;
+}
+
+bool Config::Cursor::next()
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    m_Ret = sqlite3_step(m_pStmt);
+    if (m_Ret != SQLITE_ROW && m_Ret != SQLITE_DONE)
+        setError();
+    return m_Ret == SQLITE_ROW;
+}
+
+void Config::Cursor::reset()
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    sqlite3_reset(m_pStmt);
+    m_Ret = SQLITE_OK;
+}
+
+size_t Config::Cursor::cols()
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    return sqlite3_column_count(m_pStmt);
+}
+
+const char *Config::Cursor::getColumnName(size_t n)
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    const char *str = sqlite3_column_name(m_pStmt, n);
+    return str ? str : "";
+}
+
+const char *Config::Cursor::getStr(size_t n)
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    const char *str = reinterpret_cast<const char*>(sqlite3_column_text(m_pStmt, n));
+    return str ? str : "";
+}
+
+size_t Config::Cursor::getNum(size_t n)
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    return static_cast<size_t>(sqlite3_column_int64(m_pStmt, n));
+}
+
+bool Config::Cursor::getBool(size_t n)
+{
+    const char *s = getStr(n);
+    if (!strcmp(s, "true") || !strcmp(s, "True") || !strcmp(s, "1"))
+        return true;
+    else
+        return false;
+}
+
+const char *Config::Cursor::getStr(const char *str)
+{
+    size_t n = lookupCol(str);
+    if (n == ~0UL) return "";
+    return getStr(n);
+}
+
+size_t Config::Cursor::getNum(const char *str)
+{
+    size_t n = lookupCol(str);
+    if (n == ~0UL) return 0;
+    return getNum(n);
+}
+
+bool Config::Cursor::getBool(const char *str)
+{
+    size_t n = lookupCol(str);
+    if (n == ~0UL) return false;
+    return getBool(n);
+}
+
+size_t Config::Cursor::lookupCol(const char *str)
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    size_t nCols = sqlite3_column_count(m_pStmt);
+    for (size_t i = 0; i < nCols; i++)
+    {
+        if (!strcmp(str, sqlite3_column_name(m_pStmt, i)))
+            return i;
+    }
+    return ~0UL;
+}
+
+void Config::Cursor::setError()
+{
+    m_Error = sqlite3_errmsg(g_pSqlite);
+}
+
+Config::Config() : m_nUseCount(0)
+{
+    memset(m_Statements, 0, sizeof(m_Statements));
+}
+
 Config::~Config()
 {
+    for (size_t i = 0; i < StatementCacheSize; i++)
+    {
+        if (m_Statements[i].pStmt)
+            sqlite3_finalize(m_Statements[i].pStmt);
+        delete [] m_Statements[i].sql;
+    }
 }
 
 Config::Result *Config::query(const char *sql)
@@ -148,3 +291,93 @@ Config::Result *Config::query(const char *sql)
     return new Result(result, static_cast<size_t>(rows), static_cast<size_t>(cols), error, ret);
 }
 
+
+Config::Cursor *Config::prepare(const char *sql)
+{
+    if(!sql || !*sql)
+    {
+        ERROR("Dud query string passed to Config::prepare");
+        return 0;
+    }
+
+    uint32_t hash = 2166136261U;
+    for (const char *p = sql; *p; p++)
+    {
+        hash ^= static_cast<uint8_t>(*p);
+        hash *= 16777619U;
+    }
+
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    // Reuse an idle compiled copy of this statement if there is one.
+    size_t victim = ~0UL;
+    for (size_t i = 0; i < StatementCacheSize; i++)
+    {
+        CachedStatement &entry = m_Statements[i];
+        if (!entry.pStmt)
+        {
+            if (victim == ~0UL || m_Statements[victim].pStmt)
+                victim = i;
+            continue;
+        }
+
+        if (entry.bInUse)
+            continue;
+
+        if (entry.hash == hash && !strcmp(entry.sql, sql))
+        {
+            entry.bInUse = true;
+            entry.lastUsed = ++m_nUseCount;
+            return new Cursor(entry.pStmt, i);
+        }
+
+        // Otherwise remember the least recently used idle entry.
+        if (victim == ~0UL || (m_Statements[victim].pStmt && entry.lastUsed < m_Statements[victim].lastUsed))
+            victim = i;
+    }
+
+    sqlite3_stmt *pStmt = 0;
+    int ret = sqlite3_prepare_v2(g_pSqlite, sql, -1, &pStmt, 0);
+    if (ret != SQLITE_OK)
+    {
+        ERROR("Config: could not prepare '" << sql << "': " << sqlite3_errmsg(g_pSqlite));
+        if (pStmt)
+            sqlite3_finalize(pStmt);
+        return 0;
+    }
+
+    // Every cached statement is busy: hand out a private one.
+    if (victim == ~0UL)
+        return new Cursor(pStmt, ~0UL);
+
+    CachedStatement &entry = m_Statements[victim];
+    if (entry.pStmt)
+    {
+        sqlite3_finalize(entry.pStmt);
+        delete [] entry.sql;
+    }
+
+    entry.pStmt = pStmt;
+    entry.sql = new char[strlen(sql) + 1];
+    strcpy(entry.sql, sql);
+    entry.hash = hash;
+    entry.bInUse = true;
+    entry.lastUsed = ++m_nUseCount;
+
+    return new Cursor(pStmt, victim);
+}
+
+void Config::release(Cursor *pCursor)
+{
+    LockGuard<Mutex> guard(g_sqlLock);
+
+    if (pCursor->m_CacheSlot == ~0UL)
+    {
+        sqlite3_finalize(pCursor->m_pStmt);
+        return;
+    }
+
+    sqlite3_reset(pCursor->m_pStmt);
+    sqlite3_clear_bindings(pCursor->m_pStmt);
+    m_Statements[pCursor->m_CacheSlot].bInUse = false;
+}
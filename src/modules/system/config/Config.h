@@ -81,6 +81,72 @@ public:
         int    m_Ret;
     };
 
+    /** A prepared statement with bound parameters, read one row at a time.
+     *
+     * Unlike Result, rows are not copied out of the database: column values
+     * point into SQLite's own row buffer and are only valid until the next
+     * call to next(). Parameters are numbered from 1, as in SQL ("?1"). */
+    class Cursor
+    {
+    public:
+        ~Cursor();
+
+        /** Binds a number to the n'th parameter. */
+        bool bind(size_t n, int64_t value);
+        /** Binds a string to the n'th parameter. The string is copied. */
+        bool bind(size_t n, const char *value);
+        /** Binds NULL to the n'th parameter. */
+        bool bindNull(size_t n);
+
+        /** Steps to the next row.
+            \return True if there is a row, false when done or on error. */
+        bool next();
+        /** Rewinds the statement so it can be run again; bindings are kept. */
+        void reset();
+
+        /** Returns true unless the last operation failed. */
+        bool succeeded()
+        {return m_Ret == SQLITE_OK || m_Ret == SQLITE_ROW || m_Ret == SQLITE_DONE;}
+        /** Returns the error message of the last failed operation. */
+        const char *errorMessage()
+        {return static_cast<const char*>(m_Error);}
+
+        /** Returns the number of columns. */
+        size_t cols();
+        /** Returns the name of the n'th column. */
+        const char *getColumnName(size_t n);
+
+        /** Returns the value in column 'n' of the current row, in string form. */
+        const char *getStr(size_t n);
+        /** Returns the value in column 'n' of the current row, in number form. */
+        size_t getNum(size_t n);
+        /** Returns the value in column 'n' of the current row, in boolean form. */
+        bool getBool(size_t n);
+
+        /** Returns the value in the column called 'str', in string form. */
+        const char *getStr(const char *str);
+        /** Returns the value in the column called 'str', in number form. */
+        size_t getNum(const char *str);
+        /** Returns the value in the column called 'str', in boolean form. */
+        bool getBool(const char *str);
+
+    private:
+        friend class Config;
+
+        Cursor(sqlite3_stmt *pStmt, size_t cacheSlot);
+        Cursor(const Cursor &);
+        Cursor &operator = (const Cursor &);
+
+        size_t lookupCol(const char *str);
+        void setError();
+
+        sqlite3_stmt *m_pStmt;
+        /** Index into the statement cache, or ~0 if this cursor owns m_pStmt. */
+        size_t m_CacheSlot;
+        int m_Ret;
+        String m_Error;
+    };
+
     Config();
     ~Config();
 
@@ -91,7 +157,31 @@ public:
         \return A Result* object, which should be deleted after use, or 0. */
     Result *query(const char *sql);
 
+    /** Prepares a statement, reusing a cached one for the same SQL text if
+        one is available so that it needn't be parsed again.
+        \return A Cursor* object, which should be deleted after use, or 0 if
+                the SQL could not be compiled. */
+    Cursor *prepare(const char *sql);
+
 private:
+    /** A compiled statement, kept for reuse. */
+    struct CachedStatement
+    {
+        sqlite3_stmt *pStmt;
+        char *sql;
+        uint32_t hash;
+        bool bInUse;
+        size_t lastUsed;
+    };
+
+    static const size_t StatementCacheSize = 32;
+
+    /** Called when a cursor is deleted, to return its statement. */
+    void release(Cursor *pCursor);
+
+    CachedStatement m_Statements[StatementCacheSize];
+    size_t m_nUseCount;
+
     static Config m_Instance;
 };
 
@@ -0,0 +1,138 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "MemoryFile.h"
+#include <utilities/utility.h>
+
+MemoryFile::MemoryFile() : m_pPages(0), m_nCapacity(0), m_Size(0)
+{
+}
+
+MemoryFile::~MemoryFile()
+{
+    truncate(0);
+    delete [] m_pPages;
+}
+
+size_t MemoryFile::read(uint64_t offset, void *buffer, size_t len)
+{
+    if (offset >= m_Size)
+        return 0;
+    if (offset + len > m_Size)
+        len = m_Size - offset;
+
+    uint8_t *pDest = reinterpret_cast<uint8_t*>(buffer);
+    size_t done = 0;
+    while (done < len)
+    {
+        size_t page = (offset + done) / PageSize;
+        size_t pageOffset = (offset + done) % PageSize;
+        size_t chunk = PageSize - pageOffset;
+        if (chunk > len - done)
+            chunk = len - done;
+
+        if (m_pPages[page])
+            memcpy(pDest + done, m_pPages[page] + pageOffset, chunk);
+        else
+            memset(pDest + done, 0, chunk);
+
+        done += chunk;
+    }
+
+    return len;
+}
+
+bool MemoryFile::write(uint64_t offset, const void *buffer, size_t len)
+{
+    if (!reserve((offset + len + PageSize - 1) / PageSize))
+        return false;
+
+    const uint8_t *pSrc = reinterpret_cast<const uint8_t*>(buffer);
+    size_t done = 0;
+    while (done < len)
+    {
+        size_t page = (offset + done) / PageSize;
+        size_t pageOffset = (offset + done) % PageSize;
+        size_t chunk = PageSize - pageOffset;
+        if (chunk > len - done)
+            chunk = len - done;
+
+        if (!m_pPages[page])
+        {
+            m_pPages[page] = new uint8_t[PageSize];
+            if (!m_pPages[page])
+                return false;
+            memset(m_pPages[page], 0, PageSize);
+        }
+
+        memcpy(m_pPages[page] + pageOffset, pSrc + done, chunk);
+        done += chunk;
+    }
+
+    if (offset + len > m_Size)
+        m_Size = offset + len;
+    return true;
+}
+
+void MemoryFile::truncate(uint64_t size)
+{
+    if (size < m_Size)
+    {
+        // Free whole pages past the new end, and clear the tail of the last
+        // one so that a later extension reads zeroes.
+        size_t firstFree = (size + PageSize - 1) / PageSize;
+        for (size_t i = firstFree; i < m_nCapacity; i++)
+        {
+            delete [] m_pPages[i];
+            m_pPages[i] = 0;
+        }
+
+        if ((size % PageSize) && m_pPages[size / PageSize])
+            memset(m_pPages[size / PageSize] + (size % PageSize), 0, PageSize - (size % PageSize));
+    }
+    else if (!reserve((size + PageSize - 1) / PageSize))
+        return;
+
+    m_Size = size;
+}
+
+bool MemoryFile::reserve(size_t nPages)
+{
+    if (nPages <= m_nCapacity)
+        return true;
+
+    // Grow the page table geometrically; only pointers are copied.
+    size_t nNewCapacity = m_nCapacity ? m_nCapacity : 16;
+    while (nNewCapacity < nPages)
+        nNewCapacity *= 2;
+
+    uint8_t **pNewPages = new uint8_t*[nNewCapacity];
+    if (!pNewPages)
+        return false;
+
+    if (m_nCapacity)
+        memcpy(pNewPages, m_pPages, m_nCapacity * sizeof(uint8_t*));
+    memset(pNewPages + m_nCapacity, 0, (nNewCapacity - m_nCapacity) * sizeof(uint8_t*));
+
+    delete [] m_pPages;
+    m_pPages = pNewPages;
+    m_nCapacity = nNewCapacity;
+    return true;
+}
@@ -0,0 +1,71 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CONFIG_MEMORYFILE_H
+#define CONFIG_MEMORYFILE_H
+
+#include <processor/types.h>
+
+/** A growable in-memory file, used as the backing store for the config
+ *  database.
+ *
+ * The contents are held in fixed-size pages reached through a page table, so
+ * extending the file only allocates the new pages (and, occasionally, a
+ * larger page table) rather than copying the whole image. Pages that have
+ * never been written read as zeroes. */
+class MemoryFile
+{
+public:
+    MemoryFile();
+    ~MemoryFile();
+
+    /** Reads up to 'len' bytes at 'offset'.
+        \return The number of bytes read, which is short at end-of-file. */
+    size_t read(uint64_t offset, void *buffer, size_t len);
+
+    /** Writes 'len' bytes at 'offset', extending the file if needed.
+        \return False if memory for the new pages could not be found. */
+    bool write(uint64_t offset, const void *buffer, size_t len);
+
+    /** Sets the size of the file, releasing any pages past the end. */
+    void truncate(uint64_t size);
+
+    /** Returns the size of the file, in bytes. */
+    uint64_t size() const
+    {return m_Size;}
+
+private:
+    MemoryFile(const MemoryFile &);
+    MemoryFile &operator = (const MemoryFile &);
+
+    static const size_t PageSize = 4096;
+
+    /** Makes the page table large enough for 'nPages' pages. */
+    bool reserve(size_t nPages);
+
+    /** Page table; entries are null for pages never written. */
+    uint8_t **m_pPages;
+    /** Number of entries in the page table. */
+    size_t m_nCapacity;
+    /** Size of the file, in bytes. */
+    uint64_t m_Size;
+};
+
+#endif
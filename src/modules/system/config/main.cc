@@ -32,11 +32,12 @@
 #include <linker/KernelElf.h>
 
 #include "Config.h"
+#include "MemoryFile.h"
 
 extern BootstrapStruct_t *g_pBootstrapInfo;
 
-uint8_t *g_pFile = 0;
-size_t g_FileSz = 0;
+/** The database image. */
+static MemoryFile g_File;
 
 extern "C" void log_(unsigned long a)
 {
@@ -67,17 +68,14 @@ int xClose(sqlite3_file *file)
 
 int xRead(sqlite3_file *file, void *ptr, int iAmt, sqlite3_int64 iOfst)
 {
-    int ret = 0;
-    if ((iOfst + static_cast<unsigned int>(iAmt)) >= g_FileSz)
+    size_t nRead = g_File.read(iOfst, ptr, iAmt);
+    if (nRead < static_cast<size_t>(iAmt))
     {
-        if(static_cast<unsigned int>(iAmt) > g_FileSz)
-            iAmt = g_FileSz;
-        memset(ptr, 0, iAmt);
-        iAmt = g_FileSz - iOfst;
-        ret = SQLITE_IOERR_SHORT_READ;
+        // SQLite requires the rest of the buffer to be zeroed.
+        memset(reinterpret_cast<uint8_t*>(ptr) + nRead, 0, iAmt - nRead);
+        return SQLITE_IOERR_SHORT_READ;
     }
-    memcpy(ptr, &g_pFile[iOfst], iAmt);
-    return ret;
+    return 0;
 }
 
 int xReadFail(sqlite3_file *file, void *ptr, int iAmt, sqlite3_int64 iOfst)
@@ -88,24 +86,8 @@ int xReadFail(sqlite3_file *file, void *ptr, int iAmt, sqlite3_int64 iOfst)
 
 int xWrite(sqlite3_file *file, const void *ptr, int iAmt, sqlite3_int64 iOfst)
 {
-    // Write past the end of the file?
-    if((iOfst + static_cast<unsigned int>(iAmt)) >= g_FileSz)
-    {
-        // How many extra bytes do we need?
-        size_t nNewSize = iOfst + iAmt + 1; // We know the read crosses the EOF, so this is correct
-
-        // Allocate it, zero, and copy
-        uint8_t *tmp = new uint8_t[nNewSize];
-        memset(tmp, 0, nNewSize - 1);
-        memcpy(tmp, g_pFile, g_FileSz);
-        
-        delete [] g_pFile;
-        
-        g_pFile = tmp;
-        g_FileSz = nNewSize - 1;
-    }
-
-    memcpy(&g_pFile[iOfst], ptr, iAmt);
+    if (!g_File.write(iOfst, ptr, iAmt))
+        return SQLITE_IOERR_WRITE;
     return 0;
 }
 
@@ -115,6 +97,12 @@ int xWriteFail(sqlite3_file *file, const void *ptr, int iAmt, sqlite3_int64 iOfs
 }
 
 int xTruncate(sqlite3_file *file, sqlite3_int64 size)
+{
+    g_File.truncate(size);
+    return 0;
+}
+
+int xTruncateFail(sqlite3_file *file, sqlite3_int64 size)
 {
     return 0;
 }
@@ -126,7 +114,13 @@ int xSync(sqlite3_file *file, int flags)
 
 int xFileSize(sqlite3_file *file, sqlite3_int64 *pSize)
 {
-    *pSize = g_FileSz;
+    *pSize = g_File.size();
+    return 0;
+}
+
+int xFileSizeFail(sqlite3_file *file, sqlite3_int64 *pSize)
+{
+    *pSize = 0;
     return 0;
 }
 
@@ -184,9 +178,9 @@ static struct sqlite3_io_methods theio_fail =
     &xClose,
     &xReadFail,
     &xWriteFail,
-    &xTruncate,
+    &xTruncateFail,
     &xSync,
-    &xFileSize,
+    &xFileSizeFail,
     &xLock,
     &xUnlock,
     &xCheckReservedLock,
@@ -411,13 +405,12 @@ static bool init()
         ERROR("Config: allocateRegion failed.");
     }
 
-    g_pFile = new uint8_t[sSize];
-    memcpy(g_pFile, region.virtualAddress(), sSize);
-    g_FileSz = sSize;
+    if (!g_File.write(0, region.virtualAddress(), sSize))
+        FATAL("Config: not enough memory for the database.");
     NOTICE("region.va: " << (uintptr_t)region.virtualAddress());
 #else
-    g_pFile = file;
-    g_FileSz = sizeof file;
+    if (!g_File.write(0, file, sizeof file))
+        FATAL("Config: not enough memory for the database.");
 #endif
     sqlite3_initialize();
     NOTICE("Initialize fin");
@@ -428,6 +421,13 @@ static bool init()
         FATAL("sqlite3 error: " << sqlite3_errmsg(g_pSqlite));
     }
 
+#ifdef CONFIG_NO_JOURNAL
+    // Without a rollback journal each transaction's pages go straight into
+    // the image in one batch at commit. The price is that a statement which
+    // fails part way through can't be rolled back, so this is opt-in.
+    sqlite3_exec(g_pSqlite, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF;", 0, 0, 0);
+#endif
+
     sqlite3_create_function(g_pSqlite, "pedigree_callback", 1, SQLITE_ANY, 0, &xCallback0, 0, 0);
     sqlite3_create_function(g_pSqlite, "pedigree_callback", 2, SQLITE_ANY, 0, &xCallback1, 0, 0);
     sqlite3_create_function(g_pSqlite, "pedigree_callback", 3, SQLITE_ANY, 0, &xCallback2, 0, 0);
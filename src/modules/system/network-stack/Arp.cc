@@ -28,16 +28,20 @@
 
 Arp Arp::arpInstance;
 
-Arp::Arp() :
-  RequestQueue(), m_ArpCache(), m_ArpRequests()
+Arp::Arp()
 {
-    // By now threading should be active, as we're a module.
-    initialise();
 }
 
 Arp::~Arp()
 {
-    destroy();
+}
+
+NeighbourCache::Result Arp::resolve(IpAddress ip, Network* pCard, MacAddress* ent, uintptr_t packet, size_t nBytes)
+{
+  if(ip.getType() == IpAddress::IPv6)
+    return NeighbourCache::Failed; // ARP isn't for IPv6
+
+  return NeighbourCache::instance().resolve(ip, pCard, ent, &solicit, packet, nBytes, ETH_IPV4);
 }
 
 bool Arp::getFromCache(IpAddress ip, bool resolve, MacAddress* ent, Network* pCard)
@@ -48,33 +52,15 @@ bool Arp::getFromCache(IpAddress ip, bool resolve, MacAddress* ent, Network* pCa
   if(!pCard->isConnected())
     return false; // NIC isn't active
 
-  // do we have an entry for it yet?
-  arpEntry* arpEnt;
-  if((arpEnt = m_ArpCache.lookup(static_cast<uintptr_t>(ip.getIp()))) != 0)
-  {
-    *ent = arpEnt->mac;
-    return true;
-  }
-
-  // not found, do we resolve?
   if(!resolve)
-    return false;
-  ArpRequest* req = new ArpRequest;
-  req->destIp = ip;
-
-  // push this onto the list
-  m_ArpRequests.pushBack(req);
-
-  bool success = addRequest(0, reinterpret_cast<uint64_t>(req), reinterpret_cast<uint64_t>(pCard));
+    return NeighbourCache::instance().lookup(ip, pCard, ent);
 
-  // if sucessful, load into the passed MacAddress
-  // callers should check the return value to ensure this is valid
-  if(success)
-    *ent = req->mac;
+  return NeighbourCache::instance().resolveAndWait(ip, pCard, ent, &solicit, 5);
+}
 
-  // clean up
-  delete req;
-  return success;
+void Arp::solicit(IpAddress ip, Network* pCard)
+{
+  Arp::instance().send(ip, pCard);
 }
 
 void Arp::send(IpAddress req, Network* pCard)
@@ -114,42 +100,19 @@ void Arp::send(IpAddress req, Network* pCard)
   NetworkStack::instance().getMemPool().free(packet);
 }
 
-uint64_t Arp::executeRequest(uint64_t p1, uint64_t p2, uint64_t p3, uint64_t p4, uint64_t p5,
-                             uint64_t p6, uint64_t p7, uint64_t p8)
-{
-  ArpRequest* req = reinterpret_cast<ArpRequest*>(p1);
-  Network *pCard = reinterpret_cast<Network*>(p2);
-
-  // Send the request
-  req->success = false;
-  send(req->destIp, pCard);
-
-  // Wait for the reply
-  req->waitSem.acquire(1, 15);
-  return req->success ? 1 : 0;
-}
-
-bool Arp::isInCache(IpAddress ip)
+bool Arp::isInCache(IpAddress ip, Network* pCard)
 {
-    return m_ArpCache.lookup(ip.getIp()) != 0;
+    return NeighbourCache::instance().lookup(ip, pCard, 0);
 }
 
-void Arp::insertToCache(IpAddress ip, MacAddress mac)
+void Arp::insertToCache(IpAddress ip, MacAddress mac, Network* pCard)
 {
-    if(isInCache(ip))
-        return;
-
-    arpEntry* ent = new arpEntry;
-    ent->valid = true;
-    ent->mac = mac;
-    ent->ip = ip;
-    m_ArpCache.insert(ip.getIp(), ent);
+    NeighbourCache::instance().update(ip, pCard, mac, false);
 }
 
 void Arp::removeFromCache(IpAddress ip)
 {
-    /// \todo Implement
-    WARNING("ARP: implement removeFromCache");
+    NeighbourCache::instance().remove(ip);
 }
 
 void Arp::receive(size_t nBytes, uintptr_t packet, Network* pCard, uint32_t offset)
@@ -183,13 +146,16 @@ void Arp::receive(size_t nBytes, uintptr_t packet, Network* pCard, uint32_t offs
     // request?
     if(BIG_TO_HOST16(header->opcode) == ARP_OP_REQUEST)
     {
-      // Add to local cache even if the request isn't for us
-      MacAddress myMac = cardInfo.mac;
-      insertToCache(IpAddress(header->ipSrc), sourceMac);
+      // The sender will be talking to us if the request is for us, so it
+      // is worth an entry. Otherwise only refresh one we already have -
+      // every request on the segment would fill the cache with neighbours
+      // we never use, evicting the ones we do.
+      bool bForUs = (cardInfo.ipv4 == header->ipDest);
+      NeighbourCache::instance().update(IpAddress(header->ipSrc), pCard, sourceMac, false, bForUs);
 
       // We can glean information from ARP requests, but unless they're for us
       // we can't really respond.
-      if((cardInfo.ipv4 == header->ipDest))
+      if(bForUs)
       {
           // allocate the reply
           uintptr_t packet = NetworkStack::instance().getMemPool().allocate();
@@ -213,24 +179,10 @@ void Arp::receive(size_t nBytes, uintptr_t packet, Network* pCard, uint32_t offs
     {
       NOTICE("arp " << IpAddress(header->ipSrc).toString() << " is at " << sourceMac.toString());
 
-      // add to our local cache, if needed
-      insertToCache(IpAddress(header->ipSrc), sourceMac);
-
-      // search all the requests we've made, trigger the first we find
-      for(Vector<ArpRequest*>::Iterator it = m_ArpRequests.begin();
-          it != m_ArpRequests.end();
-          it++)
-      {
-        ArpRequest* p = *it;
-        if(p->destIp.getIp() == header->ipSrc)
-        {
-          p->mac = header->hwSrc;
-          p->waitSem.release();
-          p->success = true;
-          m_ArpRequests.erase(it);
-          break;
-        }
-      }
+      // this answers (or refreshes) one of our requests, and releases any
+      // packets that were waiting on it; an unsolicited reply doesn't get
+      // an entry of its own
+      NeighbourCache::instance().update(IpAddress(header->ipSrc), pCard, sourceMac, true, false);
     }
     else
     {
@@ -22,16 +22,12 @@
 #define MACHINE_ARP_H
 
 #include <utilities/String.h>
-#include <utilities/Vector.h>
-#include <utilities/Tree.h>
-#include <processor/state.h>
 #include <processor/types.h>
-#include <process/Semaphore.h>
 #include <machine/Network.h>
 #include <machine/Machine.h>
-#include <utilities/RequestQueue.h>
 
 #include "NetworkStack.h"
+#include "NeighbourCache.h"
 #include "Ethernet.h"
 
 #define ARP_OP_REQUEST  0x0001
@@ -39,8 +35,11 @@
 
 /**
  * The Pedigree network stack - ARP layer
+ *
+ * Mappings live in the shared NeighbourCache; this class only speaks the
+ * protocol.
  */
-class Arp : public RequestQueue
+class Arp
 {
 public:
   Arp();
@@ -58,19 +57,23 @@ public:
   /** Sends an ARP request */
   void send(IpAddress req, Network* pCard = 0);
 
-  /** Gets an entry from the ARP cache, and optionally resolves it if needed. */
+  /** Resolves an address for the send path without blocking. If the address
+   *  isn't known yet, the nBytes at packet are queued and sent once it is. */
+  NeighbourCache::Result resolve(IpAddress ip, Network* pCard, MacAddress* ent, uintptr_t packet, size_t nBytes);
+
+  /** Gets an entry from the ARP cache, and optionally resolves it if needed.
+   *  Resolving here blocks until an answer arrives or we give up. */
   bool getFromCache(IpAddress ip, bool resolve, MacAddress* ent, Network* pCard);
-  
+
   /** Direct cache manipulation */
-  bool isInCache(IpAddress ip);
-  void insertToCache(IpAddress ip, MacAddress mac);
+  bool isInCache(IpAddress ip, Network* pCard);
+  void insertToCache(IpAddress ip, MacAddress mac, Network* pCard);
   void removeFromCache(IpAddress ip);
 
 private:
 
-  /** ARP request doer */
-  virtual uint64_t executeRequest(uint64_t p1, uint64_t p2, uint64_t p3, uint64_t p4, uint64_t p5,
-                                  uint64_t p6, uint64_t p7, uint64_t p8);
+  /** NeighbourCache solicitation callback */
+  static void solicit(IpAddress ip, Network* pCard);
 
   static Arp arpInstance;
 
@@ -87,41 +90,6 @@ private:
     uint32_t  ipDest;
   } __attribute__ ((packed));
 
-  // an entry in the arp cache
-  /// \todo Will need to store *time* and *type* - time for removing from cache
-  ///       and type for static entries
-  struct arpEntry
-  {
-    arpEntry() :
-      valid(false), ip(), mac()
-    {};
-
-    bool valid;
-    IpAddress ip;
-    MacAddress mac;
-  };
-
-  // an ARP request we've sent
-  class ArpRequest // : public TimerHandler
-  {
-    public:
-      ArpRequest() :
-        destIp(), mac(), waitSem(0), success(false)
-      {};
-
-      IpAddress destIp;
-      MacAddress mac;
-      Semaphore waitSem;
-
-      bool success;
-  };
-
-  // ARP Cache
-  Tree<size_t, arpEntry*> m_ArpCache;
-
-  // ARP request list
-  Vector<ArpRequest*> m_ArpRequests;
-
 };
 
 #endif
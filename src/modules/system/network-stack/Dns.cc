@@ -24,84 +24,79 @@
 
 #include "UdpManager.h"
 #include <processor/Processor.h>
+#include <machine/Timer.h>
+#include <config/Config.h>
+#include <LockGuard.h>
+#include <utilities/utility.h>
 
 Dns Dns::dnsInstance;
 uint16_t Dns::m_NextId = 0;
 
-String qnameLabelHelper(char *buff, size_t *len, uintptr_t buffLoc)
-{
-    String ret;
-    size_t retLen = 0;
-    char *locbuff = buff;
-
-    // Current offset within this section
-    size_t currOffset = 0;
+/** Most compression pointers followed while reading one name. Anything
+ *  legitimate needs far fewer; this stops pointer loops. */
+#define DNS_MAX_POINTER_HOPS    16
 
-    // Current size of this section
-    size_t sectionSize = *locbuff++;
-    if(!sectionSize)
-    {
-      // Empty name.
-      *len = 1;
-      ret = ".";
-      return ret;
-    }
+/** Reads a (possibly compressed) name at offset in a DNS packet. On success,
+ *  consumed is the number of bytes the name takes up at offset itself. Fails
+ *  if the name runs off the end of the packet, is too long, or loops. */
+static bool readName(const uint8_t *pPacket, size_t packetLen, size_t offset,
+                     String &name, size_t &consumed)
+{
+    char buff[256];
+    size_t nameLen = 0;
+    size_t hops = 0;
+    bool bJumped = false;
+    consumed = 0;
 
-    // Keep reading until we hit a zero-sized section
     while(true)
     {
-        retLen++;
+        if(offset >= packetLen)
+            return false;
 
-        // Read in the character at this specific position
-        char c = *locbuff++;
-
-        // If it's null, then this is the beginning of a zero-sized section, so
-        // break from the loop: we're done.
-        if(!c)
-            break;
-        // If the top two bits are set, then it's an inline pointer (FUN)
-        else if((c & 0xC0) == 0xC0)
+        uint8_t label = pPacket[offset];
+        if((label & 0xC0) == 0xC0)
         {
-            // The rest of this read comes from *that* location!
-            char offset = *locbuff++;
-            locbuff = reinterpret_cast<char*>(buffLoc + offset);
-            ret += ".";
-
-            // Prepare to read the next part of the hostname
-            currOffset = 0;
-            sectionSize = *locbuff++;
+            // The rest of the name is somewhere else in the packet.
+            if((offset + 1) >= packetLen || ++hops > DNS_MAX_POINTER_HOPS)
+                return false;
+            if(!bJumped)
+                consumed += 2;
+            bJumped = true;
+            offset = ((label & 0x3F) << 8) | pPacket[offset + 1];
             continue;
         }
+        else if(label & 0xC0)
+            return false;
 
-        // Otherwise, check to see if we're at the end of the section
-        if(currOffset++ == sectionSize)
-        {
-            ret += ".";
-            sectionSize = c;
-            currOffset = 0;
-        }
-        else
-        {
-            char s[2] = {c, 0};
-            ret += s;
-        }
-      }
+        if(!bJumped)
+            consumed += 1 + label;
+        if(!label)
+            break;
 
-      // Count the last section size byte
-      retLen++;
+        if((offset + 1 + label) > packetLen || (nameLen + label + 1) >= sizeof(buff))
+            return false;
+        if(nameLen)
+            buff[nameLen++] = '.';
+        memcpy(buff + nameLen, pPacket + offset + 1, label);
+        nameLen += label;
+        offset += 1 + label;
+    }
 
-      // All done!
-      *len = retLen;
-      return ret;
+    if(!nameLen)
+        buff[nameLen++] = '.';
+    name.assign(buff, nameLen);
+    return true;
 }
 
 Dns::Dns() :
-  m_DnsCache(), m_DnsRequests(), m_Endpoint(0)
+  m_Cache(), m_nCacheEntries(0), m_DnsRequests(), m_Lock(false),
+  m_nHits(0), m_nMisses(0), m_nCoalesced(0), m_Endpoint(0)
 {
 }
 
 Dns::Dns(const Dns& ent) :
-  m_DnsCache(ent.m_DnsCache), m_DnsRequests(ent.m_DnsRequests), m_Endpoint(ent.m_Endpoint)
+  m_Cache(), m_nCacheEntries(0), m_DnsRequests(), m_Lock(false),
+  m_nHits(0), m_nMisses(0), m_nCoalesced(0), m_Endpoint(ent.m_Endpoint)
 {
   Thread *pThread = new Thread(Processor::information().getCurrentThread()->getParent(),
                                reinterpret_cast<Thread::ThreadStartFunc>(&trampoline),
@@ -131,6 +126,172 @@ int Dns::trampoline(void* p)
   return 0;
 }
 
+uint32_t Dns::hashName(const char *name)
+{
+  // FNV-1a
+  uint32_t h = 2166136261U;
+  for(; *name; ++name)
+  {
+    h ^= static_cast<uint8_t>(*name);
+    h *= 16777619U;
+  }
+  return h;
+}
+
+Dns::CacheEntry *Dns::findEntry(const String &name, uint32_t hash)
+{
+  for(CacheEntry *e = m_Cache[hash & (CacheBuckets - 1)]; e; e = e->pNext)
+  {
+    if(e->hash == hash && e->name == name)
+      return e;
+  }
+  return 0;
+}
+
+Dns::CacheEntry *Dns::createEntry(const String &name, uint32_t hash)
+{
+  if(m_nCacheEntries >= MaxCacheEntries)
+  {
+    // Throw out everything that has expired...
+    uint64_t now = Machine::instance().getTimer()->getTickCount();
+    for(size_t i = 0; i < CacheBuckets; ++i)
+    {
+      CacheEntry *e = m_Cache[i];
+      while(e)
+      {
+        CacheEntry *pNext = e->pNext;
+        if(!e->pPending && e->expires <= now)
+          destroyEntry(e);
+        e = pNext;
+      }
+    }
+
+    // ... and if that wasn't enough, something from this bucket.
+    if(m_nCacheEntries >= MaxCacheEntries)
+    {
+      for(CacheEntry *e = m_Cache[hash & (CacheBuckets - 1)]; e; e = e->pNext)
+      {
+        if(!e->pPending)
+        {
+          destroyEntry(e);
+          break;
+        }
+      }
+    }
+  }
+
+  CacheEntry *e = new CacheEntry;
+  e->name = name;
+  e->hash = hash;
+
+  size_t bucket = hash & (CacheBuckets - 1);
+  e->pNext = m_Cache[bucket];
+  m_Cache[bucket] = e;
+  ++m_nCacheEntries;
+  return e;
+}
+
+void Dns::destroyEntry(CacheEntry *pEntry)
+{
+  CacheEntry **pp = &m_Cache[pEntry->hash & (CacheBuckets - 1)];
+  while(*pp && *pp != pEntry)
+    pp = &(*pp)->pNext;
+  if(*pp)
+    *pp = pEntry->pNext;
+
+  clearInfo(pEntry->aliases, pEntry->addresses);
+  delete pEntry;
+  --m_nCacheEntries;
+}
+
+void Dns::clearInfo(List<String*> &aliases, List<IpAddress*> &addresses)
+{
+  for(List<String*>::Iterator it = aliases.begin(); it != aliases.end(); it++)
+    delete *it;
+  aliases.clear();
+
+  for(List<IpAddress*>::Iterator it = addresses.begin(); it != addresses.end(); it++)
+    delete *it;
+  addresses.clear();
+}
+
+void Dns::copyInfo(List<String*> &dstAliases, List<IpAddress*> &dstAddresses,
+                   List<String*> &srcAliases, List<IpAddress*> &srcAddresses)
+{
+  for(List<String*>::Iterator it = srcAliases.begin(); it != srcAliases.end(); it++)
+    dstAliases.pushBack(new String(**it));
+
+  for(List<IpAddress*>::Iterator it = srcAddresses.begin(); it != srcAddresses.end(); it++)
+    dstAddresses.pushBack(new IpAddress(**it));
+}
+
+void Dns::releaseRequest(DnsRequest *req)
+{
+  if(--req->nRefs)
+    return;
+
+  clearInfo(req->aliases, req->addresses);
+  delete req;
+}
+
+/** Parses a dotted-quad IPv4 address. */
+static bool parseIpv4(const char *str, IpAddress &ip)
+{
+  uint32_t octets[4] = {0, 0, 0, 0};
+  size_t n = 0;
+  bool bDigit = false;
+  for(; *str; ++str)
+  {
+    if(*str >= '0' && *str <= '9')
+    {
+      octets[n] = (octets[n] * 10) + (*str - '0');
+      if(octets[n] > 255)
+        return false;
+      bDigit = true;
+    }
+    else if(*str == '.' && bDigit && n < 3)
+    {
+      ++n;
+      bDigit = false;
+    }
+    else
+      return false;
+  }
+  if(n != 3 || !bDigit)
+    return false;
+
+  ip.setIp(Network::convertToIpv4(octets[0], octets[1], octets[2], octets[3]));
+  return true;
+}
+
+size_t Dns::getServers(Network *pCard, IpAddress *pServers, size_t nMax)
+{
+  size_t n = 0;
+
+  // A statically configured nameserver comes first, so that it can be used
+  // to override whatever the card was given.
+  Config::Cursor *pCursor = Config::instance().prepare("select value from 'network_generic' where key='nameserver';");
+  if(pCursor)
+  {
+    if(nMax && pCursor->next() && pCursor->getStr("value") && parseIpv4(pCursor->getStr("value"), pServers[0]))
+      n = 1;
+    delete pCursor;
+  }
+
+  if(pCard && pCard->isConnected())
+  {
+    StationInfo info = pCard->getStationInfo();
+    for(size_t i = 0; i < info.nDnsServers && n < nMax; ++i)
+    {
+      if(n && pServers[0] == info.dnsServers[i])
+        continue;
+      pServers[n++] = info.dnsServers[i];
+    }
+  }
+
+  return n;
+}
+
 void Dns::mainThread()
 {
   uint8_t* buff = new uint8_t[1024];
@@ -148,95 +309,91 @@ void Dns::mainThread()
     {
       // Read the packet (Safe to block because we've already run dataReady)
       int n = e->recv(buffLoc, 1024, true, &remoteHost);
-      if(n <= 0)
+      if(n <= static_cast<int>(sizeof(DnsHeader)))
         continue;
+      uintptr_t buffEnd = buffLoc + n;
 
       // grab the header
       DnsHeader* head = reinterpret_cast<DnsHeader*>(buffLoc);
 
-      // look for the ID in our request list
-      bool bFound = false;
-      DnsRequest* req = 0;
-      for(Vector<DnsRequest*>::Iterator it = m_DnsRequests.begin(); it != m_DnsRequests.end(); it++)
-      {
-        if((*it)->id == head->id)
-        {
-          req = (*it);
-          bFound = true;
-
-          m_DnsRequests.erase(it);
-          break;
-        }
-      }
+      LockGuard<Mutex> guard(m_Lock);
 
-      if(!bFound)
+      // look for the ID in our request list
+      DnsRequest* req = m_DnsRequests.lookup(head->id);
+      if(!req)
         continue;
+      m_DnsRequests.remove(head->id);
 
       uint16_t qCount = BIG_TO_HOST16(head->qCount);
       uint16_t ansCount = BIG_TO_HOST16(head->aCount);
       uint16_t nameCount = BIG_TO_HOST16(head->nCount);
       uint16_t addCount = BIG_TO_HOST16(head->dCount);
+      uint16_t rcode = BIG_TO_HOST16(head->opAndParam) & DNS_RESPONSE;
 
-      // If there were no answers, this is a "name not found" error.
-      if(!ansCount)
-      {
-          req->success = false;
-          req->waitSem.release();
-          continue;
-      }
-
-      // Read in each question section
-      size_t ansOffset = sizeof(DnsHeader);
+      // Skip the question section. Every read from here on is checked
+      // against the length of the packet.
+      size_t packetLen = n;
+      size_t offset = sizeof(DnsHeader);
+      bool bMalformed = false;
       for(uint16_t question = 0; question < qCount; question++)
       {
-          // Read in the string (have to do this to get the size... bah). Note
-          // that the NAME field for a QUESTION section will never be a pointer,
-          // unlike the ANSWER section below.
+          String tmp;
           size_t nameLength = 0;
-          String tmp = qnameLabelHelper(reinterpret_cast<char*>(buffLoc + ansOffset), &nameLength, buffLoc);
-
-          // Add to the offset. We don't really care about the suffix at the
-          // moment as we're mainly doing this to get to the answer section.
-          ansOffset += nameLength + sizeof(QuestionSecNameSuffix);
+          if(!readName(buff, packetLen, offset, tmp, nameLength) ||
+             (offset + nameLength + sizeof(QuestionSecNameSuffix)) > packetLen)
+          {
+              bMalformed = true;
+              break;
+          }
+
+          offset += nameLength + sizeof(QuestionSecNameSuffix);
       }
 
-      uintptr_t ansStart = buffLoc + ansOffset;
+      // The answer may be cached for as long as its shortest-lived record.
+      uint32_t ttl = MaxTtl;
+      uint32_t negativeTtl = DefaultNegativeTtl;
 
       // http://www.zytrax.com/books/dns/ch15/ for future reference
       bool hostnameFilled = false;
-      for(uint16_t answer = 0; answer < (ansCount + nameCount + addCount); answer++)
+      for(uint16_t answer = 0; !bMalformed && answer < (ansCount + nameCount + addCount); answer++)
       {
-        DnsAnswer* ans = reinterpret_cast<DnsAnswer*>(ansStart);
         String *qname = new String;
-        if(BIG_TO_HOST16(ans->name) & 0xC000)
+        size_t nameLength = 0;
+        if(!readName(buff, packetLen, offset, *qname, nameLength) ||
+           (offset + nameLength + sizeof(DnsAnswer) - sizeof(uint16_t)) > packetLen)
         {
-          // This is an offset within the DNS packet to the string
-          size_t len = 0;
-          size_t offset = BIG_TO_HOST16(ans->name) - 0xC000;
-          *qname = qnameLabelHelper(reinterpret_cast<char*>(buffLoc + offset), &len, buffLoc);
-          NOTICE("Got: " << *qname << ", len " << len << ".");
+          delete qname;
+          bMalformed = true;
+          break;
         }
-        else
+
+        // The fixed part of the record follows the name; DnsAnswer starts
+        // with the last two bytes of it (or the pointer to it).
+        DnsAnswer* ans = reinterpret_cast<DnsAnswer*>(buffLoc + offset + nameLength - sizeof(ans->name));
+
+        uintptr_t rdata = reinterpret_cast<uintptr_t>(ans) + sizeof(DnsAnswer);
+        uint16_t rdLength = BIG_TO_HOST16(ans->length);
+        uint32_t recordTtl = BIG_TO_HOST32(ans->ttl);
+        if((rdata + rdLength) > buffEnd)
         {
-          // This is a name component within the answer section
-          /// \todo this code is pretty broken - needs to be rewritten.
-          size_t len = 0;
-          *qname = qnameLabelHelper(reinterpret_cast<char*>(ansStart), &len, buffLoc);
-          NOTICE("Got: " << *qname << ", len " << len << ".");
-
-          // Update the answer pointer so the rest of the structure comes across properly
-          ans = reinterpret_cast<DnsAnswer*>((ansStart + len) - sizeof(ans->name));
+          delete qname;
+          bMalformed = true;
+          break;
         }
 
+        bool bAnswerSection = answer < ansCount;
+        if(bAnswerSection && recordTtl < ttl)
+          ttl = recordTtl;
+
         switch(BIG_TO_HOST16(ans->type))
         {
           /** A Record */
           case 0x0001:
             {
               // Add the IP address for this entry to the list
-              if(BIG_TO_HOST16(ans->length) == 4)
+              if(rdLength == 4)
               {
-                uint32_t newIp = *reinterpret_cast<uint32_t*>(ansStart + sizeof(DnsAnswer));
+                uint32_t newIp = *reinterpret_cast<uint32_t*>(rdata);
                 IpAddress *ip = new IpAddress(newIp);
                 req->addresses.pushBack(ip);
               }
@@ -249,7 +406,7 @@ void Dns::mainThread()
             /** NS */
             case 0x0002:
             {
-                WARNING("TODO: NS Records");
+                // Only expected in the authority section; nothing to do.
             }
             break;
             /** CNAME */
@@ -266,7 +423,14 @@ void Dns::mainThread()
             /** SOA */
             case 0x0006:
             {
-                WARNING("TODO: SOA Records");
+                // An SOA in the authority section says how long a negative
+                // answer may be cached: the lesser of its TTL and its
+                // MINIMUM field, the last word of the record (RFC 2308).
+                if(!bAnswerSection && rdLength >= 20)
+                {
+                    uint32_t minimum = BIG_TO_HOST32(*reinterpret_cast<uint32_t*>(rdata + rdLength - 4));
+                    negativeTtl = recordTtl < minimum ? recordTtl : minimum;
+                }
             }
             break;
             /* WKS */
@@ -310,7 +474,7 @@ void Dns::mainThread()
         if(qname)
             delete qname;
 
-        ansStart += sizeof(DnsAnswer) + BIG_TO_HOST16(ans->length);
+        offset = (rdata + rdLength) - buffLoc;
       }
 
       // If no hostname was filled, take one from the aliases (if possible)
@@ -320,124 +484,228 @@ void Dns::mainThread()
               req->hostname = *(*(req->aliases.begin()));
       }
 
-      if(req->callerLeft)
-          delete req;
-      else
+      // NXDOMAIN, or a "successful" answer with no addresses in it, means
+      // the name doesn't exist. Anything else with no addresses (SERVFAIL,
+      // REFUSED...) is a failure we shouldn't remember.
+      req->success = req->addresses.count() != 0;
+      req->bNegative = !req->success && !bMalformed && (rcode == 3 || rcode == 0);
+      req->ttl = req->success ? ttl : negativeTtl;
+      if(req->ttl > MaxTtl)
+          req->ttl = MaxTtl;
+
+      // Fill the cache entry, and let everyone waiting on this name go.
+      CacheEntry *pEntry = req->pEntry;
+      pEntry->pPending = 0;
+      if(req->success || req->bNegative)
       {
-          /// \todo Rewrite the DNS cache mechanism. For now, we'll just avoid
-          ///       caching. A proper DNS cache mechanism needs to handle the
-          ///       CNAMEs as well as the aliases
-          // m_DnsCache.pushBack(req->entry);
-          req->success = true;
-          req->waitSem.release();
+          clearInfo(pEntry->aliases, pEntry->addresses);
+          copyInfo(pEntry->aliases, pEntry->addresses, req->aliases, req->addresses);
+          pEntry->hostname = req->hostname;
+          pEntry->bNegative = req->bNegative;
+          pEntry->expires = Machine::instance().getTimer()->getTickCount() + (req->ttl * 1000ULL);
       }
+      else if(!pEntry->expires)
+          destroyEntry(pEntry);
+
+      req->pEntry = 0;
+      req->done = true;
+      req->waitSem.release(req->nRefs);
     }
   }
 }
 
-int Dns::hostToIp(String hostname, HostInfo& ret, Network* pCard)
+bool Dns::cachedAnswer(const String &name, uint32_t hash, HostInfo &ret, int &result)
 {
-    if(!pCard || !pCard->isConnected())
-        return -1;
+    uint64_t now = Machine::instance().getTimer()->getTickCount();
+    CacheEntry *pEntry = findEntry(name, hash);
+    if(!pEntry || pEntry->pPending || pEntry->expires <= now)
+        return false;
 
-    /// \todo Rewrite DNS cache mechanism
-    /*for(List<DnsEntry*>::Iterator it = m_DnsCache.begin(); it!= m_DnsCache.end(); it++)
+    ++m_nHits;
+    if(pEntry->bNegative)
     {
-        if(!strcmp(static_cast<const char*>((*it)->hostname), static_cast<const char*>(hostname)))
-        {
-            nIps = (*it)->numIps;
-            return (*it)->ip;
-        }
-    }*/
+        result = -1;
+        return true;
+    }
 
-    // Grab the DNS server to use
-    StationInfo info = pCard->getStationInfo();
-    if(info.nDnsServers == 0)
-        return -1;
+    copyInfo(ret.aliases, ret.addresses, pEntry->aliases, pEntry->addresses);
+    ret.hostname = pEntry->hostname;
+    result = 0;
+    return true;
+}
 
-    // Setup for our request
-    ConnectionlessEndpoint* e = m_Endpoint;
+int Dns::hostToIp(String hostname, HostInfo& ret, Network* pCard)
+{
+    // Names are case-insensitive, so the cache is keyed on the lower-cased
+    // name. Build the query from what we were given, though.
+    size_t nameLen = hostname.length();
+    if(!nameLen || nameLen > 253)
+        return -1;
 
-    uint8_t* buff = new uint8_t[1024];
-    uintptr_t buffLoc = reinterpret_cast<uintptr_t>(buff);
-    memset(buff, 0, 1024);
+    char *lower = new char[nameLen + 1];
+    for(size_t i = 0; i < nameLen; i++)
+        lower[i] = toLower(hostname[i]);
+    lower[nameLen] = 0;
+    String key(lower);
+    uint32_t hash = hashName(lower);
+    delete [] lower;
 
-    // Setup the DNS message header
-    DnsHeader* head = reinterpret_cast<DnsHeader*>(buffLoc);
-    head->id = m_NextId++;
-    head->opAndParam = HOST_TO_BIG16(DNS_RECURSION);
-    head->qCount = HOST_TO_BIG16(1);
+    int result = -1;
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        if(cachedAnswer(key, hash, ret, result))
+            return result;
+    }
 
-    // Build the modified hostname
-    size_t len = hostname.length() + 1;
-    char* host = new char[len];
-    memset(host, 0, len);
+    // Only lookups that miss need the DNS servers.
+    IpAddress servers[MaxServers];
+    size_t nServers = getServers(pCard, servers, MaxServers);
 
-    size_t top = hostname.length();
-    size_t prevSize = 0;
-    for(ssize_t i = top - 1; i >= 0; i--)
+    DnsRequest *req = 0;
+    bool bOwner = false;
     {
-        if(hostname[i] == '.')
+        LockGuard<Mutex> guard(m_Lock);
+
+        // Somebody may have filled the entry in the meantime.
+        if(cachedAnswer(key, hash, ret, result))
+            return result;
+
+        CacheEntry *pEntry = findEntry(key, hash);
+
+        if(pEntry && pEntry->pPending)
         {
-            host[i+1] = prevSize;
-            prevSize = 0;
+            // Somebody is already asking; wait for their answer.
+            ++m_nCoalesced;
+            req = pEntry->pPending;
+            ++req->nRefs;
         }
         else
         {
-            host[i+1] = hostname[i];
-            prevSize++;
+            ++m_nMisses;
+            if(!nServers)
+                return -1;
+
+            if(!pEntry)
+                pEntry = createEntry(key, hash);
+
+            req = new DnsRequest;
+            req->id = m_NextId++;
+            req->nRefs = 1;
+            req->pEntry = pEntry;
+            pEntry->pPending = req;
+            m_DnsRequests.insert(req->id, req);
+            bOwner = true;
         }
     }
-    host[0] = prevSize;
 
-    memcpy(reinterpret_cast<char*>(buffLoc + sizeof(DnsHeader)), host, len);
+    if(bOwner)
+    {
+        // Setup for our request
+        ConnectionlessEndpoint* e = m_Endpoint;
+
+        uint8_t* buff = new uint8_t[1024];
+        uintptr_t buffLoc = reinterpret_cast<uintptr_t>(buff);
+        memset(buff, 0, 1024);
+
+        // Setup the DNS message header
+        DnsHeader* head = reinterpret_cast<DnsHeader*>(buffLoc);
+        head->id = req->id;
+        head->opAndParam = HOST_TO_BIG16(DNS_RECURSION);
+        head->qCount = HOST_TO_BIG16(1);
+
+        // Build the modified hostname
+        size_t len = hostname.length() + 1;
+        char* host = new char[len];
+        memset(host, 0, len);
+
+        size_t top = hostname.length();
+        size_t prevSize = 0;
+        for(ssize_t i = top - 1; i >= 0; i--)
+        {
+            if(hostname[i] == '.')
+            {
+                host[i+1] = prevSize;
+                prevSize = 0;
+            }
+            else
+            {
+                host[i+1] = hostname[i];
+                prevSize++;
+            }
+        }
+        host[0] = prevSize;
 
-    delete [] host;
+        memcpy(reinterpret_cast<char*>(buffLoc + sizeof(DnsHeader)), host, len);
 
-    // Request the host address
-    QuestionSecNameSuffix* q = reinterpret_cast<QuestionSecNameSuffix*>(buffLoc + sizeof(DnsHeader) + len + 1);
-    q->type = HOST_TO_BIG16(1);
-    q->cls = HOST_TO_BIG16(1);
+        delete [] host;
 
-    // Shove all this into a DnsRequest ready for replies
-    DnsRequest* req = new DnsRequest;
-    req->id = head->id;
+        // Request the host address
+        QuestionSecNameSuffix* q = reinterpret_cast<QuestionSecNameSuffix*>(buffLoc + sizeof(DnsHeader) + len + 1);
+        q->type = HOST_TO_BIG16(1);
+        q->cls = HOST_TO_BIG16(1);
 
-    m_DnsRequests.pushBack(req);
+        // Try each DNS server until one of them answers
+        bool bAnswered = false;
+        for(size_t dnsServer = 0; dnsServer < nServers; dnsServer++)
+        {
+            Endpoint::RemoteEndpoint remoteHost;
+            remoteHost.remotePort = 53;
+            remoteHost.ip = servers[dnsServer];
 
-    // Try each DNS server until we actually get a successful query on one
-    for(size_t dnsServer = 0; dnsServer < info.nDnsServers; dnsServer++)
-    {
-        Endpoint::RemoteEndpoint remoteHost;
-        remoteHost.remotePort = 53;
-        remoteHost.ip = info.dnsServers[dnsServer];
+            if(e->send(sizeof(DnsHeader) + sizeof(QuestionSecNameSuffix) + len + 1, buffLoc, remoteHost, false) < 0)
+                continue;
 
-        req->success = false;
-        if(e->send(sizeof(DnsHeader) + sizeof(QuestionSecNameSuffix) + len + 1, buffLoc, remoteHost, false) < 0)
-            continue;
+            if(req->waitSem.acquire(1, QueryTimeout))
+            {
+                bAnswered = true;
+                break;
+            }
 
-        req->waitSem.acquire(1, 15);
-        if(Processor::information().getCurrentThread()->wasInterrupted())
-        {
-            req->callerLeft = true;
-            return -1;
+            if(Processor::information().getCurrentThread()->wasInterrupted())
+                break;
         }
 
-        if(!req->success)
+        delete [] buff;
+
+        LockGuard<Mutex> guard(m_Lock);
+        if(!req->done)
         {
-            delete req;
+            // Nobody answered. Withdraw the request and release anyone who
+            // joined it; they'll all see the failure.
+            m_DnsRequests.remove(req->id);
+
+            CacheEntry *pEntry = req->pEntry;
+            pEntry->pPending = 0;
+            if(!pEntry->expires)
+                destroyEntry(pEntry);
+            req->pEntry = 0;
+
+            req->success = false;
+            req->done = true;
+            if(req->nRefs > 1)
+                req->waitSem.release(req->nRefs - 1);
         }
-        else
+        else if(!bAnswered)
         {
-
-            ret.addresses = req->addresses;
-            ret.aliases = req->aliases;
-            ret.hostname = req->hostname;
-
-            delete req;
-            return 0;
+            // The answer came in just as we gave up, and released a count
+            // meant for us; soak it up so it doesn't linger.
+            req->waitSem.tryAcquire();
         }
     }
+    else
+    {
+        // The owner gives up after QueryTimeout per server; don't wait
+        // much longer than that.
+        req->waitSem.acquire(1, (QueryTimeout * (nServers ? nServers : MaxServers)) + 1);
+    }
 
-    return -1;
+    LockGuard<Mutex> guard(m_Lock);
+    if(req->done && req->success)
+    {
+        copyInfo(ret.aliases, ret.addresses, req->aliases, req->addresses);
+        ret.hostname = req->hostname;
+        result = 0;
+    }
+    releaseRequest(req);
+    return result;
 }
@@ -27,6 +27,7 @@
 #include <processor/state.h>
 #include <processor/types.h>
 #include <process/Semaphore.h>
+#include <process/Mutex.h>
 #include <machine/Network.h>
 #include <machine/Machine.h>
 
@@ -85,7 +86,9 @@ public:
   /** Initialises the Endpoint and begins running the worker thread */
   void initialise();
   
-  /** Requests a lookup for a hostname */
+  /** Requests a lookup for a hostname. Answers are cached for their TTL
+   *  (names that don't exist, too), and concurrent lookups of the same name
+   *  share one query. The caller owns the pointers placed in ret. */
   int hostToIp(String hostname, HostInfo& ret, Network* pCard = 0);
   
   /** Operator = is invalid */
@@ -125,44 +128,57 @@ private:
     uint16_t  length;
   } __attribute__ ((packed));
   
-  /** An entry in the DNS cache */
-  class DnsEntry
+  /** Answers are cached for at most this many seconds, whatever the TTL. */
+  static const uint32_t MaxTtl = 86400;
+  /** Negative answers without an SOA record are cached this long. */
+  static const uint32_t DefaultNegativeTtl = 60;
+  /** Seconds to wait for each DNS server before trying the next. */
+  static const size_t QueryTimeout = 5;
+  /** Most DNS servers tried for one lookup. */
+  static const size_t MaxServers = 4;
+  /** Number of buckets in the cache (must be a power of two). */
+  static const size_t CacheBuckets = 128;
+  /** Entries kept before expired (then arbitrary) entries are evicted. */
+  static const size_t MaxCacheEntries = 512;
+
+  class DnsRequest;
+
+  /** An entry in the DNS cache, keyed on the lower-cased name looked up.
+   *  Negative entries record that the name does not exist. While a query
+   *  for the name is on the wire, pPending points to it so that other
+   *  lookups can wait for that query rather than sending their own. */
+  struct CacheEntry
   {
-    public:
-      DnsEntry() : ip(0), numIps(0), hostname()
+      CacheEntry() :
+        pNext(0), name(), hash(0), bNegative(false), expires(0),
+        hostname(), aliases(), addresses(), pPending(0)
       {};
-      DnsEntry(const DnsEntry& ent) : ip(ent.ip), numIps(ent.numIps), hostname(ent.hostname)
-      {};
-      
-      /// Multiple IP addresses are possible
-      IpAddress* ip;
-      size_t numIps;
-      
-      /// Hostname
+
+      CacheEntry *pNext;
+
+      String name;
+      uint32_t hash;
+
+      bool bNegative;
+      /// Tick count (ms) after which the entry must be refreshed
+      uint64_t expires;
+
       String hostname;
-      
-      DnsEntry& operator = (const DnsEntry& ent)
-      {
-        ip = ent.ip;
-        numIps = ent.numIps;
-        hostname = ent.hostname;
-        return *this;
-      }
+      List<String*> aliases;
+      List<IpAddress*> addresses;
+
+      DnsRequest *pPending;
   };
-  
+
   /// a DNS request we've sent
   class DnsRequest
   {
     public:
       DnsRequest() :
         hostname(), aliases(), addresses(), id(0), waitSem(0),
-        success(false), callerLeft(false)
-      {};
-      DnsRequest(const DnsRequest& ent) :
-        hostname(ent.hostname), aliases(ent.aliases), addresses(ent.addresses), id(ent.id),
-        waitSem(0), success(ent.success), callerLeft(ent.callerLeft)
+        success(false), done(false), bNegative(false), ttl(0), nRefs(0), pEntry(0)
       {};
-      
+
       /// Hostname for this host, based on our request (probably a CNAME)
       String hostname;
 
@@ -174,39 +190,89 @@ private:
 
       /// DNS request ID
       uint16_t id;
-      
-      /// Semaphore used to wake up the caller thread when this request completes
+
+      /// Semaphore used to wake up the caller threads when this request completes
       Semaphore waitSem;
-      
-      /// Whether or not the request succeeded (possibly redundant now)
+
+      /// Whether or not the request succeeded
       bool success;
 
-      // Whether or not the caller left. If true, the request handler needs to
-      // free the request rather than waking up the calling thread.
-      bool callerLeft;
-      
-      DnsRequest& operator = (const DnsRequest& ent)
-      {
-        hostname = ent.hostname;
-        aliases = ent.aliases;
-        addresses = ent.addresses;
-        id = ent.id;
-        success = ent.success;
-        callerLeft = ent.callerLeft;
-        return *this;
-      }
-      
+      /// Whether or not an answer (or a final failure) is in
+      bool done;
+
+      /// Whether the server told us the name doesn't exist
+      bool bNegative;
+
+      /// Seconds the answer may be cached for
+      uint32_t ttl;
+
+      /// Threads waiting on this request; the last one out frees it
+      size_t nRefs;
+
+      /// The cache entry this request will fill
+      CacheEntry *pEntry;
+
     private:
+      DnsRequest(const DnsRequest&);
+      DnsRequest& operator = (const DnsRequest&);
   };
-  
-  /// DNS cache (not a Tree because we can't look up an IpAddress object)
-  List<DnsEntry*> m_DnsCache;
-  
-  /// DNS request list
-  Vector<DnsRequest*> m_DnsRequests;
-  
+
+  /** Hashes a lower-cased name. */
+  static uint32_t hashName(const char *name);
+
+  /** Finds the cache entry for a name. Lock must be held. */
+  CacheEntry *findEntry(const String &name, uint32_t hash);
+
+  /** Adds an empty cache entry for a name, evicting if needed. Lock must
+   *  be held. */
+  CacheEntry *createEntry(const String &name, uint32_t hash);
+
+  /** Unlinks and frees a cache entry. Lock must be held. */
+  void destroyEntry(CacheEntry *pEntry);
+
+  /** Frees everything in the given lists and empties them. */
+  static void clearInfo(List<String*> &aliases, List<IpAddress*> &addresses);
+
+  /** Appends copies of the given lists to the destination lists. */
+  static void copyInfo(List<String*> &dstAliases, List<IpAddress*> &dstAddresses,
+                       List<String*> &srcAliases, List<IpAddress*> &srcAddresses);
+
+  /** Drops a thread's reference to a request. Lock must be held. */
+  void releaseRequest(DnsRequest *req);
+
+  /** Fills in ret from a live cache entry for the name, if there is one.
+   *  Lock must be held.
+   *  \param[out] result what hostToIp should return
+   *  \return true if the cache had the answer */
+  bool cachedAnswer(const String &name, uint32_t hash, HostInfo &ret, int &result);
+
+  /** Gets the servers to query: the configured nameserver, if any, then the
+   *  card's. */
+  size_t getServers(Network *pCard, IpAddress *pServers, size_t nMax);
+
+  /// DNS cache
+  CacheEntry *m_Cache[CacheBuckets];
+  size_t m_nCacheEntries;
+
+  /// Outstanding requests, by ID
+  Tree<size_t, DnsRequest*> m_DnsRequests;
+
+  /// Protects the cache, the request tree and m_NextId
+  Mutex m_Lock;
+
+  /// Statistics
+  size_t m_nHits;
+  size_t m_nMisses;
+  size_t m_nCoalesced;
+
   /// DNS communication endpoint
   ConnectionlessEndpoint* m_Endpoint;
+
+public:
+  /** Statistics, for the curious. */
+  size_t cacheHits() const {return m_nHits;}
+  size_t cacheMisses() const {return m_nMisses;}
+  size_t coalescedLookups() const {return m_nCoalesced;}
 };
 
 #endif
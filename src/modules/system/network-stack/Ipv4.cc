@@ -178,16 +178,19 @@ bool Ipv4::send(IpAddress dest, IpAddress from, uint8_t type, size_t nBytes, uin
   /// \todo Perhaps flag this so if we don't want to automatically resolve the MAC
   ///       it doesn't happen?
   MacAddress destMac;
-  bool macValid = true;
   if(dest == me.broadcast)
     destMac.setMac(0xff);
   else
-    macValid = Arp::instance().getFromCache(realDest, true, &destMac, pCard);
-
-  if(macValid)
-    Ethernet::send(nBytes + sizeof(ipHeader), packet, pCard, destMac, dest.getType());
+  {
+    // Never wait for ARP here: if the address isn't known yet the packet
+    // is queued and goes out when the reply arrives.
+    NeighbourCache::Result r = Arp::instance().resolve(realDest, pCard, &destMac, packet, nBytes + sizeof(ipHeader));
+    if(r != NeighbourCache::Resolved)
+      return r == NeighbourCache::Queued;
+  }
 
-  return macValid;
+  Ethernet::send(nBytes + sizeof(ipHeader), packet, pCard, destMac, dest.getType());
+  return true;
 }
 
 void Ipv4::receive(size_t nBytes, uintptr_t packet, Network* pCard, uint32_t offset)
@@ -226,13 +229,13 @@ void Ipv4::receive(size_t nBytes, uintptr_t packet, Network* pCard, uint32_t off
     remoteHost.ip = from;
 
     StationInfo me = pCard->getStationInfo();
-    if((!me.ipv4.getIp()) && (!Arp::instance().isInCache(from))) // Not configured yet?
+    if((!me.ipv4.getIp()) && (!Arp::instance().isInCache(from, pCard))) // Not configured yet?
     {
         // Poison the ARP cache with this packet, as we won't be able to do
         // ARP for link-layer address determination yet.
         MacAddress e;
         Ethernet::instance().getMacFromPacket(packet, &e);
-        Arp::instance().insertToCache(from, e);
+        Arp::instance().insertToCache(from, e, pCard);
     }
 
 #ifdef IPV4_FORWARDING
@@ -252,10 +255,11 @@ void Ipv4::receive(size_t nBytes, uintptr_t packet, Network* pCard, uint32_t off
             return;
         }
 
-        bool macValid = Arp::instance().getFromCache(realDest, true, &e, pCard);
-        if(macValid)
-            Ethernet::send(nBytes - Ethernet::instance().ethHeaderSize(), packet + Ethernet::instance().ethHeaderSize(), pCard, e, to.getType());
-        else
+        size_t ethSize = Ethernet::instance().ethHeaderSize();
+        NeighbourCache::Result r = Arp::instance().resolve(realDest, pCard, &e, packet + ethSize, nBytes - ethSize);
+        if(r == NeighbourCache::Resolved)
+            Ethernet::send(nBytes - ethSize, packet + ethSize, pCard, e, to.getType());
+        else if(r == NeighbourCache::Failed)
             pCard->droppedPacket();
         return;
     }
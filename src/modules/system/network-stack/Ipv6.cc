@@ -210,7 +210,6 @@ bool Ipv6::send(IpAddress dest, IpAddress from, uint8_t type, size_t nBytes, uin
 
     // Get the address to send this packet to.
     MacAddress destMac;
-    bool macValid = true;
     if(dest.isMulticast())
     {
         // Need individual octets of the IPv6 address.
@@ -221,16 +220,18 @@ bool Ipv6::send(IpAddress dest, IpAddress from, uint8_t type, size_t nBytes, uin
         /// \todo Ethernet-specific
         uint8_t tmp[6] = {0x33, 0x33, ipv6[12], ipv6[13], ipv6[14], ipv6[15]};
         destMac.setMac(tmp);
-
-        macValid = true;
     }
     else
-        macValid = Ndp::instance().neighbourSolicit(realDest, &destMac, pCard);
-
-    if(macValid)
-        Ethernet::send(nBytes + sizeof(ip6Header), packet, pCard, destMac, dest.getType());
+    {
+        // Never wait for the neighbour here: if its address isn't known yet
+        // the packet is queued and goes out when the advertisement arrives.
+        NeighbourCache::Result r = Ndp::instance().resolve(realDest, pCard, &destMac, packet, nBytes + sizeof(ip6Header));
+        if(r != NeighbourCache::Resolved)
+            return r == NeighbourCache::Queued;
+    }
 
-    return macValid;
+    Ethernet::send(nBytes + sizeof(ip6Header), packet, pCard, destMac, dest.getType());
+    return true;
 }
 
 void Ipv6::receive(size_t nBytes, uintptr_t packet, Network* pCard, uint32_t offset)
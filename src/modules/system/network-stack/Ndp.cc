@@ -25,6 +25,7 @@
 #include "NetworkStack.h"
 
 #include "RoutingTable.h"
+#include "Ethernet.h"
 
 Ndp Ndp::ndpInstance;
 
@@ -33,7 +34,7 @@ Ndp Ndp::ndpInstance;
 #define NDP_SOLICIT     135
 #define NDP_ADVERT      136
 
-Ndp::Ndp() : m_LookupCache()
+Ndp::Ndp()
 {
 }
 
@@ -41,13 +42,9 @@ Ndp::~Ndp()
 {
 }
 
-void Ndp::addEntry(IpAddress addr, MacAddress mac)
+void Ndp::addEntry(IpAddress addr, MacAddress mac, Network *pCard)
 {
-    if(m_LookupCache.lookup(addr.toString()))
-        return;
-
-    MacAddress *pNew = new MacAddress(mac);
-    m_LookupCache.insert(addr.toString(), pNew);
+    NeighbourCache::instance().update(addr, pCard, mac, false);
 }
 
 void Ndp::receive(IpAddress from, IpAddress to, uint8_t icmpType, uint8_t icmpCode, uintptr_t payload, size_t nBytes, Network *pCard)
@@ -202,7 +199,7 @@ void Ndp::receive(IpAddress from, IpAddress to, uint8_t icmpType, uint8_t icmpCo
                             if(p->type == 1)
                             {
                                 // Add to our cache.
-                                addEntry(from, mac);
+                                addEntry(from, mac, pCard);
                             }
                         }
 
@@ -230,7 +227,33 @@ void Ndp::receive(IpAddress from, IpAddress to, uint8_t icmpType, uint8_t icmpCo
             break;
         case NDP_ADVERT:
             {
-                NOTICE("NDP Advertisement from " << from.toString() << ".");
+                if(nBytes < sizeof(NeighbourAdvertisement))
+                    return;
+
+                NeighbourAdvertisement *pMessage = reinterpret_cast<NeighbourAdvertisement*>(payload);
+                IpAddress packetTarget = pMessage->target;
+                bool bSolicited = (pMessage->flags >> 5) & NADVERT_FLAGS_SOLICIT;
+
+                // The target link-layer address option tells us where the
+                // target lives; it answers any solicitation we have pending.
+                Option *pOption = reinterpret_cast<Option*>(payload + sizeof(NeighbourAdvertisement));
+                while((reinterpret_cast<uintptr_t>(pOption) + sizeof(LinkLayerAddressOption)) <= (payload + nBytes))
+                {
+                    if(!pOption->length)
+                        break;
+
+                    if(pOption->type == 2)
+                    {
+                        LinkLayerAddressOption *p = reinterpret_cast<LinkLayerAddressOption*>(pOption);
+                        MacAddress mac;
+                        mac.setMac(p->address);
+
+                        NeighbourCache::instance().update(packetTarget, pCard, mac, bSolicited);
+                        break;
+                    }
+
+                    pOption = reinterpret_cast<Option*>(reinterpret_cast<uintptr_t>(pOption) + (pOption->length * 8));
+                }
             }
             break;
     };
@@ -274,16 +297,18 @@ bool Ndp::routerSolicit(Network *pCard)
     return true;
 }
 
+NeighbourCache::Result Ndp::resolve(IpAddress addr, Network *pCard, MacAddress *pMac, uintptr_t packet, size_t nBytes)
+{
+    return NeighbourCache::instance().resolve(addr, pCard, pMac, &solicit, packet, nBytes, ETH_IPV6);
+}
+
 bool Ndp::neighbourSolicit(IpAddress addr, MacAddress *pMac, Network *pCard)
 {
-    // Easy lookup?
-    MacAddress *p;
-    if((p = m_LookupCache.lookup(addr.toString())))
-    {
-        *pMac = *p;
-        return true;
-    }
+    return resolve(addr, pCard, pMac, 0, 0) == NeighbourCache::Resolved;
+}
 
+void Ndp::solicit(IpAddress addr, Network *pCard)
+{
     StationInfo me = pCard->getStationInfo();
 
     /// \todo Find an address with the same PREFIX as the NEIGHBOUR we want to
@@ -300,7 +325,7 @@ bool Ndp::neighbourSolicit(IpAddress addr, MacAddress *pMac, Network *pCard)
         }
     }
     if(i == me.nIpv6Addresses)
-        return false;
+        return;
 
     // Okay, we'll have to send a Neighbour Solicit.
     uintptr_t packet = NetworkStack::instance().getMemPool().allocate();
@@ -323,8 +348,4 @@ bool Ndp::neighbourSolicit(IpAddress addr, MacAddress *pMac, Network *pCard)
     // Send the solicit packet.
     Icmpv6::instance().send(to, from, NDP_SOLICIT, 0, packet, sizeof(NeighbourSolicitation) + sizeof(LinkLayerAddressOption), pCard);
     NetworkStack::instance().getMemPool().free(packet);
-
-    // Not yet implemented & working properly.
-    /// \todo Needs to wait until a response comes in or a timeout occurs.
-    return false;
 }
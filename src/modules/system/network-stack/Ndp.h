@@ -24,9 +24,8 @@
 #include <processor/types.h>
 #include <machine/Network.h>
 
-#include <utilities/RadixTree.h>
-
 #include "IpCommon.h"
+#include "NeighbourCache.h"
 
 #define NADVERT_FLAGS_ROUTER        1
 #define NADVERT_FLAGS_SOLICIT       2
@@ -45,7 +44,13 @@ class Ndp
 
         void receive(IpAddress from, IpAddress to, uint8_t icmpType, uint8_t icmpCode, uintptr_t payload, size_t nBytes, Network *pCard);
 
-        /// Solicit a neighbour for an address. Uses cache where possible.
+        /// Resolves a neighbour for the send path without blocking. If the
+        /// address isn't known yet, the nBytes at packet are queued and sent
+        /// once it is.
+        NeighbourCache::Result resolve(IpAddress addr, Network *pCard, MacAddress *pMac, uintptr_t packet, size_t nBytes);
+
+        /// Solicit a neighbour for an address. Uses cache where possible,
+        /// and returns false (with the solicitation in flight) otherwise.
         bool neighbourSolicit(IpAddress addr, MacAddress *pMac, Network *pCard);
 
         /// Solicit a router for routing information. Should be called if
@@ -55,12 +60,13 @@ class Ndp
         bool routerSolicit(Network *pCard);
 
         /// Adds a given IP->LinkLayer association to the cache.
-        void addEntry(IpAddress addr, MacAddress mac);
+        void addEntry(IpAddress addr, MacAddress mac, Network *pCard);
 
     private:
-        static Ndp ndpInstance;
+        /// NeighbourCache solicitation callback.
+        static void solicit(IpAddress addr, Network *pCard);
 
-        RadixTree<MacAddress*> m_LookupCache;
+        static Ndp ndpInstance;
 
         struct RouterSolicitation
         {
@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "NeighbourCache.h"
+#include "NetworkStack.h"
+#include "Ethernet.h"
+#include <LockGuard.h>
+#include <Log.h>
+#include <machine/Machine.h>
+#include <machine/Timer.h>
+#include <process/Thread.h>
+#include <processor/Processor.h>
+#include <utilities/utility.h>
+
+NeighbourCache NeighbourCache::m_Instance;
+
+/// Most solicitations sent by one pass of the maintenance thread. Anything
+/// beyond this is picked up on the next pass.
+#define MAX_PROBES_PER_PASS 32
+
+static uint64_t now()
+{
+    Timer *t = Machine::instance().getTimer();
+    return t ? t->getTickCount() : 0;
+}
+
+NeighbourCache::NeighbourCache() :
+    m_Buckets(), m_nEntries(0), m_nHits(0), m_nMisses(0), m_Nanoseconds(0),
+    m_TickSem(0), m_Lock(false)
+{
+}
+
+NeighbourCache::~NeighbourCache()
+{
+}
+
+void NeighbourCache::initialise()
+{
+    Thread *pThread = new Thread(Processor::information().getCurrentThread()->getParent(),
+                                 reinterpret_cast<Thread::ThreadStartFunc>(&trampoline),
+                                 reinterpret_cast<void*>(this));
+    pThread->detach();
+
+    Timer *t = Machine::instance().getTimer();
+    if(t)
+        t->registerHandler(this);
+}
+
+int NeighbourCache::trampoline(void *p)
+{
+    NeighbourCache *pCache = reinterpret_cast<NeighbourCache*>(p);
+    pCache->mainThread();
+    return 0;
+}
+
+void NeighbourCache::mainThread()
+{
+    while(true)
+    {
+        m_TickSem.acquire();
+        maintain();
+    }
+}
+
+void NeighbourCache::timer(uint64_t delta, InterruptState &state)
+{
+    m_Nanoseconds += delta;
+    if(UNLIKELY(m_Nanoseconds >= TickInterval))
+    {
+        m_Nanoseconds = 0;
+
+        // Don't let ticks pile up if the thread falls behind.
+        if(m_TickSem.getValue() == 0)
+            m_TickSem.release();
+    }
+}
+
+size_t NeighbourCache::hash(const uint8_t *key, Network *pCard)
+{
+    // FNV-1a over the address, seeded with the card pointer.
+    uint32_t h = 2166136261U ^ static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pCard) >> 4);
+    for(size_t i = 0; i < 16; ++i)
+    {
+        h ^= key[i];
+        h *= 16777619U;
+    }
+    return h & (NumBuckets - 1);
+}
+
+void NeighbourCache::makeKey(IpAddress &addr, uint8_t *key)
+{
+    memset(key, 0, 16);
+    if(addr.getType() == IpAddress::IPv6)
+        addr.getIp(key);
+    else
+    {
+        uint32_t ip = addr.getIp();
+        memcpy(key, &ip, sizeof(ip));
+    }
+}
+
+IpAddress NeighbourCache::addressOf(Entry *pEntry)
+{
+    if(pEntry->type == IpAddress::IPv6)
+        return IpAddress(pEntry->key);
+
+    uint32_t ip;
+    memcpy(&ip, pEntry->key, sizeof(ip));
+    return IpAddress(ip);
+}
+
+NeighbourCache::Entry *NeighbourCache::find(const uint8_t *key, IpAddress::IpType type, Network *pCard, size_t bucket)
+{
+    for(Entry *e = m_Buckets[bucket]; e; e = e->pNext)
+    {
+        if(e->pCard == pCard && e->type == type && !memcmp(e->key, key, 16))
+            return e;
+    }
+    return 0;
+}
+
+NeighbourCache::Entry *NeighbourCache::create(const uint8_t *key, IpAddress::IpType type, Network *pCard, size_t bucket,
+                                              SolicitFunc pSolicit)
+{
+    if(m_nEntries >= MaxEntries)
+        return 0;
+
+    Entry *e = new Entry;
+    memcpy(e->key, key, 16);
+    e->type = type;
+    e->pCard = pCard;
+    e->pSolicit = pSolicit;
+    e->updated = e->lastUsed = now();
+
+    e->pNext = m_Buckets[bucket];
+    m_Buckets[bucket] = e;
+    ++m_nEntries;
+    return e;
+}
+
+void NeighbourCache::destroy(Entry *pEntry, size_t bucket)
+{
+    Entry **pp = &m_Buckets[bucket];
+    while(*pp && *pp != pEntry)
+        pp = &(*pp)->pNext;
+    if(*pp)
+        *pp = pEntry->pNext;
+
+    for(size_t i = 0; i < pEntry->nQueued; ++i)
+    {
+        NetworkStack::instance().getMemPool().free(pEntry->queue[i].buffer);
+        pEntry->pCard->droppedPacket();
+    }
+
+    delete pEntry;
+    --m_nEntries;
+}
+
+size_t NeighbourCache::takeQueue(Entry *pEntry, QueuedPacket *pOut)
+{
+    size_t n = pEntry->nQueued;
+    for(size_t i = 0; i < n; ++i)
+        pOut[i] = pEntry->queue[i];
+    pEntry->nQueued = 0;
+    return n;
+}
+
+NeighbourCache::Result NeighbourCache::resolve(IpAddress addr, Network *pCard, MacAddress *pMac, SolicitFunc pSolicit,
+                                               uintptr_t packet, size_t nBytes, uint16_t type)
+{
+    if(!pCard || !pCard->isConnected())
+        return Failed;
+
+    uint8_t key[16];
+    makeKey(addr, key);
+    size_t bucket = hash(key, pCard);
+
+    bool bSolicit = false;
+    Result ret = Failed;
+    {
+        LockGuard<Mutex> guard(m_Lock);
+
+        uint64_t tick = now();
+        Entry *e = find(key, addr.getType(), pCard, bucket);
+        if(e && e->bFailed && !e->nWaiters)
+        {
+            // A previous attempt gave up; start afresh.
+            destroy(e, bucket);
+            e = 0;
+        }
+
+        if(e && e->state != Incomplete)
+        {
+            ++m_nHits;
+            if(!e->pSolicit)
+                e->pSolicit = pSolicit;
+            *pMac = e->mac;
+            e->lastUsed = tick;
+
+            // Stale entries are still good enough to send to, but ask the
+            // neighbour to confirm itself in the background.
+            if(e->state == Stale && (tick - e->lastProbe) >= RetransmitTime)
+            {
+                e->lastProbe = tick;
+                bSolicit = true;
+            }
+            ret = Resolved;
+        }
+        else
+        {
+            ++m_nMisses;
+            if(!e)
+            {
+                e = create(key, addr.getType(), pCard, bucket, pSolicit);
+                if(!e)
+                    return Failed;
+
+                e->nProbes = 1;
+                e->lastProbe = tick;
+                bSolicit = true;
+            }
+
+            if(packet && nBytes && e->nQueued < MaxQueued)
+            {
+                // The caller's buffer is gone as soon as we return, so keep
+                // a copy. Pool buffers leave room for the Ethernet header.
+                uintptr_t buffer = NetworkStack::instance().getMemPool().allocateNow();
+                if(buffer)
+                {
+                    memcpy(reinterpret_cast<void*>(buffer), reinterpret_cast<void*>(packet), nBytes);
+                    QueuedPacket &q = e->queue[e->nQueued++];
+                    q.buffer = buffer;
+                    q.nBytes = nBytes;
+                    q.type = type;
+                    ret = Queued;
+                }
+            }
+        }
+    }
+
+    // Send outside the lock: the card may loop the packet straight back
+    // into receive(), which will want to update the cache.
+    if(bSolicit && pSolicit)
+        pSolicit(addr, pCard);
+
+    return ret;
+}
+
+bool NeighbourCache::resolveAndWait(IpAddress addr, Network *pCard, MacAddress *pMac, SolicitFunc pSolicit,
+                                    size_t timeoutSecs)
+{
+    Result r = resolve(addr, pCard, pMac, pSolicit);
+    if(r == Resolved)
+        return true;
+
+    uint8_t key[16];
+    makeKey(addr, key);
+    size_t bucket = hash(key, pCard);
+
+    Entry *e;
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        e = find(key, addr.getType(), pCard, bucket);
+        if(!e)
+            return false;
+        if(e->state != Incomplete)
+        {
+            *pMac = e->mac;
+            return true;
+        }
+        ++e->nWaiters;
+    }
+
+    // The entry can't be freed while it has waiters.
+    e->waitSem.acquire(1, timeoutSecs);
+
+    LockGuard<Mutex> guard(m_Lock);
+    --e->nWaiters;
+    bool bResult = e->state != Incomplete;
+    if(bResult)
+        *pMac = e->mac;
+    return bResult;
+}
+
+bool NeighbourCache::lookup(IpAddress addr, Network *pCard, MacAddress *pMac)
+{
+    uint8_t key[16];
+    makeKey(addr, key);
+    size_t bucket = hash(key, pCard);
+
+    LockGuard<Mutex> guard(m_Lock);
+    Entry *e = find(key, addr.getType(), pCard, bucket);
+    if(!e || e->state == Incomplete)
+        return false;
+
+    if(pMac)
+        *pMac = e->mac;
+    return true;
+}
+
+void NeighbourCache::update(IpAddress addr, Network *pCard, MacAddress mac, bool bConfirmed,
+                            bool bCreate)
+{
+    if(!pCard)
+        return;
+
+    uint8_t key[16];
+    makeKey(addr, key);
+    size_t bucket = hash(key, pCard);
+
+    QueuedPacket queue[MaxQueued];
+    size_t nQueued = 0;
+    {
+        LockGuard<Mutex> guard(m_Lock);
+
+        Entry *e = find(key, addr.getType(), pCard, bucket);
+        if(!e)
+        {
+            if(!bCreate)
+                return;
+            e = create(key, addr.getType(), pCard, bucket, 0);
+            if(!e)
+                return;
+        }
+
+        uint64_t tick = now();
+        bool bWasIncomplete = e->state == Incomplete;
+
+        // A gleaned address only replaces what we have if it differs;
+        // otherwise it would keep stale entries alive forever.
+        if(bConfirmed || bWasIncomplete || memcmp(e->mac.getMac(), mac.getMac(), 6))
+        {
+            e->mac = mac;
+            e->state = bConfirmed ? Reachable : Stale;
+            e->updated = tick;
+        }
+
+        if(bWasIncomplete)
+        {
+            e->nProbes = 0;
+            e->bFailed = false;
+            nQueued = takeQueue(e, queue);
+            if(e->nWaiters)
+                e->waitSem.release(e->nWaiters);
+        }
+    }
+
+    for(size_t i = 0; i < nQueued; ++i)
+    {
+        Ethernet::send(queue[i].nBytes, queue[i].buffer, pCard, mac, queue[i].type);
+        NetworkStack::instance().getMemPool().free(queue[i].buffer);
+    }
+}
+
+void NeighbourCache::remove(IpAddress addr)
+{
+    uint8_t key[16];
+    makeKey(addr, key);
+
+    LockGuard<Mutex> guard(m_Lock);
+    for(size_t bucket = 0; bucket < NumBuckets; ++bucket)
+    {
+        Entry *e = m_Buckets[bucket];
+        while(e)
+        {
+            Entry *pNext = e->pNext;
+            if(e->type == addr.getType() && !memcmp(e->key, key, 16) && !e->nWaiters)
+                destroy(e, bucket);
+            e = pNext;
+        }
+    }
+}
+
+void NeighbourCache::remove(Network *pCard)
+{
+    LockGuard<Mutex> guard(m_Lock);
+    for(size_t bucket = 0; bucket < NumBuckets; ++bucket)
+    {
+        Entry *e = m_Buckets[bucket];
+        while(e)
+        {
+            Entry *pNext = e->pNext;
+            if(e->pCard == pCard && !e->nWaiters)
+                destroy(e, bucket);
+            e = pNext;
+        }
+    }
+}
+
+void NeighbourCache::maintain()
+{
+    struct Probe
+    {
+        IpAddress addr;
+        Network *pCard;
+        SolicitFunc pSolicit;
+    } probes[MAX_PROBES_PER_PASS];
+    size_t nProbes = 0;
+
+    {
+        LockGuard<Mutex> guard(m_Lock);
+
+        uint64_t tick = now();
+        for(size_t bucket = 0; bucket < NumBuckets; ++bucket)
+        {
+            Entry *e = m_Buckets[bucket];
+            while(e)
+            {
+                Entry *pNext = e->pNext;
+
+                if(e->state == Incomplete)
+                {
+                    if(e->bFailed)
+                    {
+                        // Waiters have been told; free once they've gone.
+                        if(!e->nWaiters)
+                            destroy(e, bucket);
+                    }
+                    else if((tick - e->lastProbe) >= RetransmitTime)
+                    {
+                        if(e->nProbes >= MaxProbes)
+                        {
+                            // Nobody answered. Drop what was queued and wake
+                            // anyone waiting so they can fail.
+                            e->bFailed = true;
+                            if(e->nWaiters)
+                                e->waitSem.release(e->nWaiters);
+                            else
+                                destroy(e, bucket);
+                        }
+                        else if(nProbes < MAX_PROBES_PER_PASS && e->pSolicit)
+                        {
+                            ++e->nProbes;
+                            e->lastProbe = tick;
+
+                            Probe &p = probes[nProbes++];
+                            p.addr = addressOf(e);
+                            p.pCard = e->pCard;
+                            p.pSolicit = e->pSolicit;
+                        }
+                    }
+                }
+                else if(e->state == Reachable)
+                {
+                    if((tick - e->updated) >= ReachableTime)
+                    {
+                        e->state = Stale;
+                        e->updated = tick;
+                    }
+                }
+                else if(e->state == Stale)
+                {
+                    if((tick - e->lastUsed) >= StaleTime && (tick - e->updated) >= StaleTime && !e->nWaiters)
+                        destroy(e, bucket);
+                }
+
+                e = pNext;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < nProbes; ++i)
+        probes[i].pSolicit(probes[i].addr, probes[i].pCard);
+}
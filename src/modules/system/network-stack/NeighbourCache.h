@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MACHINE_NEIGHBOUR_CACHE_H
+#define MACHINE_NEIGHBOUR_CACHE_H
+
+#include <processor/types.h>
+#include <process/Mutex.h>
+#include <process/Semaphore.h>
+#include <machine/Network.h>
+#include <machine/TimerHandler.h>
+
+/** Protocol-independent cache of IP -> link-layer address mappings.
+ *
+ * Both ARP (IPv4) and NDP (IPv6) keep their neighbours here. Entries are
+ * hashed on (address, card) and move through the usual states:
+ *  - Incomplete: a solicitation has been sent and no answer is in yet.
+ *    Packets sent to the neighbour in the meantime are queued on the entry
+ *    (up to MaxQueued of them) and transmitted as soon as it resolves.
+ *  - Reachable: the neighbour answered recently.
+ *  - Stale: the mapping is older than ReachableTime, or was gleaned from an
+ *    unsolicited packet. It is still used, but using it sends a fresh
+ *    solicitation in the background.
+ *
+ * Senders never block: resolve() either hands back the address or queues
+ * the packet. Retransmission of solicitations and expiry of old entries are
+ * driven from a timer and done on a worker thread.
+ */
+class NeighbourCache : public TimerHandler
+{
+public:
+    NeighbourCache();
+    virtual ~NeighbourCache();
+
+    /** Returns the singleton NeighbourCache instance. */
+    static NeighbourCache &instance()
+    {
+        return m_Instance;
+    }
+
+    /** Sends a solicitation for the given address on the given card. Each
+     *  protocol (ARP, NDP) provides one of these. */
+    typedef void (*SolicitFunc)(IpAddress addr, Network *pCard);
+
+    /** Outcome of a call to resolve(). */
+    enum Result
+    {
+        Resolved,   ///< pMac holds the link-layer address.
+        Queued,     ///< The packet will be sent once the address resolves.
+        Failed      ///< The address isn't known and the packet wasn't queued.
+    };
+
+    /** Starts the maintenance thread and hooks the system timer. */
+    void initialise();
+
+    /** Resolves addr on pCard without blocking.
+     *
+     *  If the address is known, pMac is filled and Resolved is returned. If
+     *  not, resolution is started (via pSolicit) if it is not already in
+     *  progress, and - if packet is non-zero - a copy of the nBytes at
+     *  packet is queued for transmission with the given Ethernet type once
+     *  the address is known. */
+    Result resolve(IpAddress addr, Network *pCard, MacAddress *pMac, SolicitFunc pSolicit,
+                   uintptr_t packet = 0, size_t nBytes = 0, uint16_t type = 0);
+
+    /** Resolves addr on pCard, waiting up to timeoutSecs for an answer.
+     *  Only for callers that cannot do anything useful until resolution
+     *  completes - the send paths use resolve(). */
+    bool resolveAndWait(IpAddress addr, Network *pCard, MacAddress *pMac, SolicitFunc pSolicit,
+                        size_t timeoutSecs);
+
+    /** Looks up addr on pCard without starting resolution. */
+    bool lookup(IpAddress addr, Network *pCard, MacAddress *pMac);
+
+    /** Records that addr is at mac on pCard. bConfirmed should be true when
+     *  the mapping came from an answer to our own solicitation, false when
+     *  it was gleaned from some other packet. If bCreate is false, only an
+     *  existing entry is updated. Any queued packets for the neighbour are
+     *  sent. */
+    void update(IpAddress addr, Network *pCard, MacAddress mac, bool bConfirmed,
+                bool bCreate = true);
+
+    /** Removes any entry for addr, on every card. Queued packets are
+     *  dropped. */
+    void remove(IpAddress addr);
+
+    /** Removes every entry belonging to pCard. */
+    void remove(Network *pCard);
+
+    /** TimerHandler interface: wakes the maintenance thread periodically. */
+    virtual void timer(uint64_t delta, InterruptState &state);
+
+    /** Statistics, for the curious. */
+    size_t entries() const {return m_nEntries;}
+    size_t hits() const {return m_nHits;}
+    size_t misses() const {return m_nMisses;}
+
+private:
+    NeighbourCache(const NeighbourCache &);
+    NeighbourCache &operator = (const NeighbourCache &);
+
+    /** Number of hash buckets (must be a power of two). */
+    static const size_t NumBuckets = 256;
+    /** Most entries the cache will hold before refusing new neighbours. */
+    static const size_t MaxEntries = 1024;
+    /** Most packets queued on an incomplete entry. */
+    static const size_t MaxQueued = 3;
+    /** Solicitations sent before an incomplete entry is given up on. */
+    static const size_t MaxProbes = 3;
+    /** Milliseconds between solicitations. */
+    static const uint64_t RetransmitTime = 1000;
+    /** Milliseconds a confirmed entry stays Reachable. */
+    static const uint64_t ReachableTime = 30000;
+    /** Milliseconds an unused Stale entry is kept before being freed. */
+    static const uint64_t StaleTime = 300000;
+    /** Nanoseconds between runs of the maintenance thread. */
+    static const uint64_t TickInterval = 500000000ULL;
+
+    enum State
+    {
+        Incomplete,
+        Reachable,
+        Stale
+    };
+
+    struct QueuedPacket
+    {
+        uintptr_t buffer;
+        size_t nBytes;
+        uint16_t type;
+    };
+
+    struct Entry
+    {
+        Entry() :
+            pNext(0), key(), type(IpAddress::IPv4), pCard(0), mac(), state(Incomplete),
+            pSolicit(0), updated(0), lastProbe(0), lastUsed(0), nProbes(0),
+            bFailed(false), nQueued(0), queue(), nWaiters(0), waitSem(0)
+        {}
+
+        Entry *pNext;
+
+        uint8_t key[16];
+        IpAddress::IpType type;
+        Network *pCard;
+
+        MacAddress mac;
+        State state;
+        SolicitFunc pSolicit;
+
+        /// Tick counts (ms) of the last state change, probe, and use.
+        uint64_t updated;
+        uint64_t lastProbe;
+        uint64_t lastUsed;
+
+        size_t nProbes;
+        bool bFailed;
+
+        size_t nQueued;
+        QueuedPacket queue[MaxQueued];
+
+        /// Threads blocked in resolveAndWait() on this entry.
+        size_t nWaiters;
+        Semaphore waitSem;
+    };
+
+    /** Hashes (addr, card) to a bucket index. */
+    static size_t hash(const uint8_t *key, Network *pCard);
+
+    /** Fills key with the 16-byte form of addr. */
+    static void makeKey(IpAddress &addr, uint8_t *key);
+
+    /** Locates the entry for (key, pCard), or null. Lock must be held. */
+    Entry *find(const uint8_t *key, IpAddress::IpType type, Network *pCard, size_t bucket);
+
+    /** Creates an incomplete entry. Lock must be held. */
+    Entry *create(const uint8_t *key, IpAddress::IpType type, Network *pCard, size_t bucket,
+                  SolicitFunc pSolicit);
+
+    /** Unlinks and frees an entry, dropping queued packets. Lock must be
+     *  held, and the entry must have no waiters. */
+    void destroy(Entry *pEntry, size_t bucket);
+
+    /** Moves the queued packets of pEntry into pOut. Lock must be held. */
+    static size_t takeQueue(Entry *pEntry, QueuedPacket *pOut);
+
+    /** Rebuilds an IpAddress from an entry's key. */
+    static IpAddress addressOf(Entry *pEntry);
+
+    /** Retransmits solicitations, expires and frees old entries. */
+    void maintain();
+
+    static int trampoline(void *p);
+    void mainThread();
+
+    Entry *m_Buckets[NumBuckets];
+
+    size_t m_nEntries;
+    size_t m_nHits;
+    size_t m_nMisses;
+
+    /** Nanoseconds accumulated since the maintenance thread was last woken. */
+    uint64_t m_Nanoseconds;
+
+    /** Released by the timer to wake the maintenance thread. */
+    Semaphore m_TickSem;
+
+    Mutex m_Lock;
+
+    static NeighbourCache m_Instance;
+};
+
+#endif
@@ -25,6 +25,7 @@
 #include <processor/Processor.h>
 
 #include "Dns.h"
+#include "NeighbourCache.h"
 
 NetworkStack NetworkStack::stack;
 
@@ -145,6 +146,9 @@ extern ServiceFeatures *g_pIpv6Features;
 
 static bool entry()
 {
+    // Start expiring and retrying neighbour (ARP/NDP) entries
+    NeighbourCache::instance().initialise();
+
     // Initialise the DNS implementation
     Dns::instance().initialise();
 
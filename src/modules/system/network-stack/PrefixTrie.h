@@ -0,0 +1,207 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MACHINE_PREFIXTRIE_H
+#define MACHINE_PREFIXTRIE_H
+
+#include <processor/types.h>
+#include <utilities/utility.h>
+
+/**
+ * A path-compressed binary trie for longest-prefix matching over keys of up
+ * to 128 bits, stored most significant bit first (ie, network order). Each
+ * node holds a prefix and, optionally, a value; nodes with only one child and
+ * no value are never created, so a lookup touches at most one node per
+ * distinct prefix length on the path.
+ *
+ * The trie does not own its values.
+ */
+template <class T>
+class PrefixTrie
+{
+    public:
+        PrefixTrie() : m_pRoot(0)
+        {
+        }
+
+        virtual ~PrefixTrie()
+        {
+            clear();
+        }
+
+        /** Associates a value with the given prefix.
+         * \return The value previously associated with exactly this prefix,
+         *         if any. */
+        T *insert(const uint8_t *key, size_t prefixLen, T *pValue)
+        {
+            Node **ppNode = &m_pRoot;
+            while (true)
+            {
+                Node *pNode = *ppNode;
+                if (!pNode)
+                {
+                    *ppNode = newNode(key, prefixLen, pValue);
+                    return 0;
+                }
+
+                size_t maxCommon = pNode->prefixLen < prefixLen ? pNode->prefixLen : prefixLen;
+                size_t common = commonPrefix(pNode->key, key, maxCommon);
+                if (common == pNode->prefixLen)
+                {
+                    if (prefixLen == pNode->prefixLen)
+                    {
+                        T *pOld = pNode->pValue;
+                        pNode->pValue = pValue;
+                        return pOld;
+                    }
+
+                    ppNode = &pNode->pChild[bit(key, pNode->prefixLen)];
+                    continue;
+                }
+
+                if (common == prefixLen)
+                {
+                    // The new prefix contains this node.
+                    Node *pNew = newNode(key, prefixLen, pValue);
+                    pNew->pChild[bit(pNode->key, prefixLen)] = pNode;
+                    *ppNode = pNew;
+                    return 0;
+                }
+
+                // The prefixes diverge part way through this node.
+                Node *pGlue = newNode(key, common, 0);
+                pGlue->pChild[bit(pNode->key, common)] = pNode;
+                pGlue->pChild[bit(key, common)] = newNode(key, prefixLen, pValue);
+                *ppNode = pGlue;
+                return 0;
+            }
+        }
+
+        /** Finds the value with the longest prefix matching the key.
+         * \param keyLen The length of the key, in bits. */
+        T *lookup(const uint8_t *key, size_t keyLen) const
+        {
+            T *pBest = 0;
+            Node *pNode = m_pRoot;
+            while (pNode)
+            {
+                if (pNode->prefixLen > keyLen)
+                    break;
+                if (commonPrefix(pNode->key, key, pNode->prefixLen) < pNode->prefixLen)
+                    break;
+
+                if (pNode->pValue)
+                    pBest = pNode->pValue;
+                if (pNode->prefixLen == keyLen)
+                    break;
+
+                pNode = pNode->pChild[bit(key, pNode->prefixLen)];
+            }
+
+            return pBest;
+        }
+
+        /** Finds the value associated with exactly the given prefix. */
+        T *find(const uint8_t *key, size_t prefixLen) const
+        {
+            Node *pNode = m_pRoot;
+            while (pNode && pNode->prefixLen <= prefixLen)
+            {
+                if (commonPrefix(pNode->key, key, pNode->prefixLen) < pNode->prefixLen)
+                    return 0;
+                if (pNode->prefixLen == prefixLen)
+                    return pNode->pValue;
+
+                pNode = pNode->pChild[bit(key, pNode->prefixLen)];
+            }
+
+            return 0;
+        }
+
+        /** Removes every prefix from the trie. */
+        void clear()
+        {
+            freeNode(m_pRoot);
+            m_pRoot = 0;
+        }
+
+        /** Number of bits two keys have in common, up to maxBits. */
+        static size_t commonPrefix(const uint8_t *a, const uint8_t *b, size_t maxBits)
+        {
+            size_t n = 0;
+            for (size_t i = 0; n < maxBits; ++i, n += 8)
+            {
+                uint8_t diff = a[i] ^ b[i];
+                if (diff)
+                {
+                    n += __builtin_clz(diff) - 24;
+                    break;
+                }
+            }
+
+            return n < maxBits ? n : maxBits;
+        }
+
+    private:
+        PrefixTrie(const PrefixTrie &);
+        PrefixTrie &operator = (const PrefixTrie &);
+
+        struct Node
+        {
+            uint8_t key[16];
+            size_t prefixLen;
+            T *pValue;
+            Node *pChild[2];
+        };
+
+        static size_t bit(const uint8_t *key, size_t n)
+        {
+            return (key[n / 8] >> (7 - (n % 8))) & 1;
+        }
+
+        static Node *newNode(const uint8_t *key, size_t prefixLen, T *pValue)
+        {
+            Node *pNode = new Node;
+
+            // Only the prefix is significant; keep the rest zeroed.
+            memset(pNode->key, 0, sizeof(pNode->key));
+            memcpy(pNode->key, key, (prefixLen + 7) / 8);
+            if (prefixLen % 8)
+                pNode->key[prefixLen / 8] &= 0xFF << (8 - (prefixLen % 8));
+
+            pNode->prefixLen = prefixLen;
+            pNode->pValue = pValue;
+            pNode->pChild[0] = pNode->pChild[1] = 0;
+            return pNode;
+        }
+
+        static void freeNode(Node *pNode)
+        {
+            if (!pNode)
+                return;
+            freeNode(pNode->pChild[0]);
+            freeNode(pNode->pChild[1]);
+            delete pNode;
+        }
+
+        Node *m_pRoot;
+};
+
+#endif
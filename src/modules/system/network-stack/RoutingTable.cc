@@ -25,12 +25,30 @@
 
 RoutingTable RoutingTable::m_Instance;
 
-RoutingTable::RoutingTable() : m_bHasRoutes(false), m_TableLock(false)
+/** Runs a prepared route insert and frees it. The database copy of the
+ *  routes is informational, so a failure is logged and nothing more. */
+static void runInsert(Config::Cursor *pInsert)
 {
+    pInsert->next();
+    if(!pInsert->succeeded())
+    {
+        ERROR("Routing table query failed: " << pInsert->errorMessage());
+    }
+    delete pInsert;
+}
+
+RoutingTable::RoutingTable() :
+    m_bHasRoutes(false), m_TableLock(false), m_Routes(), m_Fib4(), m_Fib6(),
+    m_Complement4(), m_Complement6(), m_Named(), m_nLookups(0), m_nCacheHits(0)
+{
+    for(size_t i = 0; i < RouteCacheSize; i++)
+        m_RouteCache[i].bValid = false;
 }
 
 RoutingTable::~RoutingTable()
 {
+    for(List<Route*>::Iterator it = m_Routes.begin(); it != m_Routes.end(); it++)
+        delete *it;
 }
 
 void RoutingTable::Add(Type type, IpAddress dest, IpAddress subIp, String meta, Network *card)
@@ -41,7 +59,6 @@ void RoutingTable::Add(Type type, IpAddress dest, IpAddress subIp, String meta,
     // device is definitely available as an interface.
     DeviceHashTree::instance().add(card);
 
-    Config::Result *pResult = 0;
     size_t hash = DeviceHashTree::instance().getHash(card);
 
     if((dest.getType() == IpAddress::IPv4) && (type != NamedV6))
@@ -50,13 +67,20 @@ void RoutingTable::Add(Type type, IpAddress dest, IpAddress subIp, String meta,
         NOTICE("RoutingTable: Adding IPv4 match route for " << dest.toString() << ", sub " << subIp.toString() << ".");
 
         // Add the route to the database directly
-        String str;
-        str.sprintf("INSERT INTO routes (ipaddr, subip, name, type, iface) VALUES (%u, %u, '%s', %u, %u)", BIG_TO_HOST32(dest.getIp()), BIG_TO_HOST32(subIp.getIp()), static_cast<const char*>(meta), static_cast<int>(type), hash);
-        pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
+        Config::Cursor *pInsert = Config::instance().prepare("INSERT INTO routes (ipaddr, subip, name, type, iface) VALUES (?1, ?2, ?3, ?4, ?5)");
+        if(pInsert)
         {
-            ERROR("Routing table query failed: " << pResult->errorMessage());
+            pInsert->bind(1, static_cast<int64_t>(BIG_TO_HOST32(dest.getIp())));
+            pInsert->bind(2, static_cast<int64_t>(BIG_TO_HOST32(subIp.getIp())));
+            pInsert->bind(3, static_cast<const char*>(meta));
+            pInsert->bind(4, static_cast<int64_t>(type));
+            pInsert->bind(5, static_cast<int64_t>(hash));
+            runInsert(pInsert);
         }
+        else
+            ERROR("Routing table query failed: couldn't prepare the insert");
+
+        compile(type, dest, 32, subIp, meta, card, 0);
     }
     else
     {
@@ -68,27 +92,26 @@ void RoutingTable::Add(Type type, IpAddress dest, IpAddress subIp, String meta,
         subIp.getIp(reinterpret_cast<uint8_t*>(subipTemp));
 
         // Add the route to the database
-        String str;
-        str.sprintf("INSERT INTO routesv6 (ipaddr, subip1, subip2, subip3, subip4, name, type, iface, metric) VALUES ('%s', %u, %u, %u, %u, '%s', %u, %u, %u)",
-                    static_cast<const char *>(dest.prefixString(128)),
-                    subipTemp[0],
-                    subipTemp[1],
-                    subipTemp[2],
-                    subipTemp[3],
-                    static_cast<const char*>(meta),
-                    static_cast<int>(type),
-                    hash,
-                    1); /// Default metric is 1. \todo Make configureable.
-        pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
+        Config::Cursor *pInsert = Config::instance().prepare("INSERT INTO routesv6 (ipaddr, subip1, subip2, subip3, subip4, name, type, iface, metric) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)");
+        if(pInsert)
         {
-            ERROR("Routing table query failed: " << pResult->errorMessage());
+            String prefix = dest.prefixString(128);
+            pInsert->bind(1, static_cast<const char *>(prefix));
+            for(size_t i = 0; i < 4; i++)
+                pInsert->bind(2 + i, static_cast<int64_t>(subipTemp[i]));
+            pInsert->bind(6, static_cast<const char*>(meta));
+            pInsert->bind(7, static_cast<int64_t>(type));
+            pInsert->bind(8, static_cast<int64_t>(hash));
+            pInsert->bind(9, static_cast<int64_t>(1)); /// Default metric is 1. \todo Make configureable.
+            runInsert(pInsert);
         }
+        else
+            ERROR("Routing table query failed: couldn't prepare the insert");
+
+        compile(type, dest, 128, subIp, meta, card, 1);
     }
 
     m_bHasRoutes = true;
-
-    delete pResult;
 }
 
 void RoutingTable::Add(Type type, IpAddress dest, IpAddress subnet, IpAddress subIp, String meta, Network *card)
@@ -99,7 +122,6 @@ void RoutingTable::Add(Type type, IpAddress dest, IpAddress subnet, IpAddress su
     // device is definitely available as an interface.
     DeviceHashTree::instance().add(card);
 
-    Config::Result *pResult = 0;
 
     if(dest.getType() == IpAddress::IPv4 && (type != NamedV6))
     {
@@ -112,20 +134,28 @@ void RoutingTable::Add(Type type, IpAddress dest, IpAddress subnet, IpAddress su
             NOTICE("RoutingTable: Adding IPv4 " << (type == DestSubnetComplement ? "complement of " : "") << "subnet match for range " << bottomOfRange.toString() << " - " << topOfRange.toString());
 
         // Add to the database
-        String str;
         size_t hash = DeviceHashTree::instance().getHash(card);
-        str.sprintf("INSERT INTO routes (ipstart, ipend, subip, name, type, iface) VALUES (%u, %u, %u, '%s', %u, %u)",
-                    BIG_TO_HOST32(bottomOfRange.getIp()),
-                    BIG_TO_HOST32(topOfRange.getIp()),
-                    BIG_TO_HOST32(subIp.getIp()),
-                    static_cast<const char*>(meta),
-                    static_cast<int>(type),
-                    hash);
-        pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
+        Config::Cursor *pInsert = Config::instance().prepare("INSERT INTO routes (ipstart, ipend, subip, name, type, iface) VALUES (?1, ?2, ?3, ?4, ?5, ?6)");
+        if(pInsert)
         {
-            ERROR("Routing table query failed: " << pResult->errorMessage());
+            pInsert->bind(1, static_cast<int64_t>(BIG_TO_HOST32(bottomOfRange.getIp())));
+            pInsert->bind(2, static_cast<int64_t>(BIG_TO_HOST32(topOfRange.getIp())));
+            pInsert->bind(3, static_cast<int64_t>(BIG_TO_HOST32(subIp.getIp())));
+            pInsert->bind(4, static_cast<const char*>(meta));
+            pInsert->bind(5, static_cast<int64_t>(type));
+            pInsert->bind(6, static_cast<int64_t>(hash));
+            runInsert(pInsert);
         }
+        else
+            ERROR("Routing table query failed: couldn't prepare the insert");
+
+        // The subnet mask becomes a prefix length.
+        uint32_t mask = BIG_TO_HOST32(subnet.getIp());
+        size_t prefixLen = __builtin_popcount(mask);
+        if(prefixLen && (mask != (0xFFFFFFFF << (32 - prefixLen))))
+            WARNING("RoutingTable: subnet mask " << subnet.toString() << " is not contiguous, treating it as /" << Dec << prefixLen << Hex);
+
+        compile(type, bottomOfRange, prefixLen, subIp, meta, card, 0);
     }
     else
     {
@@ -139,190 +169,218 @@ void RoutingTable::Add(Type type, IpAddress dest, IpAddress subnet, IpAddress su
         subIp.getIp(reinterpret_cast<uint8_t*>(subipTemp));
 
         // Add to the database
-        String str;
         size_t hash = DeviceHashTree::instance().getHash(card);
-        str.sprintf("INSERT INTO routesv6 (prefix, subip1, subip2, subip3, subip4, prefixNum, name, type, iface, metric) VALUES ('%s', %u, %u, %u, %u, %u, '%s', %u, %u, %u)",
-                    static_cast<const char*>(dest.prefixString()),
-                    subipTemp[0],
-                    subipTemp[1],
-                    subipTemp[2],
-                    subipTemp[3],
-                    dest.getIpv6Prefix(),
-                    static_cast<const char*>(meta),
-                    static_cast<int>(type),
-                    hash,
-                    1024); /// Default metric is 1024. \todo Make configurable.
-        pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
+        Config::Cursor *pInsert = Config::instance().prepare("INSERT INTO routesv6 (prefix, subip1, subip2, subip3, subip4, prefixNum, name, type, iface, metric) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10)");
+        if(pInsert)
         {
-            ERROR("Routing table query failed: " << pResult->errorMessage());
+            String prefix = dest.prefixString();
+            pInsert->bind(1, static_cast<const char*>(prefix));
+            for(size_t i = 0; i < 4; i++)
+                pInsert->bind(2 + i, static_cast<int64_t>(subipTemp[i]));
+            pInsert->bind(6, static_cast<int64_t>(dest.getIpv6Prefix()));
+            pInsert->bind(7, static_cast<const char*>(meta));
+            pInsert->bind(8, static_cast<int64_t>(type));
+            pInsert->bind(9, static_cast<int64_t>(hash));
+            pInsert->bind(10, static_cast<int64_t>(1024)); /// Default metric is 1024. \todo Make configurable.
+            runInsert(pInsert);
         }
+        else
+            ERROR("Routing table query failed: couldn't prepare the insert");
+
+        compile(type, dest, dest.getIpv6Prefix(), subIp, meta, card, 1024);
     }
 
     m_bHasRoutes = true;
-
-    delete pResult;
 }
 
-Network *RoutingTable::route(IpAddress *ip, Config::Result *pResult)
+void RoutingTable::compile(Type type, IpAddress &dest, size_t prefixLen, IpAddress &subIp, String &meta, Network *card, size_t metric)
 {
-    // Grab the interface
-    Network *pCard = static_cast<Network*>(DeviceHashTree::instance().getDevice(pResult->getNum(0, "iface")));
+    bool bIpv6 = (dest.getType() == IpAddress::IPv6) || (type == NamedV6);
+
+    Route *pRoute = new Route;
+    pRoute->type = type;
+    pRoute->prefixLen = prefixLen;
+    pRoute->subIp = subIp;
+    pRoute->name = meta;
+    pRoute->pCard = card;
+    pRoute->metric = metric;
+
+    memset(pRoute->key, 0, sizeof(pRoute->key));
+    if(bIpv6)
+        dest.getIp(pRoute->key);
+    else
+    {
+        uint32_t ip = dest.getIp();
+        memcpy(pRoute->key, &ip, sizeof(ip));
+    }
 
-    // If we are to perform substitution, do so
-    Type t = static_cast<Type>(pResult->getNum(0, "type"));
-    if(t == DestIpSub || t == DestSubnetComplement)
-        ip->setIp(HOST_TO_BIG32(pResult->getNum(0, "subip")));
-    else if(t == DestIpv6Sub || t == DestPrefixComplement)
+    m_Routes.pushBack(pRoute);
+
+    switch(type)
     {
-        uint32_t subIp[4];
-        subIp[0] = pResult->getNum(0, "subip1");
-        subIp[1] = pResult->getNum(0, "subip2");
-        subIp[2] = pResult->getNum(0, "subip3");
-        subIp[3] = pResult->getNum(0, "subip4");
+        case Named:
+        case NamedV6:
+            m_Named.pushBack(pRoute);
+            break;
+
+        case DestSubnetComplement:
+            m_Complement4.pushBack(pRoute);
+            break;
 
-        ip->setIp(reinterpret_cast<uint8_t*>(subIp));
+        case DestPrefixComplement:
+            m_Complement6.pushBack(pRoute);
+            break;
+
+        default:
+        {
+            // For a duplicate prefix, the lower metric (or, on a tie, the
+            // first added) wins.
+            PrefixTrie<Route> &fib = bIpv6 ? m_Fib6 : m_Fib4;
+            Route *pExisting = fib.find(pRoute->key, prefixLen);
+            if(!pExisting || pExisting->metric > metric)
+                fib.insert(pRoute->key, prefixLen, pRoute);
+        }
     }
 
-    // Return the interface to use
-    delete pResult;
-    return pCard;
+    // Any cached decision may now be wrong.
+    for(size_t i = 0; i < RouteCacheSize; i++)
+        m_RouteCache[i].bValid = false;
 }
 
-Network *RoutingTable::DetermineRoute(IpAddress *ip, bool bGiveDefault)
+RoutingTable::Route *RoutingTable::lookup(IpAddress &ip)
 {
-    LockGuard<Mutex> guard(m_TableLock);
+    bool bIpv6 = ip.getType() == IpAddress::IPv6;
 
-    // Use the IPv6 route table?
-    if(ip->getType() == IpAddress::IPv6)
+    uint8_t key[16];
+    memset(key, 0, sizeof(key));
+    if(bIpv6)
+        ip.getIp(key);
+    else
     {
-        // Can we directly match a route (/128)?
-        String str;
-        str.sprintf("SELECT * FROM routesv6 WHERE ipaddr='%s'", static_cast<const char *>(ip->prefixString(128))); // prefixString doesn't add /xx on the end.
-        Config::Result *pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
-            ERROR("Routing table query failed: " << pResult->errorMessage());
-        else if(pResult->rows())
-        {
-            return route(ip, pResult);
-        }
-        delete pResult;
-
-        // Try a prefix lookup. This involves finding all the potential prefix numbers and then
-        // using those to find a usable prefix.
-        str.sprintf("SELECT id, prefixNum FROM routesv6 WHERE type = %u ORDER BY metric ASC", static_cast<int>(DestPrefix));
-        pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
-            ERROR("Routing table query failed: " << pResult->errorMessage());
-        else if(pResult->rows())
-        {
-            // Got a bunch of prefixes!
-            for(size_t i = 0; i < pResult->rows(); i++)
-            {
-                // Check this prefix.
-                size_t prefixNum = pResult->getNum(i, "prefixNum");
-                str.sprintf("SELECT * FROM routesv6 WHERE prefix = '%s' AND type = %u ORDER BY metric ASC", static_cast<const char *>(ip->prefixString(prefixNum)), static_cast<int>(DestPrefix));
-                Config::Result *pTempResult = Config::instance().query(str);
-                if(!pTempResult->succeeded())
-                    continue;
-                else if(pTempResult->rows())
-                {
-                    delete pResult;
-                    return route(ip, pTempResult);
-                }
-            }
-        }
-        else
-            NOTICE("No prefixes");
-        delete pResult;
-
-        // Still nothing, try a complement prefix search
-        str.sprintf("SELECT * FROM routesv6 WHERE (NOT prefix='%s') AND type=%u ORDER BY metric ASC", static_cast<const char *>(ip->prefixString()), static_cast<int>(DestPrefixComplement));
-        pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
-            ERROR("Routing table query failed: " << pResult->errorMessage());
-        else if(pResult->rows())
-        {
-            return route(ip, pResult);
-        }
-        delete pResult;
+        uint32_t addr = ip.getIp();
+        memcpy(key, &addr, sizeof(addr));
+    }
 
-        // Nothing even still, try the default route if we're allowed
-        if(bGiveDefault)
-        {
-            return DefaultRouteV6();
-        }
+    ++m_nLookups;
+
+    // Check the route cache first.
+    uint32_t hash = 2166136261U;
+    for(size_t i = 0; i < (bIpv6 ? 16U : 4U); i++)
+    {
+        hash ^= key[i];
+        hash *= 16777619U;
     }
-    else
+    CacheEntry &entry = m_RouteCache[hash % RouteCacheSize];
+    if(entry.bValid && entry.bIpv6 == bIpv6 && !memcmp(entry.key, key, sizeof(key)))
     {
-        // Build a query to search for a direct match
-        String str;
-        str.sprintf("SELECT * FROM routes WHERE ipaddr=%u", BIG_TO_HOST32(ip->getIp()));
-        Config::Result *pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
-            ERROR("Routing table query failed: " << pResult->errorMessage());
-        else if(pResult->rows())
-        {
-            return route(ip, pResult);
-        }
-        delete pResult;
-
-        // No rows! Try a subnet lookup first, without a complement.
-        str.sprintf("SELECT * FROM routes WHERE ((ipstart <= %u) AND (ipend >= %u)) AND (type == %u)", BIG_TO_HOST32(ip->getIp()), BIG_TO_HOST32(ip->getIp()), static_cast<int>(DestSubnet));
-        pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
-            ERROR("Routing table query failed: " << pResult->errorMessage());
-        else if(pResult->rows())
-        {
-            return route(ip, pResult);
-        }
-        delete pResult;
-
-        // Still nothing, try a complement subnet search
-        str.sprintf("SELECT * FROM routes WHERE (NOT ((ipstart <= %u) AND (ipend >= %u))) AND (type == %u)", BIG_TO_HOST32(ip->getIp()), BIG_TO_HOST32(ip->getIp()), static_cast<int>(DestSubnetComplement));
-        pResult = Config::instance().query(str);
-        if(!pResult->succeeded())
-            ERROR("Routing table query failed: " << pResult->errorMessage());
-        else if(pResult->rows())
+        ++m_nCacheHits;
+        return entry.pRoute;
+    }
+
+    // Longest matching prefix (exact matches are the longest of all).
+    Route *pRoute = bIpv6 ? m_Fib6.lookup(key, 128) : m_Fib4.lookup(key, 32);
+
+    // Otherwise, the best complement route that excludes this address.
+    if(!pRoute)
+    {
+        List<Route*> &complements = bIpv6 ? m_Complement6 : m_Complement4;
+        for(List<Route*>::Iterator it = complements.begin(); it != complements.end(); it++)
         {
-            return route(ip, pResult);
+            Route *pCandidate = *it;
+            if(PrefixTrie<Route>::commonPrefix(pCandidate->key, key, pCandidate->prefixLen) == pCandidate->prefixLen)
+                continue;
+
+            if(!pRoute || pCandidate->metric < pRoute->metric)
+                pRoute = pCandidate;
         }
-        delete pResult;
+    }
 
-        // Nothing even still, try the default route if we're allowed
-        if(bGiveDefault)
-        {
+    memcpy(entry.key, key, sizeof(key));
+    entry.bIpv6 = bIpv6;
+    entry.pRoute = pRoute;
+    entry.bValid = true;
+
+    return pRoute;
+}
+
+RoutingTable::Route *RoutingTable::findNamed(const String &name, bool bIpv6)
+{
+    for(List<Route*>::Iterator it = m_Named.begin(); it != m_Named.end(); it++)
+    {
+        Route *pRoute = *it;
+        if(((pRoute->type == NamedV6) == bIpv6) && (pRoute->name == name))
+            return pRoute;
+    }
+
+    return 0;
+}
+
+Network *RoutingTable::route(IpAddress *ip, Route *pRoute)
+{
+    // If we are to perform substitution, do so
+    Type t = pRoute->type;
+    if(ip && (t == DestIpSub || t == DestSubnetComplement))
+        ip->setIp(pRoute->subIp.getIp());
+    else if(ip && (t == DestIpv6Sub || t == DestPrefixComplement))
+    {
+        uint8_t subIp[16];
+        pRoute->subIp.getIp(subIp);
+
+        ip->setIp(subIp);
+    }
+
+    // Return the interface to use
+    return pRoute->pCard;
+}
+
+Network *RoutingTable::DetermineRoute(IpAddress *ip, bool bGiveDefault)
+{
+    LockGuard<Mutex> guard(m_TableLock);
+
+    Route *pRoute = lookup(*ip);
+    if(pRoute)
+        return route(ip, pRoute);
+
+    // Nothing, try the default route if we're allowed
+    if(bGiveDefault)
+    {
+        if(ip->getType() == IpAddress::IPv6)
+            return DefaultRouteV6();
+        else
             return DefaultRoute();
-        }
     }
 
     // Not even the default route worked!
     return 0;
 }
 
+Network *RoutingTable::DetermineRoute(String name, bool bGiveDefault)
+{
+    LockGuard<Mutex> guard(m_TableLock);
+
+    Route *pRoute = findNamed(name, false);
+    if(!pRoute)
+        pRoute = findNamed(name, true);
+    if(pRoute)
+        return route(0, pRoute);
+
+    if(bGiveDefault)
+        return DefaultRoute();
+
+    return 0;
+}
+
 Network *RoutingTable::DefaultRoute()
 {
     // If already locked, will return false, so we don't unlock (DetermineRoute calls this function)
     bool bLocked = m_TableLock.tryAcquire();
 
-    String str;
-    str.sprintf("SELECT * FROM routes WHERE name='default'");
-    Config::Result *pResult = Config::instance().query(str);
-    if(!pResult->succeeded())
-        ERROR("Routing table query failed: " << pResult->errorMessage());
-    else if(pResult->rows())
-    {
-        if(bLocked)
-            m_TableLock.release();
-        return route(0, pResult);
-    }
-
-    delete pResult;
+    Route *pRoute = findNamed(String("default"), false);
 
     if(bLocked)
         m_TableLock.release();
 
-    return 0;
+    return pRoute ? route(0, pRoute) : 0;
 }
 
 Network *RoutingTable::DefaultRouteV6()
@@ -330,23 +388,10 @@ Network *RoutingTable::DefaultRouteV6()
     // If already locked, will return false, so we don't unlock (DetermineRoute calls this function)
     bool bLocked = m_TableLock.tryAcquire();
 
-    String str;
-    str.sprintf("SELECT * FROM routesv6 WHERE name='default'");
-    Config::Result *pResult = Config::instance().query(str);
-    if(!pResult->succeeded())
-        ERROR("Routing table query failed: " << pResult->errorMessage());
-    else if(pResult->rows())
-    {
-        if(bLocked)
-            m_TableLock.release();
-        return route(0, pResult);
-    }
-
-    delete pResult;
+    Route *pRoute = findNamed(String("default"), true);
 
     if(bLocked)
         m_TableLock.release();
 
-    return 0;
+    return pRoute ? route(0, pRoute) : 0;
 }
-
@@ -28,6 +28,7 @@
 #include <process/Semaphore.h>
 #include <machine/Network.h>
 #include <config/Config.h>
+#include "PrefixTrie.h"
 
 /**
  * The Pedigree routing table supports three different ways to route packets:
@@ -52,6 +53,10 @@
  * A named route is a route with a specific name, such as "default".
  *
  * All of these are stored in the routes table in the configuration database.
+ * Lookups do not go to the database, though: each route is also compiled into
+ * an in-memory forwarding table (a longest-prefix-match trie per address
+ * family) fronted by a small per-destination cache, which is flushed whenever
+ * a route is added.
  */
 
 /** Routing table implementation */
@@ -113,16 +118,77 @@ class RoutingTable
         /** Grabs the default route for IPv6 */
         Network *DefaultRouteV6();
 
+        /** Number of address lookups, and how many were answered by the
+         *  per-destination cache. */
+        size_t lookups() const {return m_nLookups;}
+        size_t cacheHits() const {return m_nCacheHits;}
+
     private:
 
+        /** A route as held in the forwarding tables. */
+        struct Route
+        {
+            Type type;
+            /** Destination (or subnet/prefix) in network byte order. */
+            uint8_t key[16];
+            size_t prefixLen;
+            IpAddress subIp;
+            String name;
+            Network *pCard;
+            size_t metric;
+        };
+
+        /** An entry in the per-destination route cache. */
+        struct CacheEntry
+        {
+            uint8_t key[16];
+            bool bIpv6;
+            bool bValid;
+            /** The route found for this destination, or null if only the
+             *  default route applies. */
+            Route *pRoute;
+        };
+
+        static const size_t RouteCacheSize = 64;
+
         static RoutingTable m_Instance;
 
         bool m_bHasRoutes;
 
         Mutex m_TableLock;
 
+        /** Compiles a route into the forwarding tables. The table lock must
+         *  be held. */
+        void compile(Type type, IpAddress &dest, size_t prefixLen, IpAddress &subIp, String &meta, Network *card, size_t metric);
+
+        /** Finds the best non-default route for an address. The table lock
+         *  must be held. */
+        Route *lookup(IpAddress &ip);
+
+        /** Finds a named route. */
+        Route *findNamed(const String &name, bool bIpv6);
+
         /** Used to finalise the determined route */
-        Network *route(IpAddress *ip, Config::Result *pResult);
+        Network *route(IpAddress *ip, Route *pRoute);
+
+        /** All routes, in the order they were added. */
+        List<Route*> m_Routes;
+
+        /** Exact and subnet/prefix routes, per address family. */
+        PrefixTrie<Route> m_Fib4;
+        PrefixTrie<Route> m_Fib6;
+
+        /** Complement routes, tried in order when the tries have no match. */
+        List<Route*> m_Complement4;
+        List<Route*> m_Complement6;
+
+        /** Named routes. */
+        List<Route*> m_Named;
+
+        CacheEntry m_RouteCache[RouteCacheSize];
+
+        size_t m_nLookups;
+        size_t m_nCacheHits;
 };
 
 #endif
@@ -19,6 +19,7 @@
 
 #include "RawFsDir.h"
 #include "RawFs.h"
+#include <vfs/DentryCache.h>
 
 RawFsDir::RawFsDir(String name, RawFs *pFs, File *pParent) :
     Directory(name,
@@ -46,4 +47,5 @@ void RawFsDir::removeRecursive()
     /// \todo Leaky.
     NOTICE("rawfs: removing '" << getName() << "'");
     m_Cache.clear();
+    DentryCache::instance().invalidate(this);
 }
@@ -269,36 +269,30 @@ void progress(const char *text)
 
 static void getColor(const char *colorName, uint32_t &color)
 {
-    // The query string
-    String sQuery;
-
-    // Create the query string
-    sQuery += "select r,g,b from 'colour_scheme' where name='";
-    sQuery += colorName;
-    sQuery += "';";
-
-    // Query the database
-    Config::Result *pResult = Config::instance().query(sQuery);
+    // Prepare (or reuse) the lookup
+    Config::Cursor *pCursor = Config::instance().prepare("select r,g,b from 'colour_scheme' where name=?1;");
 
     // Did the query fail?
-    if(!pResult)
+    if(!pCursor)
     {
         ERROR("Splash: Error looking up '" << colorName << "' colour.");
         return;
     }
 
-    if(!pResult->succeeded())
+    pCursor->bind(1, colorName);
+    if(!pCursor->next())
     {
-        ERROR("Splash: Error looking up '" << colorName << "' colour: " << pResult->errorMessage());
-        delete pResult;
+        if(!pCursor->succeeded())
+            ERROR("Splash: Error looking up '" << colorName << "' colour: " << pCursor->errorMessage());
+        delete pCursor;
         return;
     }
 
     // Get the color from the query result
-    color = Graphics::createRgb(pResult->getNum(0, "r"), pResult->getNum(0, "g"), pResult->getNum(0, "b"));
+    color = Graphics::createRgb(pCursor->getNum("r"), pCursor->getNum("g"), pCursor->getNum("b"));
 
-    // Dispose of the query result
-    delete pResult;
+    // Dispose of the cursor
+    delete pCursor;
 }
 
 static void getDesiredMode(size_t &width, size_t &height, size_t &bpp)
@@ -274,18 +274,30 @@ void UsbDevice::initialise(uint8_t nAddress)
 }
 
 ssize_t UsbDevice::doSync(UsbDevice::Endpoint *pEndpoint, UsbPid pid, uintptr_t pBuffer, size_t nBytes, size_t timeout)
+{
+    if(!nBytes)
+        return 0;
+
+    uintptr_t pPending = startTransfer(pEndpoint, pid, pBuffer, nBytes);
+    if(!pPending)
+        return -TransactionError;
+
+    return finishTransfer(pPending, timeout);
+}
+
+uintptr_t UsbDevice::startTransfer(UsbDevice::Endpoint *pEndpoint, UsbPid pid, uintptr_t pBuffer, size_t nBytes)
 {
     if(!pEndpoint)
     {
-        ERROR("USB: UsbDevice::doSync called with invalid endpoint");
-        return -TransactionError;
+        ERROR("USB: UsbDevice::startTransfer called with invalid endpoint");
+        return 0;
     }
 
     UsbHub *pParentHub = m_pHub;
     if(!pParentHub)
     {
         ERROR("USB: Orphaned UsbDevice!");
-        return -TransactionError;
+        return 0;
     }
 
     if(!nBytes)
@@ -294,7 +306,7 @@ ssize_t UsbDevice::doSync(UsbDevice::Endpoint *pEndpoint, UsbPid pid, uintptr_t
     if(pBuffer & 0xF)
     {
         ERROR("USB: Input pointer wasn't properly aligned [" << pBuffer << ", " << nBytes << "]");
-        return -TransactionError;
+        return 0;
     }
 
     UsbEndpoint endpointInfo(m_nAddress, m_nPort, pEndpoint->nEndpoint, m_Speed, pEndpoint->nMaxPacketSize);
@@ -302,22 +314,37 @@ ssize_t UsbDevice::doSync(UsbDevice::Endpoint *pEndpoint, UsbPid pid, uintptr_t
     if(nTransaction == static_cast<uintptr_t>(-1))
     {
         ERROR("UsbDevice: couldn't get a valid transaction to work with from the parent hub");
-        return -TransactionError;
+        return 0;
     }
 
+    // Let each transfer carry as many whole packets as the controller can take
+    size_t nMaxPacketSize = pEndpoint->nMaxPacketSize;
+    size_t nMaxTransferBytes = pParentHub->getMaxTransferBytes();
+    nMaxTransferBytes -= nMaxTransferBytes % nMaxPacketSize;
+    if(!nMaxTransferBytes)
+        nMaxTransferBytes = nMaxPacketSize;
+
     size_t byteOffset = 0;
     while(nBytes)
     {
-        size_t nBytesThisTransaction = nBytes > pEndpoint->nMaxPacketSize ? pEndpoint->nMaxPacketSize : nBytes;
+        size_t nBytesThisTransaction = nBytes > nMaxTransferBytes ? nMaxTransferBytes : nBytes;
 
         pParentHub->addTransferToTransaction(nTransaction, pEndpoint->bDataToggle, pid, pBuffer + byteOffset, nBytesThisTransaction);
         byteOffset += nBytesThisTransaction;
         nBytes -= nBytesThisTransaction;
 
-        pEndpoint->bDataToggle = !pEndpoint->bDataToggle;
+        // The toggle flips with each packet
+        size_t nPackets = (nBytesThisTransaction + nMaxPacketSize - 1) / nMaxPacketSize;
+        if(nPackets & 1)
+            pEndpoint->bDataToggle = !pEndpoint->bDataToggle;
     }
 
-    return pParentHub->doSync(nTransaction, timeout);
+    return pParentHub->startSync(nTransaction);
+}
+
+ssize_t UsbDevice::finishTransfer(uintptr_t pPending, size_t timeout)
+{
+    return m_pHub->finishSync(pPending, timeout);
 }
 
 ssize_t UsbDevice::syncIn(Endpoint *pEndpoint, uintptr_t pBuffer, size_t nBytes, size_t timeout)
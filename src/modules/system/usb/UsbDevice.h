@@ -252,6 +252,14 @@ class UsbDevice
         ssize_t syncIn(Endpoint *pEndpoint, uintptr_t pBuffer, size_t nBytes, size_t timeout = 5000);
         ssize_t syncOut(Endpoint *pEndpoint, uintptr_t pBuffer, size_t nBytes, size_t timeout = 5000);
 
+        /// Starts a transfer without waiting for it to complete, so that other
+        /// transfers can proceed at the same time. Transfers started on the same
+        /// endpoint are carried out in order. Returns a handle to pass to
+        /// finishTransfer(), or 0 if the transfer couldn't be started.
+        uintptr_t startTransfer(Endpoint *pEndpoint, UsbPid pid, uintptr_t pBuffer, size_t nBytes);
+        /// Waits for a transfer started with startTransfer() and returns its result
+        ssize_t finishTransfer(uintptr_t pPending, size_t timeout = 5000);
+
         void addInterruptInHandler(Endpoint *pEndpoint, uintptr_t pBuffer, uint16_t nBytes, void (*pCallback)(uintptr_t, ssize_t), uintptr_t pParam=0);
 
         /// Performs an USB control request
@@ -199,12 +199,24 @@ void UsbHub::syncCallback(uintptr_t pParam, ssize_t nResult)
 }
 
 ssize_t UsbHub::doSync(uintptr_t nTransaction, uint32_t timeout)
+{
+    return finishSync(startSync(nTransaction), timeout);
+}
+
+uintptr_t UsbHub::startSync(uintptr_t nTransaction)
 {
     // Create a structure to hold the semaphore and the result
     SyncParam *pSyncParam = new SyncParam();
     
     // Send the async request
     doAsync(nTransaction, syncCallback, reinterpret_cast<uintptr_t>(pSyncParam));
+    return reinterpret_cast<uintptr_t>(pSyncParam);
+}
+
+ssize_t UsbHub::finishSync(uintptr_t pPending, uint32_t timeout)
+{
+    SyncParam *pSyncParam = reinterpret_cast<SyncParam*>(pPending);
+
     // Wait for the semaphore to release
     /// \bug Transaction is never deleted here - which makes pParam in the syncCallback above
     ///      invalid, causing an assertion failure in Semaphore if this times out.
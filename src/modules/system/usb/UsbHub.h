@@ -54,9 +54,18 @@ class UsbHub : public Device
         /// Creates a new transaction with the given endpoint data
         virtual uintptr_t createTransaction(UsbEndpoint endpointInfo) =0;
 
-        /// Performs a transaction asynchronously, calling the given callback on completion
+        /// Performs a transaction asynchronously, calling the given callback on completion.
+        /// Several transactions may be in flight on the same endpoint: they are
+        /// carried out, and complete, in the order they were submitted
         virtual void doAsync(uintptr_t pTransaction, void (*pCallback)(uintptr_t, ssize_t)=0, uintptr_t pParam=0) =0;
 
+        /// Gets the most bytes a single transfer added to a transaction may carry,
+        /// or zero if each transfer must fit in a single packet
+        virtual size_t getMaxTransferBytes()
+        {
+            return 0;
+        }
+
         /// Adds a new handler for an interrupt IN transaction
         virtual void addInterruptInHandler(UsbEndpoint endpointInfo, uintptr_t pBuffer, uint16_t nBytes, void (*pCallback)(uintptr_t, ssize_t), uintptr_t pParam=0) =0;
 
@@ -69,6 +78,14 @@ class UsbHub : public Device
         /// Performs a transaction, blocks until it's completed and returns the result
         ssize_t doSync(uintptr_t nTransaction, uint32_t timeout=5000);
 
+        /// Starts a transaction that is to be waited for with finishSync(), so
+        /// the caller can keep other transactions going in the meantime
+        uintptr_t startSync(uintptr_t nTransaction);
+
+        /// Blocks until a transaction started with startSync() has completed
+        /// and returns the result
+        ssize_t finishSync(uintptr_t pPending, uint32_t timeout=5000);
+
         /// Gets a UsbDevice from a given vendor:product pair
         //void getDeviceByIds(size_t vendor, size_t product, void (*pCallback)(class UsbDevice *));
 
@@ -92,6 +109,49 @@ class UsbHub : public Device
                 m_IgnoredPorts.clear(nPort);
         }
 
+    protected:
+        /// Collects the callbacks of the transactions completed during an
+        /// interrupt, so that they can all be called once the schedule has been
+        /// brought up to date
+        class CompletionBatch
+        {
+            public:
+                CompletionBatch() : m_nCompletions(0) {}
+
+                /// Adds a callback to the batch, calling the batch so far if it's full
+                void add(void (*pCallback)(uintptr_t, ssize_t), uintptr_t pParam, ssize_t nResult)
+                {
+                    if(!pCallback)
+                        return;
+                    if(m_nCompletions == MaxCompletions)
+                        run();
+
+                    m_Completions[m_nCompletions].pCallback = pCallback;
+                    m_Completions[m_nCompletions].pParam = pParam;
+                    m_Completions[m_nCompletions].nResult = nResult;
+                    m_nCompletions++;
+                }
+
+                /// Calls every callback in the batch
+                void run()
+                {
+                    for(size_t i = 0; i < m_nCompletions; i++)
+                        m_Completions[i].pCallback(m_Completions[i].pParam, m_Completions[i].nResult);
+                    m_nCompletions = 0;
+                }
+
+            private:
+                static const size_t MaxCompletions = 16;
+
+                struct Completion
+                {
+                    void (*pCallback)(uintptr_t, ssize_t);
+                    uintptr_t pParam;
+                    ssize_t nResult;
+                } m_Completions[MaxCompletions];
+                size_t m_nCompletions;
+        };
+
     private:
         /// Structure used synchronous transactions
         struct SyncParam
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "DentryCache.h"
+#include "File.h"
+#include "Filesystem.h"
+#include <LockGuard.h>
+#include <utilities/utility.h>
+
+DentryCache DentryCache::m_Instance;
+
+DentryCache::DentryCache() :
+    m_Entries(), m_NextVictim(), m_Generations(), m_nHits(0), m_nNegativeHits(0),
+    m_nMisses(0), m_Lock()
+{
+}
+
+DentryCache::~DentryCache()
+{
+}
+
+uint32_t DentryCache::hash(File *pParent, const char *name, size_t len, bool bCaseSensitive)
+{
+    // FNV-1a over the name, seeded with the parent pointer.
+    uint32_t h = 2166136261U ^ static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pParent) >> 4);
+    for (size_t i = 0; i < len; ++i)
+    {
+        char c = bCaseSensitive ? name[i] : toLower(name[i]);
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619U;
+    }
+    return h;
+}
+
+bool DentryCache::matches(const Entry &e, const char *name, size_t len, bool bCaseSensitive)
+{
+    if (e.length != len)
+        return false;
+
+    if (bCaseSensitive)
+        return !memcmp(e.name, name, len);
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (toLower(e.name[i]) != toLower(name[i]))
+            return false;
+    }
+    return true;
+}
+
+DentryCache::Entry *DentryCache::find(File *pParent, const char *name, size_t len, uint32_t h, bool bCaseSensitive)
+{
+    Entry *pSet = m_Entries[h & (NumSets - 1)];
+    for (size_t i = 0; i < SetSize; ++i)
+    {
+        Entry &e = pSet[i];
+        if (e.pParent == pParent && e.hash == h && matches(e, name, len, bCaseSensitive))
+            return &e;
+    }
+    return 0;
+}
+
+bool DentryCache::lookup(File *pParent, const char *name, size_t len, File *&pResult)
+{
+    if (len > MaxNameLength)
+        return false;
+
+    bool bCaseSensitive = pParent->getFilesystem()->isCaseSensitive();
+    uint32_t h = hash(pParent, name, len, bCaseSensitive);
+
+    LockGuard<Spinlock> guard(m_Lock);
+    Entry *e = find(pParent, name, len, h, bCaseSensitive);
+    if (!e)
+    {
+        ++m_nMisses;
+        return false;
+    }
+
+    pResult = e->pChild;
+    if (pResult)
+        ++m_nHits;
+    else
+        ++m_nNegativeHits;
+    return true;
+}
+
+uint32_t DentryCache::generation(File *pParent)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    return m_Generations[generationSlot(pParent)];
+}
+
+void DentryCache::bumpAllGenerations()
+{
+    for (size_t i = 0; i < NumGenerations; ++i)
+        ++m_Generations[i];
+}
+
+void DentryCache::insert(File *pParent, const char *name, size_t len, File *pChild, uint32_t generation)
+{
+    if (len > MaxNameLength)
+        return;
+
+    bool bCaseSensitive = pParent->getFilesystem()->isCaseSensitive();
+    uint32_t h = hash(pParent, name, len, bCaseSensitive);
+    size_t set = h & (NumSets - 1);
+
+    LockGuard<Spinlock> guard(m_Lock);
+
+    // The directory changed while it was being read, so what was read may
+    // already be out of date.
+    if (m_Generations[generationSlot(pParent)] != generation)
+        return;
+
+    Entry *e = find(pParent, name, len, h, bCaseSensitive);
+    if (!e)
+    {
+        // Prefer an empty way, otherwise evict round-robin.
+        for (size_t i = 0; i < SetSize; ++i)
+        {
+            if (!m_Entries[set][i].pParent)
+            {
+                e = &m_Entries[set][i];
+                break;
+            }
+        }
+        if (!e)
+        {
+            e = &m_Entries[set][m_NextVictim[set]];
+            m_NextVictim[set] = (m_NextVictim[set] + 1) % SetSize;
+        }
+    }
+
+    e->pParent = pParent;
+    e->pChild = pChild;
+    e->hash = h;
+    e->length = len;
+    memcpy(e->name, name, len);
+    e->name[len] = 0;
+}
+
+void DentryCache::invalidate(File *pParent, const char *name, size_t len)
+{
+    if (len > MaxNameLength)
+        return;
+
+    bool bCaseSensitive = pParent->getFilesystem()->isCaseSensitive();
+    uint32_t h = hash(pParent, name, len, bCaseSensitive);
+
+    LockGuard<Spinlock> guard(m_Lock);
+    ++m_Generations[generationSlot(pParent)];
+    Entry *e = find(pParent, name, len, h, bCaseSensitive);
+    if (e)
+        e->pParent = 0;
+}
+
+void DentryCache::invalidate(File *pFile)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    bumpAllGenerations();
+    for (size_t set = 0; set < NumSets; ++set)
+    {
+        for (size_t i = 0; i < SetSize; ++i)
+        {
+            Entry &e = m_Entries[set][i];
+            if (e.pParent && (e.pParent == pFile || e.pChild == pFile))
+                e.pParent = 0;
+        }
+    }
+}
+
+void DentryCache::invalidate(Filesystem *pFs)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    bumpAllGenerations();
+    for (size_t set = 0; set < NumSets; ++set)
+    {
+        for (size_t i = 0; i < SetSize; ++i)
+        {
+            Entry &e = m_Entries[set][i];
+            if (e.pParent && e.pParent->getFilesystem() == pFs)
+                e.pParent = 0;
+        }
+    }
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DENTRY_CACHE_H
+#define DENTRY_CACHE_H
+
+#include <processor/types.h>
+#include <Spinlock.h>
+
+class File;
+class Filesystem;
+
+/** Global cache of path components, keyed on (parent directory, name).
+ *
+ * This sits in front of the per-Directory RadixTree caches so that
+ * Filesystem::findNode can resolve a component without building any
+ * Strings. Entries may be negative (the name was looked up in a fully
+ * cached directory and did not exist), which makes repeated misses - for
+ * example, searching PATH in execve - as cheap as hits.
+ *
+ * The table is a fixed, set-associative array: lookups and insertions
+ * never allocate, and a full set simply evicts its oldest entry.
+ */
+class DentryCache
+{
+public:
+    DentryCache();
+    ~DentryCache();
+
+    /** Returns the singleton DentryCache instance. */
+    static DentryCache &instance()
+    {
+        return m_Instance;
+    }
+
+    /** Looks up the given name in pParent.
+     *  \param[out] pResult The child File, or null for a negative entry.
+     *  \return true if an entry (positive or negative) was found. */
+    bool lookup(File *pParent, const char *name, size_t len, File *&pResult);
+
+    /** Returns pParent's generation, which changes whenever an entry for
+     *  pParent is invalidated. Take it before reading the directory. */
+    uint32_t generation(File *pParent);
+
+    /** Adds an entry for the given name in pParent. pChild may be null to
+     *  record that the name does not exist. Names too long to be stored
+     *  inline are silently not cached, as is anything read from the
+     *  directory before an invalidation (that is, if pParent's generation
+     *  is no longer the one given). */
+    void insert(File *pParent, const char *name, size_t len, File *pChild, uint32_t generation);
+
+    /** Removes the entry, if any, for the given name in pParent. */
+    void invalidate(File *pParent, const char *name, size_t len);
+
+    /** Removes every entry that refers to pFile, either as the parent or
+     *  as the cached child. */
+    void invalidate(File *pFile);
+
+    /** Removes every entry belonging to the given filesystem. */
+    void invalidate(Filesystem *pFs);
+
+    /** Statistics, for the curious. */
+    size_t hits() const {return m_nHits;}
+    size_t negativeHits() const {return m_nNegativeHits;}
+    size_t misses() const {return m_nMisses;}
+
+private:
+    DentryCache(const DentryCache &);
+    DentryCache &operator = (const DentryCache &);
+
+    /** Longest name that is stored inline in an entry. */
+    static const size_t MaxNameLength = 47;
+    /** Number of sets in the table (must be a power of two). */
+    static const size_t NumSets = 512;
+    /** Number of entries per set. */
+    static const size_t SetSize = 4;
+    /** Number of generation counters (must be a power of two). Directories
+     *  that share one only cost each other the odd uncached lookup. */
+    static const size_t NumGenerations = 512;
+
+    struct Entry
+    {
+        File *pParent;
+        File *pChild;
+        uint32_t hash;
+        uint8_t length;
+        char name[MaxNameLength + 1];
+    };
+
+    /** Hashes the given (parent, name) pair. */
+    static uint32_t hash(File *pParent, const char *name, size_t len, bool bCaseSensitive);
+
+    /** Compares an entry's name against the given name. */
+    static bool matches(const Entry &e, const char *name, size_t len, bool bCaseSensitive);
+
+    /** Locates the entry for (pParent, name), or null. Lock must be held. */
+    Entry *find(File *pParent, const char *name, size_t len, uint32_t h, bool bCaseSensitive);
+
+    /** Generation counter covering pParent. */
+    static size_t generationSlot(File *pParent)
+    {
+        return (reinterpret_cast<uintptr_t>(pParent) >> 4) & (NumGenerations - 1);
+    }
+
+    /** Bumps every generation, for invalidations that cover many parents.
+     *  Lock must be held. */
+    void bumpAllGenerations();
+
+    Entry m_Entries[NumSets][SetSize];
+
+    /** Next way to evict in each set. */
+    uint8_t m_NextVictim[NumSets];
+
+    /** Invalidation counts, by parent directory. */
+    uint32_t m_Generations[NumGenerations];
+
+    size_t m_nHits;
+    size_t m_nNegativeHits;
+    size_t m_nMisses;
+
+    Spinlock m_Lock;
+
+    static DentryCache m_Instance;
+};
+
+#endif
@@ -19,6 +19,7 @@
 
 #include "Directory.h"
 #include "Filesystem.h"
+#include "DentryCache.h"
 
 Directory::Directory() :
     File(), m_Cache(), m_bCachePopulated(false)
@@ -34,6 +35,7 @@ Directory::Directory(String name, Time accessedTime, Time modifiedTime, Time cre
 
 Directory::~Directory()
 {
+    DentryCache::instance().invalidate(this);
 }
 
 File* Directory::getChild(size_t n)
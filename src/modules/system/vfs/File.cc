@@ -232,6 +232,33 @@ void File::returnPhysicalPage(size_t offset)
     m_Lock.release();
 }
 
+uintptr_t File::getCachedBlock(size_t offset)
+{
+    size_t blockSize = getBlockSize();
+    offset &= ~(blockSize - 1);
+
+    if(offset >= m_Size)
+    {
+        return 0;
+    }
+
+    LockGuard<Mutex> guard(m_Lock);
+    uintptr_t buff = m_DataCache.lookup(offset);
+    if (!buff)
+    {
+        buff = readBlock(offset);
+        if (!buff)
+            return 0;
+        m_DataCache.insert(offset, buff);
+    }
+
+    // Pin while still holding the lock so the block can't be evicted
+    // between the lookup and the caller using it.
+    pinBlock(offset);
+
+    return buff;
+}
+
 void File::sync()
 {
     Tree<uint64_t,size_t>::Iterator it;
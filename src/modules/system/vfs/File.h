@@ -85,6 +85,15 @@ public:
      */
     void returnPhysicalPage(size_t offset);
 
+    /**
+     * Get the kernel address of the cached block containing the given
+     * offset, reading it in first if needed. The block is pinned, just as
+     * with getPhysicalPage, and must be handed back with returnPhysicalPage.
+     * Returns 0 if the offset is past the end of the file or the File does
+     * not keep its data in the block cache (pipes, sockets, devices...).
+     */
+    uintptr_t getCachedBlock(size_t offset);
+
     /**
      * Sync all cached pages for the file back to disk.
      *
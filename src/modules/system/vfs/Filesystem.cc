@@ -27,6 +27,8 @@
 #include "File.h"
 #include "Directory.h"
 #include "Symlink.h"
+#include "DentryCache.h"
+#include "MemoryMappedFile.h"
 
 Filesystem::Filesystem() :
 #ifdef CRIPPLE_HDD
@@ -67,7 +69,9 @@ bool Filesystem::createFile(String path, uint32_t mask, File *pStartNode)
     }
 
     // Now make the file.
-    return createFile(pParent, filename, mask);
+    bool bCreated = createFile(pParent, filename, mask);
+    invalidateDentry(pParent, filename);
+    return bCreated;
 }
 
 bool Filesystem::createDirectory(String path, File *pStartNode)
@@ -93,6 +97,7 @@ bool Filesystem::createDirectory(String path, File *pStartNode)
 
     // Now make the directory.
     createDirectory(pParent, filename);
+    invalidateDentry(pParent, filename);
 
     return true;
 }
@@ -120,6 +125,7 @@ bool Filesystem::createSymlink(String path, String value, File *pStartNode)
 
     // Now make the symlink.
     createSymlink(pParent, filename, value);
+    invalidateDentry(pParent, filename);
 
     return true;
 }
@@ -155,105 +161,115 @@ bool Filesystem::remove(String path, File *pStartNode)
 
     bool bRemoved = remove(pParent, pFile);
     if (bRemoved)
+    {
         pDParent->m_Cache.remove(filename);
+        DentryCache::instance().invalidate(pFile);
+
+        // Nothing may read the File in the background once it is gone.
+        MemoryMapManager::instance().cancelReadahead(pFile);
+    }
     return bRemoved;
 }
 
 File *Filesystem::findNode(File *pNode, String path)
 {
-    if (path.length() == 0)
-        return pNode;
+    const char *p = path;
 
-    // If the pathname has a leading slash, cd to root and remove it.
-    if (path[0] == '/')
-    {
+    // If the pathname has a leading slash, cd to root.
+    if (*p == '/')
         pNode = getRoot();
-        path = String(&path[1]);
-    }
 
-    // Grab the next filename component.
-    size_t i = 0;
-    size_t nExtra = 0;
-    while (path[i] != '/' && path[i] != '\0')
-        i = path.nextCharacter(i);
-    while (path[i] != '\0')
+    while (true)
     {
-        size_t n = path.nextCharacter(i);
-        if (path[n] == '/')
+        // Skip any separators, for example in a '/a//b' path.
+        while (*p == '/')
+            ++p;
+
+        if (*p == '\0')
+            return pNode;
+
+        // Find the extent of this component - [p, p + len).
+        size_t len = 0;
+        while (p[len] != '/' && p[len] != '\0')
+            ++len;
+
+        const char *component = p;
+        p += len;
+
+        // Firstly, if the current node is a symlink, follow it.
+        while (pNode && pNode->isSymlink())
+            pNode = Symlink::fromFile(pNode)->followLink();
+        if (!pNode)
+            return 0;
+
+        // Next, if the current node isn't a directory, die.
+        if (!pNode->isDirectory())
         {
-            i = n;
-            ++nExtra;
+            SYSCALL_ERROR(NotADirectory);
+            return 0;
         }
-        else
-            break;
-    }
 
-    String restOfPath;
-    // Why did the loop exit?
-    if (path[i] != '\0')
-    {
-        restOfPath = path.split(path.nextCharacter(i));
-        // restOfPath is now 'path', but starting at the next token, and with no leading slash.
-        // Unfortunately 'path' now has a trailing slash, so chomp it off.
-        path.chomp();
+        if (component[0] == '.')
+        {
+            if (len == 1)
+                continue;
+            else if (len == 2 && component[1] == '.')
+            {
+                if (pNode->m_pParent)
+                    pNode = pNode->m_pParent;
+                continue;
+            }
+        }
 
-        // Remove any extra slashes, for example in a '/a//b' path.
-        for (size_t z = 0; z < nExtra; ++z)
-            path.chomp();
-    }
+        Directory *pDir = Directory::fromFile(pNode);
 
-    // At this point 'path' contains the token to search for. 'restOfPath' contains the path for the next recursion (or nil).
+        // Global dentry cache lookup first - this needs no String.
+        File *pFile = 0;
+        if (DentryCache::instance().lookup(pDir, component, len, pFile))
+        {
+            if (!pFile)
+                return 0;
+            pNode = pFile;
+            continue;
+        }
 
-    // If 'path' is zero-lengthed, ignore and recurse.
-    if (path.length() == 0)
-        return findNode(pNode, restOfPath);
+        // Anything created or removed from here on must stop us caching
+        // what we read below.
+        uint32_t generation = DentryCache::instance().generation(pDir);
 
-    // Firstly, if the current node is a symlink, follow it.
-    while (pNode->isSymlink())
-        pNode = Symlink::fromFile(pNode)->followLink();
+        if (!pDir->m_bCachePopulated)
+        {
+            // Directory contents not cached - cache them now.
+            pDir->cacheDirectoryContents();
+        }
 
-    // Next, if the current node isn't a directory, die.
-    if (!pNode->isDirectory())
-    {
-        SYSCALL_ERROR(NotADirectory);
-        return 0;
-    }
+        String name;
+        name.assign(component, len);
+        pFile = pDir->m_Cache.lookup(name);
 
-    if (!strcmp(path, ".") || (!strcmp(path, "..") && pNode->m_pParent == 0))
-    {
-        return findNode(pNode, restOfPath);
-    }
-    else if (!strcmp(path, ".."))
-    {
-        return findNode(pNode->m_pParent, restOfPath);
-    }
+        // Only remember a miss if we know the directory listing is complete.
+        if (pFile || pDir->m_bCachePopulated)
+            DentryCache::instance().insert(pDir, component, len, pFile, generation);
 
-    Directory *pDir = Directory::fromFile(pNode);
-    if(!pDir)
-    {
-        // Throw some error...
-        return 0;
-    }
+        if (!pFile)
+        {
+            // Cache lookup failed, does not exist.
+            return 0;
+        }
 
-    // Cache lookup.
-    File *pFile;
-    if (!pDir->m_bCachePopulated)
-    {
-        // Directory contents not cached - cache them now.
-        pDir->cacheDirectoryContents();
+        pNode = pFile;
     }
+}
 
-    pFile = pDir->m_Cache.lookup(path);
-    if (pFile)
-    {
-        // Cache lookup succeeded, recurse and return.
-        return findNode(pFile, restOfPath);
-    }
-    else
-    {
-        // Cache lookup failed, does not exist.
-        return 0;
-    }
+void Filesystem::invalidateDentry(File *pParent, String &filename)
+{
+    // Entries are keyed on the directory findNode ends up in.
+    while (pParent && pParent->isSymlink())
+        pParent = Symlink::fromFile(pParent)->followLink();
+    if (!pParent)
+        return;
+
+    DentryCache::instance().invalidate(pParent, filename, filename.length());
 }
 
 File *Filesystem::findParent(String path, File *pStartNode, String &filename)
@@ -127,6 +127,10 @@ private:
         \param[out] filename The child file's name. */
     File *findParent(String path, File *pStartNode, String &filename);
 
+    /** Drops any cached lookup of filename in pParent, after the directory
+        has been changed underneath it. */
+    void invalidateDentry(File *pParent, String &filename);
+
     /** Accessed by VFS */
     size_t m_nAliases;
 
@@ -21,6 +21,9 @@
 
 #include <processor/PhysicalMemoryManager.h>
 #include <process/MemoryPressureManager.h>
+#include <process/CompressedPageStore.h>
+#include <process/Scheduler.h>
+#include <process/Thread.h>
 #include <Spinlock.h>
 
 #include <utilities/assert.h>
@@ -35,8 +38,9 @@ MemoryMappedObject::~MemoryMappedObject()
 {
 }
 
-AnonymousMemoryMap::AnonymousMemoryMap(uintptr_t address, size_t length, MemoryMappedObject::Permissions perms) :
-    MemoryMappedObject(address, true, length, perms), m_Mappings()
+AnonymousMemoryMap::AnonymousMemoryMap(uintptr_t address, size_t length, MemoryMappedObject::Permissions perms, bool bLargePages) :
+    MemoryMappedObject(address, true, length, perms), m_Mappings(), m_bLargePages(bLargePages),
+    m_ClockHand(0), m_SwapLock(false, true)
 {
     if(m_Zero == 0)
     {
@@ -52,7 +56,7 @@ AnonymousMemoryMap::AnonymousMemoryMap(uintptr_t address, size_t length, MemoryM
 
 MemoryMappedObject *AnonymousMemoryMap::clone()
 {
-    AnonymousMemoryMap *pResult = new AnonymousMemoryMap(m_Address, m_Length, m_Permissions);
+    AnonymousMemoryMap *pResult = new AnonymousMemoryMap(m_Address, m_Length, m_Permissions, m_bLargePages);
     pResult->m_Mappings = m_Mappings;
     return pResult;
 }
@@ -76,7 +80,7 @@ MemoryMappedObject *AnonymousMemoryMap::split(uintptr_t at)
     m_Length = at - m_Address;
 
     // New object.
-    AnonymousMemoryMap *pResult = new AnonymousMemoryMap(at, oldLength - m_Length, m_Permissions);
+    AnonymousMemoryMap *pResult = new AnonymousMemoryMap(at, oldLength - m_Length, m_Permissions, m_bLargePages);
 
     // Fix up mapping metadata.
     for(List<void *>::Iterator it = m_Mappings.begin();
@@ -136,6 +140,8 @@ bool AnonymousMemoryMap::remove(size_t length)
             va.unmap(v);
             PhysicalMemoryManager::instance().freePage(phys);
         }
+        else if(va.isSwapped(v))
+            unmapSwapped(va, v);
 
         it = m_Mappings.erase(it);
     }
@@ -209,6 +215,27 @@ void AnonymousMemoryMap::unmap()
 
     VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
 
+    // Unmap in batches, so other processors get one TLB shootdown per batch
+    // rather than one per page. The pages can only be freed afterwards.
+    // Batches start on large page boundaries so a whole large page lands in
+    // one batch, and can be unmapped without splitting it up.
+    void *pOneVirtual[1];
+    physical_uintptr_t pOnePhysical[1];
+    size_t nBatchSize = UnmapBatchSize;
+    void **pVirtual = new void *[UnmapBatchSize];
+    physical_uintptr_t *pPhysical = new physical_uintptr_t[UnmapBatchSize];
+    if(!pVirtual || !pPhysical)
+    {
+        delete [] pVirtual;
+        delete [] pPhysical;
+        pVirtual = pOneVirtual;
+        pPhysical = pOnePhysical;
+        nBatchSize = 1;
+    }
+    size_t nBatch = 0;
+
+    size_t largePageSize = va.getLargePageSize();
+
     for(List<void *>::Iterator it = m_Mappings.begin();
         it != m_Mappings.end();
         ++it)
@@ -221,16 +248,69 @@ void AnonymousMemoryMap::unmap()
 
             va.getMapping(v, phys, flags);
 
-            // Clean up. Shared read-only zero page will only have its refcount
-            // decreased by this - it will not hit zero.
-            va.unmap(v);
-            PhysicalMemoryManager::instance().freePage(phys);
+            if(nBatch && largePageSize &&
+               (reinterpret_cast<uintptr_t>(v) & (largePageSize - 1)) == 0)
+            {
+                unmapBatch(va, pVirtual, pPhysical, nBatch);
+                nBatch = 0;
+            }
+
+            pVirtual[nBatch] = v;
+            pPhysical[nBatch] = phys;
+            if(++nBatch == nBatchSize)
+            {
+                unmapBatch(va, pVirtual, pPhysical, nBatch);
+                nBatch = 0;
+            }
         }
+        else if(va.isSwapped(v))
+            unmapSwapped(va, v);
+    }
+
+    if(nBatch)
+        unmapBatch(va, pVirtual, pPhysical, nBatch);
+
+    if(pVirtual != pOneVirtual)
+    {
+        delete [] pVirtual;
+        delete [] pPhysical;
     }
 
     m_Mappings.clear();
 }
 
+void AnonymousMemoryMap::unmapBatch(VirtualAddressSpace &va, void **pVirtual,
+                                    physical_uintptr_t *pPhysical, size_t nPages)
+{
+    bool bAll = va.unmapMany(pVirtual, nPages);
+
+    // Clean up. Shared read-only zero page will only have its refcount
+    // decreased by this - it will not hit zero. Pages that couldn't be
+    // unmapped are still in use, so have to be leaked instead.
+    for(size_t i = 0; i < nPages; ++i)
+    {
+        if(!bAll && va.isMapped(pVirtual[i]))
+            continue;
+        PhysicalMemoryManager::instance().freePage(pPhysical[i]);
+    }
+}
+
+void AnonymousMemoryMap::unmapSwapped(VirtualAddressSpace &va, void *v)
+{
+    LockGuard<Spinlock> guard(m_SwapLock);
+
+    // A trap may have brought it back since the caller looked.
+    if(!va.isSwapped(v))
+        return;
+
+    size_t flags;
+    physical_uintptr_t address;
+    va.getMapping(v, address, flags);
+
+    va.unmap(v);
+    CompressedPageStore::instance().release(CompressedPageStore::addressToHandle(address));
+}
+
 bool AnonymousMemoryMap::trap(uintptr_t address, bool bWrite)
 {
 #ifdef DEBUG_MMOBJECTS
@@ -264,6 +344,15 @@ bool AnonymousMemoryMap::trap(uintptr_t address, bool bWrite)
     if(m_Permissions & Exec)
         extraFlags |= VirtualAddressSpace::Execute;
 
+    // A page compressed under memory pressure comes back whatever the access.
+    if(va.isSwapped(reinterpret_cast<void *>(address)))
+        return trapSwapped(address, extraFlags);
+
+    // Writable large page mappings get a whole large page on the first
+    // fault in it, read or write - there's no large zero page to share.
+    if(m_bLargePages && (m_Permissions & Write) && trapLarge(address, extraFlags))
+        return true;
+
     if(!bWrite)
     {
         PhysicalMemoryManager::instance().pin(m_Zero);
@@ -277,6 +366,29 @@ bool AnonymousMemoryMap::trap(uintptr_t address, bool bWrite)
         // Clean up existing page, if any.
         if(va.isMapped(reinterpret_cast<void *>(address)))
         {
+            // Our own page, made read-only for a moment by compact(). Under
+            // m_SwapLock, compact() either hasn't looked at the page yet or
+            // has finished with it.
+            m_SwapLock.acquire();
+            if(va.isMapped(reinterpret_cast<void *>(address)))
+            {
+                size_t flags;
+                physical_uintptr_t phys;
+                va.getMapping(reinterpret_cast<void *>(address), phys, flags);
+                if(phys != m_Zero)
+                {
+                    va.setFlags(reinterpret_cast<void *>(address), flags | VirtualAddressSpace::Write);
+                    m_SwapLock.release();
+                    return true;
+                }
+            }
+            else if(va.isSwapped(reinterpret_cast<void *>(address)))
+            {
+                m_SwapLock.release();
+                return trapSwapped(address, extraFlags);
+            }
+            m_SwapLock.release();
+
             va.unmap(reinterpret_cast<void *>(address));
 
             // Drop the refcount on the zero page.
@@ -298,8 +410,218 @@ bool AnonymousMemoryMap::trap(uintptr_t address, bool bWrite)
     return true;
 }
 
+bool AnonymousMemoryMap::trapLarge(uintptr_t address, size_t extraFlags)
+{
+    size_t pageSz = PhysicalMemoryManager::getPageSize();
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+
+    size_t largePageSz = va.getLargePageSize();
+    if(!largePageSz)
+        return false;
+
+    uintptr_t base = address & ~(largePageSz - 1);
+    if((base < m_Address) || ((base + largePageSz) > (m_Address + m_Length)))
+        return false;
+
+    // Pages already in the way (eg, a large page wasn't available before)
+    // keep this block on normal pages.
+    for(uintptr_t v = base; v < (base + largePageSz); v += pageSz)
+    {
+        if(va.isMapped(reinterpret_cast<void *>(v)))
+            return false;
+    }
+
+    physical_uintptr_t phys = PhysicalMemoryManager::instance().allocateLargePage();
+    if(!phys)
+        return false;
+
+    if(!va.mapLarge(phys, reinterpret_cast<void *>(base), VirtualAddressSpace::Write | extraFlags))
+    {
+        for(size_t i = 0; i < largePageSz; i += pageSz)
+            PhysicalMemoryManager::instance().freePage(phys + i);
+        return false;
+    }
+    memset(reinterpret_cast<void *>(base), 0, largePageSz);
+
+    // Track each page, so the rest of this object can treat them as any other.
+    for(uintptr_t v = base; v < (base + largePageSz); v += pageSz)
+        m_Mappings.pushBack(reinterpret_cast<void *>(v));
+
+    return true;
+}
+
+bool AnonymousMemoryMap::trapSwapped(uintptr_t address, size_t extraFlags)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    void *v = reinterpret_cast<void *>(address);
+
+    // Allocating may compact, which takes m_SwapLock, so get the page first.
+    physical_uintptr_t newPage = PhysicalMemoryManager::instance().allocatePage();
+    if(!newPage)
+        return false;
+
+    m_SwapLock.acquire();
+
+    // Another thread may have faulted it back in (or unmapped it) while we
+    // weren't holding the lock, in which case the access can just retry.
+    if(!va.isSwapped(v))
+    {
+        m_SwapLock.release();
+        PhysicalMemoryManager::instance().freePage(newPage);
+        return true;
+    }
+
+    size_t flags;
+    physical_uintptr_t swapAddress;
+    va.getMapping(v, swapAddress, flags);
+    uintptr_t handle = CompressedPageStore::addressToHandle(swapAddress);
+
+    va.unmap(v);
+    if(!va.map(newPage, v, VirtualAddressSpace::Write | extraFlags))
+        ERROR("map() failed in AnonymousMemoryMap::trapSwapped()");
+
+    bool bLoaded = CompressedPageStore::instance().load(handle, v);
+    CompressedPageStore::instance().release(handle);
+    if(!bLoaded)
+    {
+        // Nothing sensible to give back, so this access faults.
+        va.unmap(v);
+        m_SwapLock.release();
+        PhysicalMemoryManager::instance().freePage(newPage);
+        return false;
+    }
+
+    // Written with the page writable; set the permissions it should have.
+    if(!(m_Permissions & Write))
+        va.setFlags(v, extraFlags);
+
+    m_SwapLock.release();
+    return true;
+}
+
+bool AnonymousMemoryMap::compact()
+{
+#ifdef X86_COMMON
+    // Large pages are left alone: there's no compressing half of one.
+    if(m_bLargePages)
+        return false;
+
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+
+    size_t nMappings = m_Mappings.count();
+    if(!nMappings)
+        return false;
+
+    // Carry on from where the last compact() stopped. The list itself is
+    // left alone, as this may run while something further up the stack is
+    // iterating over it.
+    if(m_ClockHand >= nMappings)
+        m_ClockHand = 0;
+    List<void *>::Iterator it = m_Mappings.begin();
+    for(size_t i = 0; i < m_ClockHand; ++i)
+        ++it;
+
+    // Go once around the clock at most.
+    size_t nCompressed = 0;
+    for(size_t n = nMappings; n && (nCompressed < CompactBatchSize); --n)
+    {
+        void *v = *it;
+        ++it;
+        if(++m_ClockHand == nMappings)
+        {
+            m_ClockHand = 0;
+            it = m_Mappings.begin();
+        }
+
+        if(va.isMapped(v) && compactPage(va, v))
+            ++nCompressed;
+    }
+
+    return nCompressed > 0;
+#else
+    return false;
+#endif
+}
+
+bool AnonymousMemoryMap::compactPage(VirtualAddressSpace &va, void *v)
+{
+    size_t flags;
+    physical_uintptr_t phys;
+
+    m_SwapLock.acquire();
+    if(!va.isMapped(v))
+    {
+        m_SwapLock.release();
+        return false;
+    }
+    va.getMapping(v, phys, flags);
+
+    if(flags & (VirtualAddressSpace::Shared | VirtualAddressSpace::CopyOnWrite))
+    {
+        m_SwapLock.release();
+        return false;
+    }
+
+    if(flags & VirtualAddressSpace::Accessed)
+    {
+        va.setFlags(v, flags & ~VirtualAddressSpace::Accessed);
+        m_SwapLock.release();
+        return false;
+    }
+
+    // Hold off writes while the page is compressed. The lock isn't held
+    // for that, so a write in the meantime traps and makes the page
+    // writable again; that is checked for below.
+    size_t pageFlags = flags & (VirtualAddressSpace::Write | VirtualAddressSpace::Execute);
+    va.setFlags(v, flags & ~VirtualAddressSpace::Write);
+    m_SwapLock.release();
+
+    uintptr_t handle;
+    if(!CompressedPageStore::instance().store(v, handle))
+    {
+        LockGuard<Spinlock> guard(m_SwapLock);
+        if(va.isMapped(v))
+        {
+            physical_uintptr_t newPhys;
+            size_t newFlags;
+            va.getMapping(v, newPhys, newFlags);
+            if(newPhys == phys)
+                va.setFlags(v, newFlags | (flags & VirtualAddressSpace::Write));
+        }
+        return false;
+    }
+
+    // Only swap the page out if it is still the one that was compressed,
+    // and nothing has been written to it since.
+    m_SwapLock.acquire();
+    bool bUnchanged = va.isMapped(v);
+    if(bUnchanged)
+    {
+        physical_uintptr_t newPhys;
+        size_t newFlags;
+        va.getMapping(v, newPhys, newFlags);
+        bUnchanged = (newPhys == phys) && !(newFlags & VirtualAddressSpace::Write);
+    }
+    if(bUnchanged)
+    {
+        va.unmap(v);
+        va.map(CompressedPageStore::handleToAddress(handle), v, VirtualAddressSpace::Swapped | pageFlags);
+    }
+    m_SwapLock.release();
+
+    if(!bUnchanged)
+    {
+        CompressedPageStore::instance().release(handle);
+        return false;
+    }
+
+    PhysicalMemoryManager::instance().freePage(phys);
+    return true;
+}
+
 MemoryMappedFile::MemoryMappedFile(uintptr_t address, size_t length, size_t offset, File *backing, bool bCopyOnWrite, MemoryMappedObject::Permissions perms) :
-    MemoryMappedObject(address, bCopyOnWrite, length, perms), m_pBacking(backing), m_Offset(offset), m_Mappings()
+    MemoryMappedObject(address, bCopyOnWrite, length, perms), m_pBacking(backing), m_Offset(offset), m_Mappings(),
+    m_ReadaheadStart(0), m_ReadaheadEnd(0)
 {
     assert(m_pBacking);
 }
@@ -667,6 +989,11 @@ bool MemoryMappedFile::trap(uintptr_t address, bool bWrite)
         va.map(phys, reinterpret_cast<void *>(address), flags | extraFlags);
 
         m_Mappings.insert(address, ~0);
+
+        // Only read-only neighbours: mapping pages writable would make them
+        // look dirty to sync() and compact().
+        if(m_bCopyOnWrite)
+            faultAround(address, flags | extraFlags);
     }
     else
     {
@@ -701,6 +1028,60 @@ bool MemoryMappedFile::trap(uintptr_t address, bool bWrite)
     return true;
 }
 
+void MemoryMappedFile::faultAround(uintptr_t address, size_t flags)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    size_t pageSz = PhysicalMemoryManager::getPageSize();
+    size_t windowSz = FaultAroundPages * pageSz;
+
+    uintptr_t start = address & ~(windowSz - 1);
+    uintptr_t end = start + windowSz;
+    if(start < m_Address)
+        start = m_Address;
+
+    // The page holding EOF is always copied (to zero its tail), so stop
+    // short of it. The mapping may run past the end of the file, too.
+    size_t fileSize = m_pBacking->getSize();
+    size_t validLength = fileSize > m_Offset ? fileSize - m_Offset : 0;
+    if(validLength > m_Length)
+        validLength = m_Length;
+    uintptr_t lastFull = m_Address + (validLength & ~(pageSz - 1));
+    if(end > lastFull)
+        end = lastFull;
+
+    size_t firstUncached = ~0UL, lastUncached = 0;
+    for(uintptr_t virt = start; virt < end; virt += pageSz)
+    {
+        void *v = reinterpret_cast<void *>(virt);
+        if((virt == address) || va.isMapped(v))
+            continue;
+
+        size_t fileOffset = (virt - m_Address) + m_Offset;
+        physical_uintptr_t phys = m_pBacking->getPhysicalPage(fileOffset);
+        if(phys == static_cast<physical_uintptr_t>(~0UL))
+        {
+            if(firstUncached == ~0UL)
+                firstUncached = fileOffset;
+            lastUncached = fileOffset;
+            continue;
+        }
+
+        va.map(phys, v, flags);
+        m_Mappings.insert(virt, ~0);
+    }
+
+    if(firstUncached == ~0UL)
+        return;
+    if((firstUncached >= m_ReadaheadStart) && (lastUncached < m_ReadaheadEnd))
+        return;
+
+    m_ReadaheadStart = firstUncached;
+    m_ReadaheadEnd = lastUncached + pageSz;
+
+    MemoryMapManager::instance().readahead(m_pBacking, m_ReadaheadStart,
+                                           m_ReadaheadEnd - m_ReadaheadStart);
+}
+
 bool MemoryMappedFile::compact()
 {
     VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
@@ -782,7 +1163,9 @@ bool MemoryMappedFile::compact()
 }
 
 MemoryMapManager::MemoryMapManager() :
-    m_MmObjectLists(), m_Lock()
+    m_MmObjectLists(), m_Lock(), m_Readahead(), m_ReadaheadHead(0),
+    m_ReadaheadCount(0), m_pReadaheadActive(0), m_bReadaheadStarted(false),
+    m_ReadaheadLock(), m_ReadaheadWaiting(0)
 {
     PageFaultHandler::instance().registerHandler(this);
     MemoryPressureManager::instance().registerHandler(MemoryPressureManager::HighPriority, this);
@@ -793,6 +1176,107 @@ MemoryMapManager::~MemoryMapManager()
     MemoryPressureManager::instance().removeHandler(this);
 }
 
+void MemoryMapManager::readahead(File *pFile, size_t offset, size_t length)
+{
+    m_ReadaheadLock.acquire();
+
+    if(m_ReadaheadCount == ReadaheadQueueSize)
+    {
+        m_ReadaheadLock.release();
+        return;
+    }
+
+    Readahead &r = m_Readahead[(m_ReadaheadHead + m_ReadaheadCount) % ReadaheadQueueSize];
+    r.pFile = pFile;
+    r.offset = offset;
+    r.length = length;
+    m_ReadaheadCount++;
+
+    bool bStart = !m_bReadaheadStarted;
+    m_bReadaheadStarted = true;
+
+    m_ReadaheadLock.release();
+
+    if(bStart)
+    {
+        Thread *pThread = new Thread(Scheduler::instance().getKernelProcess(),
+                                     &readaheadThread,
+                                     reinterpret_cast<void *>(this));
+        pThread->detach();
+    }
+
+    m_ReadaheadWaiting.release();
+}
+
+void MemoryMapManager::cancelReadahead(File *pFile)
+{
+    cancelReadahead(pFile, 0);
+}
+
+void MemoryMapManager::cancelReadahead(Filesystem *pFs)
+{
+    cancelReadahead(0, pFs);
+}
+
+void MemoryMapManager::cancelReadahead(File *pFile, Filesystem *pFs)
+{
+    m_ReadaheadLock.acquire();
+
+    // Close up the queue over the matching entries.
+    size_t nKept = 0;
+    for(size_t i = 0; i < m_ReadaheadCount; i++)
+    {
+        Readahead &r = m_Readahead[(m_ReadaheadHead + i) % ReadaheadQueueSize];
+        if(r.pFile == pFile || (pFs && r.pFile->getFilesystem() == pFs))
+            continue;
+        m_Readahead[(m_ReadaheadHead + nKept) % ReadaheadQueueSize] = r;
+        nKept++;
+    }
+    m_ReadaheadCount = nKept;
+
+    while(m_pReadaheadActive &&
+          (m_pReadaheadActive == pFile || (pFs && m_pReadaheadActive->getFilesystem() == pFs)))
+    {
+        m_ReadaheadLock.release();
+        Scheduler::instance().yield();
+        m_ReadaheadLock.acquire();
+    }
+
+    m_ReadaheadLock.release();
+}
+
+int MemoryMapManager::readaheadThread(void *p)
+{
+    MemoryMapManager *pManager = reinterpret_cast<MemoryMapManager *>(p);
+
+    while(true)
+    {
+        pManager->m_ReadaheadWaiting.acquire();
+
+        // The semaphore counts readaheads that have since been cancelled too.
+        pManager->m_ReadaheadLock.acquire();
+        if(!pManager->m_ReadaheadCount)
+        {
+            pManager->m_ReadaheadLock.release();
+            continue;
+        }
+        Readahead r = pManager->m_Readahead[pManager->m_ReadaheadHead];
+        pManager->m_ReadaheadHead = (pManager->m_ReadaheadHead + 1) % ReadaheadQueueSize;
+        pManager->m_ReadaheadCount--;
+        pManager->m_pReadaheadActive = r.pFile;
+        pManager->m_ReadaheadLock.release();
+
+        // A null buffer just fills the cache.
+        r.pFile->read(r.offset, r.length, 0);
+
+        pManager->m_ReadaheadLock.acquire();
+        pManager->m_pReadaheadActive = 0;
+        pManager->m_ReadaheadLock.release();
+    }
+
+    return 0;
+}
+
 MemoryMappedObject *MemoryMapManager::mapFile(File *pFile, uintptr_t &address, size_t length, MemoryMappedObject::Permissions perms, size_t offset, bool bCopyOnWrite)
 {
     VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
@@ -837,7 +1321,7 @@ MemoryMappedObject *MemoryMapManager::mapFile(File *pFile, uintptr_t &address, s
     return pMappedFile;
 }
 
-MemoryMappedObject *MemoryMapManager::mapAnon(uintptr_t &address, size_t length, MemoryMappedObject::Permissions perms)
+MemoryMappedObject *MemoryMapManager::mapAnon(uintptr_t &address, size_t length, MemoryMappedObject::Permissions perms, bool bLargePages)
 {
     VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
     size_t pageSz = PhysicalMemoryManager::getPageSize();
@@ -850,7 +1334,13 @@ MemoryMappedObject *MemoryMapManager::mapAnon(uintptr_t &address, size_t length,
         length &= ~(pageSz - 1);
     }
 
-    if(!sanitiseAddress(address, length))
+    // Large pages are only used where they are aligned, so line the mapping
+    // up with them.
+    size_t alignment = 0;
+    if(bLargePages)
+        alignment = va.getLargePageSize();
+
+    if(!sanitiseAddress(address, length, alignment))
         return 0;
 
     // Override any existing mappings that might exist.
@@ -859,7 +1349,7 @@ MemoryMappedObject *MemoryMapManager::mapAnon(uintptr_t &address, size_t length,
 #ifdef DEBUG_MMOBJECTS
     NOTICE("MemoryMapManager::mapAnon: " << address << " length " << length);
 #endif
-    AnonymousMemoryMap *pMap = new AnonymousMemoryMap(address, length, perms);
+    AnonymousMemoryMap *pMap = new AnonymousMemoryMap(address, length, perms, bLargePages);
 
     {
         // This operation must appear atomic.
@@ -1382,21 +1872,23 @@ bool MemoryMapManager::trap(uintptr_t address, bool bIsWrite)
     return false;
 }
 
-bool MemoryMapManager::sanitiseAddress(uintptr_t &address, size_t length)
+bool MemoryMapManager::sanitiseAddress(uintptr_t &address, size_t length, size_t alignment)
 {
     Process *pProcess = Processor::information().getCurrentThread()->getParent();
     size_t pageSz = PhysicalMemoryManager::getPageSize();
+    if(alignment < pageSz)
+        alignment = pageSz;
 
     // Can we get some space for this mapping?
     if(address == 0)
     {
-        if(!pProcess->getDynamicSpaceAllocator().allocate(length + pageSz, address))
-            if(!pProcess->getSpaceAllocator().allocate(length + pageSz, address))
+        if(!pProcess->getDynamicSpaceAllocator().allocate(length + alignment, address))
+            if(!pProcess->getSpaceAllocator().allocate(length + alignment, address))
                 return false;
 
-        if(address & (pageSz - 1))
+        if(address & (alignment - 1))
         {
-            address = (address + pageSz) & ~(pageSz - 1);
+            address = (address + alignment) & ~(alignment - 1);
         }
     }
     else
@@ -1411,12 +1903,48 @@ bool MemoryMapManager::sanitiseAddress(uintptr_t &address, size_t length)
     return true;
 }
 
+size_t MemoryMapManager::compactCurrent()
+{
+    VirtualAddressSpace *va = &Processor::information().getVirtualAddressSpace();
+
+    CompressedPageStore::Statistics before;
+    CompressedPageStore::instance().getStatistics(before);
+
+    {
+        LockGuard<Mutex> guard(m_Lock);
+
+        MmObjectList *pMmObjectList = m_MmObjectLists.lookup(va);
+        if(!pMmObjectList)
+            return 0;
+
+        for(MmObjectList::Iterator it = pMmObjectList->begin();
+            it != pMmObjectList->end();
+            ++it)
+        {
+            // The first pass only clears the accessed bits of pages used
+            // since compact() last looked, so it takes two to get them all.
+            for(size_t pass = 0; pass < 2; ++pass)
+            {
+                while((*it)->compact())
+                    ;
+            }
+        }
+    }
+
+    CompressedPageStore::Statistics after;
+    CompressedPageStore::instance().getStatistics(after);
+    return after.nPages > before.nPages ? after.nPages - before.nPages : 0;
+}
+
 bool MemoryMapManager::compact()
 {
     // Track current address space as we need to switch into each known address
     // space in order to compact them.
     VirtualAddressSpace &currva = Processor::information().getVirtualAddressSpace();
 
+    CompressedPageStore::Statistics before;
+    CompressedPageStore::instance().getStatistics(before);
+
     bool bCompact = false;
     for(Tree<VirtualAddressSpace*, MmObjectList*>::Iterator it = m_MmObjectLists.begin();
         it != m_MmObjectLists.end();
@@ -1440,9 +1968,19 @@ bool MemoryMapManager::compact()
     // Restore old address space now.
     Processor::switchAddressSpace(currva);
 
+    // Anonymous memory maps free the pages they compress.
+    CompressedPageStore::Statistics after;
+    CompressedPageStore::instance().getStatistics(after);
+    if(after.nPages > before.nPages)
+    {
+        NOTICE("    -> compressed " << (after.nPages - before.nPages) << " pages, "
+               << after.nPages << " pages in " << after.slabBytes << " bytes now");
+        return true;
+    }
+
     // Memory mapped files tend to un-pin pages for the Cache system to
-    // release, so we never return success (as we never actually released
-    // pages and therefore didn't resolve any memory pressure).
+    // release, so we don't return success for them (as we never actually
+    // released pages and therefore didn't resolve any memory pressure).
     if(bCompact)
         NOTICE("    -> success, hoping for Cache eviction...");
     return false;
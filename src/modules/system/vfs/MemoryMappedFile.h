@@ -27,8 +27,10 @@
 #include <utilities/Tree.h>
 #include <utilities/List.h>
 #include <process/Mutex.h>
+#include <process/Semaphore.h>
 #include <process/Process.h>
 #include <LockGuard.h>
+#include <Spinlock.h>
 
 /** \addtogroup vfs
     @{ */
@@ -85,6 +87,20 @@
  * A file memory map that is mapped shared will allow this physical page to be
  * modified on write. A copy-on-write file memory map will trigger a copy of the
  * page, and further writes will go to the copy of this page.
+ *
+ * \section mmap_compress Compressing Anonymous Memory
+ * Under memory pressure, pages of anonymous memory maps that haven't been
+ * accessed recently are compressed into the CompressedPageStore and their
+ * physical pages freed. The page table entry is left marked as swapped, and
+ * the trap on the next access decompresses the page into a new physical
+ * page.
+ *
+ * \section mmap_faultaround Fault-Around
+ * A read trap on a copy-on-write file memory map also maps in the rest of the
+ * surrounding window of pages that are already in the File's cache, so that
+ * code and data which is read in order doesn't trap once per page. Pages of
+ * the window which aren't cached yet are read into the cache in the
+ * background, ready for the next trap nearby.
  */
 
 /** \file
@@ -277,7 +293,7 @@ class MemoryMappedObject
 class AnonymousMemoryMap : public MemoryMappedObject
 {
     public:
-        AnonymousMemoryMap(uintptr_t address, size_t length, Permissions perms);
+        AnonymousMemoryMap(uintptr_t address, size_t length, Permissions perms, bool bLargePages = false);
 
         virtual ~AnonymousMemoryMap()
         {}
@@ -292,11 +308,68 @@ class AnonymousMemoryMap : public MemoryMappedObject
 
         virtual bool trap(uintptr_t address, bool bWrite);
 
+        /**
+         * Compresses pages that haven't been used recently into the
+         * CompressedPageStore, freeing their physical pages.
+         *
+         * Pages are visited in turn as by a clock: one that has been
+         * accessed since it was last visited has its accessed bit cleared
+         * and is left alone, one that hasn't is compressed. Pages shared
+         * with anything else (the zero page, or a forked process before
+         * either side writes) are skipped.
+         *
+         * \return true if any pages were compressed.
+         */
+        virtual bool compact();
+
     private:
+        /** Pages unmapped by unmap() at once: enough for a whole large page,
+         *  so it can go without being split up first. */
+        static const size_t UnmapBatchSize = 512;
+        /** Most pages compressed by one compact(). */
+        static const size_t CompactBatchSize = 64;
+
+        /** Unmaps a batch of pages and frees them. */
+        void unmapBatch(VirtualAddressSpace &va, void **pVirtual,
+                        physical_uintptr_t *pPhysical, size_t nPages);
+
+        /**
+         * Maps a zeroed large page over the given address, if the large
+         * page lies within this object and nothing has been mapped into it
+         * yet. Returns false if the caller should map a normal page instead.
+         */
+        bool trapLarge(uintptr_t address, size_t extraFlags);
+
+        /**
+         * Brings a page back from the CompressedPageStore.
+         */
+        bool trapSwapped(uintptr_t address, size_t extraFlags);
+
+        /**
+         * Removes a page that is in the CompressedPageStore.
+         */
+        void unmapSwapped(VirtualAddressSpace &va, void *v);
+
+        /**
+         * Compresses one page, if it is private and hasn't been accessed
+         * since compact() last looked at it.
+         */
+        bool compactPage(VirtualAddressSpace &va, void *v);
+
         static physical_uintptr_t m_Zero;
 
         /** List of existing virtual addresses we've mapped in. */
         List<void *> m_Mappings;
+
+        /** Whether faults should map in large pages where possible. */
+        bool m_bLargePages;
+
+        /** Index in m_Mappings of the next page compact() looks at. */
+        size_t m_ClockHand;
+
+        /** Serialises compressing pages with traps bringing them back.
+         *  A Spinlock, as compact() runs with interrupts disabled. */
+        Spinlock m_SwapLock;
 };
 
 /**
@@ -347,6 +420,17 @@ class MemoryMappedFile : public MemoryMappedObject
         virtual bool compact();
 
     private:
+        /** Size in pages of the aligned window fault-around works within. */
+        static const size_t FaultAroundPages = 16;
+
+        /**
+         * Maps the cached pages of the window around a read trap that aren't
+         * mapped yet, and queues a readahead of those that aren't cached.
+         * \param address the page which trapped (already mapped)
+         * \param flags flags to map the other pages with
+         */
+        void faultAround(uintptr_t address, size_t flags);
+
         /** Backing file. */
         File *m_pBacking;
 
@@ -358,6 +442,11 @@ class MemoryMappedFile : public MemoryMappedObject
 
         /** List of existing mappings. */
         Tree<uintptr_t, physical_uintptr_t> m_Mappings;
+
+        /** Range of the file the last readahead covered, so traps in the
+         *  same window while it's in progress don't queue another. */
+        size_t m_ReadaheadStart;
+        size_t m_ReadaheadEnd;
 };
 
 /**
@@ -380,8 +469,10 @@ class MemoryMapManager : public MemoryTrapHandler, public MemoryPressureHandler
 
         /**
          * Create a new anonymous memory mapping.
+         * \param bLargePages Back the mapping with large pages where the
+         *        architecture supports them (eg, 2MB pages on x86_64).
          */
-        MemoryMappedObject *mapAnon(uintptr_t &address, size_t length, MemoryMappedObject::Permissions perms);
+        MemoryMappedObject *mapAnon(uintptr_t &address, size_t length, MemoryMappedObject::Permissions perms, bool bLargePages = false);
 
         /**
          * Registers the current address space's mappings with the target
@@ -449,17 +540,68 @@ class MemoryMapManager : public MemoryTrapHandler, public MemoryPressureHandler
          */
         virtual bool compact();
 
+        /**
+         * Compact every object in the current address space as far as it
+         * will go now, rather than waiting for memory pressure. Lets tests
+         * check the compressed page store without filling memory first.
+         *
+         * \return the number of pages stored.
+         */
+        size_t compactCurrent();
+
         virtual const String getMemoryPressureDescription()
         {
-          return String("Unmap safe pages from memory mapped files.");
+          return String("Unmap safe pages from memory mapped files and compress cold anonymous pages.");
         }
 
+        /**
+         * Queues a read of part of a file into its cache, for the readahead
+         * thread to do in the background. It is dropped if the queue is full:
+         * the pages will just be read when they trap instead.
+         */
+        void readahead(File *pFile, size_t offset, size_t length);
+
+        /**
+         * Drops any readahead queued for the given File, and waits for one
+         * in progress to finish. Called when the File is removed, while it
+         * is still whole: the readahead thread may be inside its readBlock.
+         */
+        void cancelReadahead(File *pFile);
+
+        /**
+         * Drops any readahead queued for a File on the given Filesystem, and
+         * waits for one in progress to finish. Called before the Filesystem
+         * (and with it, its Files) is destroyed.
+         */
+        void cancelReadahead(Filesystem *pFs);
+
     private:
+        /** Does the work for both cancelReadahead()s. */
+        void cancelReadahead(File *pFile, Filesystem *pFs);
+
+        /** Most readaheads waiting at once. */
+        static const size_t ReadaheadQueueSize = 16;
+
+        /** A range of a file for the readahead thread to bring into the cache. */
+        struct Readahead
+        {
+            File *pFile;
+            size_t offset;
+            size_t length;
+        };
+
+        /** Entry point of the readahead thread. */
+        static int readaheadThread(void *p);
+
         /** Default and only constructor. Registers with PageFaultHandler. */
         MemoryMapManager();
         ~MemoryMapManager();
 
-        bool sanitiseAddress(uintptr_t &address, size_t length);
+        /**
+         * Finds space for a mapping if no address is given, aligned to
+         * the given alignment if that is more than a page.
+         */
+        bool sanitiseAddress(uintptr_t &address, size_t length, size_t alignment = 0);
 
         enum Ops
         {
@@ -479,6 +621,19 @@ class MemoryMapManager : public MemoryTrapHandler, public MemoryPressureHandler
 
         /** Lock for the cache. */
         Mutex m_Lock;
+
+        /** Queued readaheads, oldest at m_ReadaheadHead. */
+        Readahead m_Readahead[ReadaheadQueueSize];
+        size_t m_ReadaheadHead;
+        size_t m_ReadaheadCount;
+        /** File the readahead thread is reading from right now, if any. */
+        File *m_pReadaheadActive;
+        /** Whether the readahead thread has been started. */
+        bool m_bReadaheadStarted;
+        /** Lock for all of the above. */
+        Spinlock m_ReadaheadLock;
+        /** Posted once for each readahead queued. */
+        Semaphore m_ReadaheadWaiting;
 };
 
 /** @} */
@@ -20,6 +20,7 @@
 #include "Pipe.h"
 #include "Filesystem.h"
 #include <utilities/ZombieQueue.h>
+#include <LockGuard.h>
 
 class ZombiePipe : public ZombieObject
 {
@@ -36,8 +37,9 @@ class ZombiePipe : public ZombieObject
 };
 
 Pipe::Pipe() :
-    File(), m_bIsAnonymous(true), m_bIsEOF(false), m_BufLen(0),
-    m_BufAvailable(PIPE_BUF_MAX), m_Front(0), m_Back(0)
+    File(), m_bIsAnonymous(true), m_bIsEOF(false), m_Buffer(new uint8_t[PIPE_BUF_MAX]),
+    m_Head(0), m_Tail(0), m_ReadLock(false), m_WriteLock(false), m_DataSem(0), m_SpaceSem(0),
+    m_nDataWaiters(0), m_nSpaceWaiters(0), m_nSpaceSelects(0), m_SpaceWanted(0)
 {
 }
 
@@ -45,130 +47,193 @@ Pipe::Pipe(String name, Time accessedTime, Time modifiedTime, Time creationTime,
            uintptr_t inode, Filesystem *pFs, size_t size, File *pParent,
            bool bIsAnonymous) :
     File(name,accessedTime,modifiedTime,creationTime,inode,pFs,size,pParent),
-    m_bIsAnonymous(bIsAnonymous), m_bIsEOF(false), m_BufLen(0),
-    m_BufAvailable(PIPE_BUF_MAX), m_Front(0), m_Back(0)
+    m_bIsAnonymous(bIsAnonymous), m_bIsEOF(false), m_Buffer(new uint8_t[PIPE_BUF_MAX]),
+    m_Head(0), m_Tail(0), m_ReadLock(false), m_WriteLock(false), m_DataSem(0), m_SpaceSem(0),
+    m_nDataWaiters(0), m_nSpaceWaiters(0), m_nSpaceSelects(0), m_SpaceWanted(0)
 {
 }
 
 Pipe::~Pipe()
 {
+    delete [] m_Buffer;
+}
+
+bool Pipe::wait(Semaphore &sem, volatile size_t &nWaiters, size_t timeout)
+{
+    bool bResult = sem.acquire(1, timeout);
+    __sync_fetch_and_sub(&nWaiters, 1);
+    return bResult;
+}
+
+void Pipe::wake(Semaphore &sem, volatile size_t &nWaiters)
+{
+    // Pairs with the barrier between registering as a waiter and checking
+    // the byte counts in read() and write(): either the waiter sees our
+    // update, or we see the waiter. A spare token only causes a recheck.
+    __sync_synchronize();
+    size_t n = nWaiters;
+    if (n)
+        sem.release(n);
 }
 
 int Pipe::select(bool bWriting, int timeout)
 {
-    if(timeout)
+    while (true)
     {
-        if(bWriting)
+        if (bWriting)
         {
-            if(m_BufAvailable.acquire(1, timeout))
-            {
-                m_BufAvailable.release();
+            if (used() < PIPE_BUF_MAX)
                 return true;
-            }
         }
         else
         {
-            if(m_BufLen.acquire(1, timeout))
-            {
-                m_BufLen.release();
-                return true;
-            }
-        }
-    }
-    else
-    {
-        if(bWriting)
-        {
-            if(m_BufAvailable.tryAcquire())
-            {
-                m_BufAvailable.release();
+            if (used() || m_bIsEOF)
                 return true;
-            }
         }
+
+        if (!timeout)
+            return false;
+
+        // Register, then check again so a wakeup can't slip past us. Any
+        // space at all will do for us, whatever a blocked writer needs.
+        Semaphore &sem = bWriting ? m_SpaceSem : m_DataSem;
+        volatile size_t &nWaiters = bWriting ? m_nSpaceWaiters : m_nDataWaiters;
+        if (bWriting)
+            __sync_fetch_and_add(&m_nSpaceSelects, 1);
+        __sync_fetch_and_add(&nWaiters, 1);
+        __sync_synchronize();
+
+        bool bWoken = true;
+        if ((bWriting && used() < PIPE_BUF_MAX) || (!bWriting && (used() || m_bIsEOF)))
+            __sync_fetch_and_sub(&nWaiters, 1);
         else
-        {
-            if(m_BufLen.tryAcquire())
-            {
-                m_BufLen.release();
-                return true;
-            }
-        }
-    }
+            bWoken = wait(sem, nWaiters, timeout);
 
-    return false;
+        if (bWriting)
+            __sync_fetch_and_sub(&m_nSpaceSelects, 1);
+
+        if (!bWoken)
+            return false;
+    }
 }
 
 uint64_t Pipe::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
 {
-    uint64_t n = 0;
-    uint8_t *pBuf = reinterpret_cast<uint8_t*>(buffer);
-    while (size)
+    if (!size)
+        return 0;
+
+    LockGuard<Mutex> guard(m_ReadLock);
+
+    // Wait for there to be something to read. Unlike a file, a pipe hands
+    // back whatever is there rather than waiting to fill the whole buffer.
+    size_t avail;
+    while (!(avail = used()))
     {
-        if (m_bIsEOF)
-        {
-            // If EOF has been signalled or we already have some data,
-            // we mustn't block, so tentatively attempt to tryAcquire until
-            // it fails.
-            if (!m_BufLen.tryAcquire())
-            {
-                // No data left and currently EOF - END.
-                return n;
-            }
+        if (m_bIsEOF || !bCanBlock)
+            return 0;
 
-            // Otherwise, we may have an un-acked EOF.
-            /// \note There is a possibility that the pipe is actually full here
-            ///       and that, should this return zero, we'll lose the data in
-            ///       the pipe...
-            if (m_Front == m_Back)
-            {
-                return n;
-            }
-        }
-        else
+        __sync_fetch_and_add(&m_nDataWaiters, 1);
+        __sync_synchronize();
+        if (used() || m_bIsEOF)
         {
-            // EOF not signalled, so do a blocking wait on data, if we can.
-            if(bCanBlock)
-                m_BufLen.acquire();
-            else
-            {
-                if(!m_BufLen.tryAcquire())
-                {
-                    return n;
-                }
-            }
-
-            // Is EOF signalled (is this why we were woken?)
-            if (m_bIsEOF && (m_Front == m_Back))
-            {
-                // Yes, the next call will probably return zero.
-                return n;
-            }
+            __sync_fetch_and_sub(&m_nDataWaiters, 1);
+            continue;
         }
 
-        // Otherwise, there is data available. If m_Front == m_Back, the
-        // pipe is currently *full*.
-        pBuf[n++] = m_Buffer[m_Front];
-        m_Front = (m_Front+1) % PIPE_BUF_MAX;
-        m_BufAvailable.release();
-        size --;
+        wait(m_DataSem, m_nDataWaiters);
     }
+
+    // Copy out in at most two spans: up to the end of the ring, then from
+    // its start.
+    size_t n = size < avail ? size : avail;
+    size_t offset = m_Tail & (PIPE_BUF_MAX - 1);
+    size_t first = PIPE_BUF_MAX - offset;
+    if (first > n)
+        first = n;
+
+    uint8_t *pBuf = reinterpret_cast<uint8_t*>(buffer);
+    memcpy(pBuf, m_Buffer + offset, first);
+    if (n > first)
+        memcpy(pBuf + first, m_Buffer, n - first);
+
+    // Make sure the copy is done before the writer may reuse the space.
+    __sync_synchronize();
+    m_Tail += n;
+
+    // Pairs with the barrier a blocked writer takes after registering: the
+    // waiter count must not be read before the new tail is visible, or both
+    // sides can miss each other.
+    __sync_synchronize();
+    if (m_nSpaceWaiters && (m_nSpaceSelects || (PIPE_BUF_MAX - used()) >= m_SpaceWanted))
+        wake(m_SpaceSem, m_nSpaceWaiters);
+
     return n;
 }
 
 uint64_t Pipe::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
 {
+    if (!size)
+        return 0;
+
+    LockGuard<Mutex> guard(m_WriteLock);
+
+    // Holding m_WriteLock for the whole write keeps it from interleaving
+    // with any other writer. Small writes also wait until they fit in one
+    // go, so that a non-blocking one is all-or-nothing.
+    size_t atomic = size <= PIPE_BUF_ATOMIC ? size : 1;
+
+    const uint8_t *pBuf = reinterpret_cast<const uint8_t*>(buffer);
     uint64_t n = 0;
-    uint8_t *pBuf = reinterpret_cast<uint8_t*>(buffer);
-    while (size)
+    while (n < size)
     {
-        m_BufAvailable.acquire();
-        m_Buffer[m_Back] = pBuf[n++];
-        m_Back = (m_Back+1) % PIPE_BUF_MAX;
-        m_BufLen.release();
-        size --;
+        size_t space = PIPE_BUF_MAX - used();
+        if (space < atomic)
+        {
+            if (!bCanBlock)
+                break;
+
+            m_SpaceWanted = atomic;
+            __sync_fetch_and_add(&m_nSpaceWaiters, 1);
+            __sync_synchronize();
+            if ((PIPE_BUF_MAX - used()) >= atomic)
+                __sync_fetch_and_sub(&m_nSpaceWaiters, 1);
+            else
+                wait(m_SpaceSem, m_nSpaceWaiters);
+
+            // Only we set it (under m_WriteLock), and the next writer may
+            // want less.
+            m_SpaceWanted = 0;
+            continue;
+        }
+
+        size_t chunk = size - n;
+        if (chunk > space)
+            chunk = space;
+
+        size_t offset = m_Head & (PIPE_BUF_MAX - 1);
+        size_t first = PIPE_BUF_MAX - offset;
+        if (first > chunk)
+            first = chunk;
+
+        memcpy(m_Buffer + offset, pBuf + n, first);
+        if (chunk > first)
+            memcpy(m_Buffer, pBuf + n + first, chunk - first);
+
+        // Publish the data only once it is all in place.
+        __sync_synchronize();
+        m_Head += chunk;
+        __sync_synchronize();
+        n += chunk;
+
+        // Once the first chunk is in, the rest of a large write needn't
+        // wait for more than a byte of space at a time.
+        atomic = 1;
+
+        wake(m_DataSem, m_nDataWaiters);
     }
 
-    dataChanged();
+    if (n)
+        dataChanged();
     return n;
 }
 
@@ -178,10 +243,10 @@ void Pipe::increaseRefCount(bool bIsWriter)
     {
         if (m_bIsEOF)
         {
-            // Start the pipe again.
+            // Start the pipe again, throwing away anything left over.
+            LockGuard<Mutex> guard(m_ReadLock);
             m_bIsEOF = false;
-            while (m_BufLen.tryAcquire()) ;
-            m_Front = m_Back = 0;
+            m_Tail = m_Head;
         }
         m_nWriters++;
     }
@@ -214,12 +279,9 @@ void Pipe::decreaseRefCount(bool bIsWriter)
             m_nWriters --;
             if (m_nWriters == 0)
             {
+                // Wake any readers up so they can see the EOF.
                 m_bIsEOF = true;
-                if (m_Front == m_Back)
-                {
-                    // No data available - post the m_BufLen semaphore to wake any readers up.
-                    m_BufLen.release();
-                }
+                wake(m_DataSem, m_nDataWaiters);
 
                 bDataChanged = true;
             }
@@ -25,9 +25,16 @@
 #include <utilities/String.h>
 #include <utilities/RadixTree.h>
 #include <process/Semaphore.h>
+#include <process/Mutex.h>
 #include "File.h"
 
-#define PIPE_BUF_MAX 2048
+/** Capacity of a pipe, in bytes. Must be a power of two. */
+#define PIPE_BUF_MAX 65536
+
+/** Writes of at most this many bytes are atomic: they are never interleaved
+ *  with other writers, and a non-blocking one either writes everything or
+ *  nothing. Matches PIPE_BUF in the POSIX headers. */
+#define PIPE_BUF_ATOMIC 512
 
 /** A first-in-first-out buffer node. */
 class Pipe : public File
@@ -81,11 +88,46 @@ protected:
     /** Have we reached EOF? */
     volatile bool m_bIsEOF;
 
-    /** The implements needed to create a ring buffer. */
-    Semaphore m_BufLen;
-    Semaphore m_BufAvailable;
-    uint8_t m_Buffer[PIPE_BUF_MAX];
-    uintptr_t m_Front, m_Back;
+    /** Bytes currently in the buffer. */
+    size_t used() const
+    {
+        return m_Head - m_Tail;
+    }
+
+    /** Sleeps on sem, registered in nWaiters, until whatever the caller is
+     *  waiting for may have happened; the caller must check again. Returns
+     *  false on timeout. */
+    bool wait(Semaphore &sem, volatile size_t &nWaiters, size_t timeout = 0);
+
+    /** Wakes everyone registered in nWaiters. */
+    static void wake(Semaphore &sem, volatile size_t &nWaiters);
+
+    /** The ring buffer. m_Head and m_Tail count every byte ever written and
+     *  read; only the writer holding m_WriteLock moves m_Head and only the
+     *  reader holding m_ReadLock moves m_Tail, so a reader and a writer
+     *  never contend with each other. */
+    uint8_t *m_Buffer;
+    volatile size_t m_Head;
+    volatile size_t m_Tail;
+
+    /** Serialise readers, and writers, amongst themselves. */
+    Mutex m_ReadLock;
+    Mutex m_WriteLock;
+
+    /** Readers waiting for data and writers waiting for space sleep on
+     *  these; they are released once per waiter whenever the byte counts
+     *  move, rather than once per byte. */
+    Semaphore m_DataSem;
+    Semaphore m_SpaceSem;
+    volatile size_t m_nDataWaiters;
+    volatile size_t m_nSpaceWaiters;
+
+    /** Number of m_nSpaceWaiters in select(), which want any space at all. */
+    volatile size_t m_nSpaceSelects;
+
+    /** Bytes of free space the writer waiting in write() needs before it is
+     *  woken, or 0. Only changed with m_WriteLock held. */
+    volatile size_t m_SpaceWanted;
 };
 
 #endif
@@ -18,6 +18,8 @@
  */
 
 #include "VFS.h"
+#include "DentryCache.h"
+#include "MemoryMappedFile.h"
 #include <Log.h>
 #include <Module.h>
 #include <utilities/utility.h>
@@ -169,7 +171,9 @@ void VFS::removeAllAliases(Filesystem *pFs)
         
         m_Mounts.remove(pFs);
     }
-    
+
+    DentryCache::instance().invalidate(pFs);
+    MemoryMapManager::instance().cancelReadahead(pFs);
     delete pFs;
 }
 
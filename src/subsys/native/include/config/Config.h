@@ -65,8 +65,46 @@ namespace Config
             size_t m_nResultIdx;
     };
 
+    /// A prepared statement with bound parameters, read one row at a time.
+    /// Preparing the same SQL again reuses the kernel's compiled statement.
+    /// Parameters are numbered from 1, as in SQL ("?1").
+    class Cursor
+    {
+        public:
+            Cursor(size_t nCursorIdx) : m_nCursorIdx(nCursorIdx), m_bError(false) {}
+            ~Cursor();
+
+            /// Binds a number to the n'th parameter
+            bool bind(size_t n, long value);
+            /// Binds a string to the n'th parameter
+            bool bind(size_t n, const char *value);
+
+            /// Steps to the next row; returns false when done or on error
+            bool next();
+
+            /// Returns true unless the last operation failed
+            bool succeeded();
+            /// Returns the error message
+            std::string errorMessage(size_t buffSz = 256);
+
+            /// Returns the value in column 'col' of the current row, in string form
+            std::string getStr(size_t col, size_t buffSz = 256);
+            /// Returns the value in column 'col' of the current row, in number form
+            size_t getNum(size_t col);
+
+        private:
+            Cursor(const Cursor &);
+            Cursor &operator = (const Cursor &);
+
+            size_t m_nCursorIdx;
+            bool m_bError;
+    };
+
     /// Performs a select/update/insert/whatever query on the database
     Result *query(const char *sql);
+
+    /// Prepares a statement for binding and stepping through
+    Cursor *prepare(const char *sql);
 };
 
 #endif
@@ -129,3 +129,70 @@ Config::Result *Config::query(const char *sql)
     // Return a new Result
     return new Result(resultIdx);
 }
+
+Config::Cursor::~Cursor()
+{
+    pedigree_config_free_cursor(m_nCursorIdx);
+}
+
+bool Config::Cursor::bind(size_t n, long value)
+{
+    m_bError = pedigree_config_bind_num(m_nCursorIdx, n, value) != 0;
+    return !m_bError;
+}
+
+bool Config::Cursor::bind(size_t n, const char *value)
+{
+    m_bError = pedigree_config_bind_str(m_nCursorIdx, n, value) != 0;
+    return !m_bError;
+}
+
+bool Config::Cursor::next()
+{
+    int ret = pedigree_config_step(m_nCursorIdx);
+    m_bError = ret < 0;
+    return ret > 0;
+}
+
+bool Config::Cursor::succeeded()
+{
+    return !m_bError;
+}
+
+std::string Config::Cursor::errorMessage(size_t buffSz)
+{
+    char *pBuffer = new char [buffSz];
+    memset(pBuffer, 0, buffSz);
+    pedigree_config_cursor_error(m_nCursorIdx, pBuffer, buffSz);
+    std::string str(pBuffer);
+    delete [] pBuffer;
+    return str;
+}
+
+std::string Config::Cursor::getStr(size_t col, size_t buffSz)
+{
+    char *pBuffer = new char [buffSz];
+    memset(pBuffer, 0, buffSz);
+    pedigree_config_col_str(m_nCursorIdx, col, pBuffer, buffSz);
+    std::string str(pBuffer);
+    delete [] pBuffer;
+    return str;
+}
+
+size_t Config::Cursor::getNum(size_t col)
+{
+    return pedigree_config_col_num(m_nCursorIdx, col);
+}
+
+Config::Cursor *Config::prepare(const char *sql)
+{
+    // Check for null or empty queries
+    if(!sql || !*sql)
+        return 0;
+
+    int cursorIdx = pedigree_config_prepare(sql);
+    if(cursorIdx < 0)
+        return 0;
+
+    return new Cursor(cursorIdx);
+}
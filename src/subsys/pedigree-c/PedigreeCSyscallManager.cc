@@ -107,6 +107,25 @@ uintptr_t PedigreeCSyscallManager::syscall(SyscallState &state)
         case PEDIGREE_CONFIG_GET_ERROR_MESSAGE:
             pedigree_config_get_error_message(p1, reinterpret_cast<char*>(p2), p3);
             return 0;
+        case PEDIGREE_CONFIG_PREPARE:
+            return pedigree_config_prepare(reinterpret_cast<const char*>(p1));
+        case PEDIGREE_CONFIG_BIND_NUM:
+            return pedigree_config_bind_num(p1, p2, static_cast<long>(p3));
+        case PEDIGREE_CONFIG_BIND_STR:
+            return pedigree_config_bind_str(p1, p2, reinterpret_cast<const char*>(p3));
+        case PEDIGREE_CONFIG_STEP:
+            return pedigree_config_step(p1);
+        case PEDIGREE_CONFIG_COL_STR:
+            pedigree_config_col_str(p1, p2, reinterpret_cast<char*>(p3), p4);
+            return 0;
+        case PEDIGREE_CONFIG_COL_NUM:
+            return pedigree_config_col_num(p1, p2);
+        case PEDIGREE_CONFIG_CURSOR_ERROR:
+            pedigree_config_cursor_error(p1, reinterpret_cast<char*>(p2), p3);
+            return 0;
+        case PEDIGREE_CONFIG_FREE_CURSOR:
+            pedigree_config_free_cursor(p1);
+            return 0;
         case PEDIGREE_MODULE_LOAD:
             pedigree_module_load(reinterpret_cast<char*>(p1));
             return 0;
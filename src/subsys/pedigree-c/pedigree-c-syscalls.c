@@ -172,6 +172,46 @@ char *pedigree_config_escape_string(const char *str)
     return bufferStart;
 }
 
+int pedigree_config_prepare(const char *sql)
+{
+    return syscall1(PEDIGREE_CONFIG_PREPARE, (long)sql);
+}
+
+int pedigree_config_bind_num(size_t cursorIdx, size_t n, long value)
+{
+    return syscall3(PEDIGREE_CONFIG_BIND_NUM, cursorIdx, n, value);
+}
+
+int pedigree_config_bind_str(size_t cursorIdx, size_t n, const char *value)
+{
+    return syscall3(PEDIGREE_CONFIG_BIND_STR, cursorIdx, n, (long)value);
+}
+
+int pedigree_config_step(size_t cursorIdx)
+{
+    return syscall1(PEDIGREE_CONFIG_STEP, cursorIdx);
+}
+
+void pedigree_config_col_str(size_t cursorIdx, size_t col, char *buf, size_t bufsz)
+{
+    syscall4(PEDIGREE_CONFIG_COL_STR, cursorIdx, col, (long)buf, bufsz);
+}
+
+int pedigree_config_col_num(size_t cursorIdx, size_t col)
+{
+    return syscall2(PEDIGREE_CONFIG_COL_NUM, cursorIdx, col);
+}
+
+void pedigree_config_cursor_error(size_t cursorIdx, char *buf, size_t bufsz)
+{
+    syscall3(PEDIGREE_CONFIG_CURSOR_ERROR, cursorIdx, (long)buf, bufsz);
+}
+
+void pedigree_config_free_cursor(size_t cursorIdx)
+{
+    syscall1(PEDIGREE_CONFIG_FREE_CURSOR, cursorIdx);
+}
+
 // Pedigree-specific function: login with given uid and password.
 int login(uid_t uid, const char *password)
 {
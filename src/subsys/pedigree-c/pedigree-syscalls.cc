@@ -25,6 +25,10 @@
 #include <vfs/VFS.h>
 #include <Log.h>
 #include <syscallError.h>
+#include <LockGuard.h>
+#include <process/Mutex.h>
+#include <process/Process.h>
+#include <processor/Syscalls.h>
 
 #include <machine/InputManager.h>
 #include <machine/KeymapManager.h>
@@ -69,6 +73,46 @@ struct sixargs
 #define MAX_RESULTS 32
 static Config::Result *g_Results[MAX_RESULTS];
 
+/** A process' prepared statements. Cursor handles index this table, so one
+ *  process can't reach another's cursors, and they are freed with the
+ *  Process if it exits without freeing them itself. */
+class ConfigCursors : public ProcessServiceData
+{
+public:
+    ConfigCursors() : m_Lock(false)
+    {
+        memset(m_pCursors, 0, sizeof(m_pCursors));
+    }
+
+    virtual ~ConfigCursors()
+    {
+        for (size_t i = 0; i < MAX_RESULTS; i++)
+            delete m_pCursors[i];
+    }
+
+    /** Held across each cursor call, so a cursor can't be freed while
+     *  another thread of the process is still using it. */
+    Mutex m_Lock;
+    Config::Cursor *m_pCursors[MAX_RESULTS];
+};
+
+/** Gets the current process' cursor table, creating it if asked to. */
+static ConfigCursors *getCursors(bool bCreate)
+{
+    Process *pProcess = Processor::information().getCurrentThread()->getParent();
+    ConfigCursors *pCursors = static_cast<ConfigCursors*>(pProcess->getServiceData(pedigree_c));
+    if (pCursors || !bCreate)
+        return pCursors;
+
+    pCursors = new ConfigCursors;
+    if (!pProcess->installServiceData(pedigree_c, pCursors))
+    {
+        delete pCursors;
+        pCursors = static_cast<ConfigCursors*>(pProcess->getServiceData(pedigree_c));
+    }
+    return pCursors;
+}
+
 void pedigree_config_init()
 {
     memset(g_Results, 0, sizeof(Config::Result*)*MAX_RESULTS);
@@ -187,6 +231,125 @@ void pedigree_config_get_error_message(size_t resultIdx, char *buf, int buflen)
     strncpy(buf, g_Results[resultIdx]->errorMessage(), buflen);
 }
 
+/** Finds one of the current process' cursors. The caller must hold the
+ *  table's lock while it uses the cursor. */
+static Config::Cursor *getCursor(ConfigCursors *pCursors, size_t cursorIdx)
+{
+    if (!pCursors || cursorIdx >= MAX_RESULTS)
+        return 0;
+    return pCursors->m_pCursors[cursorIdx];
+}
+
+int pedigree_config_prepare(const char *sql)
+{
+    // Check for user performing the query: only root has config access
+    if(Processor::information().getCurrentThread()->getParent()->getUser()->getId())
+        return -1;
+
+    ConfigCursors *pCursors = getCursors(true);
+    if (!pCursors)
+        return -1;
+
+    LockGuard<Mutex> guard(pCursors->m_Lock);
+    for (size_t i = 0; i < MAX_RESULTS; i++)
+    {
+        if (pCursors->m_pCursors[i] == 0)
+        {
+            pCursors->m_pCursors[i] = Config::instance().prepare(sql);
+            return pCursors->m_pCursors[i] ? static_cast<int>(i) : -1;
+        }
+    }
+    ERROR("Insufficient free cursors.");
+    return -1;
+}
+
+int pedigree_config_bind_num(size_t cursorIdx, size_t n, long value)
+{
+    ConfigCursors *pCursors = getCursors(false);
+    if (!pCursors)
+        return -1;
+    LockGuard<Mutex> guard(pCursors->m_Lock);
+    Config::Cursor *pCursor = getCursor(pCursors, cursorIdx);
+    if (!pCursor)
+        return -1;
+    return pCursor->bind(n, static_cast<int64_t>(value)) ? 0 : -1;
+}
+
+int pedigree_config_bind_str(size_t cursorIdx, size_t n, const char *value)
+{
+    ConfigCursors *pCursors = getCursors(false);
+    if (!pCursors)
+        return -1;
+    LockGuard<Mutex> guard(pCursors->m_Lock);
+    Config::Cursor *pCursor = getCursor(pCursors, cursorIdx);
+    if (!pCursor)
+        return -1;
+    return pCursor->bind(n, value) ? 0 : -1;
+}
+
+int pedigree_config_step(size_t cursorIdx)
+{
+    ConfigCursors *pCursors = getCursors(false);
+    if (!pCursors)
+        return -1;
+    LockGuard<Mutex> guard(pCursors->m_Lock);
+    Config::Cursor *pCursor = getCursor(pCursors, cursorIdx);
+    if (!pCursor)
+        return -1;
+    if (pCursor->next())
+        return 1;
+    return pCursor->succeeded() ? 0 : -1;
+}
+
+void pedigree_config_col_str(size_t cursorIdx, size_t col, char *buf, size_t bufsz)
+{
+    ConfigCursors *pCursors = getCursors(false);
+    if (!pCursors)
+        return;
+    LockGuard<Mutex> guard(pCursors->m_Lock);
+    Config::Cursor *pCursor = getCursor(pCursors, cursorIdx);
+    if (!pCursor)
+        return;
+    strncpy(buf, pCursor->getStr(col), bufsz);
+}
+
+int pedigree_config_col_num(size_t cursorIdx, size_t col)
+{
+    ConfigCursors *pCursors = getCursors(false);
+    if (!pCursors)
+        return 0;
+    LockGuard<Mutex> guard(pCursors->m_Lock);
+    Config::Cursor *pCursor = getCursor(pCursors, cursorIdx);
+    if (!pCursor)
+        return 0;
+    return static_cast<int>(pCursor->getNum(col));
+}
+
+void pedigree_config_cursor_error(size_t cursorIdx, char *buf, size_t bufsz)
+{
+    ConfigCursors *pCursors = getCursors(false);
+    if (!pCursors)
+        return;
+    LockGuard<Mutex> guard(pCursors->m_Lock);
+    Config::Cursor *pCursor = getCursor(pCursors, cursorIdx);
+    if (!pCursor)
+        return;
+    strncpy(buf, pCursor->errorMessage(), bufsz);
+}
+
+void pedigree_config_free_cursor(size_t cursorIdx)
+{
+    ConfigCursors *pCursors = getCursors(false);
+    if (!pCursors)
+        return;
+    LockGuard<Mutex> guard(pCursors->m_Lock);
+    Config::Cursor *pCursor = getCursor(pCursors, cursorIdx);
+    if (!pCursor)
+        return;
+    delete pCursor;
+    pCursors->m_pCursors[cursorIdx] = 0;
+}
+
 // Module handling functions
 
 // Load a module
@@ -66,6 +66,15 @@ int pedigree_config_numrows(size_t resultIdx);
 int pedigree_config_was_successful(size_t resultIdx);
 void pedigree_config_get_error_message(size_t resultIdx, char *buf, int buflen);
 
+int pedigree_config_prepare(const char *sql);
+int pedigree_config_bind_num(size_t cursorIdx, size_t n, long value);
+int pedigree_config_bind_str(size_t cursorIdx, size_t n, const char *value);
+int pedigree_config_step(size_t cursorIdx);
+void pedigree_config_col_str(size_t cursorIdx, size_t col, char *buf, size_t bufsz);
+int pedigree_config_col_num(size_t cursorIdx, size_t col);
+void pedigree_config_cursor_error(size_t cursorIdx, char *buf, size_t bufsz);
+void pedigree_config_free_cursor(size_t cursorIdx);
+
 /** Pedigree generic system calls **/
 
 int pedigree_login(int uid, const char *password);
@@ -53,6 +53,15 @@
 
 #define PEDIGREE_SYS_REQUEST_MEM            27
 
+#define PEDIGREE_CONFIG_PREPARE             28
+#define PEDIGREE_CONFIG_BIND_NUM            29
+#define PEDIGREE_CONFIG_BIND_STR            30
+#define PEDIGREE_CONFIG_STEP                31
+#define PEDIGREE_CONFIG_COL_STR             32
+#define PEDIGREE_CONFIG_COL_NUM             33
+#define PEDIGREE_CONFIG_CURSOR_ERROR        34
+#define PEDIGREE_CONFIG_FREE_CURSOR         35
+
 #define PEDIGREE_EVENT_RETURN               60
 
 #define PEDIGREE_GFX_GET_PROVIDER           64
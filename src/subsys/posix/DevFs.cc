@@ -30,6 +30,11 @@
 #include <graphics/GraphicsService.h>
 
 #include <utilities/utility.h>
+#include <process/Profiler.h>
+#include <processor/SyscallTracer.h>
+#include <process/CompressedPageStore.h>
+#include <vfs/MemoryMappedFile.h>
+#include <LockGuard.h>
 
 #include <sys/fb.h>
 
@@ -103,6 +108,123 @@ uint64_t ZeroFile::write(uint64_t location, uint64_t size, uintptr_t buffer, boo
     return size;
 }
 
+uint64_t ProfileFile::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    LockGuard<Mutex> guard(m_Lock);
+
+    if(location == 0)
+    {
+        m_Folded.free();
+        Profiler::instance().fold(m_Folded);
+    }
+
+    if(location >= m_Folded.length())
+        return 0;
+    if(size > m_Folded.length() - location)
+        size = m_Folded.length() - location;
+
+    const char *pFolded = m_Folded;
+    memcpy(reinterpret_cast<void *>(buffer), pFolded + location, size);
+    return size;
+}
+
+uint64_t ProfileFile::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    char command[32];
+    size_t len = size < sizeof(command) - 1 ? size : sizeof(command) - 1;
+    memcpy(command, reinterpret_cast<const void *>(buffer), len);
+    command[len] = 0;
+
+    if(!strncmp(command, "start", 5))
+    {
+        size_t rate = strtoul(command + 5, 0, 10);
+        if(!Profiler::instance().start(rate ? rate : 1))
+            return 0;
+    }
+    else if(!strncmp(command, "stop", 4))
+        Profiler::instance().stop();
+    else
+        return 0;
+
+    return size;
+}
+
+uint64_t SyscallsFile::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    LockGuard<Mutex> guard(m_Lock);
+
+    if(location == 0)
+    {
+        m_Report.free();
+        SyscallTracer::instance().report(m_Report);
+    }
+
+    if(location >= m_Report.length())
+        return 0;
+    if(size > m_Report.length() - location)
+        size = m_Report.length() - location;
+
+    const char *pReport = m_Report;
+    memcpy(reinterpret_cast<void *>(buffer), pReport + location, size);
+    return size;
+}
+
+uint64_t SyscallsFile::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    const char *pCommand = reinterpret_cast<const char *>(buffer);
+
+    if(size >= 6 && !strncmp(pCommand, "enable", 6))
+    {
+        if(!SyscallTracer::instance().enable())
+            return 0;
+    }
+    else if(size >= 7 && !strncmp(pCommand, "disable", 7))
+        SyscallTracer::instance().disable();
+    else
+        return 0;
+
+    return size;
+}
+
+uint64_t CompressedFile::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    LockGuard<Mutex> guard(m_Lock);
+
+    if(location == 0)
+    {
+        CompressedPageStore::Statistics stats;
+        CompressedPageStore::instance().getStatistics(stats);
+
+        m_Report.sprintf("pages %lu\ncompressed-bytes %lu\nslab-bytes %lu\nrejected %lu\nloads %lu\n",
+                         static_cast<unsigned long>(stats.nPages),
+                         static_cast<unsigned long>(stats.compressedBytes),
+                         static_cast<unsigned long>(stats.slabBytes),
+                         static_cast<unsigned long>(stats.nRejected),
+                         static_cast<unsigned long>(stats.nLoads));
+    }
+
+    if(location >= m_Report.length())
+        return 0;
+    if(size > m_Report.length() - location)
+        size = m_Report.length() - location;
+
+    const char *pReport = m_Report;
+    memcpy(reinterpret_cast<void *>(buffer), pReport + location, size);
+    return size;
+}
+
+uint64_t CompressedFile::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    const char *pCommand = reinterpret_cast<const char *>(buffer);
+
+    if(size >= 7 && !strncmp(pCommand, "compact", 7))
+        MemoryMapManager::instance().compactCurrent();
+    else
+        return 0;
+
+    return size;
+}
+
 FramebufferFile::FramebufferFile(String str, size_t inode, Filesystem *pParentFS, File *pParentNode) :
     File(str, 0, 0, 0, inode, pParentFS, 0, pParentNode), m_pProvider(0), m_bTextMode(false), m_nDepth(0)
 {
@@ -335,6 +457,18 @@ bool DevFs::initialise(Disk *pDisk)
     RandomFile *pRandom = new RandomFile(String("urandom"), ++baseInode, this, m_pRoot);
     m_pRoot->addEntry(pRandom->getName(), pRandom);
 
+    // Sampling profiler.
+    ProfileFile *pProfile = new ProfileFile(String("profile"), ++baseInode, this, m_pRoot);
+    m_pRoot->addEntry(pProfile->getName(), pProfile);
+
+    // Syscall statistics.
+    SyscallsFile *pSyscalls = new SyscallsFile(String("syscalls"), ++baseInode, this, m_pRoot);
+    m_pRoot->addEntry(pSyscalls->getName(), pSyscalls);
+
+    // Compressed page store statistics.
+    CompressedFile *pCompressed = new CompressedFile(String("compressed"), ++baseInode, this, m_pRoot);
+    m_pRoot->addEntry(pCompressed->getName(), pCompressed);
+
     // Create /dev/fb for the framebuffer device.
     FramebufferFile *pFb = new FramebufferFile(String("fb"), ++baseInode, this, m_pRoot);
     if(pFb->initialise())
@@ -23,6 +23,7 @@
 #include <vfs/Filesystem.h>
 #include <vfs/Directory.h>
 #include <vfs/File.h>
+#include <process/Mutex.h>
 
 #include <console/TextIO.h>
 
@@ -68,6 +69,67 @@ public:
     uint64_t write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock = true);
 };
 
+/** Folded stacks from the sampling profiler. Writing "start [rate]" or
+ *  "stop" controls it. */
+class ProfileFile : public File
+{
+public:
+    ProfileFile(String str, size_t inode, Filesystem *pParentFS, File *pParentNode) :
+        File(str, 0, 0, 0, inode, pParentFS, 0, pParentNode), m_Folded(), m_Lock(false)
+    {}
+    ~ProfileFile()
+    {}
+
+    uint64_t read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock = true);
+    uint64_t write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock = true);
+
+private:
+    /** Snapshot of the folded stacks, taken by each read from offset 0 so
+     *  that a reader sees one consistent profile. */
+    String m_Folded;
+    Mutex m_Lock;
+};
+
+/** Syscall statistics from the SyscallTracer. Writing "enable" or
+ *  "disable" controls it. */
+class SyscallsFile : public File
+{
+public:
+    SyscallsFile(String str, size_t inode, Filesystem *pParentFS, File *pParentNode) :
+        File(str, 0, 0, 0, inode, pParentFS, 0, pParentNode), m_Report(), m_Lock(false)
+    {}
+    ~SyscallsFile()
+    {}
+
+    uint64_t read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock = true);
+    uint64_t write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock = true);
+
+private:
+    /** Snapshot of the report, taken by each read from offset 0. */
+    String m_Report;
+    Mutex m_Lock;
+};
+
+/** Compressed page store statistics. Writing "compact" compresses what it
+ *  can of the writer's own anonymous memory straight away. */
+class CompressedFile : public File
+{
+public:
+    CompressedFile(String str, size_t inode, Filesystem *pParentFS, File *pParentNode) :
+        File(str, 0, 0, 0, inode, pParentFS, 0, pParentNode), m_Report(), m_Lock(false)
+    {}
+    ~CompressedFile()
+    {}
+
+    uint64_t read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock = true);
+    uint64_t write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock = true);
+
+private:
+    /** Snapshot of the statistics, taken by each read from offset 0. */
+    String m_Report;
+    Mutex m_Lock;
+};
+
 class FramebufferFile : public File
 {
 public:
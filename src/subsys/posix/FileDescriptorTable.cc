@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "FileDescriptorTable.h"
+#include <utilities/utility.h>
+
+FileDescriptorTable::FileDescriptorTable() :
+    m_pTable(0), m_pInUse(0), m_pFull(0), m_nLimit(0)
+{
+    grow(InitialSize);
+}
+
+FileDescriptorTable::~FileDescriptorTable()
+{
+    delete [] m_pTable->pEntries;
+    delete m_pTable;
+
+    delete [] m_pInUse;
+    delete [] m_pFull;
+}
+
+void FileDescriptorTable::grow(size_t nSize)
+{
+    Table *pOld = m_pTable;
+    size_t nOldSize = pOld ? pOld->nSize : 0;
+    if(nSize <= nOldSize)
+        return;
+
+    // Grow geometrically, in whole summary words.
+    size_t nNewSize = nOldSize ? nOldSize : InitialSize;
+    while(nNewSize < nSize)
+        nNewSize *= 2;
+
+    size_t nOldWords = nOldSize / BitsPerWord;
+    size_t nNewWords = nNewSize / BitsPerWord;
+    size_t nOldSummary = (nOldWords + BitsPerWord - 1) / BitsPerWord;
+    size_t nNewSummary = (nNewWords + BitsPerWord - 1) / BitsPerWord;
+
+    Table *pNew = new Table;
+    pNew->nSize = nNewSize;
+    pNew->pEntries = new FileDescriptor*[nNewSize];
+    memset(pNew->pEntries, 0, nNewSize * sizeof(FileDescriptor*));
+
+    uintptr_t *pInUse = new uintptr_t[nNewWords];
+    uintptr_t *pFull = new uintptr_t[nNewSummary];
+    memset(pInUse, 0, nNewWords * sizeof(uintptr_t));
+    memset(pFull, 0, nNewSummary * sizeof(uintptr_t));
+
+    if(pOld)
+    {
+        memcpy(pNew->pEntries, pOld->pEntries, nOldSize * sizeof(FileDescriptor*));
+        memcpy(pInUse, m_pInUse, nOldWords * sizeof(uintptr_t));
+        memcpy(pFull, m_pFull, nOldSummary * sizeof(uintptr_t));
+    }
+
+    delete [] m_pInUse;
+    delete [] m_pFull;
+    m_pInUse = pInUse;
+    m_pFull = pFull;
+
+    if(pOld)
+    {
+        delete [] pOld->pEntries;
+        delete pOld;
+    }
+    m_pTable = pNew;
+}
+
+void FileDescriptorTable::updateSummary(size_t w)
+{
+    uintptr_t bit = static_cast<uintptr_t>(1) << (w % BitsPerWord);
+    if(m_pInUse[w] == ~static_cast<uintptr_t>(0))
+        m_pFull[w / BitsPerWord] |= bit;
+    else
+        m_pFull[w / BitsPerWord] &= ~bit;
+}
+
+size_t FileDescriptorTable::allocate()
+{
+    size_t nWords = m_pTable->nSize / BitsPerWord;
+    size_t nSummary = (nWords + BitsPerWord - 1) / BitsPerWord;
+
+    size_t fd = m_pTable->nSize;
+    for(size_t s = 0; s < nSummary; ++s)
+    {
+        if(m_pFull[s] == ~static_cast<uintptr_t>(0))
+            continue;
+
+        size_t w = (s * BitsPerWord) + __builtin_ctzl(~m_pFull[s]);
+        if(w >= nWords)
+            break;
+
+        fd = (w * BitsPerWord) + __builtin_ctzl(~m_pInUse[w]);
+        break;
+    }
+
+    // No free slot: this will grow the table.
+    reserve(fd);
+    return fd;
+}
+
+void FileDescriptorTable::reserve(size_t fd)
+{
+    if(fd >= m_pTable->nSize)
+        grow(fd + 1);
+
+    size_t w = fd / BitsPerWord;
+    m_pInUse[w] |= static_cast<uintptr_t>(1) << (fd % BitsPerWord);
+    updateSummary(w);
+
+    if(fd >= m_nLimit)
+        m_nLimit = fd + 1;
+}
+
+FileDescriptor *FileDescriptorTable::release(size_t fd)
+{
+    if(fd >= m_pTable->nSize)
+        return 0;
+
+    size_t w = fd / BitsPerWord;
+    m_pInUse[w] &= ~(static_cast<uintptr_t>(1) << (fd % BitsPerWord));
+    updateSummary(w);
+
+    FileDescriptor *pFd = m_pTable->pEntries[fd];
+    m_pTable->pEntries[fd] = 0;
+    return pFd;
+}
+
+void FileDescriptorTable::set(size_t fd, FileDescriptor *pFd)
+{
+    if(fd >= m_pTable->nSize)
+        grow(fd + 1);
+    m_pTable->pEntries[fd] = pFd;
+}
+
+bool FileDescriptorTable::isAllocated(size_t fd) const
+{
+    if(fd >= m_pTable->nSize)
+        return false;
+    return m_pInUse[fd / BitsPerWord] & (static_cast<uintptr_t>(1) << (fd % BitsPerWord));
+}
+
+void FileDescriptorTable::copyFrom(const FileDescriptorTable &other)
+{
+    const Table *pOther = other.m_pTable;
+    grow(pOther->nSize);
+
+    Table *pTable = m_pTable;
+    size_t nWords = pOther->nSize / BitsPerWord;
+    size_t nSummary = (nWords + BitsPerWord - 1) / BitsPerWord;
+
+    clear();
+    memcpy(pTable->pEntries, pOther->pEntries, pOther->nSize * sizeof(FileDescriptor*));
+    memcpy(m_pInUse, other.m_pInUse, nWords * sizeof(uintptr_t));
+    memcpy(m_pFull, other.m_pFull, nSummary * sizeof(uintptr_t));
+    m_nLimit = other.m_nLimit;
+}
+
+void FileDescriptorTable::clear()
+{
+    Table *pTable = m_pTable;
+    size_t nWords = pTable->nSize / BitsPerWord;
+    size_t nSummary = (nWords + BitsPerWord - 1) / BitsPerWord;
+
+    memset(pTable->pEntries, 0, pTable->nSize * sizeof(FileDescriptor*));
+    memset(m_pInUse, 0, nWords * sizeof(uintptr_t));
+    memset(m_pFull, 0, nSummary * sizeof(uintptr_t));
+    m_nLimit = 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef POSIX_FILE_DESCRIPTOR_TABLE_H
+#define POSIX_FILE_DESCRIPTOR_TABLE_H
+
+#include <processor/types.h>
+
+class FileDescriptor;
+
+/**
+ * Dense, growable table of file descriptors.
+ *
+ * Descriptors are stored in a flat array indexed by fd number, so the
+ * lookup done by every I/O syscall is a bounds check and a load.
+ * Allocation always returns the lowest free descriptor (as POSIX
+ * requires), found through a two-level bitmap: one bit per descriptor, and
+ * one summary bit per word of the first level that is completely in use.
+ *
+ * The table is NOT thread safe - the owner serialises lookups against
+ * modifications, and keeps descriptors alive for as long as a lookup's
+ * result is in use.
+ */
+class FileDescriptorTable
+{
+    public:
+        FileDescriptorTable();
+        /** Frees the table storage. Does not delete any FileDescriptor. */
+        ~FileDescriptorTable();
+
+        /** Gets the descriptor stored for fd, or null. */
+        FileDescriptor *lookup(size_t fd) const
+        {
+            if(fd >= m_pTable->nSize)
+                return 0;
+            return m_pTable->pEntries[fd];
+        }
+
+        /** Finds the lowest free descriptor number and marks it in use. */
+        size_t allocate();
+
+        /** Marks the given descriptor number as in use. */
+        void reserve(size_t fd);
+
+        /** Marks the given descriptor number as free, and returns the
+         *  descriptor that was stored there (if any). */
+        FileDescriptor *release(size_t fd);
+
+        /** Stores a descriptor in an in-use slot. */
+        void set(size_t fd, FileDescriptor *pFd);
+
+        /** Whether the given descriptor number is in use. */
+        bool isAllocated(size_t fd) const;
+
+        /** One past the highest descriptor number that may be in use. */
+        size_t limit() const
+        {
+            return m_nLimit;
+        }
+
+        /** Replaces the contents of this table with a bulk copy of another.
+         *  Slots will point at the other table's descriptors - the caller
+         *  is expected to replace them with copies. */
+        void copyFrom(const FileDescriptorTable &other);
+
+        /** Marks every descriptor as free and empties every slot. */
+        void clear();
+
+    private:
+        FileDescriptorTable(const FileDescriptorTable &);
+        FileDescriptorTable &operator = (const FileDescriptorTable &);
+
+        static const size_t BitsPerWord = sizeof(uintptr_t) * 8;
+        static const size_t InitialSize = 64;
+
+        /** Descriptor storage. */
+        struct Table
+        {
+            size_t nSize;
+            FileDescriptor **pEntries;
+        };
+
+        /** Grows the table so it can hold at least nSize descriptors. */
+        void grow(size_t nSize);
+
+        /** Updates the summary level after word w of the in-use level changed. */
+        void updateSummary(size_t w);
+
+        Table *m_pTable;
+
+        /** First level: one bit per descriptor, set if in use. */
+        uintptr_t *m_pInUse;
+        /** Second level: one bit per first-level word, set if it is full. */
+        uintptr_t *m_pFull;
+
+        /** One past the highest descriptor allocated so far. */
+        size_t m_nLimit;
+};
+
+#endif
@@ -47,7 +47,6 @@
 #define	FD_CLOEXEC	1
 
 typedef Tree<size_t, PosixSubsystem::SignalHandler*> sigHandlerTree;
-typedef Tree<size_t, FileDescriptor*> FdMap;
 
 RadixTree<LockedFile*> g_PosixGlobalLockedFiles;
 
@@ -56,13 +55,13 @@ ProcessGroupManager ProcessGroupManager::m_Instance;
 /// Default constructor
 FileDescriptor::FileDescriptor() :
     file(0), offset(0), fd(0xFFFFFFFF), fdflags(0), flflags(0),
-    so_domain(0), so_type(0), so_local(0), lockedFile(0)
+    so_domain(0), so_type(0), so_local(0), lockedFile(0), m_nRefs(1)
 {
 }
 
 /// Parameterised constructor
 FileDescriptor::FileDescriptor(File *newFile, uint64_t newOffset, size_t newFd, int fdFlags, int flFlags, LockedFile *lf) :
-    file(newFile), offset(newOffset), fd(newFd), fdflags(fdFlags), flflags(flFlags), lockedFile(lf)
+    file(newFile), offset(newOffset), fd(newFd), fdflags(fdFlags), flflags(flFlags), lockedFile(lf), m_nRefs(1)
 {
     if(file)
     {
@@ -73,7 +72,7 @@ FileDescriptor::FileDescriptor(File *newFile, uint64_t newOffset, size_t newFd,
 
 /// Copy constructor
 FileDescriptor::FileDescriptor(FileDescriptor &desc) :
-    file(desc.file), offset(desc.offset), fd(desc.fd), fdflags(desc.fdflags), flflags(desc.flflags), lockedFile(0)
+    file(desc.file), offset(desc.offset), fd(desc.fd), fdflags(desc.fdflags), flflags(desc.flflags), lockedFile(0), m_nRefs(1)
 {
     if(file)
     {
@@ -84,7 +83,7 @@ FileDescriptor::FileDescriptor(FileDescriptor &desc) :
 
 /// Pointer copy constructor
 FileDescriptor::FileDescriptor(FileDescriptor *desc) :
-    file(0), offset(0), fd(0), fdflags(0), flflags(0), lockedFile(0)
+    file(0), offset(0), fd(0), fdflags(0), flflags(0), lockedFile(0), m_nRefs(1)
 {
     if(!desc)
         return;
@@ -134,8 +133,8 @@ FileDescriptor::~FileDescriptor()
 }
 
 PosixSubsystem::PosixSubsystem(PosixSubsystem &s) :
-    Subsystem(s), m_SignalHandlers(), m_SignalHandlersLock(), m_FdMap(), m_NextFd(s.m_NextFd),
-    m_FdLock(), m_FdBitmap(), m_LastFd(0), m_FreeCount(s.m_FreeCount),
+    Subsystem(s), m_SignalHandlers(), m_SignalHandlersLock(), m_FdTable(),
+    m_FdLock(), m_FreeCount(s.m_FreeCount),
     m_AltSigStack(), m_SyncObjects(), m_Threads()
 {
     while(!m_SignalHandlersLock.acquire());
@@ -594,22 +593,8 @@ size_t PosixSubsystem::getFd()
     // Enter critical section for writing.
     while(!m_FdLock.acquire());
 
-    // Try to recycle if possible
-    for(size_t i = m_LastFd; i < m_NextFd; i++)
-    {
-        if(!(m_FdBitmap.test(i)))
-        {
-            m_LastFd = i;
-            m_FdBitmap.set(i);
-            m_FdLock.release();
-            return i;
-        }
-    }
+    size_t ret = m_FdTable.allocate();
 
-    // Otherwise, allocate
-    // m_NextFd will always contain the highest allocated fd
-    m_FdBitmap.set(m_NextFd);
-    size_t ret = m_NextFd++;
     m_FdLock.release();
     return ret;
 }
@@ -619,9 +604,7 @@ void PosixSubsystem::allocateFd(size_t fdNum)
     // Enter critical section for writing.
     while(!m_FdLock.acquire());
 
-    if(fdNum >= m_NextFd)
-        m_NextFd = fdNum + 1;
-    m_FdBitmap.set(fdNum);
+    m_FdTable.reserve(fdNum);
 
     m_FdLock.release();
 }
@@ -631,19 +614,14 @@ void PosixSubsystem::freeFd(size_t fdNum)
     // Enter critical section for writing.
     while(!m_FdLock.acquire());
 
-    m_FdBitmap.clear(fdNum);
-
-    FileDescriptor *pFd = m_FdMap.lookup(fdNum);
-    if(pFd)
-    {
-        m_FdMap.remove(fdNum);
-        delete pFd;
-    }
-
-    if(fdNum < m_LastFd)
-        m_LastFd = fdNum;
+    FileDescriptor *pFd = m_FdTable.release(fdNum);
 
     m_FdLock.release();
+
+    // Drop the table's reference; anyone still using the descriptor keeps
+    // it alive until they are done.
+    if(pFd)
+        pFd->release();
 }
 
 bool PosixSubsystem::copyDescriptors(PosixSubsystem *pSubsystem)
@@ -657,24 +635,14 @@ bool PosixSubsystem::copyDescriptors(PosixSubsystem *pSubsystem)
     while(!m_FdLock.acquire());
     while(!pSubsystem->m_FdLock.acquire());
 
-    // Copy each descriptor across from the original subsystem
-    FdMap &map = pSubsystem->m_FdMap;
-    for(FdMap::Iterator it = map.begin(); it != map.end(); it++)
+    // Bulk copy the table and bitmaps, then give each slot its own copy of
+    // the original descriptor.
+    m_FdTable.copyFrom(pSubsystem->m_FdTable);
+    for(size_t fd = 0; fd < m_FdTable.limit(); ++fd)
     {
-        FileDescriptor *pFd = it.value();
-        if(!pFd)
-            continue;
-        size_t newFd = it.key();
-
-        FileDescriptor *pNewFd = new FileDescriptor(*pFd);
-
-        // Perform the same action as addFileDescriptor. We need to duplicate here because
-        // we currently hold the FD lock, which will deadlock if we call any function which
-        // attempts to acquire it.
-        if(newFd >= m_NextFd)
-            m_NextFd = newFd + 1;
-        m_FdBitmap.set(newFd);
-        m_FdMap.insert(newFd, pNewFd);
+        FileDescriptor *pFd = m_FdTable.lookup(fd);
+        if(pFd)
+            m_FdTable.set(fd, new FileDescriptor(*pFd));
     }
 
     pSubsystem->m_FdLock.release();
@@ -688,60 +656,33 @@ void PosixSubsystem::freeMultipleFds(bool bOnlyCloExec, size_t iFirst, size_t iL
 
     while(!m_FdLock.acquire()); // Don't allow any access to the FD data
 
-    // Because removing FDs as we go from the Tree can actually leave the Tree
-    // iterators in a dud state, we'll add all the FDs to remove to this list.
-    List<void*> fdsToRemove;
+    // The table's references are dropped after the descriptors are unlinked,
+    // outside the lock; any still in use stay alive until they're released.
+    List<FileDescriptor*> fdsToDelete;
 
-    // Are all FDs to be freed? Or only a selection?
-    bool bAllToBeFreed = ((iFirst == 0 && iLast == ~0UL) && !bOnlyCloExec);
-    if(bAllToBeFreed)
-        m_LastFd = 0;
+    size_t limit = m_FdTable.limit();
+    if(iLast >= limit)
+        iLast = limit ? limit - 1 : 0;
 
-    FdMap &map = m_FdMap;
-    for(FdMap::Iterator it = map.begin(); it != map.end(); it++)
+    for(size_t Fd = iFirst; Fd <= iLast && Fd < limit; ++Fd)
     {
-        size_t Fd = it.key();
-        FileDescriptor *pFd = it.value();
-        if(!pFd)
-            continue;
-
-        if(!(Fd >= iFirst && Fd <= iLast))
+        if(!m_FdTable.isAllocated(Fd))
             continue;
 
+        FileDescriptor *pFd = m_FdTable.lookup(Fd);
         if(bOnlyCloExec)
         {
-            if(!(pFd->fdflags & FD_CLOEXEC))
+            if(!pFd || !(pFd->fdflags & FD_CLOEXEC))
                 continue;
         }
 
-        // Perform the same action as freeFd. We need to duplicate code here because we currently
-        // hold the FD lock, which will deadlock if we call any function which attempts to
-        // acquire it.
-
-        // No longer usable
-        m_FdBitmap.clear(Fd);
-
-        // Add to the list of FDs to remove, iff we won't be cleaning up the entire set
-        if(!bAllToBeFreed)
-            fdsToRemove.pushBack(reinterpret_cast<void*>(Fd));
-
-        // Delete the descriptor itself
-        delete pFd;
-
-        // And reset the "last freed" tracking variable, if this is lower than it already.
-        if(Fd < m_LastFd)
-            m_LastFd = Fd;
-    }
-
-    // Clearing all AND not caring about CLOEXEC FDs? If so, clear the map. Otherwise, only
-    // clear the FDs that are supposed to be cleared.
-    if(bAllToBeFreed)
-        m_FdMap.clear();
-    else
-    {
-        for(List<void*>::Iterator it = fdsToRemove.begin(); it != fdsToRemove.end(); it++)
-            m_FdMap.remove(reinterpret_cast<size_t>(*it));
+        m_FdTable.release(Fd);
+        if(pFd)
+            fdsToDelete.pushBack(pFd);
     }
 
     m_FdLock.release();
+
+    for(List<FileDescriptor*>::Iterator it = fdsToDelete.begin(); it != fdsToDelete.end(); it++)
+        (*it)->release();
 }
@@ -32,6 +32,8 @@
 #include <utilities/ExtensibleBitmap.h>
 #include <LockGuard.h>
 
+#include "FileDescriptorTable.h"
+
 class File;
 class LockedFile;
 
@@ -168,6 +170,85 @@ class FileDescriptor
 
         /// Locked file, non-zero if there is an advisory lock on the file
         LockedFile *lockedFile;
+
+        /// Takes another reference (see FileDescriptorRef)
+        void addRef()
+        {
+            __sync_add_and_fetch(&m_nRefs, 1);
+        }
+
+        /// Drops a reference, deleting the descriptor after the last one
+        void release()
+        {
+            if(__sync_sub_and_fetch(&m_nRefs, 1) == 0)
+                delete this;
+        }
+
+    private:
+        /// One reference for the descriptor table, plus one for each
+        /// FileDescriptorRef. Not copied along with the descriptor.
+        volatile size_t m_nRefs;
+};
+
+/** A counted reference to a FileDescriptor, as returned by
+  * PosixSubsystem::getFileDescriptor. The descriptor is not destroyed while
+  * a reference to it is held, even if another thread closes it meanwhile.
+  */
+class FileDescriptorRef
+{
+    public:
+        FileDescriptorRef() : m_pFd(0)
+        {}
+
+        /// Adopts a reference the caller has already taken
+        explicit FileDescriptorRef(FileDescriptor *pFd) : m_pFd(pFd)
+        {}
+
+        FileDescriptorRef(const FileDescriptorRef &ref) : m_pFd(ref.m_pFd)
+        {
+            if(m_pFd)
+                m_pFd->addRef();
+        }
+
+        ~FileDescriptorRef()
+        {
+            if(m_pFd)
+                m_pFd->release();
+        }
+
+        FileDescriptorRef &operator = (const FileDescriptorRef &ref)
+        {
+            if(ref.m_pFd)
+                ref.m_pFd->addRef();
+            if(m_pFd)
+                m_pFd->release();
+            m_pFd = ref.m_pFd;
+            return *this;
+        }
+
+        FileDescriptor *operator -> () const
+        {
+            return m_pFd;
+        }
+
+        FileDescriptor &operator * () const
+        {
+            return *m_pFd;
+        }
+
+        /// The descriptor, valid for as long as this reference is held
+        FileDescriptor *get() const
+        {
+            return m_pFd;
+        }
+
+        bool operator ! () const
+        {
+            return !m_pFd;
+        }
+
+    private:
+        FileDescriptor *m_pFd;
 };
 
 /** Defines the compatibility layer for the POSIX Subsystem */
@@ -183,7 +264,7 @@ class PosixSubsystem : public Subsystem
         /** Default constructor */
         PosixSubsystem() :
             Subsystem(Posix), m_SignalHandlers(), m_SignalHandlersLock(),
-            m_FdMap(), m_NextFd(0), m_FdLock(), m_FdBitmap(), m_LastFd(0), m_FreeCount(1),
+            m_FdTable(), m_FdLock(), m_FreeCount(1),
             m_AltSigStack(), m_SyncObjects(), m_Threads()
         {}
 
@@ -193,7 +274,7 @@ class PosixSubsystem : public Subsystem
         /** Parameterised constructor */
         PosixSubsystem(SubsystemType type) :
             Subsystem(type), m_SignalHandlers(), m_SignalHandlersLock(),
-            m_FdMap(), m_NextFd(0), m_FdLock(), m_FdBitmap(), m_LastFd(0), m_FreeCount(1),
+            m_FdTable(), m_FdLock(), m_FreeCount(1),
             m_AltSigStack(), m_SyncObjects(), m_Threads()
         {}
 
@@ -339,17 +420,22 @@ class PosixSubsystem : public Subsystem
         /** Frees a range of descriptors (or only those marked FD_CLOEXEC) */
         void freeMultipleFds(bool bOnlyCloExec = false, size_t iFirst = 0, size_t iLast = -1);
 
-        /** Gets a pointer to a FileDescriptor object from an fd number */
-        FileDescriptor *getFileDescriptor(size_t fd)
+        /** Gets a reference to the FileDescriptor for an fd number. The
+          * descriptor stays valid until the reference is dropped, even if
+          * the fd is closed in the meantime. */
+        FileDescriptorRef getFileDescriptor(size_t fd)
         {
-            // Enter the critical section, for reading.
+            // Enter the critical section, for reading, so the descriptor
+            // can't be unlinked and released before it has our reference.
             while(!m_FdLock.enter());
 
-            FileDescriptor *pFd = m_FdMap.lookup(fd);
+            FileDescriptor *pFd = m_FdTable.lookup(fd);
+            if(pFd)
+                pFd->addRef();
 
             m_FdLock.leave();
 
-            return pFd;
+            return FileDescriptorRef(pFd);
         }
 
         /** Inserts a file descriptor */
@@ -361,7 +447,7 @@ class PosixSubsystem : public Subsystem
             // Enter critical section for writing.
             while(!m_FdLock.acquire());
 
-            m_FdMap.insert(fd, pFd);
+            m_FdTable.set(fd, pFd);
 
             m_FdLock.release();
         }
@@ -516,26 +602,15 @@ class PosixSubsystem : public Subsystem
         UnlikelyLock m_SignalHandlersLock;
 
         /**
-         * The file descriptor map. Maps number to pointers, the type of which is decided
-         * by the subsystem.
+         * The file descriptor table. Maps numbers to FileDescriptor objects,
+         * and tracks which numbers are in use.
          */
-        Tree<size_t, FileDescriptor*> m_FdMap;
+        FileDescriptorTable m_FdTable;
         /**
-         * The next available file descriptor.
-         */
-        size_t m_NextFd;
-        /**
-         * Lock to guard the next file descriptor while it is being changed.
+         * Lock to serialise modifications to the descriptor table. Lookups
+         * do not take it.
          */
         UnlikelyLock m_FdLock;
-        /**
-         * File descriptors used by this process
-         */
-        ExtensibleBitmap m_FdBitmap;
-        /**
-         * Last known unallocated descriptor
-         */
-        size_t m_LastFd;
         /**
          * Number of times freed
          */
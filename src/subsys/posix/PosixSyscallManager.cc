@@ -375,6 +375,25 @@ uintptr_t PosixSyscallManager::syscall(SyscallState &state)
         case POSIX_REALPATH:
             return posix_realpath(reinterpret_cast<const char *>(p1), reinterpret_cast<char *>(p2), static_cast<size_t>(p3));
 
+        case POSIX_SENDFILE:
+            return posix_sendfile(static_cast<int>(p1), static_cast<int>(p2), reinterpret_cast<off_t *>(p3), static_cast<size_t>(p4));
+        case POSIX_SPLICE:
+            return posix_splice(reinterpret_cast<void *>(p1));
+
+        case POSIX_READV:
+            return posix_readv(static_cast<int>(p1), reinterpret_cast<const struct iovec *>(p2), static_cast<int>(p3));
+        case POSIX_WRITEV:
+            return posix_writev(static_cast<int>(p1), reinterpret_cast<const struct iovec *>(p2), static_cast<int>(p3));
+        case POSIX_PREADV:
+            return posix_preadv(static_cast<int>(p1), reinterpret_cast<const struct iovec *>(p2), static_cast<int>(p3), static_cast<off_t>(p4));
+        case POSIX_PWRITEV:
+            return posix_pwritev(static_cast<int>(p1), reinterpret_cast<const struct iovec *>(p2), static_cast<int>(p3), static_cast<off_t>(p4));
+
+        case POSIX_SENDMSG:
+            return posix_sendmsg(static_cast<int>(p1), reinterpret_cast<const struct msghdr *>(p2), static_cast<int>(p3));
+        case POSIX_RECVMSG:
+            return posix_recvmsg(static_cast<int>(p1), reinterpret_cast<struct msghdr *>(p2), static_cast<int>(p3));
+
         default: ERROR ("PosixSyscallManager: invalid syscall received: " << Dec << state.getSyscallNumber() << Hex); return 0;
     }
 
@@ -178,7 +178,7 @@ int posix_tcgetattr(int fd, struct termios *p)
       return -1;
   }
 
-  FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+  FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
   if (!pFd)
   {
     // Error - no such file descriptor.
@@ -242,7 +242,7 @@ int posix_tcsetattr(int fd, int optional_actions, struct termios *p)
       return -1;
   }
 
-  FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+  FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
   if (!pFd)
   {
     // Error - no such file descriptor.
@@ -350,7 +350,7 @@ int console_ptsname(int fd, char *buf)
       return -1;
   }
 
-  FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+  FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
   if (!pFd)
   {
     // Error - no such file descriptor.
@@ -397,7 +397,7 @@ int console_ttyname(int fd, char *buf)
       return -1;
   }
 
-  FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+  FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
   if (!pFd)
   {
     // Error - no such file descriptor.
@@ -446,7 +446,7 @@ int console_setctty(int fd, bool steal)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -496,7 +496,7 @@ int posix_tcsetpgrp(int fd, pid_t pgid_id)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -551,7 +551,7 @@ pid_t posix_tcgetpgrp(int fd)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -147,7 +147,7 @@ int posix_close(int fd)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -362,7 +362,7 @@ int posix_read(int fd, char *ptr, int len)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -435,7 +435,7 @@ int posix_write(int fd, char *ptr, int len, bool nocheck)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -455,6 +455,219 @@ int posix_write(int fd, char *ptr, int len, bool nocheck)
     return static_cast<int>(nWritten);
 }
 
+/** Vectors up to this size going to a pipe or socket are gathered into one
+ *  kernel buffer, so it sees a single read or write and keeps them together.
+ *  Anything else gets each buffer in turn, without the extra copy. */
+#define VECTOR_GATHER_SIZE      0x10000
+
+/** Validates a user iovec array and each buffer in it. Returns the total
+ *  length, or -1 with the error set. An empty array is fine. */
+static ssize_t checkIovec(const struct iovec *iov, int iovcnt, bool bWrite)
+{
+    if(iovcnt < 0 || iovcnt > IOV_MAX)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    if(iovcnt && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(iov), sizeof(struct iovec) * iovcnt, PosixSubsystem::SafeRead))
+    {
+        F_NOTICE("  -> invalid address");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    size_t total = 0;
+    for(int i = 0; i < iovcnt; ++i)
+    {
+        size_t len = iov[i].iov_len;
+        if(len && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(iov[i].iov_base), len,
+                                               bWrite ? PosixSubsystem::SafeRead : PosixSubsystem::SafeWrite))
+        {
+            F_NOTICE("  -> invalid address");
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+        }
+
+        // The total has to fit in the return value.
+        total += len;
+        if(total < len || static_cast<ssize_t>(total) < 0)
+        {
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+        }
+    }
+
+    return static_cast<ssize_t>(total);
+}
+
+/** Performs a vectored read or write on pFile at location. */
+static uint64_t doVectoredIo(File *pFile, const struct iovec *iov, int iovcnt, size_t total,
+                             uint64_t location, bool bWrite, bool bCanBlock)
+{
+    uint64_t nDone = 0;
+
+    bool bGather = (iovcnt > 1) && (total <= VECTOR_GATHER_SIZE) &&
+                   (pFile->isPipe() || NetManager::instance().isEndpoint(pFile));
+    uint8_t *pBuffer = bGather ? new uint8_t[total] : 0;
+    if(pBuffer)
+    {
+        if(bWrite)
+        {
+            size_t off = 0;
+            for(int i = 0; i < iovcnt; ++i)
+            {
+                memcpy(pBuffer + off, iov[i].iov_base, iov[i].iov_len);
+                off += iov[i].iov_len;
+            }
+            nDone = pFile->write(location, total, reinterpret_cast<uintptr_t>(pBuffer), bCanBlock);
+        }
+        else
+        {
+            nDone = pFile->read(location, total, reinterpret_cast<uintptr_t>(pBuffer), bCanBlock);
+
+            size_t off = 0;
+            for(int i = 0; i < iovcnt && off < nDone; ++i)
+            {
+                size_t sz = iov[i].iov_len;
+                if(sz > nDone - off)
+                    sz = nDone - off;
+                memcpy(iov[i].iov_base, pBuffer + off, sz);
+                off += sz;
+            }
+        }
+        delete [] pBuffer;
+        return nDone;
+    }
+
+    // Too big to gather: hand each buffer down in turn, stopping at the
+    // first short transfer.
+    for(int i = 0; i < iovcnt; ++i)
+    {
+        size_t len = iov[i].iov_len;
+        if(!len)
+            continue;
+
+        uintptr_t buffer = reinterpret_cast<uintptr_t>(iov[i].iov_base);
+        uint64_t n = bWrite ? pFile->write(location + nDone, len, buffer, bCanBlock) :
+                              pFile->read(location + nDone, len, buffer, bCanBlock);
+        nDone += n;
+        if(n < len)
+            break;
+
+        // A pipe or socket that has given us something shouldn't then block
+        // waiting to fill the next buffer.
+        if(!bWrite && !pFile->select(false, 0))
+            break;
+    }
+
+    return nDone;
+}
+
+/** Common implementation of readv, writev, preadv and pwritev. If bOffset is
+ *  false the descriptor's offset is used and advanced; otherwise offset is
+ *  used and the descriptor is left alone. */
+static ssize_t vectoredIo(int fd, const struct iovec *iov, int iovcnt, off_t offset, bool bOffset, bool bWrite)
+{
+    ssize_t total = checkIovec(iov, iovcnt, bWrite);
+    if(total < 0)
+        return -1;
+
+    Process *pProcess = Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem = reinterpret_cast<PosixSubsystem*>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for this process!");
+        return -1;
+    }
+
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
+    if (!pFd)
+    {
+        // Error - no such file descriptor.
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    if(pFd->file->isDirectory())
+    {
+        SYSCALL_ERROR(IsADirectory);
+        return -1;
+    }
+
+    if(bOffset)
+    {
+        if(pFd->file->isPipe())
+        {
+            SYSCALL_ERROR(IllegalSeek);
+            return -1;
+        }
+        if(offset < 0)
+        {
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+        }
+    }
+
+    // Nothing to transfer; don't let a pipe or socket block over it.
+    if(!total)
+        return 0;
+
+    // Writes block as write() does; reads honour O_NONBLOCK as read() does.
+    bool canBlock = true;
+    if(!bWrite)
+    {
+        canBlock = !((pFd->flflags & O_NONBLOCK) == O_NONBLOCK);
+        if(!canBlock && !pFd->file->select(false, 0))
+        {
+            SYSCALL_ERROR(NoMoreProcesses);
+            return -1;
+        }
+    }
+
+    Thread *pThread = Processor::information().getCurrentThread();
+    pThread->setInterrupted(false);
+
+    uint64_t location = bOffset ? static_cast<uint64_t>(offset) : pFd->offset;
+    uint64_t nDone = doVectoredIo(pFd->file, iov, iovcnt, total, location, bWrite, canBlock);
+    if((!nDone) && total && (pThread->wasInterrupted()))
+    {
+        SYSCALL_ERROR(Interrupted);
+        return -1;
+    }
+
+    if(!bOffset)
+        pFd->offset += nDone;
+
+    F_NOTICE("    -> " << Dec << nDone << Hex);
+
+    return static_cast<ssize_t>(nDone);
+}
+
+ssize_t posix_readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    F_NOTICE("readv(" << fd << ", " << reinterpret_cast<uintptr_t>(iov) << ", " << iovcnt << ")");
+    return vectoredIo(fd, iov, iovcnt, 0, false, false);
+}
+
+ssize_t posix_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    F_NOTICE("writev(" << fd << ", " << reinterpret_cast<uintptr_t>(iov) << ", " << iovcnt << ")");
+    return vectoredIo(fd, iov, iovcnt, 0, false, true);
+}
+
+ssize_t posix_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    F_NOTICE("preadv(" << fd << ", " << reinterpret_cast<uintptr_t>(iov) << ", " << iovcnt << ", " << offset << ")");
+    return vectoredIo(fd, iov, iovcnt, offset, true, false);
+}
+
+ssize_t posix_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    F_NOTICE("pwritev(" << fd << ", " << reinterpret_cast<uintptr_t>(iov) << ", " << iovcnt << ", " << offset << ")");
+    return vectoredIo(fd, iov, iovcnt, offset, true, true);
+}
+
 off_t posix_lseek(int file, off_t ptr, int dir)
 {
     F_NOTICE("lseek(" << file << ", " << ptr << ", " << dir << ")");
@@ -468,7 +681,7 @@ off_t posix_lseek(int file, off_t ptr, int dir)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(file);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(file);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -839,7 +1052,7 @@ int posix_fstat(int fd, struct stat *st)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         ERROR("Error, no such FD!");
@@ -1072,7 +1285,7 @@ int posix_readdir(int fd, dirent *ent)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd || !pFd->file)
     {
         // Error - no such file descriptor.
@@ -1130,7 +1343,7 @@ void posix_rewinddir(int fd, dirent *ent)
         ERROR("No subsystem for this process!");
         return;
     }
-    FileDescriptor *f = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(fd);
     f->offset = 0;
     posix_readdir(fd, ent);
 }
@@ -1168,7 +1381,7 @@ int posix_ioctl(int fd, int command, void *buf)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(fd);
     if (!f)
     {
         // Error - no such FD.
@@ -1286,7 +1499,7 @@ int posix_dup(int fd)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(fd);
     if (!f)
     {
         SYSCALL_ERROR(BadFileDescriptor);
@@ -1324,7 +1537,7 @@ int posix_dup2(int fd1, int fd2)
         return -1;
     }
 
-    FileDescriptor* f = pSubsystem->getFileDescriptor(fd1);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(fd1);
     if (!f)
     {
         SYSCALL_ERROR(BadFileDescriptor);
@@ -1373,7 +1586,7 @@ int posix_isatty(int fd)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -1407,7 +1620,7 @@ int posix_fcntl(int fd, int cmd, int num, int* args)
         return -1;
     }
 
-    FileDescriptor* f = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(fd);
     if(!f)
     {
         SYSCALL_ERROR(BadFileDescriptor);
@@ -1653,7 +1866,8 @@ void *posix_mmap(void *p)
             return MAP_FAILED;
         }
 
-        MemoryMappedObject *pObject = MemoryMapManager::instance().mapAnon(sanityAddress, len, perms);
+        bool bLargePages = (flags & MAP_HUGETLB) == MAP_HUGETLB;
+        MemoryMappedObject *pObject = MemoryMapManager::instance().mapAnon(sanityAddress, len, perms, bLargePages);
         if(!pObject)
         {
             /// \todo Better error?
@@ -1669,7 +1883,7 @@ void *posix_mmap(void *p)
     else
     {
         // Valid file passed?
-        FileDescriptor* f = pSubsystem->getFileDescriptor(fd);
+        FileDescriptorRef f = pSubsystem->getFileDescriptor(fd);
         if(!f)
         {
             SYSCALL_ERROR(BadFileDescriptor);
@@ -1843,7 +2057,7 @@ int posix_ftruncate(int a, off_t b)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(a);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(a);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -1900,7 +2114,7 @@ int posix_fsync(int fd)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -1913,6 +2127,316 @@ int posix_fsync(int fd)
     return 0;
 }
 
+/** Size of the kernel buffer used when the source isn't in the block cache. */
+#define TRANSFER_BOUNCE_SIZE    0x10000
+
+/**
+ * Moves up to len bytes from pIn at inOffset to pOut at outOffset, without
+ * going through userspace.
+ *
+ * Sources that keep their data in the block cache (regular files) are
+ * transferred a block at a time straight from the pinned cache page.
+ * Anything else (pipes, sockets, devices) is read into a kernel buffer and
+ * written out from there. Once some data has been moved, a transfer from a
+ * source with nothing more to give stops rather than blocking, so splicing
+ * from a pipe returns what was available, as read() does.
+ *
+ * The bounce buffer is only allocated once a read actually needs it, and is
+ * no larger than len. bNoMemory is set if that allocation failed.
+ */
+static uint64_t doTransfer(File *pIn, uint64_t inOffset, File *pOut, uint64_t outOffset, size_t len, bool bCanBlock, bool &bNoMemory)
+{
+    bNoMemory = false;
+    uint8_t *pBounce = 0;
+    uint64_t nTotal = 0;
+
+    while(len)
+    {
+        size_t blockSize = pIn->getBlockSize();
+        uint64_t blockOffset = inOffset & ~(static_cast<uint64_t>(blockSize) - 1);
+
+        uint64_t nMoved = 0;
+        bool bShort = false;
+
+        uintptr_t block = pIn->getCachedBlock(blockOffset);
+        if(block && (inOffset >= pIn->getSize()))
+        {
+            // Past the end, but within the last block.
+            pIn->returnPhysicalPage(blockOffset);
+            break;
+        }
+        else if(block)
+        {
+            size_t offs = inOffset - blockOffset;
+            size_t sz = blockSize - offs;
+            if(sz > len)
+                sz = len;
+            if(sz > pIn->getSize() - inOffset)
+                sz = pIn->getSize() - inOffset;
+
+            nMoved = pOut->write(outOffset, sz, block + offs, bCanBlock);
+            pIn->returnPhysicalPage(blockOffset);
+
+            bShort = nMoved < sz;
+        }
+        else
+        {
+            if(nTotal && !pIn->select(false, 0))
+                break;
+
+            // Sources with a size (regular files that aren't cached) have
+            // nothing left to give once the offset reaches it, so don't
+            // bother allocating a buffer to find that out.
+            if(!pIn->isPipe() && pIn->getSize() && (inOffset >= pIn->getSize()))
+                break;
+
+            size_t sz = len > TRANSFER_BOUNCE_SIZE ? TRANSFER_BOUNCE_SIZE : len;
+            if(!pBounce)
+            {
+                pBounce = new uint8_t[sz];
+                if(!pBounce)
+                {
+                    bNoMemory = true;
+                    break;
+                }
+            }
+
+            uint64_t nRead = pIn->read(inOffset, sz, reinterpret_cast<uintptr_t>(pBounce), bCanBlock);
+            if(!nRead)
+                break;
+
+            // The data has left the source now, so make sure all of it gets
+            // to the destination.
+            while(nMoved < nRead)
+            {
+                uint64_t n = pOut->write(outOffset + nMoved, nRead - nMoved,
+                                         reinterpret_cast<uintptr_t>(pBounce) + nMoved, true);
+                if(!n)
+                    break;
+                nMoved += n;
+            }
+
+            bShort = nMoved < nRead;
+        }
+
+        inOffset += nMoved;
+        outOffset += nMoved;
+        len -= nMoved;
+        nTotal += nMoved;
+
+        if(bShort || !nMoved)
+            break;
+    }
+
+    delete [] pBounce;
+    return nTotal;
+}
+
+ssize_t posix_sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    F_NOTICE("sendfile(" << out_fd << ", " << in_fd << ", " << reinterpret_cast<uintptr_t>(offset) << ", " << count << ")");
+    if(offset && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(offset), sizeof(off_t), PosixSubsystem::SafeWrite))
+    {
+        F_NOTICE("  -> invalid address");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    Process *pProcess = Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem = reinterpret_cast<PosixSubsystem*>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for this process!");
+        return -1;
+    }
+
+    FileDescriptorRef pIn = pSubsystem->getFileDescriptor(in_fd);
+    FileDescriptorRef pOut = pSubsystem->getFileDescriptor(out_fd);
+    if (!pIn || !pOut || !pIn->file || !pOut->file)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    if(pIn->file->isDirectory() || pOut->file->isDirectory())
+    {
+        SYSCALL_ERROR(IsADirectory);
+        return -1;
+    }
+
+    if(offset && (*offset < 0))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+    if(offset && pIn->file->isPipe())
+    {
+        SYSCALL_ERROR(IllegalSeek);
+        return -1;
+    }
+
+    if(!count)
+        return 0;
+
+    // As with read() and write(), non-blocking descriptors that aren't ready
+    // fail with EAGAIN rather than transferring nothing.
+    bool canBlock = !((pIn->flflags & O_NONBLOCK) == O_NONBLOCK) &&
+                    !((pOut->flflags & O_NONBLOCK) == O_NONBLOCK);
+    if(!canBlock && (!pIn->file->select(false, 0) || !pOut->file->select(true, 0)))
+    {
+        SYSCALL_ERROR(NoMoreProcesses);
+        return -1;
+    }
+
+    Thread *pThread = Processor::information().getCurrentThread();
+    pThread->setInterrupted(false);
+
+    uint64_t inOffset = offset ? *offset : pIn->offset;
+    bool bNoMemory = false;
+    uint64_t nMoved = doTransfer(pIn->file, inOffset, pOut->file, pOut->offset, count, canBlock, bNoMemory);
+    if((!nMoved) && bNoMemory)
+    {
+        SYSCALL_ERROR(OutOfMemory);
+        return -1;
+    }
+    if((!nMoved) && (pThread->wasInterrupted()))
+    {
+        SYSCALL_ERROR(Interrupted);
+        return -1;
+    }
+
+    // With an explicit offset, the input descriptor's own offset is left
+    // alone.
+    if(offset)
+        *offset += nMoved;
+    else
+        pIn->offset += nMoved;
+    pOut->offset += nMoved;
+
+    F_NOTICE("    -> " << Dec << nMoved << Hex);
+
+    return static_cast<ssize_t>(nMoved);
+}
+
+/// splice() takes six arguments, so they're passed in a block.
+struct special_splice_data
+{
+    int fd_in;
+    off_t *off_in;
+    int fd_out;
+    off_t *off_out;
+    size_t len;
+    unsigned int flags;
+} __attribute__((packed));
+
+#define SPLICE_F_NONBLOCK       2
+
+ssize_t posix_splice(void *callInfo)
+{
+    if(!PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(callInfo), sizeof(special_splice_data), PosixSubsystem::SafeRead))
+    {
+        F_NOTICE("splice -> invalid address");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    special_splice_data *tmp = reinterpret_cast<special_splice_data*>(callInfo);
+    F_NOTICE("splice(" << tmp->fd_in << ", " << tmp->fd_out << ", " << tmp->len << ", " << tmp->flags << ")");
+
+    if((tmp->off_in && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(tmp->off_in), sizeof(off_t), PosixSubsystem::SafeWrite)) ||
+       (tmp->off_out && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(tmp->off_out), sizeof(off_t), PosixSubsystem::SafeWrite)))
+    {
+        F_NOTICE("  -> invalid address");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    Process *pProcess = Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem = reinterpret_cast<PosixSubsystem*>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for this process!");
+        return -1;
+    }
+
+    FileDescriptorRef pIn = pSubsystem->getFileDescriptor(tmp->fd_in);
+    FileDescriptorRef pOut = pSubsystem->getFileDescriptor(tmp->fd_out);
+    if (!pIn || !pOut || !pIn->file || !pOut->file)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    // One end must be a pipe, and pipes have no offsets.
+    bool inPipe = pIn->file->isPipe();
+    bool outPipe = pOut->file->isPipe();
+    if(!inPipe && !outPipe)
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+    if((inPipe && tmp->off_in) || (outPipe && tmp->off_out))
+    {
+        SYSCALL_ERROR(IllegalSeek);
+        return -1;
+    }
+    if(pIn->file->isDirectory() || pOut->file->isDirectory())
+    {
+        SYSCALL_ERROR(IsADirectory);
+        return -1;
+    }
+    if((tmp->off_in && (*tmp->off_in < 0)) || (tmp->off_out && (*tmp->off_out < 0)))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    if(!tmp->len)
+        return 0;
+
+    // SPLICE_F_NONBLOCK only affects the pipe ends; the other end follows
+    // its own descriptor flags.
+    bool nonBlock = (tmp->flags & SPLICE_F_NONBLOCK) ||
+                    ((pIn->flflags & O_NONBLOCK) == O_NONBLOCK && !inPipe) ||
+                    ((pOut->flflags & O_NONBLOCK) == O_NONBLOCK && !outPipe);
+    if(nonBlock && (!pIn->file->select(false, 0) || !pOut->file->select(true, 0)))
+    {
+        SYSCALL_ERROR(NoMoreProcesses);
+        return -1;
+    }
+
+    Thread *pThread = Processor::information().getCurrentThread();
+    pThread->setInterrupted(false);
+
+    uint64_t inOffset = tmp->off_in ? *tmp->off_in : pIn->offset;
+    uint64_t outOffset = tmp->off_out ? *tmp->off_out : pOut->offset;
+    bool bNoMemory = false;
+    uint64_t nMoved = doTransfer(pIn->file, inOffset, pOut->file, outOffset, tmp->len, !nonBlock, bNoMemory);
+    if((!nMoved) && bNoMemory)
+    {
+        SYSCALL_ERROR(OutOfMemory);
+        return -1;
+    }
+    if((!nMoved) && (pThread->wasInterrupted()))
+    {
+        SYSCALL_ERROR(Interrupted);
+        return -1;
+    }
+
+    if(tmp->off_in)
+        *tmp->off_in += nMoved;
+    else
+        pIn->offset += nMoved;
+    if(tmp->off_out)
+        *tmp->off_out += nMoved;
+    else
+        pOut->offset += nMoved;
+
+    F_NOTICE("    -> " << Dec << nMoved << Hex);
+
+    return static_cast<ssize_t>(nMoved);
+}
+
 int pedigree_get_mount(char* mount_buf, char* info_buf, size_t n)
 {
     if(!(PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(mount_buf), PATH_MAX, PosixSubsystem::SafeWrite) &&
@@ -2106,7 +2630,7 @@ int posix_fchmod(int fd, mode_t mode)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -2158,7 +2682,7 @@ int posix_fchown(int fd, uid_t owner, gid_t group)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -2197,7 +2721,7 @@ int posix_fchdir(int fd)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
@@ -2271,7 +2795,7 @@ int posix_fstatvfs(int fd, struct statvfs *buf)
         return -1;
     }
 
-    FileDescriptor *pFd = pSubsystem->getFileDescriptor(fd);
+    FileDescriptorRef pFd = pSubsystem->getFileDescriptor(fd);
     if (!pFd)
     {
         // Error - no such file descriptor.
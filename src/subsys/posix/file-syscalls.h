@@ -40,6 +40,10 @@ int posix_close(int fd);
 int posix_open(const char *name, int flags, int mode);
 int posix_read(int fd, char *ptr, int len);
 int posix_write(int fd, char *ptr, int len, bool nocheck = false);
+ssize_t posix_readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t posix_writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t posix_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+ssize_t posix_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
 off_t posix_lseek(int file, off_t ptr, int dir);
 int posix_link(char *old, char *_new);
 int posix_unlink(char *name);
@@ -88,6 +92,9 @@ int posix_ftruncate(int a, off_t b);
 
 int posix_fsync(int fd);
 
+ssize_t posix_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+ssize_t posix_splice(void *callInfo);
+
 int posix_fstatvfs(int fd, struct statvfs *buf);
 int posix_statvfs(const char *path, struct statvfs *buf);
 
@@ -33,8 +33,32 @@
 #define SSE_ALIGN_MASK      0xF
 #define NATURAL_MASK        (sizeof(size_t) - 1)
 
+// Above this size, non-temporal SSE2 stores keep a copy from evicting
+// everything else from the cache.
 #define SSE_THRESHOLD 524288 // 512 KiB
 
+// With ERMS, rep movsb/stosb is at least as fast as the word-sized forms
+// from about this size. With FSRM, rep movsb is fast for short copies too.
+#define REP_MOVSB_THRESHOLD 2048
+#define REP_STOSB_THRESHOLD 2048
+
+// Smallest copy worth using 32-byte AVX2 moves for.
+#define AVX2_THRESHOLD 128
+
+#define CPU_FEATURES_KNOWN  (1 << 0)
+#define CPU_ERMS            (1 << 1)
+#define CPU_FSRM            (1 << 2)
+#define CPU_AVX2            (1 << 3)
+
+#define CPUID_1_ECX_OSXSAVE (1 << 27)
+#define CPUID_1_ECX_AVX     (1 << 28)
+#define CPUID_7_EBX_AVX2    (1 << 5)
+#define CPUID_7_EBX_ERMS    (1 << 9)
+#define CPUID_7_EDX_FSRM    (1 << 4)
+
+// XCR0 bits for the XMM and YMM state.
+#define XCR0_SSE_AVX        0x6
+
 /// SSE2-optimised memcpy, where source is unaligned but destination is aligned.
 static void *sse2_src_unaligned_memcpy(void *restrict s1, const void *restrict s2, const size_t n)
 {
@@ -153,29 +177,315 @@ static void *sse2_aligned_memcpy(void *restrict s1, const void *restrict s2, con
     return s1;
 }
 
+/// SSE2-optimised memset for large buffers, with a 16-byte aligned pointer.
+static void sse2_aligned_memset(void *s, const uint64_t pattern[2], const size_t n)
+{
+    uintptr_t p = (uintptr_t) s;
+
+    asm volatile("movdqa (%0), %%xmm0" : : "r" (pattern));
 
-void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
+    // Count of 128 byte blocks
+    size_t i = n >> 7;
+    for(; i > 0; i--)
+    {
+        asm volatile("movntdq %%xmm0, 0(%0);" \
+                     "movntdq %%xmm0, 16(%0);" \
+                     "movntdq %%xmm0, 32(%0);" \
+                     "movntdq %%xmm0, 48(%0);" \
+                     "movntdq %%xmm0, 64(%0);" \
+                     "movntdq %%xmm0, 80(%0);" \
+                     "movntdq %%xmm0, 96(%0);" \
+                     "movntdq %%xmm0, 112(%0);" : : "r" (p) : "memory");
+
+        p += 128;
+    }
+
+    asm volatile("sfence" ::: "memory");
+}
+
+/// AVX2 memcpy, 32 bytes at a time. Copies n & ~31 bytes, front to back.
+static void avx2_memcpy(void *restrict s1, const void *restrict s2, const size_t n)
+{
+    uintptr_t p1 = (uintptr_t) s1;
+    uintptr_t p2 = (uintptr_t) s2;
+
+    // Count of 128 byte blocks
+    size_t i = n >> 7;
+    for(; i > 0; i--)
+    {
+        asm volatile("vmovdqu 0(%0), %%ymm0;" \
+                     "vmovdqu 32(%0), %%ymm1;" \
+                     "vmovdqu 64(%0), %%ymm2;" \
+                     "vmovdqu 96(%0), %%ymm3;" \
+                     "vmovdqu %%ymm0, 0(%1);" \
+                     "vmovdqu %%ymm1, 32(%1);" \
+                     "vmovdqu %%ymm2, 64(%1);" \
+                     "vmovdqu %%ymm3, 96(%1);" : : "r" (p2), "r" (p1) : "memory");
+
+        p1 += 128;
+        p2 += 128;
+    }
+
+    // Count of remaining 32 byte blocks
+    i = (n & 127) >> 5;
+    for(; i > 0; i--)
+    {
+        asm volatile("vmovdqu (%0), %%ymm0;" \
+                     "vmovdqu %%ymm0, (%1);" : : "r" (p2), "r" (p1) : "memory");
+
+        p1 += 32;
+        p2 += 32;
+    }
+
+    // Avoid the penalty for mixing in SSE code with the upper halves dirty.
+    asm volatile("vzeroupper");
+}
+
+/// AVX2 memset, 32 bytes at a time. Sets n & ~31 bytes.
+static void avx2_memset(void *s, const uint64_t pattern[4], const size_t n)
+{
+    uintptr_t p = (uintptr_t) s;
+
+    asm volatile("vmovdqu (%0), %%ymm0" : : "r" (pattern));
+
+    // Count of 128 byte blocks
+    size_t i = n >> 7;
+    for(; i > 0; i--)
+    {
+        asm volatile("vmovdqu %%ymm0, 0(%0);" \
+                     "vmovdqu %%ymm0, 32(%0);" \
+                     "vmovdqu %%ymm0, 64(%0);" \
+                     "vmovdqu %%ymm0, 96(%0);" : : "r" (p) : "memory");
+
+        p += 128;
+    }
+
+    // Count of remaining 32 byte blocks
+    i = (n & 127) >> 5;
+    for(; i > 0; i--)
+    {
+        asm volatile("vmovdqu %%ymm0, (%0)" : : "r" (p) : "memory");
+        p += 32;
+    }
+
+    asm volatile("vzeroupper");
+}
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+#ifdef X64
+    asm volatile("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (subleaf));
+#else
+    // %ebx is the GOT pointer in PIC code, so it can't be clobbered.
+    asm volatile("xchg %%ebx, %1; cpuid; xchg %%ebx, %1" : "=a" (*eax), "=&r" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (subleaf));
+#endif
+}
+
+/// CPU features the mem* functions dispatch on, filled in on first use.
+static int cpu_features()
+{
+    static int features = 0;
+    if(LIKELY(features))
+        return features;
+
+    int f = CPU_FEATURES_KNOWN;
+    uint32_t maxLeaf, eax, ebx, ecx, edx;
+
+    cpuid(0, 0, &maxLeaf, &ebx, &ecx, &edx);
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+    // AVX can only be used if the kernel saves the YMM registers, which it
+    // says by enabling XSAVE and the YMM state in XCR0.
+    int bAvx = 0;
+    if((ecx & CPUID_1_ECX_OSXSAVE) && (ecx & CPUID_1_ECX_AVX))
+    {
+        uint32_t xcr0, xcr0_hi;
+        asm volatile("xgetbv" : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0));
+        bAvx = (xcr0 & XCR0_SSE_AVX) == XCR0_SSE_AVX;
+    }
+
+    if(maxLeaf >= 7)
+    {
+        cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+        if(ebx & CPUID_7_EBX_ERMS)
+            f |= CPU_ERMS;
+        if(edx & CPUID_7_EDX_FSRM)
+            f |= CPU_FSRM;
+        if(bAvx && (ebx & CPUID_7_EBX_AVX2))
+            f |= CPU_AVX2;
+    }
+
+    features = f;
+    return features;
+}
+
+/// Copies using rep movs{l,q}, with byte copies to align the destination.
+static void *natural_memcpy(void *restrict s1, const void *restrict s2, size_t n)
 {
     char *restrict p1 = (char *)s1;
     const char *restrict p2 = (const char *)s2;
 
-    uintptr_t p1_u = (uintptr_t) p1;
-    uintptr_t p2_u = (uintptr_t) p2;
+    size_t unused;
 
-    // Check for bad usage of memcpy
     if(UNLIKELY(!n)) return s1;
 
+    // See if it's even worth aligning
+    switch(n)
+    {
+#ifdef X64
+        case 7:
+            *p1++ = *p2++;
+        case 6:
+            *p1++ = *p2++;
+        case 5:
+            *p1++ = *p2++;
+        case 4:
+            *p1++ = *p2++;
+#endif
+        case 3:
+            *p1++ = *p2++;
+        case 2:
+            *p1++ = *p2++;
+        case 1:
+            *p1++ = *p2++;
+            return s1;
+        default:
+            break;
+    }
+
+    // calculate the distance to the nearest natural boundary
+    size_t offset = (sizeof(size_t) - (((size_t) p1) & NATURAL_MASK)) & NATURAL_MASK;
+
+    // Align p1 on a natural boundary
+    switch(offset)
+    {
+#ifdef X64
+        case 7:
+            *p1++ = *p2++;
+        case 6:
+            *p1++ = *p2++;
+        case 5:
+            *p1++ = *p2++;
+        case 4:
+            *p1++ = *p2++;
+#endif
+        case 3:
+            *p1++ = *p2++;
+        case 2:
+            *p1++ = *p2++;
+        case 1:
+            *p1++ = *p2++;
+            n -= offset;
+        default:
+            break;
+    }
+
+    // Move in size_t size'd blocks
+#ifdef X64
+    size_t blocks = n >> 3;
+#else
+    size_t blocks = n >> 2;
+#endif
+    if(LIKELY(blocks))
+    {
+#ifdef X64
+        asm volatile("rep movsq;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(blocks) : "memory");
+#else
+        asm volatile("rep movsl;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(blocks) : "memory");
+#endif
+    }
+
+    // Clean up the remaining bytes
+    size_t tail = n & NATURAL_MASK;
+    switch(tail)
+    {
+#ifdef X64
+        case 7:
+            *p1++ = *p2++;
+        case 6:
+            *p1++ = *p2++;
+        case 5:
+            *p1++ = *p2++;
+        case 4:
+            *p1++ = *p2++;
+#endif
+        case 3:
+            *p1++ = *p2++;
+        case 2:
+            *p1++ = *p2++;
+        case 1:
+            *p1++ = *p2++;
+        default:
+            break;
+    }
+
+    return s1;
+}
+
+/// Sets using rep stos{l,q}, with byte stores to align the pointer.
+static void *natural_memset(void *s, int c, size_t n)
+{
+    char *p1 = (char *) s;
     size_t unused;
 
+    // Align to a natural boundary.
+    size_t align = (sizeof(size_t) - (((uintptr_t) p1) & NATURAL_MASK)) & NATURAL_MASK;
+    if(UNLIKELY(align > n)) align = n;
+    n -= align;
+    while(align--)
+        *p1++ = c;
+
+    // Write a full size_t at a time, with the byte in all positions.
+    size_t val = (unsigned char) c;
+#ifdef X64
+    size_t blocks = n >> 3;
+    val *= 0x0101010101010101ULL;
+#else
+    size_t blocks = n >> 2;
+    val *= 0x01010101UL;
+#endif
+
+    if(LIKELY(blocks))
+    {
+#ifdef X64
+        asm volatile("rep stosq" : "=D" (p1), "=c" (unused) : "D" (p1), "c" (blocks), "a" (val) : "memory");
+#else
+        asm volatile("rep stosl" : "=D" (p1), "=c" (unused) : "D" (p1), "c" (blocks), "a" (val) : "memory");
+#endif
+    }
+
+    // Tail.
+    size_t tail = n & NATURAL_MASK;
+    while(tail--)
+        *p1++ = c;
+
+    return s;
+}
+
+void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
+{
+    char *restrict p1 = (char *)s1;
+    const char *restrict p2 = (const char *)s2;
+
+    // Check for bad usage of memcpy
+    if(UNLIKELY(!n)) return s1;
+
     // Should we do SSE?
     // rep movs* is VERY fast until the point at which SSE prefetches
     // and the like can actually greatly improve performance.
     if(n > SSE_THRESHOLD)
     {
+        // Align destination, use source unaligned if need be.
+        // This allows us to use aligned non-temporal writes, with
+        // (prefetched) unaligned reads from the source.
+        size_t distance = (SSE_ALIGN_SIZE - (((uintptr_t) p1) & SSE_ALIGN_MASK)) & SSE_ALIGN_MASK;
+        natural_memcpy(p1, p2, distance);
+        p1 += distance;
+        p2 += distance;
+        n -= distance;
+
         // Transfer in 128 byte blocks.
-        uintptr_t p1Align = p1_u & SSE_ALIGN_MASK;
-        uintptr_t p2Align = p2_u & SSE_ALIGN_MASK;
-        if(LIKELY(!(p1Align || p2Align)))
+        if(LIKELY(!(((uintptr_t) p2) & SSE_ALIGN_MASK)))
         {
             // Fully aligned inputs.
             /// \note Please call memcpy with aligned src/dest as much as
@@ -183,161 +493,121 @@ void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
             sse2_aligned_memcpy(p1, p2, n);
         }
         else
-        {
-            // Align destination, use source unaligned.
-            // This allows us to use aligned non-temporal writes, with
-            // (prefetched) unaligned reads from the source.
-            size_t distance = SSE_ALIGN_SIZE - p1Align;
-            switch(distance)
-            {
-                case 15:
-                    *p1++ = *p2++;
-                case 14:
-                    *p1++ = *p2++;
-                case 13:
-                    *p1++ = *p2++;
-                case 12:
-                    *p1++ = *p2++;
-                case 11:
-                    *p1++ = *p2++;
-                case 10:
-                    *p1++ = *p2++;
-                case 9:
-                    *p1++ = *p2++;
-                case 8:
-                    *p1++ = *p2++;
-                case 7:
-                    *p1++ = *p2++;
-                case 6:
-                    *p1++ = *p2++;
-                case 5:
-                    *p1++ = *p2++;
-                case 4:
-                    *p1++ = *p2++;
-                case 3:
-                    *p1++ = *p2++;
-                case 2:
-                    *p1++ = *p2++;
-                case 1:
-                    *p1++ = *p2++;
-                default:
-                    break;
-            }
-
             sse2_src_unaligned_memcpy(p1, p2, n);
-        }
+        asm volatile("sfence" ::: "memory");
 
         size_t count = n & ~((1 << 7) - 1); // Aligns n to 128 byte boundary.
         p1 += count;
         p2 += count;
 
         // Finish off any trailing bytes that couldn't be transferred as part of a 128 byte block.
-        if(n != count)
-            memcpy(p1, p2, n - count);
+        natural_memcpy(p1, p2, n - count);
 
         return s1;
     }
-    else
-    {
-        // Not enough bytes for SSE to be worth the FPU save.
 
-        // See if it's even worth aligning
-        switch(n)
-        {
-#ifdef X64
-            case 7:
-                *p1++ = *p2++;
-            case 6:
-                *p1++ = *p2++;
-            case 5:
-                *p1++ = *p2++;
-            case 4:
-                *p1++ = *p2++;
-#endif
-            case 3:
-                *p1++ = *p2++;
-            case 2:
-                *p1++ = *p2++;
-            case 1:
-                *p1++ = *p2++;
-                return s1;
-            default:
-                break;
-        }
+    int features = cpu_features();
+    if((features & CPU_FSRM) || ((features & CPU_ERMS) && (n >= REP_MOVSB_THRESHOLD)))
+    {
+        size_t unused;
+        asm volatile("rep movsb" : "=D" (unused), "=S" (unused), "=c" (unused) : "D" (p1), "S" (p2), "c" (n) : "memory");
+        return s1;
+    }
 
-        // calculate the distance to the nearest natural boundary
-        size_t offset = (sizeof(size_t) - (((size_t) p1) & NATURAL_MASK)) & NATURAL_MASK;
+    if((features & CPU_AVX2) && (n >= AVX2_THRESHOLD))
+    {
+        size_t count = n & ~31;
+        avx2_memcpy(p1, p2, count);
+        natural_memcpy(p1 + count, p2 + count, n - count);
+        return s1;
+    }
 
-        // Align p1 on a natural boundary
-        switch(offset)
-        {
-#ifdef X64
-            case 7:
-                *p1++ = *p2++;
-            case 6:
-                *p1++ = *p2++;
-            case 5:
-                *p1++ = *p2++;
-            case 4:
-                *p1++ = *p2++;
-#endif
-            case 3:
-                *p1++ = *p2++;
-            case 2:
-                *p1++ = *p2++;
-            case 1:
-                *p1++ = *p2++;
-                n -= offset;
-            default:
-                break;
-        }
+    return natural_memcpy(s1, s2, n);
+}
 
-        // Move in size_t size'd blocks
-#ifdef X64
-        size_t blocks = n >> 3;
-#else
-        size_t blocks = n >> 2;
-#endif
-        if(LIKELY(blocks))
-        {
-#ifdef X64
-            asm volatile("rep movsq;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(blocks) : "memory");
-#else
-            asm volatile("rep movsl;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(blocks) : "memory");
-#endif
-        }
+void *memmove(void *s1, const void *s2, size_t n)
+{
+    char *p1 = (char *)s1;
+    const char *p2 = (const char *)s2;
+
+    // memcpy() always copies front to back, which is fine unless the
+    // destination starts inside the source.
+    if((p1 <= p2) || (p1 >= (p2 + n)))
+        return memcpy(s1, s2, n);
+
+    // Work backwards, aligning the end of the destination first.
+    p1 += n;
+    p2 += n;
+    while((((uintptr_t) p1) & NATURAL_MASK) && n)
+    {
+        *--p1 = *--p2;
+        --n;
+    }
 
-        // Clean up the remaining bytes
-        size_t tail = n & NATURAL_MASK;
-        switch(tail)
-        {
-#ifdef X64
-            case 7:
-                *p1++ = *p2++;
-            case 6:
-                *p1++ = *p2++;
-            case 5:
-                *p1++ = *p2++;
-            case 4:
-                *p1++ = *p2++;
-#endif
-            case 3:
-                *p1++ = *p2++;
-            case 2:
-                *p1++ = *p2++;
-            case 1:
-                *p1++ = *p2++;
-            default:
-                break;
-        }
+    size_t *w1 = (size_t *) p1;
+    const size_t *w2 = (const size_t *) p2;
+    while(n >= sizeof(size_t))
+    {
+        *--w1 = *--w2;
+        n -= sizeof(size_t);
     }
 
+    p1 = (char *) w1;
+    p2 = (const char *) w2;
+    while(n--)
+        *--p1 = *--p2;
+
     return s1;
 }
 
+void *memset(void *s, int c, size_t n)
+{
+    char *p1 = (char *) s;
+
+    if(UNLIKELY(!n)) return s;
+
+    if(n > SSE_THRESHOLD)
+    {
+        uint64_t pattern[2] __attribute__((aligned(16)));
+        pattern[0] = pattern[1] = ((unsigned char) c) * 0x0101010101010101ULL;
+
+        size_t distance = (SSE_ALIGN_SIZE - (((uintptr_t) p1) & SSE_ALIGN_MASK)) & SSE_ALIGN_MASK;
+        natural_memset(p1, c, distance);
+        p1 += distance;
+        n -= distance;
+
+        sse2_aligned_memset(p1, pattern, n);
+
+        size_t count = n & ~((1 << 7) - 1);
+        natural_memset(p1 + count, c, n - count);
+
+        return s;
+    }
+
+    int features = cpu_features();
+    if((features & CPU_ERMS) && (n >= REP_STOSB_THRESHOLD))
+    {
+        size_t unused;
+        asm volatile("rep stosb" : "=D" (unused), "=c" (unused) : "D" (p1), "c" (n), "a" (c) : "memory");
+        return s;
+    }
+
+    if((features & CPU_AVX2) && (n >= AVX2_THRESHOLD))
+    {
+        uint64_t pattern[4];
+        pattern[0] = pattern[1] = pattern[2] = pattern[3] = ((unsigned char) c) * 0x0101010101010101ULL;
+
+        size_t count = n & ~31;
+        avx2_memset(p1, pattern, count);
+        natural_memset(p1 + count, c, n - count);
+        return s;
+    }
+
+    return natural_memset(s, c, n);
+}
+
 #else
 
 /* No custom memcpy on ARM. */
 
 #endif
-
@@ -321,44 +321,22 @@ _ssize_t write(int file, const void *ptr, size_t len)
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
 {
-    if(!iov || !iovcnt || (fd == -1))
-    {
-        errno = EINVAL;
-        return -1;
-    }
-
-    ssize_t ret = 0;
-    int i;
-    for(i = 0; i < iovcnt; i++)
-    {
-        if(iov[i].iov_base)
-        {
-            ssize_t r = read(fd, iov[i].iov_base, iov[i].iov_len);
-            ret += r;
-        }
-    }
-    return ret;
+    return (ssize_t) syscall3(POSIX_READV, fd, (long) iov, iovcnt);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
 {
-    if(!iov || !iovcnt || (fd == -1))
-    {
-        errno = EINVAL;
-        return -1;
-    }
+    return (ssize_t) syscall3(POSIX_WRITEV, fd, (long) iov, iovcnt);
+}
 
-    ssize_t ret = 0;
-    int i;
-    for(i = 0; i < iovcnt; i++)
-    {
-        if(iov[i].iov_base)
-        {
-            ssize_t r = write(fd, iov[i].iov_base, iov[i].iov_len);
-            ret += r;
-        }
-    }
-    return ret;
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    return (ssize_t) syscall4(POSIX_PREADV, fd, (long) iov, iovcnt, offset);
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    return (ssize_t) syscall4(POSIX_PWRITEV, fd, (long) iov, iovcnt, offset);
 }
 
 int lstat(const char *file, struct stat *st)
@@ -935,14 +913,12 @@ ssize_t recvfrom(int sock, void* buff, size_t bufflen, int flags, struct sockadd
 
 ssize_t recvmsg(int sock, struct msghdr* msg, int flags)
 {
-    STUBBED("recvmsg");
-    return -1;
+    return (ssize_t)syscall3(POSIX_RECVMSG, sock, (long) msg, flags);
 }
 
 ssize_t sendmsg(int sock, const struct msghdr* msg, int flags)
 {
-    STUBBED("sendmsg");
-    return -1;
+    return (ssize_t)syscall3(POSIX_SENDMSG, sock, (long) msg, flags);
 }
 
 ssize_t sendto(int sock, const void* buff, size_t bufflen, int flags, const struct sockaddr* remote_addr, socklen_t addrlen)
@@ -1328,6 +1304,34 @@ int fsync(int fd)
     return syscall1(POSIX_FSYNC, fd);
 }
 
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    return (ssize_t) syscall4(POSIX_SENDFILE, out_fd, in_fd, (long) offset, count);
+}
+
+struct special_splice_data
+{
+    int fd_in;
+    off_t *off_in;
+    int fd_out;
+    off_t *off_out;
+    size_t len;
+    unsigned int flags;
+} __attribute__((packed));
+
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags)
+{
+    struct special_splice_data tmp;
+    tmp.fd_in = fd_in;
+    tmp.off_in = off_in;
+    tmp.fd_out = fd_out;
+    tmp.off_out = off_out;
+    tmp.len = len;
+    tmp.flags = flags;
+
+    return (ssize_t) syscall1(POSIX_SPLICE, (long) &tmp);
+}
+
 int inet_pton(int af, const char *src, void *dst)
 {
     if(af != AF_INET)
@@ -1 +1,21 @@
 #include <sys/fcntl.h>
+
+#ifndef _FCNTL_SPLICE
+#define _FCNTL_SPLICE
+
+#define SPLICE_F_MOVE       1
+#define SPLICE_F_NONBLOCK   2
+#define SPLICE_F_MORE       4
+#define SPLICE_F_GIFT       8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -49,6 +49,22 @@ void pedigree_config_get_error_message(size_t resultIdx, char *buf, int buflen);
 
 char *pedigree_config_escape_string(const char *str);
 
+int pedigree_config_prepare(const char *sql);
+
+int pedigree_config_bind_num(size_t cursorIdx, size_t n, long value);
+
+int pedigree_config_bind_str(size_t cursorIdx, size_t n, const char *value);
+
+int pedigree_config_step(size_t cursorIdx);
+
+void pedigree_config_col_str(size_t cursorIdx, size_t col, char *buf, size_t bufsz);
+
+int pedigree_config_col_num(size_t cursorIdx, size_t col);
+
+void pedigree_config_cursor_error(size_t cursorIdx, char *buf, size_t bufsz);
+
+void pedigree_config_free_cursor(size_t cursorIdx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,6 +15,7 @@ _BEGIN_STD_C
 
 #define MAP_USERSVD         0x10000
 #define MAP_PHYS_OFFSET     0x20000
+#define MAP_HUGETLB         0x40000
 
 #define MAP_FAILED ((void*) 0)
 
@@ -16,6 +16,8 @@ extern "C" {
 
 ssize_t readv(int fildes, const struct iovec *iov, int iovcnt);
 ssize_t writev(int fildes, const struct iovec *iov, int iovcnt);
+ssize_t preadv(int fildes, const struct iovec *iov, int iovcnt, off_t offset);
+ssize_t pwritev(int fildes, const struct iovec *iov, int iovcnt, off_t offset);
 
 #ifdef __cplusplus
 }
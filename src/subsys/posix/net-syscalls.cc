@@ -129,10 +129,10 @@ int posix_connect(int sock, struct sockaddr* address, size_t addrlen)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(sock);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
     if (!f || !f->file || (f->so_domain == AF_UNIX))
     {
-        if(f && ((!f->file) || (f->file == f->so_local)) && (f->so_domain == AF_UNIX))
+        if(f.get() && ((!f->file) || (f->file == f->so_local)) && (f->so_domain == AF_UNIX))
         {
             if(address->sa_family != AF_UNIX)
             {
@@ -252,9 +252,9 @@ int posix_connect(int sock, struct sockaddr* address, size_t addrlen)
     return success ? 0 : -1;
 }
 
-ssize_t posix_send(int sock, const void* buff, size_t bufflen, int flags)
+ssize_t posix_send(int sock, const void* buff, size_t bufflen, int flags, bool nocheck)
 {
-    if(!PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(buff), bufflen, PosixSubsystem::SafeRead))
+    if(!nocheck && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(buff), bufflen, PosixSubsystem::SafeRead))
     {
         N_NOTICE("send -> invalid address");
         SYSCALL_ERROR(InvalidArgument);
@@ -271,7 +271,7 @@ ssize_t posix_send(int sock, const void* buff, size_t bufflen, int flags)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(sock);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
     if (!f || !f->file)
     {
         SYSCALL_ERROR(BadFileDescriptor);
@@ -343,7 +343,7 @@ ssize_t posix_sendto(void* callInfo)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(sock);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
     if (!f || !f->file)
     {
         SYSCALL_ERROR(BadFileDescriptor);
@@ -396,9 +396,9 @@ ssize_t posix_sendto(void* callInfo)
     return -1;
 }
 
-ssize_t posix_recv(int sock, void* buff, size_t bufflen, int flags)
+ssize_t posix_recv(int sock, void* buff, size_t bufflen, int flags, bool nocheck)
 {
-    if(!PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(buff), bufflen, PosixSubsystem::SafeWrite))
+    if(!nocheck && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(buff), bufflen, PosixSubsystem::SafeWrite))
     {
         N_NOTICE("recv -> invalid address");
         SYSCALL_ERROR(InvalidArgument);
@@ -415,7 +415,7 @@ ssize_t posix_recv(int sock, void* buff, size_t bufflen, int flags)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(sock);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
     if (!f || !f->file)
     {
         SYSCALL_ERROR(BadFileDescriptor);
@@ -473,7 +473,7 @@ ssize_t posix_recvfrom(void* callInfo)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(sock);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
     if (!f || !f->file)
     {
         SYSCALL_ERROR(BadFileDescriptor);
@@ -532,6 +532,230 @@ ssize_t posix_recvfrom(void* callInfo)
     return ret;
 }
 
+/** Largest message sendmsg() and recvmsg() gather into one buffer. This is
+ *  the largest possible datagram; stream sockets just move less per call. */
+#define MSG_GATHER_SIZE     0x10000
+
+/** Whether each receive on f takes one whole message, discarding whatever
+ *  doesn't fit. UNIX sockets of every type work this way. */
+static bool isMessageSocket(const FileDescriptorRef &f)
+{
+    return (f->so_domain == AF_UNIX) || (f->so_type == SOCK_DGRAM) || (f->so_type == SOCK_RAW);
+}
+
+/** Validates a user msghdr and the buffers it points to, returning the total
+ *  length of its iovecs, or -1. An empty iovec array is fine. */
+static ssize_t checkMsghdr(const struct msghdr *msg, bool bSend)
+{
+    if(!PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(msg), sizeof(struct msghdr),
+                                     bSend ? PosixSubsystem::SafeRead : (PosixSubsystem::SafeRead | PosixSubsystem::SafeWrite)))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    if(msg->msg_iovlen < 0 || msg->msg_iovlen > IOV_MAX ||
+       (msg->msg_iovlen && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(msg->msg_iov), sizeof(struct iovec) * msg->msg_iovlen, PosixSubsystem::SafeRead)))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    if(msg->msg_name && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(msg->msg_name), msg->msg_namelen,
+                                                      bSend ? PosixSubsystem::SafeRead : PosixSubsystem::SafeWrite))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    size_t total = 0;
+    for(int i = 0; i < msg->msg_iovlen; ++i)
+    {
+        const struct iovec *v = &msg->msg_iov[i];
+        if(v->iov_len && !PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(v->iov_base), v->iov_len,
+                                                       bSend ? PosixSubsystem::SafeRead : PosixSubsystem::SafeWrite))
+        {
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+        }
+
+        total += v->iov_len;
+        if(total < v->iov_len || static_cast<ssize_t>(total) < 0)
+        {
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+        }
+    }
+
+    return static_cast<ssize_t>(total);
+}
+
+ssize_t posix_sendmsg(int sock, const struct msghdr *msg, int flags)
+{
+    N_NOTICE("posix_sendmsg");
+
+    ssize_t total = checkMsghdr(msg, true);
+    if(total < 0)
+        return -1;
+
+    Process *pProcess = Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem = reinterpret_cast<PosixSubsystem*>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for this process!");
+        return -1;
+    }
+
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
+    if (!f || !f->file)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+    bool bMessage = isMessageSocket(f);
+
+    if(total > MSG_GATHER_SIZE)
+    {
+        // A datagram has to go out whole or not at all; a stream can take
+        // the rest on the next call.
+        if(bMessage)
+        {
+            SYSCALL_ERROR(MessageTooLong);
+            return -1;
+        }
+        total = MSG_GATHER_SIZE;
+    }
+    else if(!total && !bMessage)
+    {
+        // Nothing to send. An empty datagram, on the other hand, still goes.
+        return 0;
+    }
+
+    // Gather the iovecs so the message goes out as one send - one datagram,
+    // or one run of segments on a stream.
+    uint8_t *pBuffer = new uint8_t[total ? total : 1];
+    size_t off = 0;
+    for(int i = 0; i < msg->msg_iovlen && off < static_cast<size_t>(total); ++i)
+    {
+        size_t sz = msg->msg_iov[i].iov_len;
+        if(sz > total - off)
+            sz = total - off;
+        memcpy(pBuffer + off, msg->msg_iov[i].iov_base, sz);
+        off += sz;
+    }
+
+    ssize_t ret;
+    if(msg->msg_name)
+    {
+        socklen_t addrlen = msg->msg_namelen;
+
+        special_send_recv_data data;
+        data.sock = sock;
+        data.buff = pBuffer;
+        data.bufflen = total;
+        data.flags = flags;
+        data.remote_addr = reinterpret_cast<struct sockaddr *>(msg->msg_name);
+        data.addrlen = &addrlen;
+        ret = posix_sendto(&data);
+    }
+    else
+        ret = posix_send(sock, pBuffer, total, flags, true);
+
+    delete [] pBuffer;
+    return ret;
+}
+
+ssize_t posix_recvmsg(int sock, struct msghdr *msg, int flags)
+{
+    N_NOTICE("posix_recvmsg");
+
+    ssize_t total = checkMsghdr(msg, false);
+    if(total < 0)
+        return -1;
+
+    Process *pProcess = Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pSubsystem = reinterpret_cast<PosixSubsystem*>(pProcess->getSubsystem());
+    if (!pSubsystem)
+    {
+        ERROR("No subsystem for this process!");
+        return -1;
+    }
+
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
+    if (!f || !f->file)
+    {
+        SYSCALL_ERROR(BadFileDescriptor);
+        return -1;
+    }
+
+    // No ancillary data is supported.
+    msg->msg_controllen = 0;
+    msg->msg_flags = 0;
+
+    // A message socket hands over a whole message per receive and drops
+    // what doesn't fit, so take in the largest possible one to find out
+    // whether the caller's buffers truncated it. No datagram is any bigger.
+    bool bMessage = isMessageSocket(f);
+    size_t bufflen = bMessage ? MSG_GATHER_SIZE : static_cast<size_t>(total);
+    if(bufflen > MSG_GATHER_SIZE)
+        bufflen = MSG_GATHER_SIZE;
+    if(!bufflen)
+        return 0;
+
+    uint8_t *pBuffer = new uint8_t[bufflen];
+
+    ssize_t ret;
+    if(msg->msg_name)
+    {
+        socklen_t addrlen = msg->msg_namelen;
+
+        // posix_recvfrom fills in a whole sockaddr, so receive it into a
+        // kernel one and copy out what fits.
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+
+        special_send_recv_data data;
+        data.sock = sock;
+        data.buff = pBuffer;
+        data.bufflen = bufflen;
+        data.flags = flags;
+        data.remote_addr = reinterpret_cast<struct sockaddr *>(&address);
+        data.addrlen = &addrlen;
+        ret = posix_recvfrom(&data);
+
+        if(ret >= 0)
+        {
+            if(addrlen > msg->msg_namelen)
+                addrlen = msg->msg_namelen;
+            memcpy(msg->msg_name, &address, addrlen);
+            msg->msg_namelen = addrlen;
+        }
+    }
+    else
+        ret = posix_recv(sock, pBuffer, bufflen, flags, true);
+
+    if(ret > total)
+    {
+        msg->msg_flags |= MSG_TRUNC;
+        ret = total;
+    }
+
+    // Scatter what arrived.
+    size_t off = 0;
+    for(int i = 0; ret > 0 && i < msg->msg_iovlen && off < static_cast<size_t>(ret); ++i)
+    {
+        size_t sz = msg->msg_iov[i].iov_len;
+        if(sz > ret - off)
+            sz = ret - off;
+        memcpy(msg->msg_iov[i].iov_base, pBuffer + off, sz);
+        off += sz;
+    }
+
+    delete [] pBuffer;
+
+    return ret;
+}
+
 int posix_bind(int sock, const struct sockaddr *address, size_t addrlen)
 {
     if(!PosixSubsystem::checkAddress(reinterpret_cast<uintptr_t>(address), addrlen, PosixSubsystem::SafeRead))
@@ -551,10 +775,10 @@ int posix_bind(int sock, const struct sockaddr *address, size_t addrlen)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(sock);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
     if (!f || !f->file)
     {
-        if(f && (!f->file) && (f->so_domain == AF_UNIX))
+        if(f.get() && (!f->file) && (f->so_domain == AF_UNIX))
         {
             if(address->sa_family != AF_UNIX)
             {
@@ -623,8 +847,8 @@ int posix_listen(int sock, int backlog)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(sock);
-    if(!(f && f->file))
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
+    if(!(f.get() && f->file))
     {
         SYSCALL_ERROR(BadFileDescriptor);
         return -1;
@@ -681,7 +905,7 @@ int posix_accept(int sock, struct sockaddr* address, size_t* addrlen)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(sock);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(sock);
     Socket *s1 = static_cast<Socket *>(f->file);
     if (!s1)
         return -1;
@@ -867,7 +1091,7 @@ int posix_shutdown(int socket, int how)
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(socket);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(socket);
     Socket *s = static_cast<Socket *>(f->file);
     if (!s)
     {
@@ -915,7 +1139,7 @@ int posix_getpeername(int socket, struct sockaddr *address, socklen_t *address_l
         return -1;
     }
 
-    FileDescriptor *f = pSubsystem->getFileDescriptor(socket);
+    FileDescriptorRef f = pSubsystem->getFileDescriptor(socket);
     if (!f || !f->file)
     {
         SYSCALL_ERROR(BadFileDescriptor);
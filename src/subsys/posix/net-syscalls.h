@@ -32,10 +32,12 @@
 int posix_socket(int domain, int type, int protocol);
 int posix_connect(int sock, struct sockaddr* address, size_t addrlen);
 
-ssize_t posix_send(int sock, const void* buff, size_t bufflen, int flags);
+ssize_t posix_send(int sock, const void* buff, size_t bufflen, int flags, bool nocheck = false);
 ssize_t posix_sendto(void* callInfo);
-ssize_t posix_recv(int sock, void* buff, size_t bufflen, int flags);
+ssize_t posix_recv(int sock, void* buff, size_t bufflen, int flags, bool nocheck = false);
 ssize_t posix_recvfrom(void* callInfo);
+ssize_t posix_sendmsg(int sock, const struct msghdr *msg, int flags);
+ssize_t posix_recvmsg(int sock, struct msghdr *msg, int flags);
 
 int posix_listen(int sock, int backlog);
 int posix_bind(int sock, const struct sockaddr *address, size_t addrlen);
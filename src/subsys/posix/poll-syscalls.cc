@@ -167,7 +167,7 @@ int posix_poll(struct pollfd* fds, unsigned int nfds, int timeout)
         }
 
         // valid fd?
-        FileDescriptor *pFd = pSubsystem->getFileDescriptor(me->fd);
+        FileDescriptorRef pFd = pSubsystem->getFileDescriptor(me->fd);
         if (!pFd)
         {
             // Error - no such file descriptor.
@@ -178,7 +178,7 @@ int posix_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds,
     for (int i = 0; i < nfds; i++)
     {
         // valid fd?
-        FileDescriptor *pFd = 0;
+        FileDescriptorRef pFd;
         if ((readfds && FD_ISSET(i, readfds)) ||
             (writefds && FD_ISSET(i, writefds)) ||
             (errorfds && FD_ISSET(i, errorfds)))
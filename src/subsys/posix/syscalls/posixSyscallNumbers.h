@@ -187,6 +187,17 @@
 
 #define POSIX_REALPATH          126
 
+#define POSIX_SENDFILE          127
+#define POSIX_SPLICE            128
+
+#define POSIX_READV             129
+#define POSIX_WRITEV            130
+#define POSIX_PREADV            131
+#define POSIX_PWRITEV           132
+
+#define POSIX_SENDMSG           133
+#define POSIX_RECVMSG           134
+
 #define POSIX_PTSNAME           200
 #define POSIX_TTYNAME           201
 #define POSIX_TCSETPGRP         202
@@ -33,98 +33,51 @@
 #define SHOW_FILE_IN_LOGS 0
 
 #if SHOW_FILE_IN_LOGS
-#define FILE_LOG(level) \
+#define FILE_LOG(stream) \
   do \
   { \
-    Log::instance() << level << __FILE__ << ":" << Dec << __LINE__ << Hex << " " << __FUNCTION__ << " -- "; \
+    stream << __FILE__ << ":" << Dec << __LINE__ << Hex << " " << __FUNCTION__ << " -- "; \
   } while(0)
 #else
-#define FILE_LOG(level)
+#define FILE_LOG(stream)
 #endif
 
-/** Add a debug item to the log */
-#ifdef DEBUG_LOGGING
-#define DEBUG_LOG(text) \
+/** Writes one entry to the log. Use the macros below rather than this. */
+#define LOG_WRITE(level, bLock, text) \
   do \
   { \
-    Log::instance().m_Lock.acquire(); \
-    FILE_LOG(Log::Debug); \
-    Log::instance() << Log::Debug << text << Flush; \
-    Log::instance().m_Lock.release(); \
+    Log::Stream logStream_(level, bLock); \
+    FILE_LOG(logStream_); \
+    logStream_ << text << Flush; \
   } \
   while (0)
 
-#define DEBUG_LOG_NOLOCK(text) \
-  do \
-  { \
-    FILE_LOG(Log::Debug); \
-    Log::instance() << Log::Debug << text << Flush; \
-  } \
-  while (0)
+/** Add a debug item to the log */
+#ifdef DEBUG_LOGGING
+#define DEBUG_LOG(text) LOG_WRITE(Log::Debug, true, text)
+#define DEBUG_LOG_NOLOCK(text) LOG_WRITE(Log::Debug, false, text)
 #else
 #define DEBUG_LOG(text)
 #define DEBUG_LOG_NOLOCK(text)
 #endif
 
 /** Add a notice to the log */
-#define NOTICE(text) \
-  do \
-  { \
-    Log::instance().m_Lock.acquire(); \
-    FILE_LOG(Log::Notice); \
-    Log::instance() << Log::Notice << text << Flush; \
-    Log::instance().m_Lock.release(); \
-  } \
-  while (0)
+#define NOTICE(text) LOG_WRITE(Log::Notice, true, text)
 
 /// \note You use this in the wrong way, you die.
-#define NOTICE_NOLOCK(text) \
-  do \
-  { \
-    FILE_LOG(Log::Notice); \
-    Log::instance() << Log::Notice << text << Flush; \
-  } \
-  while (0)
+#define NOTICE_NOLOCK(text) LOG_WRITE(Log::Notice, false, text)
 
 /** Add a warning message to the log */
-#define WARNING(text) \
-  do \
-  { \
-    Log::instance().m_Lock.acquire(); \
-    FILE_LOG(Log::Warning); \
-    Log::instance() << Log::Warning << text << Flush; \
-    Log::instance().m_Lock.release(); \
-  } \
-  while (0)
+#define WARNING(text) LOG_WRITE(Log::Warning, true, text)
 
 /// \note You use this in the wrong way, you die.
-#define WARNING_NOLOCK(text) \
-  do \
-  { \
-    FILE_LOG(Log::Warning); \
-    Log::instance() << Log::Warning << text << Flush; \
-  } \
-  while (0)
+#define WARNING_NOLOCK(text) LOG_WRITE(Log::Warning, false, text)
 
 /** Add a error message to the log */
-#define ERROR(text) \
-  do \
-  { \
-    Log::instance().m_Lock.acquire(); \
-    FILE_LOG(Log::Error); \
-    Log::instance() << Log::Error << text << Flush; \
-    Log::instance().m_Lock.release(); \
-  } \
-  while (0)
+#define ERROR(text) LOG_WRITE(Log::Error, true, text)
 
 /// \note You use this in the wrong way, you die.
-#define ERROR_NOLOCK(text) \
-  do \
-  { \
-    FILE_LOG(Log::Error); \
-    Log::instance() << Log::Error << text << Flush; \
-  } \
-  while (0)
+#define ERROR_NOLOCK(text) LOG_WRITE(Log::Error, false, text)
 
 
 /** Add a fatal message to the log
@@ -134,11 +87,12 @@
 #define FATAL(text) \
   do \
   { \
-    Log::instance().m_Lock.acquire(); \
-    FILE_LOG(Log::Fatal); \
-    Log::instance() << Log::Fatal << text << Flush; \
+    { \
+      Log::Stream logStream_(Log::Fatal, true); \
+      FILE_LOG(logStream_); \
+      logStream_ << text << Flush; \
+    } \
     const char *panicstr = static_cast<const char*>(Log::instance().getLatestEntry().str); \
-    Log::instance().m_Lock.release(); \
     Processor::breakpoint(); \
     panic(panicstr); \
   } \
@@ -148,8 +102,11 @@
 #define FATAL_NOLOCK(text) \
   do \
   { \
-    FILE_LOG(Log::Fatal); \
-    Log::instance() << Log::Fatal << text << Flush; \
+    { \
+      Log::Stream logStream_(Log::Fatal, false); \
+      FILE_LOG(logStream_); \
+      logStream_ << text << Flush; \
+    } \
     Processor::breakpoint(); \
     panic(static_cast<const char*>(Log::instance().getLatestEntry().str)); \
   } \
@@ -165,6 +122,8 @@
 // 64K static log buffer
 #define LOG_ENTRIES ((1<<16)/sizeof(LogEntry))
 #endif
+/** The number of entries each CPU can have waiting for the drain thread. */
+#define LOG_RING_ENTRIES  32
 
 /** Radix for Log's integer output */
 enum NumberType
@@ -196,9 +155,21 @@ extern BootProgressUpdateFn g_BootProgressUpdate;
  *\brief the kernel's log
  *\note You should use the NOTICE, WARNING, ERROR and FATAL macros to write something
  *      into the log. Direct access to the log should only be needed to retrieve
- *      the entries from the log (within the debugger's log viewer for example). */
+ *      the entries from the log (within the debugger's log viewer for example).
+ *
+ *  Once the drain thread is running, each CPU writes its entries into a ring
+ *  of its own without taking any lock, and the drain thread moves them into
+ *  the static log and out to the callbacks (in the order they were written).
+ *  Before then, and whenever a CPU's ring is full, an entry is written
+ *  straight through under m_Lock like it always was.
+ *
+ *  m_Lock is never held while a callback runs. Entries in the static log
+ *  that haven't been sent yet are taken one at a time under the lock, and
+ *  sent after it is released by whichever CPU got there first. */
 class Log
 {
+  struct CpuLog;
+
 public:
 
   /** Output callback function type. Inherit and implement callback to use. */
@@ -222,8 +193,81 @@ public:
     Fatal
   };
 
+  /** Stores an entry in the log.
+   *\param[in] T type of the log's text */
+  struct LogEntry
+  {
+    /** Constructor does nothing */
+    inline LogEntry()
+     : timestamp(), type(), str(){}
+
+    /** The time (since boot) that this log entry was added, in ticks. */
+    unsigned int timestamp;
+    /** The severity level of this entry. */
+    SeverityLevel type;
+    /** The actual entry text. */
+    StaticString<LOG_LENGTH> str;
+  };
+
+  /** Builds one log entry. Interrupts are disabled for as long as it lives,
+   *  so it must not outlive the statement that creates it (the logging
+   *  macros take care of that). */
+  class Stream
+  {
+    public:
+      /** Starts an entry.
+       *\param[in] level the severity of the entry
+       *\param[in] bLock whether m_Lock may be taken if the entry has to be
+       *                 written straight through */
+      Stream(SeverityLevel level, bool bLock);
+      /** Ends the entry. Anything not yet flushed is thrown away. */
+      ~Stream();
+
+      /** Appends to the entry.
+       *\param[in] str the null-terminated ASCII string that should be added */
+      Stream &operator<< (const char *str);
+      Stream &operator<< (const String &str);
+      /** Appends to the entry.
+       *\param[in] str the null-terminated ASCII string that should be added */
+      inline Stream &operator<< (char *str)
+        {return (*this) << (reinterpret_cast<const char*>(str));}
+      /** Appends to the entry.
+       *\param[in] b boolean value */
+      Stream &operator<< (bool b);
+      /** Appends to the entry (integer type).
+       *\param[in] n the number */
+      template<class T>
+      Stream &operator << (T n);
+
+      /** Changes the number type between hex and decimal. */
+      Stream &operator<< (NumberType type);
+      /** Modifier */
+      Stream &operator<< (Modifier type);
+
+    private:
+      Stream(const Stream &);
+      Stream &operator = (const Stream &);
+
+      /** The entry being written: a slot in a CPU's ring, or m_Buffer. */
+      LogEntry *m_pEntry;
+      /** The ring m_pEntry is in, or 0 if it is written straight through. */
+      CpuLog *m_pCpu;
+      /** The CPU writing the entry. */
+      size_t m_Cpu;
+      /** The number type mode that we are in. */
+      NumberType m_NumberType;
+      /** Whether interrupts were enabled before the entry was started. */
+      bool m_bInterrupts;
+      /** Whether we hold m_Lock. */
+      bool m_bLocked;
+      /** Whether the entry went straight into the static log, and so still
+       *  needs sending to the callbacks. */
+      bool m_bCommitted;
+  };
+
   /** The lock
-   *\note this should only be acquired by the NOTICE, WARNING, ERROR and FATAL macros */
+   *\note this should only be acquired by the logging macros and by whoever
+   *      is moving entries out of the per-CPU rings */
   Spinlock m_Lock;
 
   /** Retrieves the static Log instance.
@@ -237,34 +281,23 @@ public:
    /** Initialises the default Log callback (to a serial port) */
   void initialise2();
 
-  /** Installs an output callback */
+  /** Starts the thread that drains the per-CPU rings. Until this is called
+   *  every entry is written straight through. */
+  void initialise3();
+
+  /** Installs an output callback
+   *\note Waits for any entries being sent, so must not be called from a callback. */
   void installCallback(LogCallback *pCallback, bool bSkipBacklog=false);
 
-  /** Removes an output callback */
+  /** Removes an output callback. Once this returns the callback won't be
+   *  called again.
+   *\note Waits for any entries being sent, so must not be called from a callback. */
   void removeCallback(LogCallback *pCallback);
 
-  /** Adds an entry to the log.
-   *\param[in] str the null-terminated ASCII string that should be added */
-  Log &operator<< (const char *str);
-  Log &operator<< (String str);
-  /** Adds an entry to the log
-   *\param[in] str the null-terminated ASCII string that should be added */
-  inline Log &operator<< (char *str)
-    {return (*this) << (reinterpret_cast<const char*>(str));}
-  /** Adds an entry to the log
-   *\param[in] b boolean value */
-  Log &operator<< (bool b);
-  /** Adds an entry to the log (integer type)
-   *\param[in] n the number */
-  template<class T>
-  Log &operator << (T n);
-
-  /** Starts an entry in the log. */
-  Log &operator<< (SeverityLevel level);
-  /** Changes the number type between hex and decimal. */
-  Log &operator<< (NumberType type);
-  /** Modifier */
-  Log &operator<< (Modifier type);
+  /** Moves everything waiting in the per-CPU rings into the static log (and
+   *  out to the callbacks) right now.
+   *\param[in] bLock false if m_Lock can't be taken, e.g. in the debugger */
+  void flush(bool bLock = true);
 
   /** Get the number of static entries in the log.
    *\return the number of static entries in the log */
@@ -275,22 +308,6 @@ public:
   inline size_t getDynamicEntryCount() const
     {return 0;}
 
-  /** Stores an entry in the log.
-   *\param[in] T type of the log's text */
-  struct LogEntry
-  {
-    /** Constructor does nothing */
-    inline LogEntry()
-     : timestamp(), type(), str(){}
-
-    /** The time (since boot) that this log entry was added, in ticks. */
-    unsigned int timestamp;
-    /** The severity level of this entry. */
-    SeverityLevel type;
-    /** The actual entry text. */
-    StaticString<LOG_LENGTH> str;
-  };
-
   /** Type of a static log entry (no memory-management involved) */
   typedef LogEntry StaticLogEntry;
   typedef LogEntry DynamicLogEntry;
@@ -306,7 +323,7 @@ public:
     {return m_EchoToSerial;}
 
   inline const LogEntry &getLatestEntry() const
-    {return m_StaticLog[m_StaticEntries - 1];}
+    {return m_StaticLog[(m_StaticEntryEnd + LOG_ENTRIES - 1) % LOG_ENTRIES];}
 
 private:
   /** Default constructor - does nothing. */
@@ -320,6 +337,60 @@ private:
    *\note NOT implemented */
   Log &operator = (const Log &);
 
+  /** Number of CPUs that get a ring; any others write straight through. */
+#ifdef MULTIPROCESSOR
+  static const size_t MaxCpuLogs = 16;
+#else
+  static const size_t MaxCpuLogs = 1;
+#endif
+
+  /** Entries written by one CPU that the drain thread hasn't got to yet.
+   *  Only that CPU writes to it (with interrupts disabled), only the holder
+   *  of m_Lock reads from it. */
+  struct CpuLog
+  {
+    inline CpuLog()
+      : entries(), sequence(), head(0), tail(0), bWriting(false) {}
+
+    LogEntry entries[LOG_RING_ENTRIES];
+    /** Global order of each entry, so the drain can interleave the CPUs. */
+    size_t sequence[LOG_RING_ENTRIES];
+    /** Next slot to write; only ever incremented, by the owning CPU. */
+    volatile size_t head;
+    /** Next slot to read; only ever incremented, by the drain. */
+    volatile size_t tail;
+    /** Whether the owning CPU is in the middle of an entry. */
+    bool bWriting;
+  };
+
+  /** This CPU's ring and its index, or 0 if it doesn't have one. Interrupts
+   *  must be disabled. */
+  CpuLog *getCpuLog(size_t &cpu);
+
+  /** Moves every waiting entry into the static log, oldest first. Must
+   *  hold m_Lock (unless the other CPUs are stopped). */
+  void drainLocked();
+
+  /** Adds an entry to the static log, to be sent to the callbacks by output().
+   *  Must hold m_Lock. */
+  void commitEntry(const LogEntry &entry, size_t cpu);
+
+  /** Sends entries committed to the static log to the callbacks, unless
+   *  another CPU is already doing so (in which case it sends them).
+   *\param[in] bLock false if m_Lock can't be taken (it is held by the caller,
+   *                  or the other CPUs are stopped)
+   *\param[in] bForce send them even if another CPU is, e.g. before a panic */
+  void output(bool bLock, bool bForce);
+
+  /** Waits until no entries are being sent, and takes m_Lock. */
+  void acquireQuiet();
+
+  /** Formats an entry the way the callbacks get it. */
+  static void format(const LogEntry &entry, HugeStaticString &str);
+
+  /** Entry point of the drain thread. */
+  static int drainThread(void *p);
+
   /** Static buffer of log messages. */
   StaticLogEntry m_StaticLog[LOG_ENTRIES];
   /** Dynamic buffer of log messages */
@@ -329,15 +400,35 @@ private:
 
   size_t m_StaticEntryStart, m_StaticEntryEnd;
 
-  /** Temporary buffer which gets filled by calls to operator<<, and flushed by << Flush. */
+  /** CPU that wrote each static entry, for binary serial records. */
+  uint8_t m_StaticCpu[LOG_ENTRIES];
+
+  /** Next static entry to send to the callbacks, and how many are waiting. */
+  size_t m_OutputNext, m_OutputPending;
+  /** Entries overwritten before they could be sent. */
+  size_t m_OutputDropped;
+  /** Number of CPUs sending entries to the callbacks. */
+  size_t m_nOutputting;
+
+  /** Buffer for entries written straight through. */
   StaticLogEntry m_Buffer;
 
-  /** The number type mode that we are in. */
-  NumberType m_NumberType;
+  /** Per-CPU rings. */
+  CpuLog m_CpuLogs[MaxCpuLogs];
+
+  /** Source of CpuLog::sequence. Incremented atomically, as CPUs take
+      numbers without holding any lock. */
+  volatile size_t m_Sequence;
+
+  /** Whether the drain thread is running (and so the rings are in use). */
+  volatile bool m_bDraining;
 
   /** If we should output to serial */
   bool m_EchoToSerial;
 
+  /** If serial output should be binary records rather than text. */
+  bool m_bBinarySerial;
+
   /** Output callback list */
   List<LogCallback*> m_OutputCallbacks;
 
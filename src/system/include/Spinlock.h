@@ -30,7 +30,16 @@ class Spinlock
     inline Spinlock(bool bLocked = false, bool bAvoidTracking = false)
         : m_bInterrupts(), m_Atom(!bLocked), m_Ra(0),
         m_bAvoidTracking(bAvoidTracking), m_Magic(0xdeadbaba),
-        m_pOwner(0), m_Level(0) {}
+        m_pOwner(0), m_Level(0)
+#ifdef LOCK_STATS
+        , m_AcquiredAt(0), m_AcquiredRa(0)
+#endif
+        {}
+
+#ifdef LOCK_STATS
+    /** Drops the lock's statistics. */
+    ~Spinlock();
+#endif
 
     bool acquire();
 
@@ -63,6 +72,12 @@ class Spinlock
 
     void *m_pOwner;
     size_t m_Level;
+
+#ifdef LOCK_STATS
+    /** When and where the outermost acquire() took the lock. */
+    uint64_t m_AcquiredAt;
+    uintptr_t m_AcquiredRa;
+#endif
 };
 
 #endif
@@ -59,6 +59,7 @@ namespace Error
     TimedOut             =116,
     InProgress           =119,
     Already              =120,
+    MessageTooLong       =122,
     IsConnected          =127,
     NotSupported         =134,
     Unimplemented        =88
@@ -26,6 +26,8 @@
 #include <BootstrapInfo.h>
 #include <utilities/Vector.h>
 #include <utilities/MemoryAllocator.h>
+#include <process/Mutex.h>
+#include <utilities/String.h>
 
 #ifdef STATIC_DRIVERS
 #include <Module.h>
@@ -37,7 +39,9 @@
 class Module
 {
     public:
-        Module() : elf(), name(0), entry(0), exit(0), depends(0), buffer(0), buflen(0) {}
+        Module() : elf(), name(0), entry(0), exit(0), depends(0), depends_opt(0),
+                   buffer(0), buflen(0), loadBase(0), loadSize(0), dependents(),
+                   nPendingDepends(0), initTime(0) {}
         Elf elf;
         const char *name;
         bool (*entry)();
@@ -48,6 +52,14 @@ class Module
         size_t buflen;
         uintptr_t loadBase;
         size_t loadSize;
+
+        /** Modules in the same batch that depend on this one (see
+            KernelElf::executeModules). */
+        Vector<Module*> dependents;
+        /** Number of dependencies in the same batch not yet executed. */
+        size_t nPendingDepends;
+        /** Time taken by the module's entry point, in milliseconds. */
+        uint64_t initTime;
     protected:
         Module(const Module &);
         Module &operator = (const Module &);
@@ -75,6 +87,23 @@ class KernelElf : public Elf
         Module *loadModule(struct ModuleInfo *info, bool silent = false);
 #endif
 
+        /** Loads and links the given module, but does not execute it. The
+         *  module is held until executeModules() is called.
+         *
+         *\return A pointer to the preloaded module, or null on failure. */
+        Module *preloadModule(uint8_t *pModule, size_t len, bool silent=false);
+#ifdef STATIC_DRIVERS
+        Module *preloadModule(struct ModuleInfo *info, bool silent = false);
+#endif
+
+        /** Executes every preloaded module. A dependency graph is built over
+         *  the whole batch up front, and modules that don't depend on each
+         *  other have their entry points run concurrently. Modules which
+         *  don't declare any dependencies still run one at a time, in the
+         *  order they were preloaded.
+         *\param silent If true will not update the boot progress. */
+        void executeModules(bool silent=false);
+
         /** Unloads the specified module. */
         void unloadModule(const char *name, bool silent=false, bool progress=true);
         void unloadModule(Vector<Module*>::Iterator it, bool silent=false, bool progress=true);
@@ -108,9 +137,38 @@ class KernelElf : public Elf
         *\note NOT implemented (singleton class) */
         KernelElf &operator = (const KernelElf &);
 
+        /** Loads and links a module, without deciding when to execute it. */
+        Module *createModule(uint8_t *pModule, size_t len, bool silent);
+#ifdef STATIC_DRIVERS
+        Module *createModule(struct ModuleInfo *info, bool silent);
+#endif
+        /** Executes the module if its dependencies are met (along with any
+         *  pending modules that this allows to run), or defers it. */
+        Module *runOrDeferModule(Module *module, bool silent);
+
         bool moduleDependenciesSatisfied(Module *module);
         bool executeModule(Module *module);
 
+        /** Unloads a module. Takes m_ModuleLock itself, so must be called
+         *  without it: the module's exit function may load or unload others. */
+        void unloadModule(Module *module, bool silent, bool progress);
+
+        /** Shared state for one executeModules() batch. */
+        struct ModuleBatch;
+
+        /** Worker thread for executeModules(). */
+        static int moduleWorker(void *p);
+
+        /** Called (with the batch lock held) once a module has finished
+         *  executing, to release or cancel the modules that depend on it. */
+        void moduleFinished(ModuleBatch *pBatch, const String &name, Vector<Module*> &dependents, bool bSuccess);
+
+        /** Whether the module has a mandatory dependency on the given name. */
+        static bool dependsOn(Module *module, const char *name);
+
+        /** Finds a module in the given list by name. */
+        static Module *findModule(Vector<Module*> &list, const char *name);
+
 #if defined(X86_COMMON)
         MemoryRegion m_AdditionalSectionContents;
         MemoryRegion *m_AdditionalSectionHeaders;
@@ -130,6 +188,11 @@ class KernelElf : public Elf
         Vector<Module*> m_PendingModules;
         /** Memory allocator for modules - where they can be loaded. */
         MemoryAllocator m_ModuleAllocator;
+#ifdef THREADS
+        /** Serialises relocation, symbol table changes and the module lists
+            while module entry points run concurrently. */
+        Mutex m_ModuleLock;
+#endif
 
         /** Override Elf base class members. */
         Elf32SectionHeader_t   *m_pSectionHeaders;
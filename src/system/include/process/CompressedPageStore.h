@@ -0,0 +1,203 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef COMPRESSED_PAGE_STORE_H
+#define COMPRESSED_PAGE_STORE_H
+
+#include <processor/types.h>
+#include <utilities/Lz4.h>
+#include <Spinlock.h>
+
+/**
+ * CompressedPageStore: somewhere in RAM to put pages that haven't been used
+ * for a while, compressed, when physical memory runs low.
+ *
+ * Memory pressure handlers store() a page here, free it, and map the handle
+ * they get back with VirtualAddressSpace::Swapped in place of the physical
+ * address (see handleToAddress()). The page fault on the next access gets a
+ * new page and load()s it again.
+ *
+ * Compressed pages are packed into slabs by size class, CompressedSlotSize
+ * bytes apart, so that freeing one never leaves a hole only part of another
+ * can use. Pages that don't compress to MaxCompressedSize are refused, as
+ * keeping them would free too little to be worth the fault.
+ *
+ * Handles are reference counted, so that a forked address space can share
+ * the stored page with its parent until either of them faults it back.
+ *
+ * Pages are compressed and decompressed, and slabs allocated and freed,
+ * outside the store's lock, which only covers finding and handing out
+ * slots.
+ */
+class CompressedPageStore
+{
+    public:
+        /** Size classes are this many bytes apart. */
+        const static size_t CompressedSlotSize = 128;
+        /** Largest compressed page kept. */
+        const static size_t MaxCompressedSize = 3072;
+        /** Number of size classes. */
+        const static size_t NumSizeClasses = MaxCompressedSize / CompressedSlotSize;
+        /** Most slots in one slab. */
+        const static size_t MaxSlotsPerSlab = 32;
+        /** Slabs are sized to hold as many slots as fit in this, up to
+         *  MaxSlotsPerSlab. */
+        const static size_t SlabSize = 16384;
+        /** Number of slabs there can be. Handles must fit in the address
+         *  bits of a 32-bit page table entry. */
+        const static size_t MaxSlabs = 32768;
+        /** Number of CPUs that get their own compression buffers; any others
+         *  share one. */
+        const static size_t MaxScratchCpus = 16;
+
+        struct Statistics
+        {
+            /** Pages stored (each counted once, however many mappings). */
+            size_t nPages;
+            /** Bytes those pages compressed to. */
+            size_t compressedBytes;
+            /** Bytes of slabs holding them. */
+            size_t slabBytes;
+            /** Pages refused as they didn't compress well enough. */
+            size_t nRejected;
+            /** Pages loaded back. */
+            size_t nLoads;
+        };
+
+        static CompressedPageStore &instance()
+        {
+            return m_Instance;
+        }
+
+        /** Compresses a page into the store.
+         *\param[in] pPage the page, which must be mapped
+         *\param[out] handle where the page can be found again
+         *\return false if the page wasn't stored: it didn't compress well
+         *        enough, or there wasn't memory for another slab */
+        bool store(const void *pPage, uintptr_t &handle);
+
+        /** Decompresses a stored page. The caller must hold a reference
+         *  on the handle for the duration. The handle stays valid until it
+         *  is released.
+         *\return false for a bad handle */
+        bool load(uintptr_t handle, void *pPage);
+
+        /** Adds a reference to a stored page. */
+        void duplicate(uintptr_t handle);
+
+        /** Drops a reference to a stored page, freeing it after the last. */
+        void release(uintptr_t handle);
+
+        void getStatistics(Statistics &stats);
+
+        /** What to put in the address of a swapped page table entry. */
+        static physical_uintptr_t handleToAddress(uintptr_t handle)
+        {
+            return static_cast<physical_uintptr_t>(handle) * PAGE_SIZE;
+        }
+        /** The handle from the address of a swapped page table entry. */
+        static uintptr_t addressToHandle(physical_uintptr_t address)
+        {
+            return address / PAGE_SIZE;
+        }
+
+    private:
+        CompressedPageStore();
+
+        /** Slabs in each chunk of the slab table. */
+        const static size_t SlabsPerChunk = 256;
+
+        struct Slab
+        {
+            uint8_t *pData;
+            /** Partial list of the slab's size class. */
+            Slab *pPrev;
+            Slab *pNext;
+            /** A bit is set for each free slot. */
+            uint32_t freeMask;
+            size_t index;
+            size_t sizeClass;
+            size_t nSlots;
+            uint16_t lengths[MaxSlotsPerSlab];
+            uint32_t refs[MaxSlotsPerSlab];
+        };
+
+        /** Finds the slab and slot of a handle, or returns 0. m_Lock must
+         *  be held. */
+        Slab *lookup(uintptr_t handle, size_t &slot);
+
+        /** Space for Lz4::compress(). */
+        struct Scratch
+        {
+            uint16_t hashTable[Lz4::HashTableEntries];
+            uint8_t buffer[MaxCompressedSize];
+        };
+
+        /** Compresses a page into a buffer belonging to this CPU (or the
+         *  shared one, with m_ScratchLock held), then copies the result out.
+         *\return compressed length, or 0 if it didn't compress enough */
+        size_t compress(const void *pPage, uint8_t *pOut);
+
+        /** Allocates a new, empty slab for a size class. Doesn't lock; the
+         *  slab isn't in the table until installSlab(). */
+        static Slab *createSlab(size_t sizeClass);
+        /** Frees a slab that's no longer in the table. */
+        static void destroySlab(Slab *pSlab);
+
+        /** Puts a new slab in the table and its partial list. m_Lock must
+         *  be held. Uses pSpareChunk (setting it to 0) if the table needs
+         *  another chunk.
+         *\return false if the table is full, or needs a chunk and there
+         *        isn't a spare one */
+        bool installSlab(Slab *pSlab, Slab **&pSpareChunk);
+        /** Whether installSlab() would need a new chunk. m_Lock must be
+         *  held. */
+        bool needChunk();
+        /** Takes an empty slab out of the table. m_Lock must be held. */
+        void uninstallSlab(Slab *pSlab);
+
+        void partialInsert(Slab *pSlab);
+        void partialRemove(Slab *pSlab);
+
+        static CompressedPageStore m_Instance;
+
+        /** Slab table, in chunks allocated as they're needed. Slab 0 is
+         *  never used, so no handle is 0. */
+        Slab **m_pSlabs[MaxSlabs / SlabsPerChunk];
+        /** Lowest slab number that might be free. */
+        size_t m_NextSlab;
+
+        /** Slabs with free slots, for each size class. */
+        Slab *m_pPartial[NumSizeClasses];
+
+        /** Per-CPU scratch space, allocated on first use. */
+        Scratch *m_pScratch[MaxScratchCpus];
+        /** Scratch space for any other CPU, under m_ScratchLock. */
+        Scratch m_SharedScratch;
+        Spinlock m_ScratchLock;
+
+        Statistics m_Statistics;
+
+        /** Covers the slab table, partial lists, slot bookkeeping and
+         *  statistics. */
+        Spinlock m_Lock;
+};
+
+#endif
@@ -32,6 +32,7 @@
 #include <process/Mutex.h>
 #include <utilities/Tree.h>
 #include <utilities/MemoryAllocator.h>
+#include <processor/SyscallTracer.h>
 
 #include <Subsystem.h>
 
@@ -42,6 +43,18 @@ class User;
 class Group;
 class DynamicLinker;
 
+/**
+ * State a syscall service keeps for one Process, such as handles into the
+ * service's own tables. It is deleted along with the Process, so whatever it
+ * holds is released when the process goes away.
+ */
+class ProcessServiceData
+{
+public:
+    virtual ~ProcessServiceData()
+    {}
+};
+
 /**
  * An abstraction of a Process - a container for one or more threads all running in
  * the same address space.
@@ -245,6 +258,33 @@ public:
         return m_pSubsystem;
     }
 
+    /** Gets this process' syscall statistics for a service, if the
+     *  SyscallTracer has given it any. */
+    SyscallTable *getSyscallTable(size_t service)
+    {
+        return m_pSyscallTables[service];
+    }
+    /** Installs syscall statistics for a service, unless another thread got
+     *  there first.
+     *\return whether pTable was installed (otherwise the caller frees it) */
+    bool installSyscallTable(size_t service, SyscallTable *pTable)
+    {
+        return __sync_bool_compare_and_swap(&m_pSyscallTables[service], static_cast<SyscallTable*>(0), pTable);
+    }
+
+    /** Gets the per-process state of a syscall service, if it has any. */
+    ProcessServiceData *getServiceData(size_t service)
+    {
+        return m_pServiceData[service];
+    }
+    /** Installs per-process state for a service, unless another thread got
+     *  there first.
+     *\return whether pData was installed (otherwise the caller frees it) */
+    bool installServiceData(size_t service, ProcessServiceData *pData)
+    {
+        return __sync_bool_compare_and_swap(&m_pServiceData[service], static_cast<ProcessServiceData*>(0), pData);
+    }
+
     /** Gets the type of the Process (subsystems may override) */
     virtual ProcessType getType()
     {
@@ -359,6 +399,12 @@ private:
      */
     Thread::Status m_BeforeSuspendState;
 
+    /** Syscall statistics, per service (see SyscallTracer). */
+    SyscallTable *m_pSyscallTables[serviceEnd];
+
+    /** Per-process state of each syscall service, not inherited on fork. */
+    ProcessServiceData *m_pServiceData[serviceEnd];
+
     /** Concurrency lock for complex Process data structures. */
     Spinlock m_Lock;
 
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifdef THREADS
+
+#include <processor/types.h>
+#include <processor/state.h>
+#include <utilities/String.h>
+#include <process/Mutex.h>
+
+/**
+ * Profiler: samples whatever each CPU is running from its timer interrupt.
+ *
+ * Each sample is the interrupted PC, the current thread and process and a
+ * short frame-pointer backtrace, written into a buffer belonging to the CPU
+ * that took the interrupt. Once a buffer fills up, further samples on that
+ * CPU are counted as dropped until the profiler is restarted.
+ *
+ * The scheduler's timer calls sample() on every tick. A timer which can run
+ * faster than the scheduler wants calls oversample() instead, which gives
+ * getRate() samples per scheduler tick.
+ */
+class Profiler
+{
+    public:
+        /** Frames kept per sample, including the interrupted PC. */
+        const static size_t MaxFrames = 8;
+        /** Samples each CPU can hold. */
+        const static size_t SamplesPerCpu = 2048;
+        /** Number of CPUs that can be profiled; any others are ignored. */
+        const static size_t MaxProfiledCpus = 16;
+        /** Highest number of samples per scheduler tick. */
+        const static size_t MaxRate = 64;
+
+        struct Sample
+        {
+            size_t pid;
+            size_t tid;
+            size_t nFrames;
+            /** Whether the frames are user-space addresses. */
+            bool bUserMode;
+            /** Innermost first; frames[0] is the interrupted PC. */
+            uintptr_t frames[MaxFrames];
+        };
+
+        static Profiler &instance()
+        {
+            return m_Instance;
+        }
+
+        /** Throws away any previous samples and starts sampling.
+         *\param[in] rate samples per scheduler tick (where the timer allows it)
+         *\return false if the sample buffers couldn't be allocated */
+        bool start(size_t rate = 1);
+        /** Stops sampling. The samples are kept until the next start(). */
+        void stop();
+
+        inline bool isRunning() const
+        {
+            return m_bRunning;
+        }
+
+        /** Samples per scheduler tick the timer should aim for: 1 unless the
+         *  profiler is running. */
+        inline size_t getRate() const
+        {
+            return m_bRunning ? m_Rate : 1;
+        }
+
+        /** Records the state interrupted by the scheduler's timer. */
+        void sample(InterruptState &state);
+        /** For a timer running getRate() times as fast as the scheduler's.
+         *  Records the interrupted state on the extra ticks.
+         *\return true if this tick should go on to the scheduler (which will
+         *        sample it itself) */
+        bool oversample(InterruptState &state);
+
+        /** Gets the number of samples taken and dropped so far. */
+        void getCounts(size_t &nSamples, size_t &nDropped);
+
+        /** Appends the samples as folded stacks (the input format of
+         *  flamegraph.pl): one line per distinct stack, with the process
+         *  name followed by the frames outermost first, separated by ';',
+         *  then a space and the number of samples with that stack. */
+        void fold(String &out);
+
+        /** Finds the functions the most samples were taken in.
+         *\param[out] pFunctions start addresses, most samples first
+         *\param[out] pCounts samples taken in each function
+         *\param[in] n space in the arrays
+         *\return number of functions written
+         *\note Doesn't lock or allocate, so it can be used from the debugger. */
+        size_t topFunctions(uintptr_t *pFunctions, size_t *pCounts, size_t n);
+
+    private:
+        Profiler();
+
+        struct CpuProfile
+        {
+            Sample samples[SamplesPerCpu];
+            /** Samples written. Only the owning CPU writes it; readers see a
+             *  sample once it's counted. */
+            volatile size_t count;
+            size_t nDropped;
+            /** Timer ticks seen by oversample(). */
+            size_t nTicks;
+        };
+
+        /** Fills in the next sample of the given CPU. */
+        void record(InterruptState &state, size_t cpu);
+
+        /** Appends the name of the kernel function containing an address,
+         *  or just the address for user space. */
+        static void appendFrame(String &out, uintptr_t address, bool bUserMode);
+
+        static Profiler m_Instance;
+
+        /** Per-CPU sample buffers, allocated by the first start(). */
+        CpuProfile *m_pCpus;
+        size_t m_nCpus;
+
+        volatile bool m_bRunning;
+        size_t m_Rate;
+
+        /** Serialises start(), stop() and fold(). */
+        Mutex m_Lock;
+};
+
+#endif
+
+#endif
@@ -27,6 +27,9 @@
 #include <process/eventNumbers.h>
 #include <Spinlock.h>
 #include <utilities/List.h>
+#ifdef LOCK_STATS
+#include <utilities/LockStats.h>
+#endif
 
 /**
  * A counting semaphore.
@@ -59,6 +62,15 @@ public:
     /** Gets the current value of the semaphore */
     ssize_t getValue();
 
+#ifdef LOCK_STATS
+    /** Records acquire() and release() in the LockStats, for subclasses
+     *  which are used as locks. */
+    void setLockStatsType(LockStats::LockType type)
+    {
+        m_LockStatsType = type;
+    }
+#endif
+
 private:
     /** Private copy constructor
         \note NOT implemented. */
@@ -70,6 +82,10 @@ private:
     /** Removes the given pointer from the thread queue. */
     void removeThread(class Thread *pThread);
 
+    /** The body of acquire().
+     * \param ra the caller of acquire(), for the thread's debug state. */
+    bool doAcquire(size_t n, size_t timeoutSecs, size_t timeoutUsecs, uintptr_t ra);
+
     /** Internal event class - just interrupts the calling thread
         (sets wasInterrupted and sets the thread status to Ready). */
     class SemaphoreEvent : public Event
@@ -93,6 +109,14 @@ private:
     Atomic<ssize_t> m_Counter;
     Spinlock m_BeingModified;
     List<class Thread*> m_Queue;
+
+#ifdef LOCK_STATS
+    LockStats::LockType m_LockStatsType;
+    /** When and where the last acquire() took the semaphore, or 0 if it
+     *  hasn't been released since. */
+    uint64_t m_AcquiredAt;
+    uintptr_t m_AcquiredRa;
+#endif
 };
 
 #endif
@@ -0,0 +1,66 @@
+/*
+ *
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_PROCESSOR_KERNELFPU_H
+#define KERNEL_PROCESSOR_KERNELFPU_H
+
+#include <processor/types.h>
+#include <compiler.h>
+
+/** @addtogroup kernelprocessor
+ * @{ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Holds whatever was in the FPU and SIMD registers while kernel code uses
+ *  them between kernel_fpu_begin() and kernel_fpu_end(). */
+typedef struct KernelFpuState
+{
+    /** FXSAVE image of the registers. */
+    uint8_t registers[512] ALIGN(16);
+    /** Whether interrupts were enabled. */
+    uint8_t bInterrupts;
+    /** Whether CR0.TS was set, i.e. the registers belong to another thread. */
+    uint8_t bTaskSwitched;
+} KernelFpuState;
+
+/** Can kernel code use the SSE registers at all? */
+int kernel_fpu_available();
+
+/** Begins a kernel FPU section: the current contents of the FPU and SIMD
+ *  registers are saved and the kernel may use them freely (SSE/SSE2 only, as
+ *  the save covers the XMM registers but not the upper halves of the YMM
+ *  registers). Interrupts are disabled until kernel_fpu_end(), so sections
+ *  must be short and may not nest.
+ *\return non-zero if the section was begun, zero if the FPU can't be used */
+int kernel_fpu_begin(KernelFpuState *pState);
+
+/** Ends a kernel FPU section, putting the registers back the way they were. */
+void kernel_fpu_end(KernelFpuState *pState);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
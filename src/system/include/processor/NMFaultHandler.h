@@ -22,6 +22,7 @@
 #define KERNEL_CORE_PROCESSOR_NMFAULTHANDLER_H_
 
 #include <processor/InterruptManager.h>
+#include <processor/KernelFpu.h>
 
 /** @addtogroup kernelprocessor
  * @{ */
@@ -38,6 +39,23 @@ public:
      * \return true if sucessful, false otherwise.  */
     bool initialise();
 
+    /** Enables FXSAVE/FXRSTOR and SSE on an application processor. The boot
+     *  code and initialise() only do so for the bootstrap processor. */
+    static void initialiseProcessor();
+
+    /** Can kernel code use the SSE registers at all? */
+    static bool kernelSectionsAvailable();
+
+    /** Saves the FPU and SIMD registers so kernel code can use them, without
+     *  taking the lazy-switching fault or changing which thread owns them.
+     *  Interrupts stay disabled until endKernelSection(), and the section
+     *  must not fault or block: the scheduler refuses to switch away.
+     *  \return false if the registers can't be used. */
+    static bool beginKernelSection(KernelFpuState &state);
+
+    /** Restores the registers saved by beginKernelSection(). */
+    static void endKernelSection(KernelFpuState &state);
+
     //
     // InterruptHandler interface.
     //
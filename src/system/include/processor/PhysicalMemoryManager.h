@@ -80,6 +80,13 @@ class PhysicalMemoryManager
      *\param[in] page physical address of the page */
     virtual void freePage(physical_uintptr_t page) = 0;
 
+    /** Allocate a naturally aligned, physically continuous block of pages the size of
+     *  the architecture's large page (see VirtualAddressSpace::getLargePageSize()).
+     *  The pages are freed one by one with freePage().
+     *\return physical address of the block or 0 if none is available */
+    virtual physical_uintptr_t allocateLargePage()
+      {return 0;}
+
     /**
      * "Pin" a page, increasing its refcount.
      *
@@ -85,6 +85,9 @@ class Processor
      *\return 0, if nothing has been initialised, 1, if initialise1() has been executed
      *        successfully, 2, if initialise2() has been executed successfully */
     inline static size_t isInitialised(){return m_Initialised;}
+    /** Get the number of processors found by initialise2()
+     *\return the number of processors (1 until initialise2() has run) */
+    inline static size_t getCount(){return m_nProcessors;}
 
     /** Get the base-pointer of the calling function
      *\return base-pointer of the calling function */
@@ -99,6 +102,17 @@ class Processor
     /** Switch to a different virtual address space
      *\param[in] AddressSpace the new address space */
     static void switchAddressSpace(VirtualAddressSpace &AddressSpace);
+    /** Switch to the address space of a thread being scheduled. Unlike
+     *  switchAddressSpace(), the switch may be skipped when the new address
+     *  space is the kernel's: kernel threads only touch kernel memory, which
+     *  every address space maps, so the current one can stay loaded.
+     *\param[in] AddressSpace the new address space */
+    #if defined(X64)
+      static void lazySwitchAddressSpace(VirtualAddressSpace &AddressSpace);
+    #else
+      inline static void lazySwitchAddressSpace(VirtualAddressSpace &AddressSpace)
+        {switchAddressSpace(AddressSpace);}
+    #endif
 
     /** Save the current processor state.
         \param[out] state SchedulerState to save into.
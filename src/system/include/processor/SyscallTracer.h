@@ -0,0 +1,131 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_PROCESSOR_SYSCALLTRACER_H
+#define KERNEL_PROCESSOR_SYSCALLTRACER_H
+
+#include <processor/types.h>
+#include <processor/Syscalls.h>
+#include <processor/Timestamp.h>
+#include <utilities/String.h>
+#include <compiler.h>
+
+/** @addtogroup kernelprocessor
+ * @{ */
+
+/** Syscall numbers with their own statistics; any above share the last. */
+#define SYSCALL_TRACER_MAX_SYSCALLS     256
+/** Number of latency histogram buckets. */
+#define SYSCALL_TRACER_BUCKETS          32
+/** Number of CPUs with their own statistics; any others aren't counted. */
+#define SYSCALL_TRACER_MAX_CPUS         16
+
+class Process;
+
+/** Statistics for one syscall. Times are in SyscallTracer::timestamp() ticks. */
+struct SyscallStatistics
+{
+    uint64_t count;
+    uint64_t ticks;
+    /** histogram[i] counts calls which took [2^i, 2^(i+1)) ticks. The last
+     *  bucket also counts anything longer. */
+    uint32_t histogram[SYSCALL_TRACER_BUCKETS];
+};
+
+/** Statistics for every syscall of one service. */
+struct SyscallTable
+{
+    SyscallStatistics syscalls[SYSCALL_TRACER_MAX_SYSCALLS];
+};
+
+/** Counts syscalls and how long they take, system-wide and per process.
+ *
+ *  The architecture's syscall dispatcher calls begin() before and end()
+ *  after each handler. System-wide statistics are kept in per-CPU tables
+ *  so the common path takes no locks. Each process gets its own tables,
+ *  one per service, when tracing is enabled or when it is created while
+ *  tracing is; a process without them is only counted system-wide. */
+class SyscallTracer
+{
+  public:
+    inline static SyscallTracer &instance() {return m_Instance;}
+
+    /** Resets all statistics and starts collecting.
+     *\return false if the per-CPU tables couldn't be allocated */
+    bool enable();
+    /** Stops collecting. The statistics are kept. */
+    void disable();
+    inline bool isEnabled() const {return m_bEnabled;}
+
+    /** Call before dispatching a syscall.
+     *\return the timestamp to pass to end(), or 0 if tracing is off */
+    inline uint64_t begin()
+    {
+        if (LIKELY(!m_bEnabled))
+            return 0;
+        return timestamp();
+    }
+    /** Call after a syscall returns, if begin() returned non-zero.
+     *\param[in] pProcess the calling process, or 0 */
+    void end(uint64_t start, size_t service, size_t number, Process *pProcess);
+
+    /** Gives a new process its statistics tables, if tracing is enabled.
+     *  Called as the process is created, so end() never has to allocate. */
+    void addProcess(Process *pProcess);
+
+    /** Sums the per-CPU statistics of one syscall. */
+    void getStatistics(size_t service, size_t number, SyscallStatistics &stats);
+
+    /** Appends one line for each syscall made: system-wide first, then for
+     *  each process. */
+    void report(String &out);
+
+    /** Gets a short name for a syscall service. */
+    static const char *serviceName(size_t service);
+
+    /** Current time for the statistics (see readTimestamp()). Processors
+     *  without a timestamp counter never trace. */
+    inline static uint64_t timestamp()
+    {
+        return readTimestamp();
+    }
+
+  private:
+    SyscallTracer();
+
+    /** Bucket of the latency histogram a time falls in. */
+    static size_t bucket(uint64_t ticks);
+
+    /** Appends one report line for a syscall. */
+    static void reportLine(String &out, const char *pScope, size_t service,
+                           size_t number, const SyscallStatistics &stats);
+
+    static SyscallTracer m_Instance;
+
+    /** m_nCpus * serviceEnd tables, indexed by cpu * serviceEnd + service. */
+    SyscallTable *m_pCpuTables;
+    size_t m_nCpus;
+
+    volatile bool m_bEnabled;
+};
+
+/** @} */
+
+#endif
@@ -18,26 +18,28 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#ifndef NEIGHBOUR_DISCOVERY_H
-#define NEIGHBOUR_DISCOVERY_H
+#ifndef KERNEL_PROCESSOR_TIMESTAMP_H
+#define KERNEL_PROCESSOR_TIMESTAMP_H
 
-/** NDP for IPv6 */
-class NeighbourDiscovery
-{
-    public:
-        NeighbourDiscovery()
-        {};
-        virtual ~NeighbourDiscovery()
-        {};
-        
-        static NeighbourDiscovery &instance()
-        {
-            return m_Instance;
-        }
-        
-    private:
-        static NeighbourDiscovery m_Instance;
-};
+#include <processor/types.h>
+
+/** @addtogroup kernelprocessor
+ * @{ */
 
+/** Reads the fastest free-running counter the processor has (the TSC on
+ *  x86), for timing short stretches of code. The units are
+ *  processor-specific. Processors without one wired up return 0. */
+inline uint64_t readTimestamp()
+{
+#if defined(X86_COMMON)
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+#else
+    return 0;
 #endif
+}
 
+/** @} */
+
+#endif
@@ -31,4 +31,9 @@ typedef MIPS32TlbManager TlbManager;
 typedef MIPS64TlbManager TlbManager;
 #endif
 
+#ifdef X64
+#include <processor/x64/TlbManager.h>
+typedef X64TlbManager TlbManager;
+#endif
+
 #endif
@@ -90,6 +90,14 @@ class VirtualAddressSpace
      *\param[in] virtualAddress the virtual address
      *\return true, if a mapping exists, false otherwise */
     virtual bool isMapped(void *virtualAddress) = 0;
+    /** Checks whether the page at the specific virtual address is marked as swapped out.
+     *\note Architectures that never swap pages out leave this returning false.
+     *\param[in] virtualAddress the virtual address
+     *\return true, if the page is swapped out, false otherwise */
+    virtual bool isSwapped(void *virtualAddress)
+    {
+      return false;
+    }
 
     /** Map a specific physical page (of size PhysicalMemoryManager::getPageSize()) at a specific
      * location into the virtual address space.
@@ -124,6 +132,41 @@ class VirtualAddressSpace
      *      and that is still mapped or marked as swapped out.
      *\param[in] virtualAddress the virtual address */
     virtual void unmap(void *virtualAddress) = 0;
+    /** Remove a number of pages from the virtual address space at once. This is
+     *  equivalent to calling unmap() on each of them, but lets the architecture
+     *  invalidate the TLBs of other processors with a single request.
+     *\note The same restrictions as for unmap() apply to every address.
+     *\param[in] pAddresses the virtual addresses
+     *\param[in] nAddresses the number of virtual addresses
+     *\return false if some of the pages couldn't be unmapped (eg, splitting up a
+     *        large page needed memory there wasn't), in which case those pages
+     *        are still mapped */
+    virtual bool unmapMany(void **pAddresses, size_t nAddresses)
+    {
+      for (size_t i = 0; i < nAddresses; i++)
+        unmap(pAddresses[i]);
+      return true;
+    }
+
+    /** Map a naturally aligned, physically contiguous block of getLargePageSize() bytes
+     *  with a single large page.
+     *\note Architectures without large pages (or that don't implement this) return false,
+     *      and the caller falls back to map() on each page.
+     *\param[in] physicalAddress the physical address of the block, aligned to the large page size
+     *\param[in] virtualAddress the virtual address of the block, aligned to the large page size
+     *\param[in] flags flags that describe which accesses should be allowed on the block
+     *\return true, if successfull, false otherwise */
+    virtual bool mapLarge(physical_uintptr_t physicalAddress,
+                          void *virtualAddress,
+                          size_t flags)
+    {
+      return false;
+    }
+    /** Size of a large page, or zero if large pages are not supported. */
+    virtual size_t getLargePageSize() const
+    {
+      return 0;
+    }
 
     /** Allocates a single stack for a thread. Will use the default kernel thread size. */
     virtual void *allocateStack() = 0;
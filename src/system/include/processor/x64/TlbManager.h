@@ -0,0 +1,224 @@
+/*
+ *
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef X64_TLBMANAGER_H
+#define X64_TLBMANAGER_H
+
+#include <processor/types.h>
+#include <processor/state.h>
+#include <processor/InterruptHandler.h>
+
+class X64VirtualAddressSpace;
+
+/** @addtogroup kernelprocessorx64
+ * @{ */
+
+/** Keeps the TLBs of all processors coherent with the page tables.
+ *
+ *  Every processor records which address space it has loaded. When mappings
+ *  are removed or changed, only the processors that have the address space
+ *  loaded are sent an IPI, and a whole batch of addresses is invalidated for
+ *  each IPI. The initiator waits for every target to acknowledge before the
+ *  old pages may be reused.
+ *
+ *  Processors running kernel threads keep the previous address space loaded
+ *  ("lazy TLB"), since kernel threads only touch the kernel half which all
+ *  address spaces share. A lazy processor that receives a shootdown drops
+ *  the address space instead, so it isn't bothered again.
+ *
+ *  If the processor supports PCIDs, each address space is tagged with one so
+ *  its TLB entries survive a context switch. PCIDs are handed out in
+ *  generations; once they run out, each processor flushes its whole TLB the
+ *  next time it switches and a new generation begins. Processors that may
+ *  still hold entries for an address space they no longer have loaded are
+ *  marked stale in it and flush those entries when they next load it. */
+class X64TlbManager : public InterruptHandler
+{
+  public:
+    /** Retrieves the singleton instance of this Tlb manager. */
+    static X64TlbManager &instance()
+      {return m_Instance;}
+
+    /** Detects PCID support and hooks the shootdown IPI. Called once, on the
+     *  bootstrap processor. */
+    void initialise();
+    /** Enables global pages (and PCIDs, if supported) on the current
+     *  processor and adds it to the set of processors shootdowns may target. */
+    void initialiseProcessor();
+
+    /** Are global pages enabled? */
+    inline bool globalPages() const
+      {return m_bGlobalPages;}
+    /** Are address spaces tagged with PCIDs? */
+    inline bool usingPcid() const
+      {return m_bPcid;}
+
+    /** Loads an address space on the current processor. Interrupts must be
+     *  disabled.
+     *\param[in] space the address space
+     *\param[in] bLazy if space is the kernel's, whether the currently loaded
+     *                 address space may be kept instead
+     *\return the address space now loaded */
+    X64VirtualAddressSpace &activate(X64VirtualAddressSpace &space, bool bLazy);
+
+    /** Invalidates the given pages of an address space on all processors that
+     *  may have them cached, and waits until that has been done. The page
+     *  tables must already have been updated.
+     *\param[in] space the address space the pages belong to
+     *\param[in] pAddresses the pages to invalidate
+     *\param[in] nAddresses the number of pages, or zero to invalidate the
+     *                      whole address space */
+    void shootdown(X64VirtualAddressSpace &space, void **pAddresses, size_t nAddresses);
+
+    /** Makes every processor stop using an address space and drop any TLB
+     *  entries for it. Used before its page tables are freed. */
+    void release(X64VirtualAddressSpace &space);
+
+    /** Services shootdown requests waiting for the current processor. Called
+     *  from the IPI handler, and from code that spins with interrupts
+     *  disabled, so that two processors can shoot down at the same time. */
+    void poll();
+
+    //
+    // InterruptHandler interface.
+    //
+    virtual void interrupt(size_t nInterruptNumber, InterruptState &state);
+
+    //
+    // Statistics.
+    //
+    /** Number of times an address space was loaded. */
+    uint64_t switches() const;
+    /** Cycles spent loading address spaces. */
+    uint64_t switchCycles() const;
+    /** Number of address space loads that kept the TLB, thanks to PCIDs. */
+    uint64_t taggedSwitches() const;
+    /** Number of switches to kernel threads that kept the old address space. */
+    uint64_t lazySwitches() const;
+    /** Number of shootdowns that had to interrupt other processors. */
+    uint64_t shootdowns() const;
+    /** Number of IPIs sent for shootdowns. */
+    uint64_t ipis() const;
+    /** Cycles spent waiting for other processors to complete shootdowns. */
+    uint64_t shootdownCycles() const;
+
+  private:
+    /** Default constructor. */
+    X64TlbManager();
+    /** Destructor. */
+    ~X64TlbManager();
+    X64TlbManager(const X64TlbManager &);
+    X64TlbManager &operator = (const X64TlbManager &);
+
+    /** Most processors supported. */
+    static const size_t MaxProcessors = 64;
+    /** Most addresses invalidated one by one; bigger batches flush the
+     *  whole address space instead. */
+    static const size_t MaxBatch = 32;
+    /** Number of PCIDs available to address spaces (0 is the kernel's). */
+    static const uint64_t NumPcids = 4095;
+
+    /** A shootdown request, posted by its initiator. */
+    struct Request
+    {
+      X64VirtualAddressSpace *pSpace;
+      /** Zero to invalidate the whole address space. */
+      size_t nAddresses;
+      void *pAddresses[MaxBatch];
+      /** Stop using the address space altogether. */
+      bool bRelease;
+      /** Processors that are yet to handle the request. */
+      volatile uint64_t pending;
+    };
+
+    /** Per-processor state. */
+    struct Cpu
+    {
+      uint8_t apicId;
+      /** The address space in CR3. */
+      X64VirtualAddressSpace * volatile pLoaded;
+      /** Whether a kernel thread is running on a borrowed address space. */
+      bool bLazy;
+      /** The PCID generation this processor's TLB was last flushed for. */
+      uint64_t generation;
+      /** This processor's outgoing request. */
+      Request request;
+
+      uint64_t nSwitches;
+      uint64_t switchCycles;
+      uint64_t nTaggedSwitches;
+      uint64_t nLazySwitches;
+      uint64_t nShootdowns;
+      uint64_t nIpis;
+      uint64_t shootdownCycles;
+    };
+
+    /** Index of the current processor in m_Cpus. Processors that haven't
+     *  called initialiseProcessor() yet share the spare entry at
+     *  MaxProcessors, which shootdowns never target. Once processor IDs
+     *  are valid this is a lookup by Processor::id(). */
+    size_t current();
+    /** Finds the current processor in m_Cpus by local APIC ID. */
+    size_t find();
+
+    /** Writes CR3 for the given address space. */
+    void load(Cpu &cpu, size_t index, X64VirtualAddressSpace &space);
+
+    /** Carries out a request on the current processor. */
+    void invalidate(Cpu &cpu, size_t index, Request &request);
+
+    /** Sends the shootdown IPI to the given processors. */
+    void sendIpis(uint64_t targets, size_t me);
+
+    /** Posts a request to the given processors and waits for them. */
+    void post(Cpu &cpu, size_t me, uint64_t targets);
+
+    /** Flushes the whole TLB of the current processor, global pages
+     *  included. */
+    void flushAll();
+
+    /** Per-processor state, plus a spare entry. */
+    Cpu m_Cpus[MaxProcessors + 1];
+    /** Number of entries in m_Cpus handed out. */
+    volatile size_t m_nCpus;
+    /** Index in m_Cpus plus one for each processor ID, filled in by
+     *  current() the first time each processor asks. */
+    volatile uint8_t m_CpuIndex[MaxProcessors];
+    /** Mask of the entries in m_Cpus that are ready for shootdowns. */
+    volatile uint64_t m_OnlineMask;
+    /** Number of requests in flight, so poll() can return early. */
+    volatile size_t m_nPosted;
+
+    /** Number of PCIDs handed out so far; divided by NumPcids, this is the
+     *  current generation. */
+    volatile uint64_t m_PcidCounter;
+
+    /** Are global pages enabled? */
+    bool m_bGlobalPages;
+    /** Are PCIDs in use? */
+    bool m_bPcid;
+
+    /** The singleton instance of this class. */
+    static X64TlbManager m_Instance;
+};
+
+/** @} */
+
+#endif
@@ -93,13 +93,25 @@ class X86CommonProcessorInformation
     inline PerProcessorScheduler &getScheduler()
       {return m_Scheduler;}
 
+    /** Is a kernel FPU section running on this processor? */
+    inline bool inKernelFpuSection() const
+      {return m_bKernelFpuSection;}
+    inline void setKernelFpuSection(bool bInSection)
+      {m_bKernelFpuSection = bInSection;}
+
+    /** Get the processor's identifier, without Processor::id()'s search
+     *\return the identifier of the processor */
+    inline ProcessorId getProcessorId() const
+      {return m_ProcessorId;}
+
   protected:
     /** Construct a X86CommonProcessor object
      *\param[in] processorId Identifier of the processor */
     inline X86CommonProcessorInformation(ProcessorId processorId, uint8_t apicId = 0)
       : m_ProcessorId(processorId), m_TssSelector(0), m_Tss(0),
         m_VirtualAddressSpace(&VirtualAddressSpace::getKernelAddressSpace()), m_LocalApicId(apicId),
-        m_pCurrentThread(0), m_Scheduler(), m_TlsSelector(0) {}
+        m_pCurrentThread(0), m_Scheduler(), m_TlsSelector(0),
+        m_bKernelFpuSection(false) {}
     /** The destructor does nothing */
     inline virtual ~X86CommonProcessorInformation(){}
 
@@ -136,6 +148,8 @@ class X86CommonProcessorInformation
     PerProcessorScheduler m_Scheduler;
     /** The processor's TLS segment */
     uint16_t m_TlsSelector;
+    /** Whether a kernel FPU section is running. */
+    bool m_bKernelFpuSection;
 };
 
 /** @} */
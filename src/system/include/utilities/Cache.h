@@ -279,9 +279,6 @@ private:
     /** Static MemoryAllocator to allocate virtual address space for all caches. */
     static MemoryAllocator m_Allocator;
 
-    /** Lock for using the allocator. */
-    static Spinlock m_AllocatorLock;
-
     /** Lock for this cache. */
     UnlikelyLock m_Lock;
 
@@ -0,0 +1,127 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_LOCKSTATS_H
+#define KERNEL_UTILITIES_LOCKSTATS_H
+
+#ifdef LOCK_STATS
+
+#include <processor/types.h>
+#include <processor/Timestamp.h>
+
+/** @addtogroup kernelutilities
+ * @{ */
+
+/** Contention statistics for Spinlocks, Mutexes and UnlikelyLocks, built in
+ *  with the lock_stats option (LOCK_STATS).
+ *
+ *  Each lock is recorded by its address, with the number of times it was
+ *  acquired, how many of those had to wait, the time spent waiting and the
+ *  time it was held, all in readTimestamp() units. The same figures are kept
+ *  for the few call sites that acquire each lock the most, which is what
+ *  names a lock in practice.
+ *
+ *  Everything lives in fixed tables updated with atomic operations: the
+ *  locks themselves call in here, so nothing may lock, allocate or log. The
+ *  figures are therefore approximate when CPUs race on the same entry. A
+ *  lock's entry is dropped when the lock is destroyed, so another lock
+ *  created at the same address later doesn't inherit its figures. */
+class LockStats
+{
+  public:
+    enum LockType
+    {
+        /** Semaphores which aren't being used as locks aren't recorded. */
+        NotALock = 0,
+        SpinlockType,
+        MutexType,
+        UnlikelyLockType
+    };
+
+    /** Number of locks with statistics; later locks are only counted in
+     *  getOverflow(). */
+    static const size_t MaxLocks = 1024;
+    /** Call sites kept for each lock. */
+    static const size_t MaxCallSites = 4;
+
+    struct CallSite
+    {
+        uintptr_t ra;
+        size_t acquisitions;
+        size_t contended;
+        uint64_t waitTicks;
+        uint64_t holdTicks;
+    };
+
+    struct Entry
+    {
+        /** Address of the lock, or 0 for an unused entry. */
+        uintptr_t lock;
+        LockType type;
+        size_t acquisitions;
+        size_t contended;
+        uint64_t waitTicks;
+        uint64_t holdTicks;
+        uint64_t maxWaitTicks;
+        uint64_t maxHoldTicks;
+        CallSite sites[MaxCallSites];
+    };
+
+    /** Records an acquisition.
+     *\param[in] pLock the lock
+     *\param[in] ra the caller of the lock's acquire()
+     *\param[in] bContended whether the lock wasn't free at the first attempt
+     *\param[in] waitTicks time from the first attempt until it was acquired */
+    static void acquired(const void *pLock, LockType type, uintptr_t ra,
+                         bool bContended, uint64_t waitTicks);
+    /** Records a release.
+     *\param[in] ra the call site passed to the matching acquired()
+     *\param[in] holdTicks time since it was acquired */
+    static void released(const void *pLock, uintptr_t ra, uint64_t holdTicks);
+    /** Drops the entry of a lock that is being destroyed. */
+    static void destroyed(const void *pLock);
+
+    /** Gets an entry of the table, or 0 if it's unused. */
+    static const Entry *getEntry(size_t i);
+    /** Number of acquisitions of locks that didn't fit in the table. */
+    static size_t getOverflow()
+    {
+        return m_Overflow;
+    }
+    /** Forgets all statistics. Locks that are being recorded while this
+     *  runs may leave partial figures behind. */
+    static void reset();
+
+  private:
+    /** Finds the entry for a lock.
+     *\param[in] bClaim whether to claim one if the lock has none */
+    static Entry *lookup(const void *pLock, bool bClaim);
+    /** Finds (or claims) the entry of a call site. */
+    static CallSite *lookupSite(Entry *pEntry, uintptr_t ra);
+
+    static Entry m_Entries[MaxLocks];
+    static volatile size_t m_Overflow;
+};
+
+/** @} */
+
+#endif
+
+#endif
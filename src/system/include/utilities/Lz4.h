@@ -0,0 +1,84 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_LZ4_H
+#define KERNEL_UTILITIES_LZ4_H
+
+#include <processor/types.h>
+
+/** @addtogroup kernelutilities
+ * @{ */
+
+/** Compression in the LZ4 block format: fast enough to run on a page fault,
+ *  and decompression is little more than a memcpy.
+ *
+ *  Only single blocks of up to MaxInputLength bytes are handled, which is
+ *  all the kernel needs to compress pages. There's no framing: the caller
+ *  keeps the compressed and uncompressed lengths. */
+class Lz4
+{
+  public:
+    /** Longest input compress() accepts (offsets are 16 bits). */
+    static const size_t MaxInputLength = 65535;
+    /** Entries in the hash table the caller passes to compress(). */
+    static const size_t HashTableEntries = 4096;
+
+    /** Compresses a block.
+     *\param[in] pSource the data to compress
+     *\param[in] length length of the data, at most MaxInputLength
+     *\param[out] pDest where to write the compressed block
+     *\param[in] destLength space at pDest
+     *\param[in] pHashTable scratch space of HashTableEntries entries
+     *\return length of the compressed block, or 0 if it didn't fit */
+    static size_t compress(const void *pSource, size_t length,
+                           void *pDest, size_t destLength,
+                           uint16_t *pHashTable);
+
+    /** Decompresses a block. Malformed input is caught rather than
+     *  reading or writing out of bounds.
+     *\param[in] pSource the compressed block
+     *\param[in] length length of the compressed block
+     *\param[out] pDest where to write the data
+     *\param[in] destLength space at pDest
+     *\return length of the data, or 0 if the block was malformed or the
+     *        data didn't fit */
+    static size_t decompress(const void *pSource, size_t length,
+                             void *pDest, size_t destLength);
+
+  private:
+    /** Shortest match the format can express. */
+    static const size_t MinMatch = 4;
+    /** The last bytes of a block are always literals. */
+    static const size_t LastLiterals = 5;
+    /** The last match must start this far before the end of the block. */
+    static const size_t MatchFindLimit = 12;
+
+    /** Writes the bytes of a length that didn't fit in its token nibble. */
+    static uint8_t *putLength(uint8_t *pOut, size_t length);
+    /** Writes one sequence: literals then (if matchLength) a match. Returns
+     *  0 if it doesn't fit before pEnd. */
+    static uint8_t *putSequence(uint8_t *pOut, uint8_t *pEnd,
+                                const uint8_t *pLiterals, size_t nLiterals,
+                                size_t offset, size_t matchLength);
+};
+
+/** @} */
+
+#endif
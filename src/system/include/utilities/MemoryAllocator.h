@@ -1,5 +1,5 @@
 /*
- * 
+ *
  * Copyright (c) 2008-2014, Pedigree Developers
  *
  * Please see the CONTRIB file in the root of the source tree for a full
@@ -21,12 +21,178 @@
 #ifndef KERNEL_UTILITIES_MEMORYALLOCATOR_H
 #define KERNEL_UTILITIES_MEMORYALLOCATOR_H
 
-#include <utilities/RangeList.h>
+#include <processor/types.h>
+#include <Spinlock.h>
 
 /** @addtogroup kernelutilities
  * @{ */
 
-typedef RangeList<uintptr_t> MemoryAllocator;
+/** Hands out ranges of an address space (vmem-style).
+ *
+ *  Free ranges ("segments") are kept in two structures at once: an AVL tree
+ *  ordered by address, so free() finds its neighbours to merge with in
+ *  O(log n), and an array of free lists segregated by power-of-two size,
+ *  so allocate() can usually take the head of the first list whose every
+ *  segment is big enough.
+ *
+ *  For arenas that mostly deal in one size (e.g. single pages), a per-CPU
+ *  cache of quanta of that size can be enabled with enableQuantumCache().
+ *
+ *  All operations are internally locked. */
+class MemoryAllocator
+{
+  public:
+    /** Constructs an empty allocator. */
+    MemoryAllocator();
+    /** Constructs an empty allocator.
+     *\param[in] bReverse whether to allocate from the top of the free ranges */
+    MemoryAllocator(bool bReverse);
+    /** Constructs an allocator with one free range.
+     *\param[in] address beginning of the range
+     *\param[in] length length of the range
+     *\param[in] bReverse whether to allocate from the top of the free ranges */
+    MemoryAllocator(uintptr_t address, uintptr_t length, bool bReverse = false);
+    /** Copies the free ranges of another allocator. Anything sitting in the
+     *  other allocator's quantum caches is copied as free space, but the copy
+     *  doesn't get quantum caches of its own. */
+    MemoryAllocator(const MemoryAllocator &other);
+    /** Destructor frees all segments. */
+    ~MemoryAllocator();
+
+    /** Free a range
+     *\param[in] address beginning address of the range
+     *\param[in] length length of the range */
+    void free(uintptr_t address, uintptr_t length);
+    /** Allocate a range of a specific size
+     *\param[in] length the requested length
+     *\param[out] address the beginning address of the allocated range
+     *\return true, if successfully allocated (and address is valid), false otherwise */
+    bool allocate(uintptr_t length, uintptr_t &address);
+    /** Allocate a range of specific size and beginning address
+     *\param[in] address the beginning address
+     *\param[in] length the length
+     *\return true, if successfully allocated, false otherwise */
+    bool allocateSpecific(uintptr_t address, uintptr_t length);
+    /** Forget all free ranges (and anything in the quantum caches). */
+    void clear();
+
+    /** Get the number of free segments
+     *\return the number of free segments */
+    inline size_t size() const {return m_nSegments;}
+
+    /** Lets each CPU keep a few free ranges of exactly \p quantum bytes, so
+     *  allocations and frees of that size don't need the lock. Must be
+     *  called before the allocator is shared. */
+    void enableQuantumCache(uintptr_t quantum);
+
+  private:
+    /** One free range. */
+    struct Segment
+    {
+        uintptr_t base;
+        uintptr_t length;
+
+        /** Address-ordered AVL tree. */
+        Segment *pLeft;
+        Segment *pRight;
+        int height;
+
+        /** Size-class free list. */
+        Segment *pPrev;
+        Segment *pNext;
+    };
+
+    /** Number of quanta moved between a QuantumCache and the arena at once. */
+    static const size_t QuantumCacheBatch = 16;
+    /** Number of CPUs that get a QuantumCache; any others use the lock. */
+    static const size_t MaxQuantumCaches = 16;
+    /** Number of size classes: one per bit of an address. */
+    static const size_t NumFreeLists = sizeof(uintptr_t) * 8;
+
+    /** Free quanta belonging to one CPU. Only touched by that CPU with
+     *  interrupts disabled. */
+    struct QuantumCache
+    {
+        uintptr_t quanta[QuantumCacheBatch * 2];
+        size_t count;
+    };
+
+    MemoryAllocator &operator = (const MemoryAllocator &);
+
+    /** Size class of a segment: floor(log2(length)). */
+    static size_t sizeClass(uintptr_t length);
+
+    /** AVL helpers. All return the new root of the subtree. */
+    static int height(Segment *pNode);
+    static void updateHeight(Segment *pNode);
+    static Segment *rotateLeft(Segment *pNode);
+    static Segment *rotateRight(Segment *pNode);
+    static Segment *rebalance(Segment *pNode);
+    static Segment *treeInsert(Segment *pRoot, Segment *pNode);
+    static Segment *treeRemove(Segment *pRoot, uintptr_t base);
+    static Segment *treeRemoveMin(Segment *pRoot, Segment *&pMin);
+
+    /** Segment with the highest base <= address, or 0. */
+    Segment *findAtOrBelow(uintptr_t address) const;
+    /** Segment with the lowest base > address, or 0. */
+    Segment *findAbove(uintptr_t address) const;
+
+    /** Free list maintenance. */
+    void listInsert(Segment *pSeg);
+    void listRemove(Segment *pSeg);
+
+    /** Adds a new segment to both structures. */
+    void insertSegment(Segment *pSeg);
+    /** Removes a segment from both structures (doesn't delete it). */
+    void removeSegment(Segment *pSeg);
+    /** Changes a segment's extent, keeping it in the right free list. The
+     *  tree order must not change. */
+    void resizeSegment(Segment *pSeg, uintptr_t base, uintptr_t length);
+
+    /** Finds a segment of at least \p length bytes, or 0. */
+    Segment *findFit(uintptr_t length) const;
+
+    /** free() without the quantum caches. */
+    void freeToArena(uintptr_t address, uintptr_t length);
+
+    /** The guts of free(), allocate() and allocateSpecific(). Must hold
+     *  m_Lock. \p pSpare is a preallocated segment which is consumed (and
+     *  set to 0) if needed; \p pDead is set to a segment to delete after
+     *  the lock is released. */
+    void doFree(uintptr_t address, uintptr_t length, Segment *&pSpare, Segment *&pDead);
+    bool doAllocate(uintptr_t length, uintptr_t &address, Segment *&pDead);
+    bool doAllocateSpecific(uintptr_t address, uintptr_t length, Segment *&pSpare, Segment *&pDead);
+
+    /** Deletes every segment in a subtree. */
+    static void destroyTree(Segment *pNode);
+    /** Frees (copies of) every segment in a subtree into this allocator. */
+    void copyTree(Segment *pNode);
+
+    /** This CPU's quantum cache, or 0 if there isn't one. Interrupts must
+     *  be disabled. */
+    QuantumCache *getQuantumCache();
+    /** Fills an empty quantum cache from the arena. \p pDead is as for
+     *  doAllocate(). */
+    void refillQuantumCache(QuantumCache *pCache, Segment *&pDead);
+
+    /** Root of the address-ordered tree. */
+    Segment *m_pRoot;
+    /** Heads of the size-class free lists. */
+    Segment *m_FreeLists[NumFreeLists];
+    /** Number of segments. */
+    size_t m_nSegments;
+
+    /** Should we allocate in reverse order? */
+    bool m_bReverse;
+
+    /** Size of the quanta in the quantum caches, or 0 if they're disabled. */
+    uintptr_t m_Quantum;
+    /** Per-CPU quantum caches (MaxQuantumCaches of them), if enabled. */
+    QuantumCache *m_pQuantumCaches;
+
+    /** Protects everything but the quantum caches. */
+    Spinlock m_Lock;
+};
 
 /** @} */
 #endif
@@ -116,6 +116,15 @@ protected:
      */
     bool isRequestValid(const Request *r);
 
+    /** Takes the first waiting request with the given parameters out of the queue, so
+        that the worker thread can carry it out along with the one it is executing.
+        \return the request, which must then be passed to completeRequest(), or 0 if
+                there is no such request. */
+    Request *takeRequest(uint64_t p1, uint64_t p2, uint64_t p3);
+
+    /** Finishes a request taken with takeRequest(), waking the calling thread. */
+    void completeRequest(Request *pReq, uint64_t ret);
+
     /** Thread trampoline */
     static int trampoline(void *p);
 
@@ -86,6 +86,8 @@ class String
 
         void assign(const String &x);
         void assign(const char *s);
+        /** Assigns the first len bytes of s (which need not be terminated). */
+        void assign(const char *s, size_t len);
         void reserve(size_t size);
         void free();
 
@@ -23,6 +23,9 @@
 #include <processor/Processor.h>
 #include <process/Scheduler.h>
 #include <process/Semaphore.h>
+#ifdef LOCK_STATS
+#include <utilities/LockStats.h>
+#endif
 
 /** \file UnlikelyLock.h
     \author James Molloy
@@ -63,6 +66,12 @@ public:
 
 private:
     Semaphore m_Semaphore;
+
+#ifdef LOCK_STATS
+    /** When and where acquire() got the lock. */
+    uint64_t m_AcquiredAt;
+    uintptr_t m_AcquiredRa;
+#endif
 };
 
 #endif
@@ -22,11 +22,12 @@
 #include <processor/PhysicalMemoryManager.h>
 #include <processor/VirtualAddressSpace.h>
 #include <utilities/StaticString.h>
+#include <utilities/utility.h>
 #include <panic.h>
 #include <Log.h>
 
 Archive::Archive(uint8_t *pPhys, size_t sSize) :
-  m_Region("Archive")
+  m_Region("Archive"), m_pEntries(0), m_nFiles(0), m_pNameHash(0), m_nHashSize(0)
 {
 
   if ((reinterpret_cast<physical_uintptr_t>(pPhys) & (PhysicalMemoryManager::getPageSize() - 1)) != 0)
@@ -40,62 +41,130 @@ Archive::Archive(uint8_t *pPhys, size_t sSize) :
       == false)
   {
     ERROR("Archive: allocateRegion failed.");
+    return;
   }
+
+  buildIndex(sSize);
 }
 
 Archive::~Archive()
 {
+  delete [] m_pEntries;
+  delete [] m_pNameHash;
   m_Region.free();
 }
 
 size_t Archive::getNumFiles()
 {
-  size_t i = 0;
-  File *pFile = getFirst();
-  while (pFile != 0)
-  {
-    i++;
-    pFile = getNext(pFile);
-  }
-  return i;
+  return m_nFiles;
 }
 
 size_t Archive::getFileSize(size_t n)
 {
-  File *pFile = get(n);
-  NormalStaticString str(pFile->size);
-  return str.intValue(8); // Octal
+  if (n >= m_nFiles)
+    return 0;
+  return m_pEntries[n].size;
 }
 
 char *Archive::getFileName(size_t n)
 {
-  return get(n)->name;
+  if (n >= m_nFiles)
+    return 0;
+  return m_pEntries[n].pHeader->name;
 }
 
 uintptr_t *Archive::getFile(size_t n)
 {
-  return reinterpret_cast<uintptr_t*>(reinterpret_cast<uintptr_t>(get(n)) + 512);
+  if (n >= m_nFiles)
+    return 0;
+  return reinterpret_cast<uintptr_t*>(adjust_pointer(m_pEntries[n].pHeader, 512));
 }
 
-Archive::File *Archive::getFirst()
+bool Archive::find(const char *pName, size_t &n)
 {
-  return reinterpret_cast<File*> (m_Region.virtualAddress());
+  if (!m_nHashSize)
+    return false;
+
+  uint32_t hash = hashName(pName);
+  for (size_t slot = hash & (m_nHashSize - 1);
+       m_pNameHash[slot];
+       slot = (slot + 1) & (m_nHashSize - 1))
+  {
+    Entry &e = m_pEntries[m_pNameHash[slot] - 1];
+    if (e.hash == hash && !strncmp(e.pHeader->name, pName, sizeof(e.pHeader->name)))
+    {
+      n = m_pNameHash[slot] - 1;
+      return true;
+    }
+  }
+
+  return false;
 }
 
-Archive::File *Archive::getNext(File *pFile)
+void Archive::buildIndex(size_t sSize)
 {
-  NormalStaticString str(pFile->size);
-  size_t size = str.intValue(8); // Octal.
-  size_t nBlocks = (size + 511) / 512;
-  pFile = adjust_pointer(pFile, 512 * (nBlocks + 1));
-  if (pFile->name[0] == '\0')return 0;
-  return pFile;
+  uintptr_t base = reinterpret_cast<uintptr_t>(m_Region.virtualAddress());
+  uintptr_t end = base + sSize;
+
+  // Two passes over the headers: one to count, one to fill. Each only
+  // touches the 512-byte header blocks, never the file contents.
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    size_t i = 0;
+    uintptr_t offset = base;
+    while (offset + 512 <= end)
+    {
+      File *pFile = reinterpret_cast<File*>(offset);
+      if (pFile->name[0] == '\0')
+        break;
+
+      NormalStaticString str(pFile->size);
+      size_t size = str.intValue(8); // Octal.
+
+      if (pass)
+      {
+        m_pEntries[i].pHeader = pFile;
+        m_pEntries[i].size = size;
+        m_pEntries[i].hash = hashName(pFile->name);
+      }
+
+      ++i;
+      offset += 512 * (((size + 511) / 512) + 1);
+    }
+
+    if (!pass)
+    {
+      m_nFiles = i;
+      if (!m_nFiles)
+        return;
+      m_pEntries = new Entry[m_nFiles];
+    }
+  }
+
+  // Keep the name hash at most half full.
+  m_nHashSize = 1;
+  while (m_nHashSize < m_nFiles * 2)
+    m_nHashSize <<= 1;
+  m_pNameHash = new size_t[m_nHashSize];
+  memset(m_pNameHash, 0, m_nHashSize * sizeof(size_t));
+
+  for (size_t i = 0; i < m_nFiles; ++i)
+  {
+    size_t slot = m_pEntries[i].hash & (m_nHashSize - 1);
+    while (m_pNameHash[slot])
+      slot = (slot + 1) & (m_nHashSize - 1);
+    m_pNameHash[slot] = i + 1;
+  }
 }
 
-Archive::File *Archive::get(size_t n)
+uint32_t Archive::hashName(const char *pName)
 {
-  File *pFile = getFirst();
-  for (size_t i = 0;i < n;i++)
-    pFile = getNext(pFile);
-  return pFile;
+  // FNV-1a; tar names are at most 100 bytes and need not be terminated.
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < 100 && pName[i]; ++i)
+  {
+    hash ^= static_cast<uint8_t>(pName[i]);
+    hash *= 16777619U;
+  }
+  return hash;
 }
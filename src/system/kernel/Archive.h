@@ -26,6 +26,10 @@
 
 /**
  * This class provides functions for extracting an archive file as made by UNIX Tar.
+ *
+ * The archive is indexed once on construction, so that access to any file by
+ * number or by name is constant time. Files are returned in place within the
+ * mapped archive; nothing is copied.
  */
 class Archive
 {
@@ -52,7 +56,16 @@ public:
    *  \param n The file to retrieve. */
   uintptr_t *getFile(size_t n);
 
+  /** Finds a file by name.
+   *  \param pName The name of the file, as stored in the archive.
+   *  \param[out] n The index of the file, if found.
+   *  \return True if the file exists. */
+  bool find(const char *pName, size_t &n);
+
 private:
+  Archive(const Archive &);
+  Archive &operator = (const Archive &);
+
   struct File
   {
     char name[100];         // Filename.
@@ -66,11 +79,29 @@ private:
     char linkname[100];     // Linked-to file name.
   };
 
-  File *getFirst();
-  File *getNext(File *pFile);
-  File *get(size_t n);
+  /** An entry in the file index. */
+  struct Entry
+  {
+    File *pHeader;
+    size_t size;
+    uint32_t hash;
+  };
+
+  /** Walks the archive headers, filling the index and the name hash. */
+  void buildIndex(size_t sSize);
+
+  static uint32_t hashName(const char *pName);
 
   MemoryRegion m_Region;
+
+  /** Index of every file, in archive order. */
+  Entry *m_pEntries;
+  size_t m_nFiles;
+
+  /** Open-addressed hash of file names; each slot holds an index into
+   *  m_pEntries plus one, or zero if the slot is empty. */
+  size_t *m_pNameHash;
+  size_t m_nHashSize;
 };
 
 #endif
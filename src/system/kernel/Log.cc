@@ -27,6 +27,18 @@
 #include <processor/Processor.h>
 #include <LockGuard.h>
 
+#ifdef THREADS
+#include <process/Thread.h>
+#include <process/Scheduler.h>
+#include <process/Semaphore.h>
+#endif
+
+/** How often the drain thread empties the per-CPU rings, in microseconds. */
+#define LOG_DRAIN_INTERVAL  10000
+
+/** Marks the start of a binary log record. Never appears in log text. */
+#define LOG_RECORD_MAGIC    0xFF
+
 extern BootstrapStruct_t *g_pBootstrapInfo;
 
 Log Log::m_Instance;
@@ -56,6 +68,47 @@ class SerialLogger : public Log::LogCallback
 #endif
             }
         }
+
+        /** Writes an entry as a binary record, for scripts/logdecode.py:
+         *  the magic byte, (cpu << 3) | level, then the timestamp and the
+         *  length of the text as base-128 varints, then the text. */
+        void record(const Log::LogEntry &entry, size_t cpu)
+        {
+            uint8_t header[2 + 5 + 5];
+            size_t n = 0;
+            header[n++] = LOG_RECORD_MAGIC;
+            header[n++] = static_cast<uint8_t>(((cpu & 0x1F) << 3) | (entry.type & 0x7));
+            n += varint(&header[n], entry.timestamp);
+            n += varint(&header[n], entry.str.length());
+
+            const char *text = static_cast<const char*>(entry.str);
+            for(size_t i = 0; i < Machine::instance().getNumSerial(); i++)
+            {
+#if defined(MEMORY_TRACING) || (defined(MEMORY_LOGGING_ENABLED) && !defined(MEMORY_LOG_INLINE))
+                if(i == 1) // Don't override memory log.
+                    continue;
+#endif
+
+                Serial *pSerial = Machine::instance().getSerial(i);
+                for(size_t j = 0; j < n; j++)
+                    pSerial->write(static_cast<char>(header[j]));
+                for(size_t j = 0; j < entry.str.length(); j++)
+                    pSerial->write(text[j]);
+            }
+        }
+
+    private:
+        static size_t varint(uint8_t *p, uint32_t value)
+        {
+            size_t n = 0;
+            while(value >= 0x80)
+            {
+                p[n++] = static_cast<uint8_t>(value | 0x80);
+                value >>= 7;
+            }
+            p[n++] = static_cast<uint8_t>(value);
+            return n;
+        }
 };
 
 static SerialLogger g_SerialCallback;
@@ -65,13 +118,21 @@ Log::Log () :
     m_StaticEntries(0),
     m_StaticEntryStart(0),
     m_StaticEntryEnd(0),
+    m_StaticCpu(),
+    m_OutputNext(0),
+    m_OutputPending(0),
+    m_OutputDropped(0),
+    m_nOutputting(0),
     m_Buffer(),
-    m_NumberType(Dec),
+    m_CpuLogs(),
+    m_Sequence(0),
+    m_bDraining(false),
     #ifdef DONT_LOG_TO_SERIAL
-    m_EchoToSerial(false)
+    m_EchoToSerial(false),
     #else
-    m_EchoToSerial(true)
+    m_EchoToSerial(true),
     #endif
+    m_bBinarySerial(false)
 {
 }
 
@@ -94,12 +155,15 @@ void Log::initialise1()
             if(*cmd == String("--disable-log-to-serial"))
             {
                 m_EchoToSerial = false;
-                break;
             }
             else if(*cmd == String("--enable-log-to-serial"))
             {
                 m_EchoToSerial = true;
-                break;
+            }
+            else if(*cmd == String("--binary-log-to-serial"))
+            {
+                m_EchoToSerial = true;
+                m_bBinarySerial = true;
             }
         }
     }
@@ -108,16 +172,48 @@ void Log::initialise1()
 
 void Log::initialise2()
 {
-    if(m_EchoToSerial)
+    // Binary records are written by output() itself, as the callbacks only
+    // ever see text.
+    if(m_EchoToSerial && !m_bBinarySerial)
         installCallback(&g_SerialCallback, false);
 }
 
-void Log::installCallback(LogCallback *pCallback, bool bSkipBacklog)
+void Log::initialise3()
 {
+#ifdef THREADS
+    Process *pProcess = Scheduler::instance().getKernelProcess();
+    Thread *pThread = new Thread(pProcess, &drainThread, 0);
+    pThread->detach();
+
+    m_bDraining = true;
+#endif
+}
+
+int Log::drainThread(void *p)
+{
+#ifdef THREADS
+    Semaphore wait(0);
+    while(true)
     {
-        LockGuard<Spinlock> guard(m_Lock);
-        m_OutputCallbacks.pushBack(pCallback);
+        // Nothing ever posts this: waking us up from wherever an entry is
+        // written (perhaps inside the scheduler) isn't safe, so just poll.
+        wait.acquire(1, 0, LOG_DRAIN_INTERVAL);
+
+        Log::instance().flush();
     }
+#endif
+
+    return 0;
+}
+
+void Log::installCallback(LogCallback *pCallback, bool bSkipBacklog)
+{
+    // Entries from here on go out through output(); the ones before, which
+    // have already been sent to the other callbacks, are the backlog.
+    acquireQuiet();
+    m_OutputCallbacks.pushBack(pCallback);
+    size_t backlogEnd = m_OutputNext;
+    m_Lock.release();
 
     // Some callbacks want to skip a (potentially) massive backlog
     if(bSkipBacklog)
@@ -127,38 +223,12 @@ void Log::installCallback(LogCallback *pCallback, bool bSkipBacklog)
     size_t entry = m_StaticEntryStart;
     while(1)
     {
-        if(entry == m_StaticEntryEnd)
+        if(entry == backlogEnd)
             break;
         else
         {
             HugeStaticString str;
-            switch(m_StaticLog[entry].type)
-            {
-                case Debug:
-                    str = "(DD) ";
-                    break;
-                case Notice:
-                    str = "(NN) ";
-                    break;
-                case Warning:
-                    str = "(WW) ";
-                    break;
-                case Error:
-                    str = "(EE) ";
-                    break;
-                case Fatal:
-                    str = "(FF) ";
-                    break;
-                default:
-                    str = "(XX) ";
-                    break;
-            }
-            str += m_StaticLog[entry].str;
-#ifndef SERIAL_IS_FILE
-            str += "\r\n"; // Handle carriage return
-#else
-            str += "\n";
-#endif
+            format(m_StaticLog[entry], str);
 
             /// \note This could send a massive batch of log entries on the
             ///       callback. If the callback isn't designed to handle big
@@ -171,7 +241,7 @@ void Log::installCallback(LogCallback *pCallback, bool bSkipBacklog)
 }
 void Log::removeCallback(LogCallback *pCallback)
 {
-    LockGuard<Spinlock> guard(m_Lock);
+    acquireQuiet();
     for(List<LogCallback*>::Iterator it = m_OutputCallbacks.begin();
         it != m_OutputCallbacks.end();
         it++)
@@ -179,114 +249,161 @@ void Log::removeCallback(LogCallback *pCallback)
         if(*it == pCallback)
         {
             m_OutputCallbacks.erase(it);
-            return;
+            break;
         }
     }
+    m_Lock.release();
 }
 
-Log &Log::operator<< (const char *str)
+void Log::acquireQuiet()
 {
-    m_Buffer.str.append(str);
-    return *this;
+    // The callback list is walked without the lock while entries are sent.
+    while(true)
+    {
+        m_Lock.acquire();
+        if(!m_nOutputting)
+            return;
+        m_Lock.release();
+    }
 }
 
-Log &Log::operator<< (String str)
+void Log::flush(bool bLock)
 {
-    m_Buffer.str.append(str);
-    return *this;
+    if(bLock)
+        m_Lock.acquire();
+
+    drainLocked();
+
+    if(bLock)
+        m_Lock.release();
+
+    output(bLock, !bLock);
 }
 
-Log &Log::operator<< (bool b)
+Log::CpuLog *Log::getCpuLog(size_t &cpu)
 {
-    if (b)
-        return *this << "true";
+    // Before the processors are enumerated every CPU reports itself as the
+    // BSP, so sharing a ring would not be safe.
+    cpu = 0;
+    if(Processor::isInitialised() < 2)
+        return 0;
 
-    return *this << "false";
+    cpu = Processor::id();
+    if(cpu >= MaxCpuLogs)
+        return 0;
+    return &m_CpuLogs[cpu];
 }
 
-template<class T>
-Log &Log::operator << (T n)
+void Log::drainLocked()
 {
-    size_t radix = 10;
-    if (m_NumberType == Hex)
+    while(true)
     {
-        radix = 16;
-        m_Buffer.str.append("0x");
-    }
-    else if (m_NumberType == Oct)
-    {
-        radix = 8;
-        m_Buffer.str.append("0");
+        // Oldest entry across all the rings.
+        CpuLog *pOldest = 0;
+        size_t oldestCpu = 0;
+        for(size_t i = 0; i < MaxCpuLogs; i++)
+        {
+            CpuLog *pCpu = &m_CpuLogs[i];
+            if(pCpu->tail == pCpu->head)
+                continue;
+
+            size_t sequence = pCpu->sequence[pCpu->tail % LOG_RING_ENTRIES];
+            if(!pOldest || (sequence < pOldest->sequence[pOldest->tail % LOG_RING_ENTRIES]))
+            {
+                pOldest = pCpu;
+                oldestCpu = i;
+            }
+        }
+
+        if(!pOldest)
+            break;
+
+        // Read the slot before handing it back, and hand it back before
+        // calling anything that might log (and need the slot).
+        __sync_synchronize();
+        LogEntry entry = pOldest->entries[pOldest->tail % LOG_RING_ENTRIES];
+        __sync_synchronize();
+        pOldest->tail = pOldest->tail + 1;
+
+        commitEntry(entry, oldestCpu);
     }
-    m_Buffer.str.append(n, radix);
-    return *this;
 }
 
-// NOTE: Make sure that the templated << operator gets only instantiated for
-//       integer types.
-template Log &Log::operator << (char);
-template Log &Log::operator << (unsigned char);
-template Log &Log::operator << (short);
-template Log &Log::operator << (unsigned short);
-template Log &Log::operator << (int);
-template Log &Log::operator << (unsigned int);
-template Log &Log::operator << (long);
-template Log &Log::operator << (unsigned long);
-// NOTE: Instantiating these for MIPS32 requires __udiv3di, but we only have
-//       __udiv3ti (??) in libgcc.a for mips.
-#ifndef MIPS32
-template Log &Log::operator << (long long);
-template Log &Log::operator << (unsigned long long);
-#endif
-
-Log &Log::operator<< (Modifier type)
+void Log::commitEntry(const LogEntry &entry, size_t cpu)
 {
-    // Flush the buffer.
-    if (type == Flush)
+    if (m_StaticEntries >= LOG_ENTRIES)
     {
-        if (m_StaticEntries >= LOG_ENTRIES)
+        // The oldest entry is about to be overwritten. If it still hasn't
+        // been sent, it never will be.
+        if(m_OutputPending && (m_OutputNext == m_StaticEntryStart))
         {
-            m_StaticEntryStart = (m_StaticEntryStart+1) % LOG_ENTRIES;
+            m_OutputNext = (m_OutputNext+1) % LOG_ENTRIES;
+            m_OutputPending --;
+            m_OutputDropped ++;
         }
-        else
-            m_StaticEntries ++;
+        m_StaticEntryStart = (m_StaticEntryStart+1) % LOG_ENTRIES;
+    }
+    else
+        m_StaticEntries ++;
+
+    m_StaticLog[m_StaticEntryEnd] = entry;
+    m_StaticCpu[m_StaticEntryEnd] = static_cast<uint8_t>(cpu);
+    m_StaticEntryEnd = (m_StaticEntryEnd+1) % LOG_ENTRIES;
+
+    m_OutputPending ++;
+}
+
+void Log::output(bool bLock, bool bForce)
+{
+    if(bLock)
+        m_Lock.acquire();
+
+    // Whoever is sending already will get to our entries too, in order.
+    if(m_nOutputting && !bForce)
+    {
+        if(bLock)
+            m_Lock.release();
+        return;
+    }
+    m_nOutputting ++;
+
+    while(m_OutputPending)
+    {
+        LogEntry entry = m_StaticLog[m_OutputNext];
+        size_t cpu = m_StaticCpu[m_OutputNext];
+        size_t dropped = m_OutputDropped;
+        m_OutputNext = (m_OutputNext+1) % LOG_ENTRIES;
+        m_OutputPending --;
+        m_OutputDropped = 0;
 
-        m_StaticLog[m_StaticEntryEnd] = m_Buffer;
-        m_StaticEntryEnd = (m_StaticEntryEnd+1) % LOG_ENTRIES;
+        if(bLock)
+            m_Lock.release();
 
         if(m_OutputCallbacks.count())
         {
-            // We have output callbacks installed. Build the string we'll pass
-            // to each callback *now* and then send it.
             HugeStaticString str;
-            switch(m_Buffer.type)
+            if(dropped)
             {
-                case Debug:
-                    str = "(DD) ";
-                    break;
-                case Notice:
-                    str = "(NN) ";
-                    break;
-                case Warning:
-                    str = "(WW) ";
-                    break;
-                case Error:
-                    str = "(EE) ";
-                    break;
-                case Fatal:
-                    str = "(FF) ";
-                    break;
-                default:
-                    str = "(XX) ";
-                    break;
-            }
-            str += m_Buffer.str;
+                str = "(WW) Log: ";
+                str.append(dropped, 10);
+                str += " entries were overwritten before they were written out";
 #ifndef SERIAL_IS_FILE
-            str += "\r\n"; // Handle carriage return
+                str += "\r\n";
 #else
-            str += "\n";
+                str += "\n";
 #endif
+                for(List<LogCallback*>::Iterator it = m_OutputCallbacks.begin();
+                    it != m_OutputCallbacks.end();
+                    ++it)
+                {
+                    if(*it)
+                        (*it)->callback(static_cast<const char*>(str));
+                }
+            }
 
+            // We have output callbacks installed. Build the string we'll pass
+            // to each callback *now* and then send it.
+            format(entry, str);
             for(List<LogCallback*>::Iterator it = m_OutputCallbacks.begin();
                 it != m_OutputCallbacks.end();
                 ++it)
@@ -295,32 +412,203 @@ Log &Log::operator<< (Modifier type)
                     (*it)->callback(static_cast<const char*>(str));
             }
         }
+
+        // Binary records are written here, as the callbacks only ever see text.
+        if(m_bBinarySerial)
+            g_SerialCallback.record(entry, cpu);
+
+        if(bLock)
+            m_Lock.acquire();
     }
 
-    return *this;
+    m_nOutputting --;
+
+    if(bLock)
+        m_Lock.release();
 }
 
-Log &Log::operator<< (NumberType type)
+void Log::format(const LogEntry &entry, HugeStaticString &str)
 {
-    m_NumberType = type;
-    return *this;
+    switch(entry.type)
+    {
+        case Debug:
+            str = "(DD) ";
+            break;
+        case Notice:
+            str = "(NN) ";
+            break;
+        case Warning:
+            str = "(WW) ";
+            break;
+        case Error:
+            str = "(EE) ";
+            break;
+        case Fatal:
+            str = "(FF) ";
+            break;
+        default:
+            str = "(XX) ";
+            break;
+    }
+    str += entry.str;
+#ifndef SERIAL_IS_FILE
+    str += "\r\n"; // Handle carriage return
+#else
+    str += "\n";
+#endif
 }
 
-Log &Log::operator<< (SeverityLevel level)
+Log::Stream::Stream(SeverityLevel level, bool bLock) :
+    m_pEntry(0), m_pCpu(0), m_Cpu(0), m_NumberType(Dec),
+    m_bInterrupts(Processor::getInterrupts()), m_bLocked(false),
+    m_bCommitted(false)
 {
+    Processor::setInterrupts(false);
+
+    Log &log = Log::instance();
+
+    // Use this CPU's ring if there's room, unless this is an entry written
+    // while writing another one (from an exception, say), or a fatal one:
+    // that needs to get out before the panic.
+    CpuLog *pCpu = log.getCpuLog(m_Cpu);
+    if(log.m_bDraining && pCpu && !pCpu->bWriting && (level != Fatal) &&
+       ((pCpu->head - pCpu->tail) < LOG_RING_ENTRIES))
+    {
+        m_pCpu = pCpu;
+        m_pCpu->bWriting = true;
+        m_pEntry = &pCpu->entries[pCpu->head % LOG_RING_ENTRIES];
+    }
+    else
+    {
+        if(bLock)
+            m_bLocked = log.m_Lock.acquire();
+        m_pEntry = &log.m_Buffer;
+    }
+
     // Zero the buffer.
-    m_Buffer.str.clear();
-    m_Buffer.type = level;
+    m_pEntry->str.clear();
+    m_pEntry->type = level;
 
     Machine &machine = Machine::instance();
     if (machine.isInitialised() == true &&
         machine.getTimer() != 0)
     {
         Timer &timer = *machine.getTimer();
-        m_Buffer.timestamp = timer.getTickCount();
+        m_pEntry->timestamp = timer.getTickCount();
+    }
+    else
+        m_pEntry->timestamp = 0;
+}
+
+Log::Stream::~Stream()
+{
+    Log &log = Log::instance();
+
+    // m_Buffer is anyone's once the lock is dropped.
+    bool bFatal = (m_pEntry->type == Fatal);
+
+    if(m_pCpu)
+        m_pCpu->bWriting = false;
+    if(m_bLocked)
+        log.m_Lock.release();
+
+    Processor::setInterrupts(m_bInterrupts);
+
+    // The callbacks are called only now the lock is free. A fatal entry must
+    // get out before the panic, whoever else is sending.
+    if(m_bCommitted)
+        log.output(m_bLocked, !m_bLocked || bFatal);
+}
+
+Log::Stream &Log::Stream::operator<< (const char *str)
+{
+    m_pEntry->str.append(str);
+    return *this;
+}
+
+Log::Stream &Log::Stream::operator<< (const String &str)
+{
+    m_pEntry->str.append(str);
+    return *this;
+}
+
+Log::Stream &Log::Stream::operator<< (bool b)
+{
+    if (b)
+        return *this << "true";
+
+    return *this << "false";
+}
+
+template<class T>
+Log::Stream &Log::Stream::operator << (T n)
+{
+    size_t radix = 10;
+    if (m_NumberType == Hex)
+    {
+        radix = 16;
+        m_pEntry->str.append("0x");
+    }
+    else if (m_NumberType == Oct)
+    {
+        radix = 8;
+        m_pEntry->str.append("0");
+    }
+    m_pEntry->str.append(n, radix);
+    return *this;
+}
+
+// NOTE: Make sure that the templated << operator gets only instantiated for
+//       integer types.
+template Log::Stream &Log::Stream::operator << (char);
+template Log::Stream &Log::Stream::operator << (unsigned char);
+template Log::Stream &Log::Stream::operator << (short);
+template Log::Stream &Log::Stream::operator << (unsigned short);
+template Log::Stream &Log::Stream::operator << (int);
+template Log::Stream &Log::Stream::operator << (unsigned int);
+template Log::Stream &Log::Stream::operator << (long);
+template Log::Stream &Log::Stream::operator << (unsigned long);
+// NOTE: Instantiating these for MIPS32 requires __udiv3di, but we only have
+//       __udiv3ti (??) in libgcc.a for mips.
+#ifndef MIPS32
+template Log::Stream &Log::Stream::operator << (long long);
+template Log::Stream &Log::Stream::operator << (unsigned long long);
+#endif
+
+Log::Stream &Log::Stream::operator<< (Modifier type)
+{
+    // Flush the buffer.
+    if (type != Flush)
+        return *this;
+
+    Log &log = Log::instance();
+
+    if(m_pCpu)
+    {
+        // Publish the slot: fill in its place in the global order, make sure
+        // the drain sees all of it, then move the head past it.
+        m_pCpu->sequence[m_pCpu->head % LOG_RING_ENTRIES] = __sync_add_and_fetch(&log.m_Sequence, 1);
+        __sync_synchronize();
+        m_pCpu->head = m_pCpu->head + 1;
+
+        m_pCpu->bWriting = false;
+        m_pCpu = 0;
     }
     else
-        m_Buffer.timestamp = 0;
+    {
+        // Anything already in the rings is older, so it goes first. Without
+        // the lock there might be another drain going on, though.
+        if(m_bLocked)
+            log.drainLocked();
+        log.commitEntry(*m_pEntry, m_Cpu);
+        m_bCommitted = true;
+    }
 
     return *this;
 }
+
+Log::Stream &Log::Stream::operator<< (NumberType type)
+{
+    m_NumberType = type;
+    return *this;
+}
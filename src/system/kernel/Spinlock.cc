@@ -21,14 +21,29 @@
 #include <processor/Processor.h>
 #include <process/Thread.h>
 
+#if defined(X64) && defined(MULTIPROCESSOR)
+#include <processor/TlbManager.h>
+#endif
+
 #ifdef TRACK_LOCKS
 #include <LocksCommand.h>
 #endif
 
+#ifdef LOCK_STATS
+#include <utilities/LockStats.h>
+#endif
+
 #include <Log.h>
 
 #include <panic.h>
 
+#ifdef LOCK_STATS
+Spinlock::~Spinlock()
+{
+    LockStats::destroyed(this);
+}
+#endif
+
 bool Spinlock::acquire()
 {
   Thread *pThread = Processor::information().getCurrentThread();
@@ -53,6 +68,12 @@ bool Spinlock::acquire()
       FATAL_NOLOCK("Wrong magic in acquire [" << m_Magic << "] [this=" << ((uintptr_t) this) << "]");
   }
 
+#ifdef LOCK_STATS
+  // Set when the first attempt fails, so an uncontended acquire() doesn't
+  // pay for reading the clock.
+  uint64_t spinStart = 0;
+#endif
+
   while (m_Atom.compareAndSwap(true, false) == false)
   {
     // Couldn't take the lock - can we re-enter the critical section?
@@ -63,6 +84,17 @@ bool Spinlock::acquire()
       break;
     }
 
+#ifdef LOCK_STATS
+    if (!spinStart)
+      spinStart = readTimestamp();
+#endif
+
+#if defined(X64) && defined(MULTIPROCESSOR)
+    // The owner may be waiting for us to flush our TLB, and our interrupts
+    // are off.
+    TlbManager::instance().poll();
+#endif
+
 #ifndef MULTIPROCESSOR
     /// \note When we hit this breakpoint, we're not able to backtrace as backtracing
     ///       depends on the log spinlock, which may have deadlocked. So we actually
@@ -91,6 +123,13 @@ bool Spinlock::acquire()
   {
     m_pOwner = static_cast<void *>(pThread);
     m_Level = 1;
+
+#ifdef LOCK_STATS
+    m_AcquiredAt = readTimestamp();
+    m_AcquiredRa = m_Ra;
+    LockStats::acquired(this, LockStats::SpinlockType, m_Ra, spinStart != 0,
+                        spinStart ? m_AcquiredAt - spinStart : 0);
+#endif
   }
 
   m_bInterrupts = bInterrupts;
@@ -123,6 +162,16 @@ void Spinlock::exit()
 
   m_pOwner = 0;
 
+#ifdef LOCK_STATS
+  // Measured before the lock is dropped, while m_Acquired* are still ours.
+  // A lock constructed locked was never acquired.
+  if (m_AcquiredAt)
+  {
+    LockStats::released(this, m_AcquiredRa, readTimestamp() - m_AcquiredAt);
+    m_AcquiredAt = 0;
+  }
+#endif
+
   if (m_Atom.compareAndSwap(false, true) == false)
   {
     /// \note When we hit this breakpoint, we're not able to backtrace as backtracing
@@ -22,28 +22,89 @@
 #include <utilities/assert.h>
 #include <compiler.h>
 
+#ifdef X86_COMMON
+#include <processor/KernelFpu.h>
+#endif
+
 #include <panic.h>
 
 /**
     x86 note:
     Pedigree requires at least an SSE2-capable CPU in order to run. This allows
     us to make assumptions here about CPU support of certain features.
-    
-    Eventually we will have copies of each function for SSE2,3,4,x.
+
+    The kernel doesn't own the SSE registers (they belong to whichever thread
+    last used them), so SSE is only used inside a kernel FPU section, which
+    saves and restores them. That costs enough that only very large copies
+    are worth it. Everything else picks between rep movs{b,l,q} based on the
+    features CPUID reports.
+
+    AVX isn't used here: XSAVE isn't enabled, so the upper halves of the YMM
+    registers can't be saved.
 **/
 
 #define SSE_ALIGN_SIZE      0x10
 #define SSE_ALIGN_MASK      0xF
 #define NATURAL_MASK        (sizeof(size_t) - 1)
 
-// Below about this size, rep movs{d,q} is in fact faster than SSE.
+// Below about this size, rep movs{d,q} is in fact faster than SSE (which
+// also needs the FPU state saved). Above it, the non-temporal stores keep a
+// large copy from evicting everything else from the cache.
+// \todo None of the thresholds here have been tuned on real hardware yet;
+//       "testsuite -b" prints the sweep to tune them from.
 #define SSE_THRESHOLD 524288 // 512 KiB
 
-// Set to 1 to allow SSE to be used.
-#define USE_SSE             0
+// Most bytes handled in one kernel FPU section, which runs with interrupts
+// disabled.
+#define SSE_CHUNK_SIZE 65536 // 64 KiB
 
-#define USE_SSE_MEMCPY      1
-#define USE_SSE_MEMSET      1
+// With ERMS, rep movsb/stosb is at least as fast as the word-sized forms
+// from about this size (glibc's default for SSE2 machines). With FSRM, rep
+// movsb is fast for short copies too.
+#define REP_MOVSB_THRESHOLD 2048
+#define REP_STOSB_THRESHOLD 2048
+
+#ifdef X86_COMMON
+
+// A fault inside a kernel FPU section could block, so only kernel memory,
+// which is never paged out or mapped on demand, is touched with SSE. Large
+// copies to and from userspace use rep movs instead.
+#ifdef BITS_64
+#define KERNEL_ADDRESS(p)   (((uintptr_t) (p)) >= 0xFFFF800000000000ULL)
+#else
+#define KERNEL_ADDRESS(p)   (((uintptr_t) (p)) >= 0xC0000000)
+#endif
+
+#define CPU_FEATURES_KNOWN  (1 << 0)
+#define CPU_ERMS            (1 << 1)
+#define CPU_FSRM            (1 << 2)
+
+/// CPU features the mem* functions dispatch on, filled in on first use.
+static int g_CpuFeatures = 0;
+
+static int cpu_features()
+{
+    if(LIKELY(g_CpuFeatures))
+        return g_CpuFeatures;
+
+    int features = CPU_FEATURES_KNOWN;
+    uint32_t eax, ebx, ecx, edx;
+
+    asm volatile("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (0), "c" (0));
+    if(eax >= 7)
+    {
+        asm volatile("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (7), "c" (0));
+        if(ebx & (1 << 9))
+            features |= CPU_ERMS;
+        if(edx & (1 << 4))
+            features |= CPU_FSRM;
+    }
+
+    g_CpuFeatures = features;
+    return features;
+}
+
+#endif
 
 #ifdef X86_COMMON
 inline void *memset_nonzero(void *buf, int c, size_t n)
@@ -69,7 +130,7 @@ inline void *memset_nonzero(void *buf, int c, size_t n)
         {
             uint64_t c64 = c;
             uint64_t word = (c64 << 56ULL) | (c64 << 48ULL) | (c64 << 40ULL) | (c64 << 32ULL) | (c64 << 24ULL) | (c64 << 16ULL) | (c64 << 8ULL) | c64;
-            asm volatile("rep stosq" : "=c" (unused) : "D" (p), "c" (n / 8), "a" (word));
+            asm volatile("rep stosq" : "=D" (p), "=c" (unused) : "D" (p), "c" (n / 8), "a" (word) : "memory");
             n = 0;
         }
         else
@@ -77,13 +138,13 @@ inline void *memset_nonzero(void *buf, int c, size_t n)
         if((n % 4) == 0)
         {
             uint32_t word = (c << 24) | (c << 16) | (c << 8) | c;
-            asm volatile("rep stosl" : "=c" (unused) : "D" (p), "c" (n / 4), "a" (word));
+            asm volatile("rep stosl" : "=D" (p), "=c" (unused) : "D" (p), "c" (n / 4), "a" (word) : "memory");
             n = 0;
         }
         else if((n % 2) == 0)
         {
             uint16_t word = (c << 8) | c;
-            asm volatile("rep stosw" : "=c" (unused) : "D" (p), "c" (n / 2), "a" (word));
+            asm volatile("rep stosw" : "=D" (p), "=c" (unused) : "D" (p), "c" (n / 2), "a" (word) : "memory");
             n = 0;
         }
         else
@@ -104,65 +165,29 @@ inline void *memset_nonzero(void *buf, int c, size_t n)
                     nBytes = w;
             }
 
-            asm volatile("rep stosb;":"=c"(unused):"D"(p), "c"(nBytes), "a"(c));
+            asm volatile("rep stosb;":"=D"(p), "=c"(unused):"D"(p), "c"(nBytes), "a"(c) : "memory");
             n -= nBytes;
-            p += nBytes;
         }
     }
 
     return buf;
 }
 
+static void *sse2_memset(void *buf, int c, size_t n);
+
 void *memset(void *buf, int c, size_t n)
 {
-#if USE_SSE && USE_SSE_MEMSET
-    if(c)
-        return memset_nonzero(buf, c, n);
-    else
+    if(UNLIKELY(n > SSE_THRESHOLD) && KERNEL_ADDRESS(buf) && kernel_fpu_available())
+        return sse2_memset(buf, c, n);
+
+    if((cpu_features() & CPU_ERMS) && (n >= REP_STOSB_THRESHOLD))
     {
-        uintptr_t p = (uintptr_t) buf;
-        size_t off = 0;
-        
-        if(!n)
-            return buf;
-        
-        // Align to the SSE block size
-        if(p & SSE_ALIGN_MASK)
-        {
-            // If p == 0x01, nForAlignment will be 0x0F (0x10 - 0x01).
-            // p + off = 0x01 + 0x0F = 0x10
-            size_t nForAlignment = (SSE_ALIGN_SIZE - (p & SSE_ALIGN_MASK));
-            if(nForAlignment > n)
-                nForAlignment = n;
-            
-            uint32_t unused = 0; // Used to tell GCC ECX gets smashed.
-            off = nForAlignment;
-            asm volatile("rep stosb" : "=c" (unused) : "D" (buf), "c" (nForAlignment), "a" (0));
-            
-            if(off >= n)
-                return buf;
-        }
-        
-        // Clearing memory to zero, and at least one SSE-size block!
-        // Massive optimisation possible!
-        
-        // Now aligned, clear 16 bytes at a time
-        asm volatile("pxor %xmm0, %xmm0");
-        for(; (off + SSE_ALIGN_SIZE) <= n; off += SSE_ALIGN_SIZE)
-        {
-            // assert(((p + off) & SSE_ALIGN_MASK) == 0);
-            asm volatile("movdqa %%xmm0, (%0)" : : "r" (p + off));
-        }
-        
-        // Any remaining bytes can now be cleared.
-        if(off < n)
-            asm volatile("rep stosb" : : "D" (p + off), "c" (n - off), "a" (0));
-        
+        size_t unused;
+        asm volatile("rep stosb" : "=D" (unused), "=c" (unused) : "D" (buf), "c" (n), "a" (c) : "memory");
         return buf;
     }
-#else
+
     return memset_nonzero(buf, c, n);
-#endif
 }
 
 #else
@@ -180,11 +205,9 @@ void *memset(void *buf, int c, size_t len)
 #ifdef X86_COMMON
 void *wmemset(void *buf, int c, size_t n)
 {
-#if USE_SSE && USE_SSE_MEMSET
-    // Use SSE if it would give us an advantage here.
-    if((!c) && ((n << 1) >= SSE_ALIGN_SIZE))
+    // Zero fills can use whatever memset() picks.
+    if(!c)
       return memset(buf, (char) c, n << 1);
-#endif
     
     char *p = (char *)buf;
 
@@ -211,11 +234,9 @@ void *wmemset(void *buf, int c, size_t len)
 #ifdef X86_COMMON
 void *dmemset(void *buf, unsigned int c, size_t n)
 {
-#if USE_SSE && USE_SSE_MEMSET
-    // Use SSE if it would give us an advantage here.
-    if((!c) && ((n << 2) >= SSE_ALIGN_SIZE))
+    // Zero fills can use whatever memset() picks.
+    if(!c)
       return memset(buf, (char) c, n << 2);
-#endif
   
     char *p = (char *)buf;
 
@@ -242,13 +263,9 @@ void *dmemset(void *buf, unsigned int c, size_t len)
 void *qmemset(void *buf, unsigned long long c, size_t len)
 {
 #ifdef X86_COMMON
-
-#if USE_SSE && USE_SSE_MEMSET
-  // Use SSE if it would give us an advantage here.
-  if((!c) && ((len << 3) >= SSE_ALIGN_SIZE))
-    return memset(buf, (char) c, len << 3);
-#endif
-
+  // Zero fills can use whatever memset() picks.
+  if(!c)
+    return memset(buf, 0, len << 3);
 #endif
   
 #ifdef X64
@@ -264,35 +281,50 @@ void *qmemset(void *buf, unsigned long long c, size_t len)
 
 #ifdef X86_COMMON
 
-#define SSE2_SAVE_REGION_SIZE   (512)
-#define SSE2_SAVE_REGION_ALIGN  __attribute__((aligned(16)))
+/// SSE2 memset for large buffers, with non-temporal stores.
+static void *sse2_memset(void *buf, int c, size_t n)
+{
+    char *p = (char *) buf;
+    KernelFpuState state;
 
-/// \todo sse2_save/restore should probably use fxsave/fxrstor...
+    // Align to the SSE block size.
+    size_t nForAlignment = (SSE_ALIGN_SIZE - (((uintptr_t) p) & SSE_ALIGN_MASK)) & SSE_ALIGN_MASK;
+    memset_nonzero(p, c, nForAlignment);
+    p += nForAlignment;
+    n -= nForAlignment;
 
-/// SSE2 register save.
-void sse2_save(char p[SSE2_SAVE_REGION_SIZE])
-{
-    asm volatile("movdqu %%xmm0, 0(%0); \
-                  movdqu %%xmm1, 16(%0); \
-                  movdqu %%xmm2, 32(%0); \
-                  movdqu %%xmm3, 48(%0); \
-                  movdqu %%xmm4, 64(%0); \
-                  movdqu %%xmm5, 80(%0); \
-                  movdqu %%xmm6, 96(%0); \
-                  movdqu %%xmm7, 112(%0);" :: "r" (p) : "memory");
-}
+    uint64_t pattern[2] ALIGN(16);
+    pattern[0] = pattern[1] = (c & 0xFF) * 0x0101010101010101ULL;
 
-/// SSE2 register save.
-void sse2_restore(char p[SSE2_SAVE_REGION_SIZE])
-{
-    asm volatile("movdqu 0(%0), %%xmm0; \
-                  movdqu 16(%0), %%xmm1; \
-                  movdqu 32(%0), %%xmm2; \
-                  movdqu 48(%0), %%xmm3; \
-                  movdqu 64(%0), %%xmm4; \
-                  movdqu 80(%0), %%xmm5; \
-                  movdqu 96(%0), %%xmm6; \
-                  movdqu 112(%0), %%xmm7;" :: "r" (p) : "memory");
+    while(n >= 128)
+    {
+        size_t chunk = (n > SSE_CHUNK_SIZE) ? SSE_CHUNK_SIZE : (n & ~127);
+        kernel_fpu_begin(&state);
+
+        asm volatile("movdqa (%0), %%xmm0" :: "r" (pattern));
+        for(size_t off = 0; off < chunk; off += 128)
+        {
+            asm volatile("movntdq %%xmm0, 0(%0);" \
+                         "movntdq %%xmm0, 16(%0);" \
+                         "movntdq %%xmm0, 32(%0);" \
+                         "movntdq %%xmm0, 48(%0);" \
+                         "movntdq %%xmm0, 64(%0);" \
+                         "movntdq %%xmm0, 80(%0);" \
+                         "movntdq %%xmm0, 96(%0);" \
+                         "movntdq %%xmm0, 112(%0);" : : "r" (p + off) : "memory");
+        }
+        asm volatile("sfence" ::: "memory");
+
+        kernel_fpu_end(&state);
+
+        p += chunk;
+        n -= chunk;
+    }
+
+    // Any remaining bytes can now be set.
+    memset_nonzero(p, c, n);
+
+    return buf;
 }
 
 /// SSE2-optimised memcpy, where source is unaligned but destination is aligned.
@@ -419,213 +451,176 @@ void *sse2_aligned_memcpy(void *restrict s1, const void *restrict s2, const size
     return s1;
 }
 
-void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
+/// Copies using rep movs{l,q}, with byte copies to align the destination.
+static void *natural_memcpy(void *restrict s1, const void *restrict s2, size_t n)
 {
-    static int can_sse = 0;
-
     char *restrict p1 = (char *)s1;
     const char *restrict p2 = (const char *)s2;
 
-    uintptr_t p1_u = (uintptr_t) p1;
-    uintptr_t p2_u = (uintptr_t) p2;
+    size_t unused;
 
     // Check for bad usage of memcpy
     if(UNLIKELY(!n)) return s1;
 
-    // Check to see if we can now toggle on SSE.
-    if(UNLIKELY(!can_sse))
-    {
-        uintptr_t cr0, cr4;
-        asm volatile("mov %%cr0, %0" : "=r" (cr0));
-        if((cr0 & (1 << 2)) == 0)
-        {
-            // EM in CR0 unset. Good to go.
-            can_sse = 1;
-        }
-    }
-
-    size_t unused;
-
-    // Should we do SSE? Note that SSE involves an FPU state save,
-    // so it must be REALLY worth it.
-    if(can_sse && (n > SSE_THRESHOLD))
+    // See if it's even worth aligning
+    switch(n)
     {
-        /// \todo We should NOT save SSE state if the process has not used SSE...
-        char save_state[SSE2_SAVE_REGION_SIZE] SSE2_SAVE_REGION_ALIGN;
-
-        long ints = 0;
-        asm volatile("pushf; pop %0; and $0x200, %0; cli" : "=r" (ints));
-        // Save SSE registers, as we are about to destroy them.
-        sse2_save(save_state);
-
-        // Transfer in 128 byte blocks.
-        uintptr_t p1Align = p1_u & SSE_ALIGN_MASK;
-        uintptr_t p2Align = p2_u & SSE_ALIGN_MASK;
-        if(LIKELY(!(p1Align || p2Align)))
-        {
-            // Fully aligned inputs.
-            /// \note Please call memcpy with aligned src/dest as much as
-            ///       possible, as the performance boost is quite nice.
-            sse2_aligned_memcpy(p1, p2, n);
-        }
-        else
-        {
-            // Align destination, use source unaligned.
-            // This allows us to use aligned non-temporal writes, with
-            // (prefetched) unaligned reads from the source.
-            size_t distance = SSE_ALIGN_SIZE - p1Align;
-            switch(distance)
-            {
-                case 15:
-                    *p1++ = *p2++;
-                case 14:
-                    *p1++ = *p2++;
-                case 13:
-                    *p1++ = *p2++;
-                case 12:
-                    *p1++ = *p2++;
-                case 11:
-                    *p1++ = *p2++;
-                case 10:
-                    *p1++ = *p2++;
-                case 9:
-                    *p1++ = *p2++;
-                case 8:
-                    *p1++ = *p2++;
-                case 7:
-                    *p1++ = *p2++;
-                case 6:
-                    *p1++ = *p2++;
-                case 5:
-                    *p1++ = *p2++;
-                case 4:
-                    *p1++ = *p2++;
-                case 3:
-                    *p1++ = *p2++;
-                case 2:
-                    *p1++ = *p2++;
-                case 1:
-                    *p1++ = *p2++;
-                    n -= distance;
-                default:
-                    break;
-            }
-
-            sse2_src_unaligned_memcpy(p1, p2, n);
-        }
-
-        size_t count = n & ~127; // Aligns n to 128 byte boundary.
-        p1 += count;
-        p2 += count;
-
-        // Finish off any trailing bytes that couldn't be transferred as part of a 128 byte block.
-        memcpy(p1, p2, n & 127);
-
-        /// \todo FPU restore here!
-        sse2_restore(save_state);
-        if(ints)
-            asm volatile("sti");
-
-        return s1;
-    }
-    else
-    {
-        // Not enough bytes for SSE to be worth the FPU save.
-
-        // See if it's even worth aligning
-        switch(n)
-        {
 #ifdef X64
-            case 7:
-                *p1++ = *p2++;
-            case 6:
-                *p1++ = *p2++;
-            case 5:
-                *p1++ = *p2++;
-            case 4:
-                *p1++ = *p2++;
+        case 7:
+            *p1++ = *p2++;
+        case 6:
+            *p1++ = *p2++;
+        case 5:
+            *p1++ = *p2++;
+        case 4:
+            *p1++ = *p2++;
 #endif
-            case 3:
-                *p1++ = *p2++;
-            case 2:
-                *p1++ = *p2++;
-            case 1:
-                *p1++ = *p2++;
-                return s1;
-            default:
-                break;
-        }
+        case 3:
+            *p1++ = *p2++;
+        case 2:
+            *p1++ = *p2++;
+        case 1:
+            *p1++ = *p2++;
+            return s1;
+        default:
+            break;
+    }
 
-        // calculate the distance to the nearest natural boundary
-        size_t offset = (sizeof(size_t) - (((size_t) p1) & NATURAL_MASK)) & NATURAL_MASK;
+    // calculate the distance to the nearest natural boundary
+    size_t offset = (sizeof(size_t) - (((size_t) p1) & NATURAL_MASK)) & NATURAL_MASK;
 
-        // Align p1 on a natural boundary
-        switch(offset)
-        {
+    // Align p1 on a natural boundary
+    switch(offset)
+    {
 #ifdef X64
-            case 7:
-                *p1++ = *p2++;
-            case 6:
-                *p1++ = *p2++;
-            case 5:
-                *p1++ = *p2++;
-            case 4:
-                *p1++ = *p2++;
+        case 7:
+            *p1++ = *p2++;
+        case 6:
+            *p1++ = *p2++;
+        case 5:
+            *p1++ = *p2++;
+        case 4:
+            *p1++ = *p2++;
 #endif
-            case 3:
-                *p1++ = *p2++;
-            case 2:
-                *p1++ = *p2++;
-            case 1:
-                *p1++ = *p2++;
-                n -= offset;
-            default:
-                break;
-        }
+        case 3:
+            *p1++ = *p2++;
+        case 2:
+            *p1++ = *p2++;
+        case 1:
+            *p1++ = *p2++;
+            n -= offset;
+        default:
+            break;
+    }
 
-        // Move in size_t size'd blocks
+    // Move in size_t size'd blocks
 #ifdef X64
-        size_t blocks = n >> 3;
+    size_t blocks = n >> 3;
 #else
-        size_t blocks = n >> 2;
+    size_t blocks = n >> 2;
 #endif
-        if(LIKELY(blocks))
-        {
+    if(LIKELY(blocks))
+    {
 #ifdef X64
-            asm volatile("rep movsq;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(blocks) : "memory");
+        asm volatile("rep movsq;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(blocks) : "memory");
 #else
-            asm volatile("rep movsl;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(blocks) : "memory");
+        asm volatile("rep movsl;":"=D"(p1), "=S"(p2), "=c"(unused):"D"(p1), "S"(p2), "c"(blocks) : "memory");
 #endif
-        }
+    }
 
-        // Clean up the remaining bytes
-        size_t tail = n & NATURAL_MASK;
-        switch(tail)
-        {
+    // Clean up the remaining bytes
+    size_t tail = n & NATURAL_MASK;
+    switch(tail)
+    {
 #ifdef X64
-            case 7:
-                *p1++ = *p2++;
-            case 6:
-                *p1++ = *p2++;
-            case 5:
-                *p1++ = *p2++;
-            case 4:
-                *p1++ = *p2++;
+        case 7:
+            *p1++ = *p2++;
+        case 6:
+            *p1++ = *p2++;
+        case 5:
+            *p1++ = *p2++;
+        case 4:
+            *p1++ = *p2++;
 #endif
-            case 3:
-                *p1++ = *p2++;
-            case 2:
-                *p1++ = *p2++;
-            case 1:
-                *p1++ = *p2++;
-            default:
-                break;
-        }
+        case 3:
+            *p1++ = *p2++;
+        case 2:
+            *p1++ = *p2++;
+        case 1:
+            *p1++ = *p2++;
+        default:
+            break;
+    }
+
+    return s1;
+}
+
+/// Copies large buffers with SSE2 in kernel FPU sections.
+static void *sse2_memcpy(void *restrict s1, const void *restrict s2, size_t n)
+{
+    char *restrict p1 = (char *)s1;
+    const char *restrict p2 = (const char *)s2;
+    KernelFpuState state;
+
+    // Align destination, use source unaligned if need be.
+    // This allows us to use aligned non-temporal writes, with
+    // (prefetched) unaligned reads from the source.
+    size_t distance = (SSE_ALIGN_SIZE - (((uintptr_t) p1) & SSE_ALIGN_MASK)) & SSE_ALIGN_MASK;
+    natural_memcpy(p1, p2, distance);
+    p1 += distance;
+    p2 += distance;
+    n -= distance;
+
+    int bAligned = (((uintptr_t) p2) & SSE_ALIGN_MASK) == 0;
+    while(n >= 128)
+    {
+        // Transfer in 128 byte blocks.
+        size_t chunk = (n > SSE_CHUNK_SIZE) ? SSE_CHUNK_SIZE : (n & ~127);
+        kernel_fpu_begin(&state);
+
+        /// \note Please call memcpy with aligned src/dest as much as
+        ///       possible, as the performance boost is quite nice.
+        if(LIKELY(bAligned))
+            sse2_aligned_memcpy(p1, p2, chunk);
+        else
+            sse2_src_unaligned_memcpy(p1, p2, chunk);
+        asm volatile("sfence" ::: "memory");
+
+        kernel_fpu_end(&state);
+
+        p1 += chunk;
+        p2 += chunk;
+        n -= chunk;
     }
 
+    // Finish off any trailing bytes that couldn't be transferred as part of a 128 byte block.
+    natural_memcpy(p1, p2, n);
+
     return s1;
 }
 
+void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
+{
+    // Check for bad usage of memcpy
+    if(UNLIKELY(!n)) return s1;
+
+    // Should we do SSE? Note that SSE involves an FPU state save,
+    // so it must be REALLY worth it.
+    if(UNLIKELY(n > SSE_THRESHOLD) && KERNEL_ADDRESS(s1) && KERNEL_ADDRESS(s2) &&
+       kernel_fpu_available())
+        return sse2_memcpy(s1, s2, n);
+
+    int features = cpu_features();
+    if((features & CPU_FSRM) || ((features & CPU_ERMS) && (n >= REP_MOVSB_THRESHOLD)))
+    {
+        size_t unused;
+        asm volatile("rep movsb" : "=D" (unused), "=S" (unused), "=c" (unused) : "D" (s1), "S" (s2), "c" (n) : "memory");
+        return s1;
+    }
+
+    return natural_memcpy(s1, s2, n);
+}
+
 void *memcpy_gcc(void *restrict s1, const void *restrict s2, size_t n)
 {
     char *restrict p1 = s1;
@@ -709,7 +704,8 @@ void *memmove(void *s1, const void *s2, size_t n)
 #else
 void *memmove(void *s1, const void *s2, size_t n)
 {
-  if (s1 <= s2)
+  // Copying forwards is fine unless the destination starts inside the source.
+  if ((s1 <= s2) || ((uintptr_t)s1 >= ((uintptr_t)s2 + n)))
     memcpy(s1, s2, n);
   else
   {
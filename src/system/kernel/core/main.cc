@@ -103,6 +103,7 @@
 #include <processor/KernelCoreSyscallManager.h>
 
 #include <machine/Machine.h>              // Machine::initialise()
+#include <machine/Timer.h>
 #include <LocalIO.h>
 #include <SerialIO.h>
 #include <DebuggerIO.h>
@@ -216,12 +217,15 @@ int loadModules(void *inf)
         if(*tags == MODULE_TAG)
         {
             ModuleInfo *modinfo = reinterpret_cast<ModuleInfo*>(tags);
-            KernelElf::instance().loadModule(modinfo);
+            KernelElf::instance().preloadModule(modinfo);
         }
 
         tags++;
     }
 
+    // Run the lot, in parallel where dependencies allow.
+    KernelElf::instance().executeModules();
+
     return 0;
 
 #else
@@ -229,19 +233,57 @@ int loadModules(void *inf)
 
     /// \note We have to do this before we call Processor::initialisationDone() otherwise the
     ///       BootstrapStruct_t might already be unmapped
+    Timer *pTimer = Machine::instance().getTimer();
+    uint64_t startTime = pTimer ? pTimer->getTickCount() : 0;
+
     Archive initrd(bsInf.getInitrdAddress(), bsInf.getInitrdSize());
-    
+
+    uint64_t indexTime = pTimer ? pTimer->getTickCount() - startTime : 0;
     size_t nFiles = initrd.getNumFiles();
+    NOTICE("Indexed " << Dec << nFiles << " initrd files in " << indexTime << Hex << " ms");
+
     g_BootProgressTotal = nFiles*2; // Each file has to be preloaded and executed.
+
+    // Graphics drivers have to be loaded before splash. Look these up by name
+    // rather than trusting the order the build happened to write the archive in.
+    static const char *forcedOrder[] = {"config.o", "pci.o", "vbe.o", "vmware-gfx.o",
+                                        "gfx-deps.o", "splash.o"};
+    const size_t nForced = sizeof(forcedOrder) / sizeof(forcedOrder[0]);
+    size_t forced[nForced];
+    for (size_t i = 0; i < nForced; i++)
+    {
+        if (!initrd.find(forcedOrder[i], forced[i]))
+        {
+            forced[i] = nFiles;
+            continue;
+        }
+        KernelElf::instance().preloadModule(reinterpret_cast<uint8_t*> (initrd.getFile(forced[i])),
+                                            initrd.getFileSize(forced[i]));
+    }
+
     for (size_t i = 0; i < nFiles; i++)
     {
-        Processor::setInterrupts(true);
-        KernelElf::instance().loadModule(reinterpret_cast<uint8_t*> (initrd.getFile(i)),
-                                         initrd.getFileSize(i));
-        if(!Processor::getInterrupts())
-            WARNING("A loaded module disabled interrupts.");
+        bool bLoaded = false;
+        for (size_t j = 0; j < nForced; j++)
+            if (forced[j] == i)
+                bLoaded = true;
+        if (bLoaded)
+            continue;
+
+        KernelElf::instance().preloadModule(reinterpret_cast<uint8_t*> (initrd.getFile(i)),
+                                            initrd.getFileSize(i));
     }
 
+    // Execute every module once its dependencies have run; independent
+    // modules are initialised in parallel.
+    Processor::setInterrupts(true);
+    KernelElf::instance().executeModules();
+    if(!Processor::getInterrupts())
+        WARNING("A loaded module disabled interrupts.");
+
+    uint64_t totalTime = pTimer ? pTimer->getTickCount() - startTime : 0;
+    NOTICE("Loaded and initialised " << Dec << nFiles << " initrd modules in " << totalTime << Hex << " ms");
+
     // The initialisation is done here, unmap/free the .init section and on x86/64 the identity
     // mapping of 0-4MB
     // NOTE: BootstrapStruct_t unusable after this point
@@ -378,6 +420,9 @@ extern "C" void _main(BootstrapStruct_t &bsInf)
 
 #ifdef THREADS
   ZombieQueue::instance().initialise();
+
+  // Hand the log's callbacks over to a thread of their own.
+  Log::instance().initialise3();
 #endif
 
   /// \todo Seed random number generator.
@@ -0,0 +1,356 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <process/CompressedPageStore.h>
+#include <processor/Processor.h>
+#include <utilities/utility.h>
+#include <LockGuard.h>
+#include <Log.h>
+
+CompressedPageStore CompressedPageStore::m_Instance;
+
+CompressedPageStore::CompressedPageStore() :
+    m_NextSlab(1), m_SharedScratch(), m_ScratchLock(false, true),
+    m_Statistics(), m_Lock(false, true)
+{
+    memset(m_pSlabs, 0, sizeof(m_pSlabs));
+    memset(m_pPartial, 0, sizeof(m_pPartial));
+    memset(m_pScratch, 0, sizeof(m_pScratch));
+}
+
+size_t CompressedPageStore::compress(const void *pPage, uint8_t *pOut)
+{
+    // Allocate this CPU's buffer before interrupts go off. If we migrate in
+    // the meantime, the next CPU just uses the shared one this time round.
+    size_t cpu = Processor::id();
+    if (cpu < MaxScratchCpus && !m_pScratch[cpu])
+    {
+        Scratch *pScratch = new Scratch;
+        if (pScratch && !__sync_bool_compare_and_swap(&m_pScratch[cpu], 0, pScratch))
+            delete pScratch;
+    }
+
+    // Stay on this CPU while its buffer is in use.
+    bool bInterrupts = Processor::getInterrupts();
+    Processor::setInterrupts(false);
+
+    cpu = Processor::id();
+    Scratch *pScratch = (cpu < MaxScratchCpus) ? m_pScratch[cpu] : 0;
+
+    size_t length;
+    if (pScratch)
+    {
+        length = Lz4::compress(pPage, PAGE_SIZE, pScratch->buffer, MaxCompressedSize, pScratch->hashTable);
+        memcpy(pOut, pScratch->buffer, length);
+    }
+    else
+    {
+        LockGuard<Spinlock> guard(m_ScratchLock);
+        length = Lz4::compress(pPage, PAGE_SIZE, m_SharedScratch.buffer, MaxCompressedSize, m_SharedScratch.hashTable);
+        memcpy(pOut, m_SharedScratch.buffer, length);
+    }
+
+    Processor::setInterrupts(bInterrupts);
+    return length;
+}
+
+bool CompressedPageStore::store(const void *pPage, uintptr_t &handle)
+{
+    // Compressing straight into the slot would mean holding m_Lock for it,
+    // so go through a buffer big enough for any page that's kept.
+    uint8_t compressed[MaxCompressedSize];
+    size_t length = compress(pPage, compressed);
+    if (!length)
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+        ++m_Statistics.nRejected;
+        return false;
+    }
+
+    size_t sizeClass = (length - 1) / CompressedSlotSize;
+
+    // Anything that has to be allocated is allocated without the lock and
+    // handed in the next time round.
+    Slab *pNewSlab = 0;
+    Slab **pSpareChunk = 0;
+    Slab *pSlab = 0;
+    size_t slot = 0;
+    while (true)
+    {
+        m_Lock.acquire();
+
+        pSlab = m_pPartial[sizeClass];
+        if (!pSlab && pNewSlab && installSlab(pNewSlab, pSpareChunk))
+        {
+            pSlab = pNewSlab;
+            pNewSlab = 0;
+        }
+
+        if (pSlab)
+        {
+            slot = __builtin_ctz(pSlab->freeMask);
+            pSlab->freeMask &= ~(1U << slot);
+            if (!pSlab->freeMask)
+                partialRemove(pSlab);
+
+            pSlab->lengths[slot] = length;
+            pSlab->refs[slot] = 1;
+
+            ++m_Statistics.nPages;
+            m_Statistics.compressedBytes += length;
+            break;
+        }
+
+        bool bNeedSlab = !pNewSlab;
+        bool bNeedChunk = !pSpareChunk && needChunk();
+        bool bFull = !bNeedSlab && !bNeedChunk;
+        m_Lock.release();
+
+        if (bFull)
+        {
+            WARNING("CompressedPageStore: out of slabs");
+            break;
+        }
+
+        if (bNeedSlab && !(pNewSlab = createSlab(sizeClass)))
+            break;
+        if (bNeedChunk)
+        {
+            pSpareChunk = new Slab*[SlabsPerChunk];
+            if (!pSpareChunk)
+                break;
+            memset(pSpareChunk, 0, SlabsPerChunk * sizeof(Slab*));
+        }
+    }
+    if (pSlab)
+        m_Lock.release();
+
+    if (pNewSlab)
+        destroySlab(pNewSlab);
+    delete [] pSpareChunk;
+
+    if (!pSlab)
+        return false;
+
+    // The slot is ours, so the slab can't go away under us.
+    memcpy(pSlab->pData + slot * (sizeClass + 1) * CompressedSlotSize, compressed, length);
+
+    handle = (pSlab->index * MaxSlotsPerSlab) + slot;
+    return true;
+}
+
+bool CompressedPageStore::load(uintptr_t handle, void *pPage)
+{
+    const uint8_t *pData;
+    size_t length;
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+
+        size_t slot;
+        Slab *pSlab = lookup(handle, slot);
+        if (!pSlab)
+            return false;
+
+        // The caller's reference keeps the slot (and its slab) in place.
+        pData = pSlab->pData + slot * (pSlab->sizeClass + 1) * CompressedSlotSize;
+        length = pSlab->lengths[slot];
+        ++m_Statistics.nLoads;
+    }
+
+    if (Lz4::decompress(pData, length, pPage, PAGE_SIZE) != PAGE_SIZE)
+    {
+        ERROR("CompressedPageStore: page " << handle << " is corrupt");
+        return false;
+    }
+
+    return true;
+}
+
+void CompressedPageStore::duplicate(uintptr_t handle)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    size_t slot;
+    Slab *pSlab = lookup(handle, slot);
+    if (pSlab)
+        ++pSlab->refs[slot];
+}
+
+void CompressedPageStore::release(uintptr_t handle)
+{
+    Slab *pEmpty = 0;
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+
+        size_t slot;
+        Slab *pSlab = lookup(handle, slot);
+        if (!pSlab || --pSlab->refs[slot])
+            return;
+
+        --m_Statistics.nPages;
+        m_Statistics.compressedBytes -= pSlab->lengths[slot];
+
+        if (!pSlab->freeMask)
+            partialInsert(pSlab);
+        pSlab->freeMask |= 1U << slot;
+
+        if (pSlab->freeMask == ((1ULL << pSlab->nSlots) - 1))
+        {
+            uninstallSlab(pSlab);
+            pEmpty = pSlab;
+        }
+    }
+
+    if (pEmpty)
+        destroySlab(pEmpty);
+}
+
+void CompressedPageStore::getStatistics(Statistics &stats)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    stats = m_Statistics;
+}
+
+CompressedPageStore::Slab *CompressedPageStore::lookup(uintptr_t handle, size_t &slot)
+{
+    size_t index = handle / MaxSlotsPerSlab;
+    slot = handle % MaxSlotsPerSlab;
+    if (!index || index >= MaxSlabs)
+        return 0;
+
+    Slab **pChunk = m_pSlabs[index / SlabsPerChunk];
+    if (!pChunk)
+        return 0;
+
+    Slab *pSlab = pChunk[index % SlabsPerChunk];
+    if (!pSlab || slot >= pSlab->nSlots || (pSlab->freeMask & (1U << slot)))
+    {
+        ERROR("CompressedPageStore: bad handle " << handle);
+        return 0;
+    }
+
+    return pSlab;
+}
+
+CompressedPageStore::Slab *CompressedPageStore::createSlab(size_t sizeClass)
+{
+    size_t slotSize = (sizeClass + 1) * CompressedSlotSize;
+    size_t nSlots = SlabSize / slotSize;
+    if (nSlots > MaxSlotsPerSlab)
+        nSlots = MaxSlotsPerSlab;
+
+    Slab *pSlab = new Slab;
+    if (!pSlab)
+        return 0;
+    pSlab->pData = new uint8_t[nSlots * slotSize];
+    if (!pSlab->pData)
+    {
+        delete pSlab;
+        return 0;
+    }
+
+    pSlab->pPrev = pSlab->pNext = 0;
+    pSlab->freeMask = (1ULL << nSlots) - 1;
+    pSlab->index = 0;
+    pSlab->sizeClass = sizeClass;
+    pSlab->nSlots = nSlots;
+    return pSlab;
+}
+
+void CompressedPageStore::destroySlab(Slab *pSlab)
+{
+    delete [] pSlab->pData;
+    delete pSlab;
+}
+
+bool CompressedPageStore::needChunk()
+{
+    size_t index;
+    for (index = m_NextSlab; index < MaxSlabs; ++index)
+    {
+        Slab **pChunk = m_pSlabs[index / SlabsPerChunk];
+        if (!pChunk)
+            return true;
+        if (!pChunk[index % SlabsPerChunk])
+            return false;
+    }
+    return false;
+}
+
+bool CompressedPageStore::installSlab(Slab *pSlab, Slab **&pSpareChunk)
+{
+    size_t index;
+    for (index = m_NextSlab; index < MaxSlabs; ++index)
+    {
+        Slab **pChunk = m_pSlabs[index / SlabsPerChunk];
+        if (!pChunk || !pChunk[index % SlabsPerChunk])
+            break;
+    }
+    if (index == MaxSlabs)
+        return false;
+
+    Slab **&pChunk = m_pSlabs[index / SlabsPerChunk];
+    if (!pChunk)
+    {
+        if (!pSpareChunk)
+            return false;
+        pChunk = pSpareChunk;
+        pSpareChunk = 0;
+    }
+
+    pSlab->index = index;
+    pChunk[index % SlabsPerChunk] = pSlab;
+    m_NextSlab = index + 1;
+    m_Statistics.slabBytes += pSlab->nSlots * (pSlab->sizeClass + 1) * CompressedSlotSize;
+
+    partialInsert(pSlab);
+    return true;
+}
+
+void CompressedPageStore::uninstallSlab(Slab *pSlab)
+{
+    partialRemove(pSlab);
+
+    m_pSlabs[pSlab->index / SlabsPerChunk][pSlab->index % SlabsPerChunk] = 0;
+    if (pSlab->index < m_NextSlab)
+        m_NextSlab = pSlab->index;
+    m_Statistics.slabBytes -= pSlab->nSlots * (pSlab->sizeClass + 1) * CompressedSlotSize;
+}
+
+void CompressedPageStore::partialInsert(Slab *pSlab)
+{
+    Slab *&pHead = m_pPartial[pSlab->sizeClass];
+    pSlab->pPrev = 0;
+    pSlab->pNext = pHead;
+    if (pHead)
+        pHead->pPrev = pSlab;
+    pHead = pSlab;
+}
+
+void CompressedPageStore::partialRemove(Slab *pSlab)
+{
+    if (pSlab->pPrev)
+        pSlab->pPrev->pNext = pSlab->pNext;
+    else
+        m_pPartial[pSlab->sizeClass] = pSlab->pNext;
+    if (pSlab->pNext)
+        pSlab->pNext->pPrev = pSlab->pPrev;
+    pSlab->pPrev = pSlab->pNext = 0;
+}
@@ -26,6 +26,9 @@
 Mutex::Mutex(bool bLocked) :
     Semaphore(bLocked ? 0 : 1)
 {
+#ifdef LOCK_STATS
+    setLockStatsType(LockStats::MutexType);
+#endif
 }
 
 Mutex::~Mutex()
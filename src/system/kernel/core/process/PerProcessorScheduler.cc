@@ -23,6 +23,7 @@
 #include <process/Thread.h>
 #include <process/SchedulingAlgorithm.h>
 #include <process/RoundRobin.h>
+#include <process/Profiler.h>
 
 #include <processor/Processor.h>
 #include <processor/PhysicalMemoryManager.h>
@@ -107,7 +108,14 @@ void PerProcessorScheduler::schedule(Thread::Status nextStatus, Thread *pNewThre
     bool bWasInterrupts = Processor::getInterrupts();
     Processor::setInterrupts(false);
 
-    Thread *pCurrentThread = Processor::information().getCurrentThread();
+    ProcessorInformation &info = Processor::information();
+    Thread *pCurrentThread = info.getCurrentThread();
+
+#ifdef X86_COMMON
+    // The FPU registers hold kernel data that nobody would save.
+    if(info.inKernelFpuSection())
+        FATAL("Attempted to reschedule inside a kernel FPU section");
+#endif
 
     // Grab the current thread's lock.
     pCurrentThread->getLock().acquire();
@@ -164,7 +172,7 @@ void PerProcessorScheduler::schedule(Thread::Status nextStatus, Thread *pNewThre
 
     // Load the new kernel stack into the TSS, and the new TLS base and switch address spaces
     Processor::information().setKernelStack( reinterpret_cast<uintptr_t> (pNextThread->getKernelStack()) );
-    Processor::switchAddressSpace( *pNextThread->getParent()->getAddressSpace() );
+    Processor::lazySwitchAddressSpace( *pNextThread->getParent()->getAddressSpace() );
     Processor::setTlsBase(pNextThread->getTlsBase());
 
     if (pLock)
@@ -367,7 +375,14 @@ void PerProcessorScheduler::addThread(Thread *pThread, Thread::ThreadStartFunc p
 
     // We assume here that pThread's lock is already taken.
 
-    Thread *pCurrentThread = Processor::information().getCurrentThread();
+    ProcessorInformation &info = Processor::information();
+    Thread *pCurrentThread = info.getCurrentThread();
+
+#ifdef X86_COMMON
+    // The FPU registers hold kernel data that nobody would save.
+    if(info.inKernelFpuSection())
+        FATAL("Attempted to reschedule inside a kernel FPU section");
+#endif
 
     // Grab the current thread's lock.
     pCurrentThread->getLock().acquire();
@@ -380,7 +395,7 @@ void PerProcessorScheduler::addThread(Thread *pThread, Thread::ThreadStartFunc p
     pThread->setStatus(Thread::Running);
     Processor::information().setCurrentThread(pThread);
     Processor::information().setKernelStack( reinterpret_cast<uintptr_t> (pThread->getKernelStack()) );
-    Processor::switchAddressSpace( *pThread->getParent()->getAddressSpace() );
+    Processor::lazySwitchAddressSpace( *pThread->getParent()->getAddressSpace() );
     Processor::setTlsBase(pThread->getTlsBase());
 
     // This thread is safe from being moved as its status is now "running".
@@ -424,7 +439,14 @@ void PerProcessorScheduler::addThread(Thread *pThread, SyscallState &state)
 
     // We assume here that pThread's lock is already taken.
 
-    Thread *pCurrentThread = Processor::information().getCurrentThread();
+    ProcessorInformation &info = Processor::information();
+    Thread *pCurrentThread = info.getCurrentThread();
+
+#ifdef X86_COMMON
+    // The FPU registers hold kernel data that nobody would save.
+    if(info.inKernelFpuSection())
+        FATAL("Attempted to reschedule inside a kernel FPU section");
+#endif
 
     // Grab the current thread's lock.
     pCurrentThread->getLock().acquire();
@@ -438,7 +460,7 @@ void PerProcessorScheduler::addThread(Thread *pThread, SyscallState &state)
     pThread->setStatus(Thread::Running);
     Processor::information().setCurrentThread(pThread);
     Processor::information().setKernelStack( reinterpret_cast<uintptr_t> (pThread->getKernelStack()) );
-    Processor::switchAddressSpace( *pThread->getParent()->getAddressSpace() );
+    Processor::lazySwitchAddressSpace( *pThread->getParent()->getAddressSpace() );
     Processor::setTlsBase(pThread->getTlsBase());
 
     // This thread is safe from being moved as its status is now "running".
@@ -513,7 +535,7 @@ void PerProcessorScheduler::killCurrentThread()
     pNextThread->setStatus(Thread::Running);
     Processor::information().setCurrentThread(pNextThread);
     Processor::information().setKernelStack( reinterpret_cast<uintptr_t> (pNextThread->getKernelStack()) );
-    Processor::switchAddressSpace( *pNextThread->getParent()->getAddressSpace() );
+    Processor::lazySwitchAddressSpace( *pNextThread->getParent()->getAddressSpace() );
     Processor::setTlsBase(pNextThread->getTlsBase());
 
     pNextThread->getLock().exit();
@@ -560,6 +582,8 @@ void PerProcessorScheduler::sleep(Spinlock *pLock)
 
 void PerProcessorScheduler::timer(uint64_t delta, InterruptState &state)
 {
+    Profiler::instance().sample(state);
+
 #ifdef ARM_BEAGLE // Timer at 1 tick per ms, we want to run every 100 ms
     m_TickCount++;
     if((m_TickCount % 100) == 0)
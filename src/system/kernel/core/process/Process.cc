@@ -42,7 +42,14 @@ Process::Process() :
   m_pSubsystem(0), m_Waiters(), m_bUnreportedSuspend(false), m_bUnreportedResume(false),
   m_State(Active), m_BeforeSuspendState(Thread::Ready), m_Lock(false), m_DeadThreads(0)
 {
+  for (size_t i = 0; i < serviceEnd; i++)
+  {
+    m_pSyscallTables[i] = 0;
+    m_pServiceData[i] = 0;
+  }
+
   m_Id = Scheduler::instance().addProcess(this);
+  SyscallTracer::instance().addProcess(this);
   getSpaceAllocator().free(
       getAddressSpace()->getUserStart(),
       getAddressSpace()->getUserReservedStart() - getAddressSpace()->getUserStart());
@@ -65,7 +72,14 @@ Process::Process(Process *pParent) :
 {
    m_pAddressSpace = pParent->m_pAddressSpace->clone();
 
+  for (size_t i = 0; i < serviceEnd; i++)
+  {
+    m_pSyscallTables[i] = 0;
+    m_pServiceData[i] = 0;
+  }
+
   m_Id = Scheduler::instance().addProcess(this);
+  SyscallTracer::instance().addProcess(this);
  
   // Set a temporary description.
   str = m_pParent->str;
@@ -104,6 +118,12 @@ Process::~Process()
   if(m_pSubsystem)
     delete m_pSubsystem;
 
+  for (size_t i = 0; i < serviceEnd; i++)
+  {
+    delete m_pSyscallTables[i];
+    delete m_pServiceData[i];
+  }
+
   VirtualAddressSpace &VAddressSpace = Processor::information().getVirtualAddressSpace();
 
   bool bInterrupts = Processor::getInterrupts();
@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(THREADS)
+
+#include <process/Profiler.h>
+#include <process/Thread.h>
+#include <process/Process.h>
+#include <process/Scheduler.h>
+#include <processor/Processor.h>
+#include <processor/VirtualAddressSpace.h>
+#include <linker/KernelElf.h>
+#include <utilities/demangle.h>
+#include <utilities/StaticString.h>
+#include <utilities/Tree.h>
+#include <utilities/utility.h>
+#include <LockGuard.h>
+
+/** Size of the table topFunctions() counts in. */
+#define PROFILER_FUNCTION_TABLE 1024
+
+Profiler Profiler::m_Instance;
+
+/** A distinct stack found by fold(), and how many samples had it. */
+struct FoldedStack
+{
+    const Profiler::Sample *pSample;
+    size_t count;
+};
+
+/** FNV-1a over everything fold() distinguishes stacks by. */
+static uint64_t hashSample(const Profiler::Sample &sample)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const uintptr_t words[] = {sample.pid, sample.bUserMode, sample.nFrames};
+
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+        hash = (hash ^ words[i]) * 1099511628211ULL;
+    for (size_t i = 0; i < sample.nFrames; ++i)
+        hash = (hash ^ sample.frames[i]) * 1099511628211ULL;
+
+    return hash;
+}
+
+/** String::operator += grows the string to exactly fit, so reserve in
+ *  doubling steps to keep building a big string linear. */
+static void appendLine(String &out, const String &line)
+{
+    size_t needed = out.length() + line.length() + 1;
+    if (needed > out.size())
+        out.reserve((out.size() * 2 > needed) ? out.size() * 2 : needed);
+    out += line;
+}
+
+Profiler::Profiler() :
+    m_pCpus(0), m_nCpus(0), m_bRunning(false), m_Rate(1), m_Lock(false)
+{
+}
+
+bool Profiler::start(size_t rate)
+{
+    LockGuard<Mutex> guard(m_Lock);
+
+    if (rate < 1)
+        rate = 1;
+    if (rate > MaxRate)
+        rate = MaxRate;
+
+    m_bRunning = false;
+
+    if (!m_pCpus)
+    {
+        size_t nCpus = Processor::getCount();
+        if (nCpus > MaxProfiledCpus)
+            nCpus = MaxProfiledCpus;
+
+        m_pCpus = new CpuProfile[nCpus];
+        if (!m_pCpus)
+            return false;
+        m_nCpus = nCpus;
+    }
+
+    for (size_t i = 0; i < m_nCpus; ++i)
+    {
+        m_pCpus[i].count = 0;
+        m_pCpus[i].nDropped = 0;
+        m_pCpus[i].nTicks = 0;
+    }
+
+    m_Rate = rate;
+    __sync_synchronize();
+    m_bRunning = true;
+
+    return true;
+}
+
+void Profiler::stop()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    m_bRunning = false;
+}
+
+void Profiler::sample(InterruptState &state)
+{
+    if (!m_bRunning)
+        return;
+
+    record(state, Processor::id());
+}
+
+bool Profiler::oversample(InterruptState &state)
+{
+    if (!m_bRunning)
+        return true;
+
+    size_t cpu = Processor::id();
+    if (cpu >= m_nCpus)
+        return true;
+
+    if ((++m_pCpus[cpu].nTicks % m_Rate) == 0)
+        return true;
+
+    record(state, cpu);
+    return false;
+}
+
+void Profiler::record(InterruptState &state, size_t cpu)
+{
+    if (cpu >= m_nCpus)
+        return;
+
+    CpuProfile &profile = m_pCpus[cpu];
+    size_t n = profile.count;
+    if (n >= SamplesPerCpu)
+    {
+        ++profile.nDropped;
+        return;
+    }
+
+    Sample &sample = profile.samples[n];
+
+    Thread *pThread = Processor::information().getCurrentThread();
+    sample.tid = pThread ? pThread->getId() : 0;
+    sample.pid = (pThread && pThread->getParent()) ? pThread->getParent()->getId() : 0;
+    sample.bUserMode = !state.kernelMode();
+    sample.frames[0] = state.getInstructionPointer();
+    sample.nFrames = 1;
+
+    // Follow the saved frame pointers. Code built without them leaves
+    // anything in bp, so stop at the first frame that isn't mapped or isn't
+    // further up the stack than the last one.
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    uintptr_t base = state.getBasePointer();
+    while (sample.nFrames < MaxFrames)
+    {
+        if (!base || (base & (sizeof(uintptr_t) - 1)))
+            break;
+        if (!va.isMapped(reinterpret_cast<void*>(base)) ||
+            !va.isMapped(reinterpret_cast<void*>(base + sizeof(uintptr_t))))
+            break;
+
+        uintptr_t *pFrame = reinterpret_cast<uintptr_t*>(base);
+        if (!pFrame[1])
+            break;
+        sample.frames[sample.nFrames++] = pFrame[1];
+
+        if (pFrame[0] <= base)
+            break;
+        base = pFrame[0];
+    }
+
+    // The sample must be complete before readers can see it.
+    __sync_synchronize();
+    profile.count = n + 1;
+}
+
+void Profiler::getCounts(size_t &nSamples, size_t &nDropped)
+{
+    nSamples = nDropped = 0;
+    for (size_t i = 0; i < m_nCpus; ++i)
+    {
+        nSamples += m_pCpus[i].count;
+        nDropped += m_pCpus[i].nDropped;
+    }
+}
+
+void Profiler::appendFrame(String &out, uintptr_t address, bool bUserMode)
+{
+    const char *pName = 0;
+    if (!bUserMode)
+        pName = KernelElf::instance().globalLookupSymbol(address);
+
+    if (pName)
+    {
+        // Only ever used with m_Lock held (demangle() isn't reentrant anyway).
+        static symbol_t symbol;
+        demangle(LargeStaticString(pName), &symbol);
+        out += static_cast<const char*>(symbol.name);
+    }
+    else
+    {
+        NormalStaticString hex("0x");
+        hex.append(address, 16);
+        out += static_cast<const char*>(hex);
+    }
+}
+
+void Profiler::fold(String &out)
+{
+    LockGuard<Mutex> guard(m_Lock);
+
+    // Count the samples with each distinct stack.
+    Tree<uint64_t, FoldedStack*> stacks;
+    for (size_t cpu = 0; cpu < m_nCpus; ++cpu)
+    {
+        CpuProfile &profile = m_pCpus[cpu];
+        size_t count = profile.count;
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t hash = hashSample(profile.samples[i]);
+            FoldedStack *pStack = stacks.lookup(hash);
+            if (pStack)
+            {
+                ++pStack->count;
+                continue;
+            }
+
+            pStack = new FoldedStack;
+            pStack->pSample = &profile.samples[i];
+            pStack->count = 1;
+            stacks.insert(hash, pStack);
+        }
+    }
+
+    for (Tree<uint64_t, FoldedStack*>::Iterator it = stacks.begin();
+         it != stacks.end();
+         it++)
+    {
+        FoldedStack *pStack = it.value();
+        const Sample &sample = *pStack->pSample;
+
+        String line;
+
+        // The process is the root of each stack.
+        Process *pProcess = 0;
+        for (size_t i = 0; i < Scheduler::instance().getNumProcesses(); ++i)
+        {
+            Process *pCandidate = Scheduler::instance().getProcess(i);
+            if (pCandidate->getId() == sample.pid)
+            {
+                pProcess = pCandidate;
+                break;
+            }
+        }
+        if (pProcess)
+        {
+            // ';' separates frames.
+            LargeStaticString name;
+            for (const char *p = pProcess->description(); *p; ++p)
+                name.append((*p == ';') ? '_' : *p);
+            line += static_cast<const char*>(name);
+        }
+        else
+        {
+            NormalStaticString name("pid-");
+            name.append(sample.pid);
+            line += static_cast<const char*>(name);
+        }
+
+        for (size_t i = sample.nFrames; i > 0; --i)
+        {
+            line += ";";
+            appendFrame(line, sample.frames[i - 1], sample.bUserMode);
+        }
+
+        NormalStaticString count(" ");
+        count.append(pStack->count);
+        count += "\n";
+        line += static_cast<const char*>(count);
+
+        appendLine(out, line);
+        delete pStack;
+    }
+}
+
+size_t Profiler::topFunctions(uintptr_t *pFunctions, size_t *pCounts, size_t n)
+{
+    // Static, as this may run in the debugger where the heap isn't safe.
+    static uintptr_t functions[PROFILER_FUNCTION_TABLE];
+    static size_t counts[PROFILER_FUNCTION_TABLE];
+    size_t nFunctions = 0;
+
+    for (size_t cpu = 0; cpu < m_nCpus; ++cpu)
+    {
+        CpuProfile &profile = m_pCpus[cpu];
+        size_t count = profile.count;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Sample &sample = profile.samples[i];
+
+            // User addresses are counted by page, as there are no symbols
+            // for them here.
+            uintptr_t function = sample.frames[0] & ~0xFFFUL;
+            if (!sample.bUserMode)
+                KernelElf::instance().globalLookupSymbol(sample.frames[0], &function);
+
+            size_t j;
+            for (j = 0; j < nFunctions; ++j)
+            {
+                if (functions[j] == function)
+                    break;
+            }
+            if (j == nFunctions)
+            {
+                // Once the table is full, new functions go uncounted.
+                if (nFunctions == PROFILER_FUNCTION_TABLE)
+                    continue;
+                functions[nFunctions] = function;
+                counts[nFunctions++] = 0;
+            }
+            ++counts[j];
+        }
+    }
+
+    // Selection sort of the n biggest.
+    size_t nOut = 0;
+    for (; (nOut < n) && (nOut < nFunctions); ++nOut)
+    {
+        size_t best = nOut;
+        for (size_t j = nOut + 1; j < nFunctions; ++j)
+        {
+            if (counts[j] > counts[best])
+                best = j;
+        }
+
+        uintptr_t function = functions[best];
+        size_t count = counts[best];
+        functions[best] = functions[nOut];
+        counts[best] = counts[nOut];
+        functions[nOut] = function;
+        counts[nOut] = count;
+
+        pFunctions[nOut] = function;
+        pCounts[nOut] = count;
+    }
+
+    return nOut;
+}
+
+#endif
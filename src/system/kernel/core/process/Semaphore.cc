@@ -44,6 +44,9 @@ Semaphore::SemaphoreEvent::SemaphoreEvent() :
 
 Semaphore::Semaphore(size_t nInitialValue)
     : magic(0xdeadbaba), m_Counter(nInitialValue), m_BeingModified(false), m_Queue()
+#ifdef LOCK_STATS
+    , m_LockStatsType(LockStats::NotALock), m_AcquiredAt(0), m_AcquiredRa(0)
+#endif
 {
     assert(magic == 0xdeadbaba);
 }
@@ -52,6 +55,11 @@ Semaphore::~Semaphore()
 {
     assert(magic == 0xdeadbaba);
     m_Queue.clear();
+
+#ifdef LOCK_STATS
+    if (m_LockStatsType != LockStats::NotALock)
+        LockStats::destroyed(this);
+#endif
 }
 
 void Semaphore::removeThread(Thread *pThread)
@@ -69,6 +77,35 @@ void Semaphore::removeThread(Thread *pThread)
 }
 
 bool Semaphore::acquire(size_t n, size_t timeoutSecs, size_t timeoutUsecs)
+{
+  uintptr_t ra = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+
+#ifdef LOCK_STATS
+  if (m_LockStatsType != LockStats::NotALock)
+  {
+    // Only read the clock if there's a wait to time.
+    uint64_t start = 0;
+    bool bContended = !tryAcquire(n);
+    if (bContended)
+    {
+      start = readTimestamp();
+      if (!doAcquire(n, timeoutSecs, timeoutUsecs, ra))
+        return false;
+    }
+
+    // Locks are held from here until the counter is released.
+    uint64_t now = readTimestamp();
+    LockStats::acquired(this, m_LockStatsType, ra, bContended, bContended ? now - start : 0);
+    m_AcquiredAt = now;
+    m_AcquiredRa = ra;
+    return true;
+  }
+#endif
+
+  return doAcquire(n, timeoutSecs, timeoutUsecs, ra);
+}
+
+bool Semaphore::doAcquire(size_t n, size_t timeoutSecs, size_t timeoutUsecs, uintptr_t ra)
 {
     if(magic != 0xdeadbaba)
     {
@@ -129,7 +166,7 @@ bool Semaphore::acquire(size_t n, size_t timeoutSecs, size_t timeoutUsecs)
     m_Queue.pushBack(pThread);
 
     pThread->setInterrupted(false);
-    pThread->setDebugState(Thread::SemWait, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+    pThread->setDebugState(Thread::SemWait, ra);
     Processor::information().getScheduler().sleep(&m_BeingModified);
     pThread->setDebugState(Thread::None, 0);
 
@@ -183,6 +220,17 @@ bool Semaphore::tryAcquire(size_t n)
 void Semaphore::release(size_t n)
 {
     assert(magic == 0xdeadbaba);
+
+#ifdef LOCK_STATS
+  // Only set by acquire() for semaphores used as locks; anything acquired
+  // with tryAcquire() alone isn't timed.
+  if (m_AcquiredAt)
+  {
+    LockStats::released(this, m_AcquiredRa, readTimestamp() - m_AcquiredAt);
+    m_AcquiredAt = 0;
+  }
+#endif
+
   m_Counter += n;
 
   if(m_Queue.count())
@@ -0,0 +1,282 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <processor/SyscallTracer.h>
+#include <processor/Processor.h>
+#include <utilities/StaticString.h>
+#include <utilities/utility.h>
+
+#if defined(THREADS)
+#include <process/Process.h>
+#include <process/Scheduler.h>
+#endif
+
+SyscallTracer SyscallTracer::m_Instance;
+
+/** String::operator += grows the string to exactly fit, so reserve in
+ *  doubling steps to keep building a big report linear. */
+static void appendLine(String &out, const char *pLine)
+{
+    size_t needed = out.length() + strlen(pLine) + 1;
+    if (needed > out.size())
+        out.reserve((out.size() * 2 > needed) ? out.size() * 2 : needed);
+    out += pLine;
+}
+
+SyscallTracer::SyscallTracer() :
+    m_pCpuTables(0), m_nCpus(0), m_bEnabled(false)
+{
+}
+
+bool SyscallTracer::enable()
+{
+    if (!m_pCpuTables)
+    {
+        size_t nCpus = Processor::getCount();
+        if (nCpus > SYSCALL_TRACER_MAX_CPUS)
+            nCpus = SYSCALL_TRACER_MAX_CPUS;
+
+        SyscallTable *pTables = new SyscallTable[nCpus * serviceEnd];
+        if (!pTables)
+            return false;
+
+        m_nCpus = nCpus;
+        if (!__sync_bool_compare_and_swap(&m_pCpuTables, static_cast<SyscallTable*>(0), pTables))
+            delete [] pTables;
+    }
+
+    m_bEnabled = false;
+
+    memset(m_pCpuTables, 0, sizeof(SyscallTable) * m_nCpus * serviceEnd);
+#if defined(THREADS)
+    for (size_t i = 0; i < Scheduler::instance().getNumProcesses(); i++)
+    {
+        Process *pProcess = Scheduler::instance().getProcess(i);
+        for (size_t service = 0; service < serviceEnd; service++)
+        {
+            SyscallTable *pTable = pProcess->getSyscallTable(service);
+            if (pTable)
+                memset(pTable, 0, sizeof(SyscallTable));
+        }
+    }
+#endif
+
+    m_bEnabled = true;
+
+    // Processes created from here on get their tables from addProcess().
+#if defined(THREADS)
+    for (size_t i = 0; i < Scheduler::instance().getNumProcesses(); i++)
+        addProcess(Scheduler::instance().getProcess(i));
+#endif
+
+    return true;
+}
+
+void SyscallTracer::addProcess(Process *pProcess)
+{
+#if defined(THREADS)
+    if (!m_bEnabled)
+        return;
+
+    for (size_t service = 0; service < serviceEnd; service++)
+    {
+        if (pProcess->getSyscallTable(service))
+            continue;
+
+        SyscallTable *pTable = new SyscallTable;
+        if (!pTable)
+            return;
+        memset(pTable, 0, sizeof(SyscallTable));
+        if (!pProcess->installSyscallTable(service, pTable))
+            delete pTable;
+    }
+#endif
+}
+
+void SyscallTracer::disable()
+{
+    m_bEnabled = false;
+}
+
+size_t SyscallTracer::bucket(uint64_t ticks)
+{
+    // floor(log2(ticks)), with 32-bit bsr so 32-bit targets don't need libgcc.
+    uint32_t high = static_cast<uint32_t>(ticks >> 32);
+    uint32_t low = static_cast<uint32_t>(ticks);
+    size_t log2 = 0;
+    if (high)
+        log2 = 63 - __builtin_clz(high);
+    else if (low)
+        log2 = 31 - __builtin_clz(low);
+
+    return (log2 < SYSCALL_TRACER_BUCKETS) ? log2 : SYSCALL_TRACER_BUCKETS - 1;
+}
+
+void SyscallTracer::end(uint64_t start, size_t service, size_t number, Process *pProcess)
+{
+    uint64_t ticks = timestamp() - start;
+    size_t b = bucket(ticks);
+
+    if (service >= serviceEnd)
+        return;
+    if (number >= SYSCALL_TRACER_MAX_SYSCALLS)
+        number = SYSCALL_TRACER_MAX_SYSCALLS - 1;
+
+    // Only this CPU writes its tables. Interrupts are off so the thread
+    // can't move to another CPU, and a thread preempting this one can't
+    // interleave its update.
+    bool bInterrupts = Processor::getInterrupts();
+    Processor::setInterrupts(false);
+    size_t cpu = Processor::information().getProcessorId();
+    if (cpu < m_nCpus)
+    {
+        SyscallStatistics &stats = m_pCpuTables[cpu * serviceEnd + service].syscalls[number];
+        stats.count++;
+        stats.ticks += ticks;
+        stats.histogram[b]++;
+    }
+    Processor::setInterrupts(bInterrupts);
+
+#if defined(THREADS)
+    if (!pProcess)
+        return;
+
+    SyscallTable *pTable = pProcess->getSyscallTable(service);
+    if (UNLIKELY(!pTable))
+        return;
+
+    // Threads of the process may be updating these on other CPUs.
+    SyscallStatistics &stats = pTable->syscalls[number];
+    __sync_fetch_and_add(&stats.count, 1);
+    __sync_fetch_and_add(&stats.ticks, ticks);
+    __sync_fetch_and_add(&stats.histogram[b], 1);
+#endif
+}
+
+void SyscallTracer::getStatistics(size_t service, size_t number, SyscallStatistics &stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    if (service >= serviceEnd || number >= SYSCALL_TRACER_MAX_SYSCALLS)
+        return;
+
+    for (size_t cpu = 0; cpu < m_nCpus; cpu++)
+    {
+        const SyscallStatistics &cpuStats = m_pCpuTables[cpu * serviceEnd + service].syscalls[number];
+        stats.count += cpuStats.count;
+        stats.ticks += cpuStats.ticks;
+        for (size_t b = 0; b < SYSCALL_TRACER_BUCKETS; b++)
+            stats.histogram[b] += cpuStats.histogram[b];
+    }
+}
+
+const char *SyscallTracer::serviceName(size_t service)
+{
+    switch (service)
+    {
+        case kernelCore:    return "kernel";
+        case posix:         return "posix";
+        case TUI:           return "tui";
+        case native:        return "native";
+        case pedigree_c:    return "pedigree-c";
+        default:            return "?";
+    }
+}
+
+void SyscallTracer::reportLine(String &out, const char *pScope, size_t service,
+                               size_t number, const SyscallStatistics &stats)
+{
+    HugeStaticString line;
+    line += pScope;
+    line += " ";
+    line += serviceName(service);
+    line += " ";
+    line.append(number);
+    line += " ";
+    line.append(stats.count);
+    line += " ";
+    line.append(stats.ticks);
+    line += " ";
+    line.append(stats.ticks / stats.count);
+    for (size_t b = 0; b < SYSCALL_TRACER_BUCKETS; b++)
+    {
+        if (!stats.histogram[b])
+            continue;
+        line += " ";
+        line.append(b);
+        line += ":";
+        line.append(stats.histogram[b]);
+    }
+    line += "\n";
+
+    appendLine(out, line);
+}
+
+void SyscallTracer::report(String &out)
+{
+    appendLine(out, "# scope service number count total-ticks mean-ticks log2-bucket:count...\n");
+    if (!m_pCpuTables)
+        return;
+
+    for (size_t service = 0; service < serviceEnd; service++)
+    {
+        for (size_t number = 0; number < SYSCALL_TRACER_MAX_SYSCALLS; number++)
+        {
+            SyscallStatistics stats;
+            getStatistics(service, number, stats);
+            if (stats.count)
+                reportLine(out, "all", service, number, stats);
+        }
+    }
+
+#if defined(THREADS)
+    for (size_t i = 0; i < Scheduler::instance().getNumProcesses(); i++)
+    {
+        Process *pProcess = Scheduler::instance().getProcess(i);
+
+        NormalStaticString scope;
+        scope.append(pProcess->getId());
+        bool bNamed = false;
+
+        for (size_t service = 0; service < serviceEnd; service++)
+        {
+            SyscallTable *pTable = pProcess->getSyscallTable(service);
+            if (!pTable)
+                continue;
+
+            if (!bNamed)
+            {
+                LargeStaticString name("# ");
+                name += scope;
+                name += " ";
+                name += pProcess->description();
+                name += "\n";
+                appendLine(out, name);
+                bNamed = true;
+            }
+
+            for (size_t number = 0; number < SYSCALL_TRACER_MAX_SYSCALLS; number++)
+            {
+                if (pTable->syscalls[number].count)
+                    reportLine(out, scope, service, number, pTable->syscalls[number]);
+            }
+        }
+    }
+#endif
+}
@@ -24,6 +24,8 @@
 #include "gdt.h"
 #include "SyscallManager.h"
 #include "InterruptManager.h"
+#include <processor/x64/TlbManager.h>
+#include <processor/NMFaultHandler.h>
 #include "../x86_common/Multiprocessor.h"
 #include "../../../machine/x86_common/Pc.h"
 
@@ -56,6 +58,12 @@ void Multiprocessor::applicationProcessorStartup()
   Processor::invalidate(0);
   Processor::invalidate(reinterpret_cast<void*>(0x200000));
 
+  // Enable SSE, which only the bootstrap processor's boot code does
+  NMFaultHandler::initialiseProcessor();
+
+  // Join in TLB shootdowns
+  X64TlbManager::instance().initialiseProcessor();
+
   // Call the per-processor code in main.cc
   extern void apMain();
   apMain();
@@ -26,6 +26,7 @@
 #include "InterruptManager.h"
 #include "VirtualAddressSpace.h"
 #include "../x86_common/PhysicalMemoryManager.h"
+#include <processor/x64/TlbManager.h>
 
 // Multiprocessor headers
 #if defined(MULTIPROCESSOR)
@@ -63,22 +64,37 @@ union pat {
 
 void Processor::switchAddressSpace(VirtualAddressSpace &AddressSpace)
 {
-  const X64VirtualAddressSpace &x64AddressSpace = static_cast<const X64VirtualAddressSpace&>(AddressSpace);
-
-  // Get the current page directory
-  uint64_t cr3;
-  asm volatile ("mov %%cr3, %0" : "=r" (cr3));
-
-  // Do we need to set a new page directory?
-  if (cr3 != x64AddressSpace.m_PhysicalPML4)
-  {
-    // Set the new page directory
-    asm volatile ("mov %0, %%cr3" :: "r" (x64AddressSpace.m_PhysicalPML4));
-
-    // Update the information in the ProcessorInformation structure
-    ProcessorInformation &processorInformation = Processor::information();
-    processorInformation.setVirtualAddressSpace(AddressSpace);
-  }
+  X64VirtualAddressSpace &x64AddressSpace = static_cast<X64VirtualAddressSpace&>(AddressSpace);
+
+  bool bInterrupts = getInterrupts();
+  setInterrupts(false);
+
+  // Set the new page directory, if it isn't already
+  X64TlbManager::instance().activate(x64AddressSpace, false);
+
+  // Update the information in the ProcessorInformation structure
+  ProcessorInformation &processorInformation = Processor::information();
+  processorInformation.setVirtualAddressSpace(AddressSpace);
+
+  if (bInterrupts)
+    setInterrupts(true);
+}
+
+void Processor::lazySwitchAddressSpace(VirtualAddressSpace &AddressSpace)
+{
+  X64VirtualAddressSpace &x64AddressSpace = static_cast<X64VirtualAddressSpace&>(AddressSpace);
+
+  bool bInterrupts = getInterrupts();
+  setInterrupts(false);
+
+  // The ProcessorInformation structure reflects what is actually loaded,
+  // which for kernel threads may be the previous thread's address space.
+  VirtualAddressSpace &loaded = X64TlbManager::instance().activate(x64AddressSpace, true);
+  ProcessorInformation &processorInformation = Processor::information();
+  processorInformation.setVirtualAddressSpace(loaded);
+
+  if (bInterrupts)
+    setInterrupts(true);
 }
 
 void Processor::initialise1(const BootstrapStruct_t &Info)
@@ -143,20 +159,24 @@ PAT7 UC
 
 void Processor::initialise2(const BootstrapStruct_t &Info)
 {
-  size_t nProcessors = 1;
+  m_nProcessors = 1;
 
   #if defined(MULTIPROCESSOR)
-    nProcessors = Multiprocessor::initialise1();
+    m_nProcessors = Multiprocessor::initialise1();
   #endif
 
   // Initialise the GDT
-  X64GdtManager::instance().initialise(nProcessors);
+  X64GdtManager::instance().initialise(m_nProcessors);
   X64GdtManager::initialiseProcessor();
 
+  // Initialise TLB shootdowns, global pages and PCIDs
+  X64TlbManager::instance().initialise();
+  X64TlbManager::instance().initialiseProcessor();
+
   initialiseMultitasking();
 
   #if defined(MULTIPROCESSOR)
-    if (nProcessors != 1)
+    if (m_nProcessors != 1)
       Multiprocessor::initialise2();
   #endif
 
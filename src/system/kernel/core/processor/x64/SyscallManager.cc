@@ -20,6 +20,7 @@
 #include <compiler.h>
 #include <LockGuard.h>
 #include <processor/Processor.h>
+#include <processor/SyscallTracer.h>
 #include "SyscallManager.h"
 
 X64SyscallManager X64SyscallManager::m_Instance;
@@ -64,13 +65,21 @@ void X64SyscallManager::syscall(SyscallState &syscallState)
   
   if (LIKELY(pHandler != 0))
   {
+    uint64_t start = SyscallTracer::instance().begin();
     syscallState.setSyscallReturnValue(pHandler->syscall(syscallState));
-    syscallState.setSyscallErrno(Processor::information().getCurrentThread()->getErrno());
 
-    if (Processor::information().getCurrentThread()->getUnwindState() == Thread::Exit)
+    ProcessorInformation &info = Processor::information();
+    Thread *pThread = info.getCurrentThread();
+    if (UNLIKELY(start != 0))
+      SyscallTracer::instance().end(start, serviceNumber, syscallState.getSyscallNumber(),
+                                    pThread->getParent());
+
+    syscallState.setSyscallErrno(pThread->getErrno());
+
+    if (pThread->getUnwindState() == Thread::Exit)
     {
       NOTICE("Unwind state exit, in interrupt handler");
-      Processor::information().getCurrentThread()->getParent()->getSubsystem()->exit(0);
+      pThread->getParent()->getSubsystem()->exit(0);
     }
   }
 
@@ -0,0 +1,521 @@
+/*
+ *
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <processor/x64/TlbManager.h>
+#include <processor/InterruptManager.h>
+#include <processor/Processor.h>
+#include <utilities/utility.h>
+#include "VirtualAddressSpace.h"
+#include <Log.h>
+#include <panic.h>
+
+#if defined(MULTIPROCESSOR)
+  #include "../../../machine/x86_common/Pc.h"
+#endif
+
+#define CR4_PGE         0x80
+#define CR4_PCIDE       0x20000
+#define CR3_NOFLUSH     0x8000000000000000ULL
+
+/** Is the address in the half of the address space shared by everyone? */
+#define KERNEL_HALF(x)  (reinterpret_cast<uintptr_t>(x) >= 0xFFFF800000000000ULL)
+
+X64TlbManager X64TlbManager::m_Instance;
+
+static inline uint64_t readTsc()
+{
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return lo | (static_cast<uint64_t>(hi) << 32);
+}
+
+X64TlbManager::X64TlbManager() :
+  m_nCpus(0), m_OnlineMask(0), m_nPosted(0), m_PcidCounter(0),
+  m_bGlobalPages(false), m_bPcid(false)
+{
+  memset(m_Cpus, 0, sizeof(m_Cpus));
+  memset(const_cast<uint8_t*>(m_CpuIndex), 0, sizeof(m_CpuIndex));
+}
+
+X64TlbManager::~X64TlbManager()
+{
+}
+
+void X64TlbManager::initialise()
+{
+  uint32_t eax, ebx, ecx, edx;
+  Processor::cpuid(1, 0, eax, ebx, ecx, edx);
+  m_bGlobalPages = (edx & (1 << 13)) != 0;
+  m_bPcid = m_bGlobalPages && (ecx & (1 << 17)) != 0;
+
+  #if defined(MULTIPROCESSOR)
+    if (!InterruptManager::instance().registerInterruptHandler(IPI_TLB_VECTOR, this))
+      ERROR("X64TlbManager: couldn't register the shootdown IPI");
+  #endif
+
+  NOTICE("TLB: global pages " << (m_bGlobalPages ? "on" : "off") << ", PCIDs " << (m_bPcid ? "on" : "off"));
+}
+
+void X64TlbManager::initialiseProcessor()
+{
+  uint64_t cr4;
+  asm volatile("mov %%cr4, %0" : "=r" (cr4));
+  if (m_bGlobalPages)
+    cr4 |= CR4_PGE;
+  // CR3 must hold PCID 0 when PCIDs are turned on - it does, as we're still
+  // in the kernel address space.
+  if (m_bPcid)
+    cr4 |= CR4_PCIDE;
+  asm volatile("mov %0, %%cr4" :: "r" (cr4));
+
+  size_t index = __sync_fetch_and_add(&m_nCpus, 1);
+  if (index >= MaxProcessors)
+  {
+    ERROR("X64TlbManager: too many processors, TLB shootdowns won't reach processor #" << Dec << index << Hex);
+    return;
+  }
+
+  Cpu &cpu = m_Cpus[index];
+  #if defined(MULTIPROCESSOR)
+    cpu.apicId = Pc::instance().getLocalApic().getId();
+  #endif
+  cpu.pLoaded = &X64VirtualAddressSpace::m_KernelSpace;
+  cpu.bLazy = false;
+  cpu.generation = m_PcidCounter / NumPcids;
+
+  // From here on, shootdowns look for us.
+  __sync_fetch_and_or(&m_OnlineMask, 1ULL << index);
+}
+
+size_t X64TlbManager::current()
+{
+  #if defined(MULTIPROCESSOR)
+    // Processor IDs only mean anything once all processors are known.
+    if (Processor::isInitialised() < 2)
+      return find();
+
+    ProcessorId id = Processor::id();
+    if (id >= MaxProcessors)
+      return find();
+
+    size_t index = m_CpuIndex[id];
+    if (index)
+      return index - 1;
+
+    index = find();
+    if (index != MaxProcessors)
+      m_CpuIndex[id] = index + 1;
+    return index;
+  #else
+    return m_OnlineMask ? 0 : MaxProcessors;
+  #endif
+}
+
+size_t X64TlbManager::find()
+{
+  #if defined(MULTIPROCESSOR)
+    uint64_t online = m_OnlineMask;
+    if (!online)
+      return MaxProcessors;
+
+    uint8_t apicId = Pc::instance().getLocalApic().getId();
+    size_t nCpus = m_nCpus;
+    for (size_t i = 0; i < nCpus && i < MaxProcessors; i++)
+      if ((online & (1ULL << i)) && m_Cpus[i].apicId == apicId)
+        return i;
+  #endif
+
+  return MaxProcessors;
+}
+
+X64VirtualAddressSpace &X64TlbManager::activate(X64VirtualAddressSpace &space, bool bLazy)
+{
+  size_t index = current();
+  Cpu &cpu = m_Cpus[index];
+  X64VirtualAddressSpace *pLoaded = cpu.pLoaded;
+
+  // Kernel threads don't need the kernel's own address space, any will do.
+  if (bLazy && pLoaded && &space == &X64VirtualAddressSpace::m_KernelSpace)
+  {
+    if (pLoaded != &space && !cpu.bLazy)
+    {
+      cpu.bLazy = true;
+      ++cpu.nLazySwitches;
+    }
+    return *pLoaded;
+  }
+
+  cpu.bLazy = false;
+  if (pLoaded != &space)
+    load(cpu, index, space);
+
+  return space;
+}
+
+void X64TlbManager::load(Cpu &cpu, size_t index, X64VirtualAddressSpace &space)
+{
+  uint64_t start = readTsc();
+
+  // Publish the new address space before anything can be read through it:
+  // shootdown() relies on this ordering to know whom to interrupt.
+  cpu.pLoaded = &space;
+  __sync_synchronize();
+
+  // Processors that haven't been set up yet don't have PCIDs enabled.
+  uint64_t cr3 = space.m_PhysicalPML4;
+  if (m_bPcid && index != MaxProcessors)
+  {
+    // The kernel keeps PCID 0; everyone else needs one from the current
+    // generation.
+    if (&space != &X64VirtualAddressSpace::m_KernelSpace)
+    {
+      uint64_t tag = space.m_PcidTag;
+      if (!tag || (tag - 1) / NumPcids < m_PcidCounter / NumPcids)
+      {
+        uint64_t newTag = __sync_fetch_and_add(&m_PcidCounter, 1) + 1;
+        uint64_t oldTag = __sync_val_compare_and_swap(&space.m_PcidTag, tag, newTag);
+        tag = (oldTag == tag) ? newTag : oldTag;
+      }
+
+      // Our TLB may still hold entries for this PCID from a past generation.
+      uint64_t generation = (tag - 1) / NumPcids;
+      if (cpu.generation < generation)
+      {
+        flushAll();
+        cpu.generation = generation;
+      }
+
+      cr3 |= (tag - 1) % NumPcids + 1;
+    }
+
+    // Keep the entries tagged with this PCID, unless something changed
+    // while we didn't have the address space loaded.
+    uint64_t bit = 1ULL << index;
+    if ((__sync_fetch_and_and(&space.m_StaleMask, ~bit) & bit) == 0)
+    {
+      cr3 |= CR3_NOFLUSH;
+      ++cpu.nTaggedSwitches;
+    }
+  }
+
+  asm volatile("mov %0, %%cr3" :: "r" (cr3) : "memory");
+
+  ++cpu.nSwitches;
+  cpu.switchCycles += readTsc() - start;
+}
+
+void X64TlbManager::shootdown(X64VirtualAddressSpace &space, void **pAddresses, size_t nAddresses)
+{
+  bool bInterrupts = Processor::getInterrupts();
+  Processor::setInterrupts(false);
+
+  size_t me = current();
+  Cpu &cpu = m_Cpus[me];
+  Request &request = cpu.request;
+
+  bool bKernel = &space == &X64VirtualAddressSpace::m_KernelSpace;
+  bool bGlobal = bKernel;
+  bool bUser = !bKernel;
+
+  for (size_t i = 0; i < nAddresses; i++)
+  {
+    if (KERNEL_HALF(pAddresses[i]))
+      bGlobal = true;
+    else
+      bUser = true;
+  }
+
+  request.pSpace = &space;
+  request.bRelease = false;
+  request.nAddresses = (nAddresses > MaxBatch) ? 0 : nAddresses;
+  for (size_t i = 0; i < request.nAddresses; i++)
+    request.pAddresses[i] = pAddresses[i];
+
+  // Too many addresses, some of them shared: only flushing everything on
+  // every processor will do.
+  if (bGlobal && !request.nAddresses)
+  {
+    request.pSpace = &X64VirtualAddressSpace::m_KernelSpace;
+    bUser = false;
+  }
+
+  invalidate(cpu, me, request);
+
+  // With PCIDs, processors that don't have the address space loaded may
+  // still hold entries for it. This is done before looking at who has it
+  // loaded, so that a processor loading it concurrently either sees the
+  // mark or is seen itself.
+  if (m_bPcid && bUser)
+  {
+    uint64_t stale = m_OnlineMask;
+    if (cpu.pLoaded == &space && me != MaxProcessors)
+      stale &= ~(1ULL << me);
+    __sync_fetch_and_or(&space.m_StaleMask, stale);
+  }
+
+  __sync_synchronize();
+
+  uint64_t targets = 0;
+  if (me != MaxProcessors)
+  {
+    uint64_t online = m_OnlineMask & ~(1ULL << me);
+    for (size_t i = 0; i < MaxProcessors; i++)
+    {
+      if ((online & (1ULL << i)) == 0)
+        continue;
+      if (bGlobal || m_Cpus[i].pLoaded == &space)
+        targets |= 1ULL << i;
+    }
+  }
+
+  if (targets)
+    post(cpu, me, targets);
+
+  if (bInterrupts)
+    Processor::setInterrupts(true);
+}
+
+void X64TlbManager::release(X64VirtualAddressSpace &space)
+{
+  bool bInterrupts = Processor::getInterrupts();
+  Processor::setInterrupts(false);
+
+  size_t me = current();
+  Cpu &cpu = m_Cpus[me];
+  Request &request = cpu.request;
+
+  request.pSpace = &space;
+  request.bRelease = true;
+  request.nAddresses = 0;
+  invalidate(cpu, me, request);
+
+  __sync_synchronize();
+
+  uint64_t targets = 0;
+  if (me != MaxProcessors)
+  {
+    uint64_t online = m_OnlineMask & ~(1ULL << me);
+    for (size_t i = 0; i < MaxProcessors; i++)
+      if ((online & (1ULL << i)) && m_Cpus[i].pLoaded == &space)
+        targets |= 1ULL << i;
+  }
+
+  if (targets)
+    post(cpu, me, targets);
+
+  if (bInterrupts)
+    Processor::setInterrupts(true);
+}
+
+void X64TlbManager::invalidate(Cpu &cpu, size_t index, Request &request)
+{
+  X64VirtualAddressSpace *pSpace = request.pSpace;
+  bool bKernel = pSpace == &X64VirtualAddressSpace::m_KernelSpace;
+  // Before being set up, we don't know what's loaded - assume the worst.
+  bool bLoaded = cpu.pLoaded == pSpace || index == MaxProcessors;
+
+  // A kernel thread running on a borrowed address space can just as well
+  // run on the kernel's, and then won't be bothered by this one again.
+  if (bLoaded && !bKernel && (cpu.bLazy || request.bRelease))
+  {
+    cpu.bLazy = false;
+    load(cpu, index, X64VirtualAddressSpace::m_KernelSpace);
+    Processor::information().setVirtualAddressSpace(X64VirtualAddressSpace::m_KernelSpace);
+    return;
+  }
+
+  if (request.bRelease)
+    return;
+
+  if (request.nAddresses == 0)
+  {
+    if (bKernel)
+      flushAll();
+    else if (bLoaded)
+    {
+      // Reloading CR3 without the no-flush bit drops everything belonging
+      // to the current PCID.
+      uint64_t cr3;
+      asm volatile("mov %%cr3, %0" : "=r" (cr3));
+      asm volatile("mov %0, %%cr3" :: "r" (cr3) : "memory");
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < request.nAddresses; i++)
+    if (bLoaded || KERNEL_HALF(request.pAddresses[i]))
+      Processor::invalidate(request.pAddresses[i]);
+}
+
+void X64TlbManager::post(Cpu &cpu, size_t me, uint64_t targets)
+{
+  Request &request = cpu.request;
+
+  __sync_fetch_and_add(&m_nPosted, 1);
+  request.pending = targets;
+  __sync_synchronize();
+
+  sendIpis(targets, me);
+
+  // Keep handling other processors' requests while waiting, in case they
+  // are waiting for us at the same time.
+  uint64_t start = readTsc();
+  while (request.pending)
+  {
+    poll();
+    Processor::pause();
+  }
+  cpu.shootdownCycles += readTsc() - start;
+  ++cpu.nShootdowns;
+
+  __sync_fetch_and_sub(&m_nPosted, 1);
+}
+
+void X64TlbManager::sendIpis(uint64_t targets, size_t me)
+{
+  #if defined(MULTIPROCESSOR)
+    LocalApic &localApic = Pc::instance().getLocalApic();
+    Cpu &cpu = m_Cpus[me];
+
+    // One broadcast is cheaper than several IPIs when everyone is involved.
+    if (targets == (m_OnlineMask & ~(1ULL << me)) && (targets & (targets - 1)))
+    {
+      localApic.interProcessorInterruptAllExcludingThis(IPI_TLB_VECTOR, LocalApic::deliveryModeFixed);
+      ++cpu.nIpis;
+      return;
+    }
+
+    for (size_t i = 0; i < MaxProcessors; i++)
+    {
+      if ((targets & (1ULL << i)) == 0)
+        continue;
+      localApic.interProcessorInterrupt(m_Cpus[i].apicId,
+                                        IPI_TLB_VECTOR,
+                                        LocalApic::deliveryModeFixed,
+                                        true,
+                                        false);
+      ++cpu.nIpis;
+    }
+  #endif
+}
+
+void X64TlbManager::poll()
+{
+  if (!m_nPosted)
+    return;
+
+  size_t me = current();
+  if (me == MaxProcessors)
+    return;
+
+  uint64_t bit = 1ULL << me;
+  for (size_t i = 0; i < MaxProcessors; i++)
+  {
+    Request &request = m_Cpus[i].request;
+    if ((request.pending & bit) == 0)
+      continue;
+
+    invalidate(m_Cpus[me], me, request);
+    __sync_fetch_and_and(&request.pending, ~bit);
+  }
+}
+
+void X64TlbManager::interrupt(size_t nInterruptNumber, InterruptState &state)
+{
+  poll();
+
+  #if defined(MULTIPROCESSOR)
+    Pc::instance().getLocalApic().ack();
+  #endif
+}
+
+void X64TlbManager::flushAll()
+{
+  uint64_t cr4;
+  asm volatile("mov %%cr4, %0" : "=r" (cr4));
+  if (cr4 & CR4_PGE)
+  {
+    // Toggling PGE flushes every entry, global or not, for every PCID.
+    asm volatile("mov %0, %%cr4" :: "r" (cr4 & ~CR4_PGE) : "memory");
+    asm volatile("mov %0, %%cr4" :: "r" (cr4) : "memory");
+  }
+  else
+  {
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r" (cr3));
+    asm volatile("mov %0, %%cr3" :: "r" (cr3) : "memory");
+  }
+}
+
+uint64_t X64TlbManager::switches() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i <= MaxProcessors; i++)
+    n += m_Cpus[i].nSwitches;
+  return n;
+}
+
+uint64_t X64TlbManager::switchCycles() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i <= MaxProcessors; i++)
+    n += m_Cpus[i].switchCycles;
+  return n;
+}
+
+uint64_t X64TlbManager::taggedSwitches() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i <= MaxProcessors; i++)
+    n += m_Cpus[i].nTaggedSwitches;
+  return n;
+}
+
+uint64_t X64TlbManager::lazySwitches() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i <= MaxProcessors; i++)
+    n += m_Cpus[i].nLazySwitches;
+  return n;
+}
+
+uint64_t X64TlbManager::shootdowns() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i <= MaxProcessors; i++)
+    n += m_Cpus[i].nShootdowns;
+  return n;
+}
+
+uint64_t X64TlbManager::ipis() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i <= MaxProcessors; i++)
+    n += m_Cpus[i].nIpis;
+  return n;
+}
+
+uint64_t X64TlbManager::shootdownCycles() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i <= MaxProcessors; i++)
+    n += m_Cpus[i].shootdownCycles;
+  return n;
+}
@@ -23,8 +23,10 @@
 #include "VirtualAddressSpace.h"
 #include <processor/Processor.h>
 #include <processor/PhysicalMemoryManager.h>
+#include <processor/x64/TlbManager.h>
 #include <process/Scheduler.h>
 #include <process/Process.h>
+#include <process/CompressedPageStore.h>
 #include <LockGuard.h>
 
 //
@@ -60,6 +62,14 @@
 #define PAGE_SET_FLAGS(x, f) *x = (*x & ~0x8000000000000FFFULL) | f
 #define PAGE_GET_PHYSICAL_ADDRESS(x) (*x & ~0x8000000000000FFFULL)
 
+// 2MB pages keep the PAT bit at bit 12, as bit 7 is PAGE_2MB. These convert between
+// a 2MB page directory entry and flags laid out like those of a page table entry.
+#define PAGE_2MB_PAT                0x1000
+#define LARGE_PAGE_SIZE             0x200000
+#define LARGE_PAGE_GET_FLAGS(x) ((*x & 0x8000000000000F7FULL) | ((*x & PAGE_2MB_PAT) ? PAGE_PAT : 0))
+#define LARGE_PAGE_FLAGS(f) (((f) & ~PAGE_PAT) | (((f) & PAGE_PAT) ? PAGE_2MB_PAT : 0) | PAGE_2MB)
+#define LARGE_PAGE_GET_PHYSICAL_ADDRESS(x) (*x & ~0x80000000001FFFFFULL)
+
 // Defined in boot-standalone.s
 extern void *pml4;
 
@@ -136,14 +146,118 @@ bool X64VirtualAddressSpace::isMapped(void *virtualAddress)
   // Is a page present?
   return ((*pageTableEntry & PAGE_PRESENT) == PAGE_PRESENT);
 }
+bool X64VirtualAddressSpace::isSwapped(void *virtualAddress)
+{
+  LockGuard<Spinlock> guard(m_Lock);
+
+  uint64_t *pageTableEntry = 0;
+  if (getPageTableEntry(virtualAddress, pageTableEntry) == false)
+    return false;
+
+  return ((*pageTableEntry & (PAGE_PRESENT | PAGE_SWAPPED)) == PAGE_SWAPPED);
+}
 
 bool X64VirtualAddressSpace::map(physical_uintptr_t physAddress,
                                  void *virtualAddress,
                                  size_t flags)
 {
   LockGuard<Spinlock> guard(m_Lock);
-  
-  size_t Flags = toFlags(flags, true);
+
+  size_t Flags = globalFlags(toFlags(flags, true), virtualAddress);
+
+  uint64_t *pageDirectoryEntry = allocatePageDirectoryEntry(virtualAddress, flags);
+  if (!pageDirectoryEntry)
+    return false;
+
+  // Is the address already covered by a 2MB page?
+  if ((*pageDirectoryEntry & (PAGE_PRESENT | PAGE_2MB)) == (PAGE_PRESENT | PAGE_2MB))
+    return false;
+
+  // Is a page table present?
+  if (conditionalTableEntryAllocation(pageDirectoryEntry, flags) == false)
+    return false;
+
+  size_t pageTableIndex = PAGE_TABLE_INDEX(virtualAddress);
+  uint64_t *pageTableEntry = TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry), pageTableIndex);
+
+  // Is a page already present?
+  if ((*pageTableEntry & PAGE_PRESENT) == PAGE_PRESENT)
+    return false;
+
+  // Map the page
+  *pageTableEntry = physAddress | Flags;
+
+  // Flush the TLB
+  Processor::invalidate(virtualAddress);
+
+  return true;
+}
+
+bool X64VirtualAddressSpace::mapLarge(physical_uintptr_t physAddress,
+                                      void *virtualAddress,
+                                      size_t flags)
+{
+  if (((physAddress | reinterpret_cast<uintptr_t>(virtualAddress)) & (LARGE_PAGE_SIZE - 1)) != 0)
+    return false;
+
+  // Set aside the page table that splitting this page up again will need,
+  // so that unmapping or changing part of it can never fail for want of
+  // memory.
+  physical_uintptr_t reserve = PhysicalMemoryManager::instance().allocatePage();
+  if (!reserve)
+    return false;
+
+  physical_uintptr_t oldTable = 0;
+  {
+    LockGuard<Spinlock> guard(m_Lock);
+
+    uint64_t Flags = globalFlags(toFlags(flags, true), virtualAddress);
+
+    uint64_t *pageDirectoryEntry = allocatePageDirectoryEntry(virtualAddress, flags);
+    bool bOk = pageDirectoryEntry != 0;
+
+    // A page table may be left behind by earlier mappings; it can be replaced
+    // if nothing in it is still mapped.
+    if (bOk && (*pageDirectoryEntry & PAGE_PRESENT) == PAGE_PRESENT)
+    {
+      if ((*pageDirectoryEntry & PAGE_2MB) == PAGE_2MB)
+        bOk = false;
+      else
+      {
+        oldTable = PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry);
+        for (size_t i = 0; bOk && i < 512; i++)
+          if ((*TABLE_ENTRY(oldTable, i) & (PAGE_PRESENT | PAGE_SWAPPED)) != 0)
+            bOk = false;
+      }
+    }
+
+    if (bOk)
+    {
+      pushReserveTable(reserve);
+      reserve = 0;
+
+      // Map the page
+      *pageDirectoryEntry = physAddress | LARGE_PAGE_FLAGS(Flags);
+
+      if (!oldTable)
+        Processor::invalidate(virtualAddress);
+    }
+  }
+
+  if (reserve)
+  {
+    PhysicalMemoryManager::instance().freePage(reserve);
+    return false;
+  }
+
+  if (oldTable)
+    retireTable(oldTable, virtualAddress);
+
+  return true;
+}
+
+uint64_t *X64VirtualAddressSpace::allocatePageDirectoryEntry(void *virtualAddress, size_t flags)
+{
   size_t pml4Index = PML4_INDEX(virtualAddress);
   uint64_t *pml4Entry = TABLE_ENTRY(m_PhysicalPML4, pml4Index);
 
@@ -153,7 +267,7 @@ bool X64VirtualAddressSpace::map(physical_uintptr_t physAddress,
 
   // Is a page directory pointer table present?
   if (conditionalTableEntryAllocation(pml4Entry, flags) == false)
-    return false;
+    return 0;
 
   // If there wasn't a PDPT already present, and the address is in the kernel area
   // of memory, we need to propagate this change across all address spaces.
@@ -177,35 +291,27 @@ bool X64VirtualAddressSpace::map(physical_uintptr_t physAddress,
 
   // Is a page directory present?
   if (conditionalTableEntryAllocation(pageDirectoryPointerEntry, flags) == false)
-    return false;
+    return 0;
 
   size_t pageDirectoryIndex = PAGE_DIRECTORY_INDEX(virtualAddress);
-  uint64_t *pageDirectoryEntry = TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry), pageDirectoryIndex);
-
-  // Is a page table present?
-  if (conditionalTableEntryAllocation(pageDirectoryEntry, flags) == false)
-    return false;
-
-  size_t pageTableIndex = PAGE_TABLE_INDEX(virtualAddress);
-  uint64_t *pageTableEntry = TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry), pageTableIndex);
-
-  // Is a page already present?
-  if ((*pageTableEntry & PAGE_PRESENT) == PAGE_PRESENT)
-    return false;
-
-  // Map the page
-  *pageTableEntry = physAddress | Flags;
-
-  // Flush the TLB
-  Processor::invalidate(virtualAddress);
-
-  return true;
+  return TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry), pageDirectoryIndex);
 }
 
 void X64VirtualAddressSpace::getMapping(void *virtualAddress,
                                         physical_uintptr_t &physAddress,
                                         size_t &flags)
 {
+  // Is the address covered by a 2MB page?
+  uint64_t *pageDirectoryEntry = 0;
+  if (getPageDirectoryEntry(virtualAddress, pageDirectoryEntry) &&
+      (*pageDirectoryEntry & PAGE_2MB) == PAGE_2MB)
+  {
+    physAddress = LARGE_PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry) +
+                  (reinterpret_cast<uintptr_t>(virtualAddress) & (LARGE_PAGE_SIZE - 1) & ~0xFFFULL);
+    flags = fromFlags(LARGE_PAGE_GET_FLAGS(pageDirectoryEntry), true);
+    return;
+  }
+
   // Get a pointer to the page-table entry (Also checks whether the page is actually present
   // or marked swapped out)
   uint64_t *pageTableEntry = 0;
@@ -221,41 +327,100 @@ void X64VirtualAddressSpace::getMapping(void *virtualAddress,
 }
 void X64VirtualAddressSpace::setFlags(void *virtualAddress, size_t newFlags)
 {
-  LockGuard<Spinlock> guard(m_Lock);
+  m_Lock.acquire();
+
+  // Only this page changes, so a 2MB page covering it must be split up.
+  uint64_t *pageDirectoryEntry = 0;
+  if (getPageDirectoryEntry(virtualAddress, pageDirectoryEntry) &&
+      (*pageDirectoryEntry & PAGE_2MB) == PAGE_2MB &&
+      !demote(pageDirectoryEntry))
+  {
+    m_Lock.release();
+    WARNING("VirtualAddressSpace::setFlags(): out of memory splitting a 2MB page, flags left alone");
+    return;
+  }
   
   // Get a pointer to the page-table entry (Also checks whether the page is actually present
   // or marked swapped out)
   uint64_t *pageTableEntry = 0;
   if (getPageTableEntry(virtualAddress, pageTableEntry) == false)
   {
+    m_Lock.release();
     panic("VirtualAddressSpace::setFlags(): function misused");
     return;
   }
 
   // Set the flags
-  PAGE_SET_FLAGS(pageTableEntry, toFlags(newFlags, true));
+  PAGE_SET_FLAGS(pageTableEntry, globalFlags(toFlags(newFlags, true), virtualAddress));
+
+  m_Lock.release();
 
   // Flush TLB - modified the mapping for this address.
-  Processor::invalidate(virtualAddress);
+  X64TlbManager::instance().shootdown(*this, &virtualAddress, 1);
 }
 void X64VirtualAddressSpace::unmap(void *virtualAddress)
 {
-  LockGuard<Spinlock> guard(m_Lock);
-  
-  // Get a pointer to the page-table entry (Also checks whether the page is actually present
-  // or marked swapped out)
-  uint64_t *pageTableEntry = 0;
-  if (getPageTableEntry(virtualAddress, pageTableEntry) == false)
+  unmapMany(&virtualAddress, 1);
+}
+bool X64VirtualAddressSpace::unmapMany(void **pAddresses, size_t nAddresses)
+{
+  bool bAll = true;
+
+  m_Lock.acquire();
+
+  for (size_t i = 0; i < nAddresses; i++)
   {
-    panic("VirtualAddressSpace::unmap(): function misused");
-    return;
+    uint64_t *pageDirectoryEntry = 0;
+    if (getPageDirectoryEntry(pAddresses[i], pageDirectoryEntry) &&
+        (*pageDirectoryEntry & PAGE_2MB) == PAGE_2MB)
+    {
+      // If the whole 2MB page goes, there's no need to split it up first.
+      uintptr_t base = reinterpret_cast<uintptr_t>(pAddresses[i]);
+      bool bWhole = (base & (LARGE_PAGE_SIZE - 1)) == 0 && (i + 511) < nAddresses;
+      for (size_t j = 1; bWhole && j < 512; j++)
+        bWhole = reinterpret_cast<uintptr_t>(pAddresses[i + j]) == base + j * 0x1000;
+
+      if (bWhole)
+      {
+        *pageDirectoryEntry = 0;
+        i += 511;
+
+        // Its reserve table isn't needed any more.
+        physical_uintptr_t reserve = popReserveTable();
+        if (reserve)
+          PhysicalMemoryManager::instance().freePage(reserve);
+        continue;
+      }
+
+      if (!demote(pageDirectoryEntry))
+      {
+        // Leave it mapped; the caller finds out and keeps the memory.
+        WARNING("VirtualAddressSpace::unmap(): out of memory splitting a 2MB page");
+        bAll = false;
+        continue;
+      }
+    }
+
+    // Get a pointer to the page-table entry (Also checks whether the page is actually present
+    // or marked swapped out)
+    uint64_t *pageTableEntry = 0;
+    if (getPageTableEntry(pAddresses[i], pageTableEntry) == false)
+    {
+      m_Lock.release();
+      panic("VirtualAddressSpace::unmap(): function misused");
+      return false;
+    }
+
+    // Unmap the page
+    *pageTableEntry = 0;
   }
 
-  // Unmap the page
-  *pageTableEntry = 0;
+  m_Lock.release();
 
-  // Invalidate the TLB entry
-  Processor::invalidate(virtualAddress);
+  // Invalidate the TLB entries, on every processor that may have them.
+  X64TlbManager::instance().shootdown(*this, pAddresses, nAddresses);
+
+  return bAll;
 }
 
 VirtualAddressSpace *X64VirtualAddressSpace::clone()
@@ -292,14 +457,36 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone()
                 if ((*pdEntry & PAGE_PRESENT) != PAGE_PRESENT)
                     continue;
 
-                /// \todo Deal with 2MB pages here.
                 if ((*pdEntry & PAGE_2MB) == PAGE_2MB)
-                    continue;
+                {
+                    uint64_t flags = LARGE_PAGE_GET_FLAGS(pdEntry);
+                    if (flags & PAGE_SHARED)
+                    {
+                        // Shared 2MB pages can stay whole in both address spaces.
+                        physical_uintptr_t physicalAddress = LARGE_PAGE_GET_PHYSICAL_ADDRESS(pdEntry);
+                        void *virtualAddress = reinterpret_cast<void*> ( ((i & 0x100)?(~0ULL << 48):0ULL) | /* Sign-extension. */
+                                                                         (i << 39) |
+                                                                         (j << 30) |
+                                                                         (k << 21) );
+
+                        for (size_t l = 0; l < 512; l++)
+                            PhysicalMemoryManager::instance().pin(physicalAddress + l * 0x1000);
+                        pClone->mapLarge(physicalAddress, virtualAddress, fromFlags(flags, true));
+                        continue;
+                    }
+
+                    // Copy-on-write works on single pages, so split it up.
+                    if (!demote(pdEntry))
+                    {
+                        WARNING("X64VirtualAddressSpace: Clone() failed to split a 2MB page!");
+                        continue;
+                    }
+                }
 
                 for (uint64_t l = 0; l < 512; l++)
                 {
                     uint64_t *ptEntry = TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pdEntry), l);
-                    if ((*ptEntry & PAGE_PRESENT) != PAGE_PRESENT)
+                    if ((*ptEntry & (PAGE_PRESENT | PAGE_SWAPPED)) == 0)
                         continue;
                   
                     uint64_t flags = PAGE_GET_FLAGS(ptEntry);
@@ -311,6 +498,15 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone()
                                                                      (k << 21) |
                                                                      (l << 12) );
 
+                    if ((*ptEntry & PAGE_PRESENT) != PAGE_PRESENT)
+                    {
+                        // A compressed page is shared by both sides until
+                        // one of them faults it back in.
+                        CompressedPageStore::instance().duplicate(CompressedPageStore::addressToHandle(physicalAddress));
+                        pClone->map(physicalAddress, virtualAddress, fromFlags(flags, true));
+                        continue;
+                    }
+
                     if(flags & PAGE_SHARED) {
                         // The physical address is now referenced (shared) in
                         // two address spaces, so make sure we hold another
@@ -337,7 +533,6 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone()
                     // writes in the parent process will cause the child process to see
                     // those changes immediately.
                     PAGE_SET_FLAGS(ptEntry, flags);
-                    Processor::invalidate(virtualAddress);
 
                     // Pin the page twice - once for each side of the clone.
                     // But only pin for the parent if the parent page is not already
@@ -351,6 +546,10 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone()
         }
     }
 
+    // Our pages are now read-only, which every processor running this
+    // address space must see before either side writes to them again.
+    X64TlbManager::instance().shootdown(*this, 0, 0);
+
     X64VirtualAddressSpace *pX64Clone = static_cast<X64VirtualAddressSpace *>(pClone);
 
     // Before returning the address space, bring across metadata.
@@ -380,13 +579,37 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone()
 
 void X64VirtualAddressSpace::revertToKernelAddressSpace()
 {
-    LockGuard<Spinlock> guard(m_Lock);
-
     // The userspace area is only the bottom half of the address space - the top 256 PML4 entries are for
     // the kernel, and these should be mapped anyway.
+    // Detach it under the lock, and only free it once no processor can still be using the old tables.
+    uint64_t userEntries[256];
+    physical_uintptr_t reserveTables;
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+        for (uint64_t i = 0; i < 256; i++)
+        {
+            uint64_t *pml4Entry = TABLE_ENTRY(m_PhysicalPML4, i);
+            userEntries[i] = *pml4Entry;
+            *pml4Entry = 0;
+        }
+
+        // The 2MB pages are all going, so their reserve tables can too.
+        reserveTables = m_ReserveTables;
+        m_ReserveTables = 0;
+    }
+
+    X64TlbManager::instance().shootdown(*this, 0, 0);
+
+    while (reserveTables)
+    {
+        physical_uintptr_t table = reserveTables;
+        reserveTables = *TABLE_ENTRY(table, 0);
+        PhysicalMemoryManager::instance().freePage(table);
+    }
+
     for (uint64_t i = 0; i < 256; i++)
     {
-        uint64_t *pml4Entry = TABLE_ENTRY(m_PhysicalPML4, i);
+        uint64_t *pml4Entry = &userEntries[i];
         if ((*pml4Entry & PAGE_PRESENT) != PAGE_PRESENT)
             continue;
 
@@ -413,48 +636,45 @@ void X64VirtualAddressSpace::revertToKernelAddressSpace()
                 if(regionVirtualAddress > KERNEL_SPACE_START)
                     break;
 
-                /// \todo Deal with 2MB pages here.
                 if ((*pdEntry & PAGE_2MB) == PAGE_2MB)
+                {
+                    // Release the memory of the 2MB page unless it is shared.
+                    if ((LARGE_PAGE_GET_FLAGS(pdEntry) & (PAGE_SHARED | PAGE_SWAPPED)) == 0)
+                    {
+                        physical_uintptr_t physicalAddress = LARGE_PAGE_GET_PHYSICAL_ADDRESS(pdEntry);
+                        for (size_t l = 0; l < 512; l++)
+                            PhysicalMemoryManager::instance().freePage(physicalAddress + l * 0x1000);
+                    }
                     continue;
+                }
 
                 for (uint64_t l = 0; l < 512; l++)
                 {
                     uint64_t *ptEntry = TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pdEntry), l);
                     if ((*ptEntry & PAGE_PRESENT) != PAGE_PRESENT)
+                    {
+                        // Drop our reference to a compressed page.
+                        if ((*ptEntry & PAGE_SWAPPED) == PAGE_SWAPPED)
+                            CompressedPageStore::instance().release(CompressedPageStore::addressToHandle(PAGE_GET_PHYSICAL_ADDRESS(ptEntry)));
                         continue;
-
-                    void *virtualAddress = reinterpret_cast<void *>(
-                        reinterpret_cast<uintptr_t>(regionVirtualAddress) | (l << 12));
-
-                    size_t flags = PAGE_GET_FLAGS(ptEntry);
-                    physical_uintptr_t physicalAddress = PAGE_GET_PHYSICAL_ADDRESS(ptEntry);
+                    }
 
                     // Release the physical memory if it is not shared with another
                     // process (eg, memory mapped file)
-                    // Also avoid stumbling over a swapped out page.
-                    /// \todo When swap system comes along, we want to remove this page
-                    ///       from swap!
-                    if((flags & (PAGE_SHARED | PAGE_SWAPPED)) == 0)
+                    if((PAGE_GET_FLAGS(ptEntry) & PAGE_SHARED) == 0)
                     {
-                        PhysicalMemoryManager::instance().freePage(physicalAddress);
+                        PhysicalMemoryManager::instance().freePage(PAGE_GET_PHYSICAL_ADDRESS(ptEntry));
                     }
-
-                    // Free the page.
-                    *ptEntry = 0;
-                    Processor::invalidate(virtualAddress);
                 }
 
                 // Remove the table.
                 PhysicalMemoryManager::instance().freePage(PAGE_GET_PHYSICAL_ADDRESS(pdEntry));
-                *pdEntry = 0;
             }
 
             PhysicalMemoryManager::instance().freePage(PAGE_GET_PHYSICAL_ADDRESS(pdptEntry));
-            *pdptEntry = 0;
         }
 
         PhysicalMemoryManager::instance().freePage(PAGE_GET_PHYSICAL_ADDRESS(pml4Entry));
-        *pml4Entry = 0;
     }
 }
 
@@ -649,6 +869,15 @@ X64VirtualAddressSpace::~X64VirtualAddressSpace()
   // TODO: Free other things, perhaps in VirtualAddressSpace
   //       We can't do this in VirtualAddressSpace destructor though!
 
+  // Make sure no processor still has us loaded (kernel threads borrow
+  // whichever address space was there before them).
+  X64TlbManager::instance().release(*this);
+
+  // Free the tables set aside for splitting 2MB pages.
+  physical_uintptr_t reserve;
+  while ((reserve = popReserveTable()))
+    physicalMemoryManager.freePage(reserve);
+
   // Free the PageMapLevel4
   physicalMemoryManager.freePage(m_PhysicalPML4);
 }
@@ -656,7 +885,7 @@ X64VirtualAddressSpace::~X64VirtualAddressSpace()
 X64VirtualAddressSpace::X64VirtualAddressSpace()
   : VirtualAddressSpace(USERSPACE_VIRTUAL_HEAP), m_PhysicalPML4(0),
     m_pStackTop(USERSPACE_VIRTUAL_STACK), m_freeStacks(), m_bKernelSpace(false),
-    m_Lock(false, true)
+    m_Lock(false, true), m_ReserveTables(0), m_StaleMask(0), m_PcidTag(0)
 {
 
   // Allocate a new PageMapLevel4
@@ -677,10 +906,80 @@ X64VirtualAddressSpace::X64VirtualAddressSpace()
 X64VirtualAddressSpace::X64VirtualAddressSpace(void *Heap, physical_uintptr_t PhysicalPML4, void *VirtualStack)
   : VirtualAddressSpace(Heap), m_PhysicalPML4(PhysicalPML4),
     m_pStackTop(VirtualStack), m_freeStacks(), m_bKernelSpace(true),
-    m_Lock(false, true)
+    m_Lock(false, true), m_ReserveTables(0), m_StaleMask(0), m_PcidTag(0)
+{
+}
+
+bool X64VirtualAddressSpace::getPageDirectoryEntry(void *virtualAddress,
+                                                   uint64_t *&pageDirectoryEntry)
+{
+  size_t pml4Index = PML4_INDEX(virtualAddress);
+  uint64_t *pml4Entry = TABLE_ENTRY(m_PhysicalPML4, pml4Index);
+
+  // Is a page directory pointer table present?
+  if ((*pml4Entry & PAGE_PRESENT) != PAGE_PRESENT)
+    return false;
+
+  size_t pageDirectoryPointerIndex = PAGE_DIRECTORY_POINTER_INDEX(virtualAddress);
+  uint64_t *pageDirectoryPointerEntry = TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pml4Entry), pageDirectoryPointerIndex);
+
+  // Is a page directory present?
+  if ((*pageDirectoryPointerEntry & PAGE_PRESENT) != PAGE_PRESENT)
+    return false;
+
+  size_t pageDirectoryIndex = PAGE_DIRECTORY_INDEX(virtualAddress);
+  pageDirectoryEntry = TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry), pageDirectoryIndex);
+
+  // Is a page table or 2MB page present?
+  return (*pageDirectoryEntry & PAGE_PRESENT) == PAGE_PRESENT;
+}
+void X64VirtualAddressSpace::retireTable(physical_uintptr_t table, void *virtualAddress)
+{
+  // The page table may still be in the paging-structure caches, which an
+  // invalidation of any address in the current PCID flushes. Kernel tables
+  // are reachable from every PCID though, so need everything flushed.
+  void *largePage = reinterpret_cast<void *>(
+    reinterpret_cast<uintptr_t>(virtualAddress) & ~(LARGE_PAGE_SIZE - 1));
+  if (PML4_INDEX(virtualAddress) >= 256)
+    X64TlbManager::instance().shootdown(m_KernelSpace, 0, 0);
+  else
+    X64TlbManager::instance().shootdown(*this, &largePage, 1);
+
+  PhysicalMemoryManager::instance().freePage(table);
+}
+void X64VirtualAddressSpace::pushReserveTable(physical_uintptr_t table)
+{
+  // Free tables are chained through their first entry.
+  *TABLE_ENTRY(table, 0) = m_ReserveTables;
+  m_ReserveTables = table;
+}
+physical_uintptr_t X64VirtualAddressSpace::popReserveTable()
 {
+  physical_uintptr_t table = m_ReserveTables;
+  if (table)
+    m_ReserveTables = *TABLE_ENTRY(table, 0);
+  return table;
 }
+bool X64VirtualAddressSpace::demote(uint64_t *pageDirectoryEntry)
+{
+  // mapLarge() put a table aside for every 2MB page it made. Only 2MB pages
+  // set up some other way (at boot) need a new one.
+  physical_uintptr_t table = popReserveTable();
+  if (table == 0)
+    table = PhysicalMemoryManager::instance().allocatePage();
+  if (table == 0)
+    return false;
+
+  physical_uintptr_t base = LARGE_PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry);
+  uint64_t flags = LARGE_PAGE_GET_FLAGS(pageDirectoryEntry);
+  for (size_t i = 0; i < 512; i++)
+    *TABLE_ENTRY(table, i) = (base + i * 0x1000) | flags;
 
+  // As in conditionalTableEntryAllocation, the pages themselves control
+  // access.
+  *pageDirectoryEntry = table | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+  return true;
+}
 bool X64VirtualAddressSpace::getPageTableEntry(void *virtualAddress,
                                                uint64_t *&pageTableEntry)
 {
@@ -717,6 +1016,16 @@ bool X64VirtualAddressSpace::getPageTableEntry(void *virtualAddress,
 
   return true;
 }
+uint64_t X64VirtualAddressSpace::globalFlags(uint64_t Flags, void *virtualAddress)
+{
+  // Only the kernel half is the same in every address space. Making all of
+  // it global means a single invlpg reaches every PCID's copy.
+  if (PML4_INDEX(virtualAddress) < 256)
+    Flags &= ~PAGE_GLOBAL;
+  else if (X64TlbManager::instance().globalPages())
+    Flags |= PAGE_GLOBAL;
+  return Flags;
+}
 uint64_t X64VirtualAddressSpace::toFlags(size_t flags, bool bFinal)
 {
   uint64_t Flags = 0;
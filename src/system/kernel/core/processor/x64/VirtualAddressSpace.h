@@ -67,12 +67,15 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
   friend VirtualAddressSpace &VirtualAddressSpace::getKernelAddressSpace();
   /** VirtualAddressSpace::create needs access to the constructor */
   friend VirtualAddressSpace *VirtualAddressSpace::create();
+  /** X64TlbManager loads address spaces and tracks their PCIDs */
+  friend class X64TlbManager;
   public:
     //
     // VirtualAddressSpace Interface
     //
     virtual bool isAddressValid(void *virtualAddress);
     virtual bool isMapped(void *virtualAddress);
+    virtual bool isSwapped(void *virtualAddress);
 
     virtual bool map(physical_uintptr_t physAddress,
                      void *virtualAddress,
@@ -82,6 +85,12 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
                             size_t &flags);
     virtual void setFlags(void *virtualAddress, size_t newFlags);
     virtual void unmap(void *virtualAddress);
+    virtual bool unmapMany(void **pAddresses, size_t nAddresses);
+    virtual bool mapLarge(physical_uintptr_t physAddress,
+                          void *virtualAddress,
+                          size_t flags);
+    virtual size_t getLargePageSize() const
+      {return 0x200000;}
     virtual void *allocateStack();
     virtual void *allocateStack(size_t stackSz);
     virtual void freeStack(void *pStack);
@@ -191,6 +200,40 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
      *        otherwise */
     bool getPageTableEntry(void *virtualAddress,
                            uint64_t *&pageTableEntry);
+    /** Get the page directory entry, if the page directory exists and the entry is present.
+     *\param[in] virtualAddress the virtual address
+     *\param[out] pageDirectoryEntry pointer to the page directory entry
+     *\return true, if the page directory entry is present (as a page table or a 2MB page),
+     *        false otherwise */
+    bool getPageDirectoryEntry(void *virtualAddress,
+                               uint64_t *&pageDirectoryEntry);
+    /** Get the page directory entry, allocating the page directory pointer table and the page
+     *  directory if they are not present.
+     *\note m_Lock must be held.
+     *\param[in] virtualAddress the virtual address
+     *\param[in] flags flags that are used for the mapping
+     *\return pointer to the page directory entry, or 0 if a table could not be allocated */
+    uint64_t *allocatePageDirectoryEntry(void *virtualAddress, size_t flags);
+    /** Flush a page table that is no longer in use from the paging-structure caches
+     *  of every processor, then free it.
+     *\note m_Lock must not be held, as the flush may have to wait for other processors.
+     *\param[in] table the page table
+     *\param[in] virtualAddress any virtual address the table used to cover */
+    void retireTable(physical_uintptr_t table, void *virtualAddress);
+    /** Replace a 2MB page with a page table mapping the same memory, so that parts of
+     *  it can be changed independently.
+     *\note m_Lock must be held. The translation doesn't change, so nothing needs to be
+     *      invalidated until the new page table entries are. 2MB pages made by mapLarge()
+     *      use the table it set aside, so only those made some other way can fail.
+     *\param[in] pageDirectoryEntry pointer to the page directory entry
+     *\return true, if successfull, false if no page table could be allocated */
+    bool demote(uint64_t *pageDirectoryEntry);
+    /** Set a page table aside for demote().
+     *\note m_Lock must be held. */
+    void pushReserveTable(physical_uintptr_t table);
+    /** Take a page table set aside for demote(), or 0 if there are none.
+     *\note m_Lock must be held. */
+    physical_uintptr_t popReserveTable();
     /** Convert the processor independant flags to the processor's representation of the flags
      *\param[in] flags the processor independant flag representation
      *\param[in] bFinal whether this is for the actual page or just an intermediate PTE/PDE
@@ -201,6 +244,12 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
      *\param[in] bFinal whether this is for the actual page or just an intermediate PTE/PDE
      *\return the proessor independant flag representation */
     size_t fromFlags(uint64_t Flags, bool bFinal = false);
+    /** Adjust the global flag of a page's processor-specific flags for the
+     *  page's location.
+     *\param[in] Flags the processor specific flag representation
+     *\param[in] virtualAddress the virtual address of the page
+     *\return the adjusted flags */
+    uint64_t globalFlags(uint64_t Flags, void *virtualAddress);
     /** Allocate and map the table entry if none is present
      *\param[in] tableEntry pointer to the current table entry
      *\param[in] flags flags that are used for the mapping
@@ -228,6 +277,15 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
     bool m_bKernelSpace;
     /** Lock to guard against multiprocessor reentrancy. */
     Spinlock m_Lock;
+    /** Page tables set aside for splitting up 2MB pages, one for each made
+     *  by mapLarge(), chained through their first entry. */
+    physical_uintptr_t m_ReserveTables;
+    /** Processors that may hold TLB entries for this address space under its
+     *  PCID that are out of date, and must flush them when they load it. */
+    volatile uint64_t m_StaleMask;
+    /** The PCID and its generation, as handed out by X64TlbManager (zero if
+     *  none has been yet). */
+    volatile uint64_t m_PcidTag;
 
 
     /** The kernel virtual address space */
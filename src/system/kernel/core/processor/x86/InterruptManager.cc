@@ -22,6 +22,7 @@
 #include <LockGuard.h>
 #include <utilities/StaticString.h>
 #include <processor/Processor.h>
+#include <processor/SyscallTracer.h>
 #include "InterruptManager.h"
 #if defined(DEBUGGER)
   #include <Debugger.h>
@@ -186,12 +187,20 @@ void X86InterruptManager::interrupt(InterruptState &interruptState)
 
     if (LIKELY(pHandler != 0))
     {
+      uint64_t start = SyscallTracer::instance().begin();
       interruptState.m_Eax = pHandler->syscall(interruptState);
-      interruptState.m_Ebx = Processor::information().getCurrentThread()->getErrno();
-      if (Processor::information().getCurrentThread()->getUnwindState() == Thread::Exit)
+
+      ProcessorInformation &info = Processor::information();
+      Thread *pThread = info.getCurrentThread();
+      if (UNLIKELY(start != 0))
+        SyscallTracer::instance().end(start, serviceNumber, interruptState.getSyscallNumber(),
+                                      pThread->getParent());
+
+      interruptState.m_Ebx = pThread->getErrno();
+      if (pThread->getUnwindState() == Thread::Exit)
       {
           NOTICE("Unwind state exit, in interrupt handler");
-          Processor::information().getCurrentThread()->getParent()->getSubsystem()->exit(0);
+          pThread->getParent()->getSubsystem()->exit(0);
       }
     }
     return;
@@ -23,6 +23,7 @@
 #include <processor/Processor.h>
 #include "gdt.h"
 #include "InterruptManager.h"
+#include <processor/NMFaultHandler.h>
 #include "../x86_common/Multiprocessor.h"
 #include <process/initialiseMultitasking.h>
 
@@ -53,6 +54,9 @@ void Multiprocessor::applicationProcessorStartup()
   // We need to synchronize the -init section invalidation
   Processor::invalidate(0);
 
+  // Enable SSE, which initialise() only did for the bootstrap processor
+  NMFaultHandler::initialiseProcessor();
+
   // Start multitasking and ensure there is a spare idle thread for this CPU.
   initialiseMultitaskingPerProcessor();
 
@@ -123,6 +123,22 @@ bool NMFaultHandler::initialise()
     return false;
 }
 
+void NMFaultHandler::initialiseProcessor()
+{
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t cr4;
+
+    Processor::cpuid(1, 0, eax, ebx, ecx, edx);
+    asm volatile ("mov %%cr4, %0" : "=r" (cr4));
+
+    if(edx & CPUID_FEAT_EDX_FXSR)
+        cr4 |= CR4_OSFXSR;
+    if(edx & CPUID_FEAT_EDX_SSE)
+        cr4 |= CR4_OSXMMEXCPT;
+
+    asm volatile("mov %0, %%cr4;"::"r"(cr4));
+}
+
 // old/current owner
 static X86SchedulerState *x87FPU_MMX_XMM_MXCSR_StateOwner = 0;
 static X86SchedulerState x87FPU_MMX_XMM_MXCSR_StateBlank;
@@ -24,6 +24,7 @@
 #include <processor/PhysicalMemoryManager.h>
 #include <process/Scheduler.h>
 #include <process/Process.h>
+#include <process/CompressedPageStore.h>
 #include <LockGuard.h>
 #include "VirtualAddressSpace.h"
 
@@ -111,6 +112,23 @@ bool X86VirtualAddressSpace::isMapped(void *virtualAddress)
 
   return doIsMapped(virtualAddress);
 }
+bool X86VirtualAddressSpace::isSwapped(void *virtualAddress)
+{
+  #if defined(ADDITIONAL_CHECKS)
+    if (Processor::readCr3() != m_PhysicalPageDirectory)
+      panic("VirtualAddressSpace::isSwapped(): not in this VirtualAddressSpace");
+  #endif
+
+#ifndef TRACK_LOCKS
+  LockGuard<Spinlock> guard(m_Lock);
+#endif
+
+  uint32_t *pageTableEntry = 0;
+  if (getPageTableEntry(virtualAddress, pageTableEntry) == false)
+    return false;
+
+  return ((*pageTableEntry & (PAGE_PRESENT | PAGE_SWAPPED)) == PAGE_SWAPPED);
+}
 bool X86VirtualAddressSpace::map(physical_uintptr_t physicalAddress,
                                  void *virtualAddress,
                                  size_t flags)
@@ -617,7 +635,7 @@ VirtualAddressSpace *X86VirtualAddressSpace::clone()
         {
             uint32_t *pageTableEntry = PAGE_TABLE_ENTRY(m_VirtualPageTables, i, j);
 
-            if ((*pageTableEntry & PAGE_PRESENT) != PAGE_PRESENT)
+            if ((*pageTableEntry & (PAGE_PRESENT | PAGE_SWAPPED)) == 0)
                 continue;
 
             uint32_t flags = PAGE_GET_FLAGS(pageTableEntry);
@@ -628,6 +646,15 @@ VirtualAddressSpace *X86VirtualAddressSpace::clone()
                 (virtualAddress >= KERNEL_SPACE_START))
                 continue;
 
+            if ((flags & PAGE_PRESENT) != PAGE_PRESENT)
+            {
+                // A compressed page is shared by both sides until one of
+                // them faults it back in.
+                CompressedPageStore::instance().duplicate(CompressedPageStore::addressToHandle(physicalAddress));
+                mapCrossSpace(v, physicalAddress, virtualAddress, fromFlags(flags, true));
+                continue;
+            }
+
             if(flags & PAGE_SHARED) {
                 // Handle shared mappings - don't copy the original page.
                 mapCrossSpace(v, physicalAddress, virtualAddress, fromFlags(flags, true));
@@ -711,7 +738,15 @@ void X86VirtualAddressSpace::revertToKernelAddressSpace()
             uint32_t *pageTableEntry = PAGE_TABLE_ENTRY(m_VirtualPageTables, i, j);
 
             if ((*pageTableEntry & PAGE_PRESENT) != PAGE_PRESENT)
+            {
+                // Drop our reference to a compressed page.
+                if ((*pageTableEntry & PAGE_SWAPPED) == PAGE_SWAPPED)
+                {
+                    CompressedPageStore::instance().release(CompressedPageStore::addressToHandle(PAGE_GET_PHYSICAL_ADDRESS(pageTableEntry)));
+                    *pageTableEntry = 0;
+                }
                 continue;
+            }
 
             size_t flags = PAGE_GET_FLAGS(pageTableEntry);
 
@@ -724,10 +759,7 @@ void X86VirtualAddressSpace::revertToKernelAddressSpace()
 
             // And release the physical memory if it is not shared with another
             // process (eg, memory mapped file)
-            // Also avoid stumbling over a swapped out page.
-            /// \todo When swap system comes along, we want to remove this page
-            ///       from swap!
-            if((flags & (PAGE_SHARED|PAGE_SWAPPED)) == 0)
+            if((flags & PAGE_SHARED) == 0)
                 PhysicalMemoryManager::instance().freePage(physicalAddress);
 
             // This PTE is no longer valid
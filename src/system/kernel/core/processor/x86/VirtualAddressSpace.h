@@ -72,6 +72,7 @@ class X86VirtualAddressSpace : public VirtualAddressSpace
     //
     virtual bool isAddressValid(void *virtualAddress);
     virtual bool isMapped(void *virtualAddress);
+    virtual bool isSwapped(void *virtualAddress);
     virtual bool map(physical_uintptr_t physicalAddress,
                      void *virtualAddress,
                      size_t flags);
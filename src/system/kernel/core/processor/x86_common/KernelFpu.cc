@@ -0,0 +1,97 @@
+/*
+ *
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <processor/KernelFpu.h>
+#include <processor/NMFaultHandler.h>
+#include <processor/Processor.h>
+
+#define CR0_TS                  (1 << 3)
+#define CR4_OSFXSR              (1 << 9)
+#define EFLAGS_IF               (1 << 9)
+
+bool NMFaultHandler::kernelSectionsAvailable()
+{
+    // The boot code (or initialiseProcessor(), on the other processors) only
+    // sets OSFXSR (which SSE needs as well) if the processor has FXSAVE. It's
+    // per processor, so check this one's.
+    uintptr_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r" (cr4));
+    return (cr4 & CR4_OSFXSR) != 0;
+}
+
+bool NMFaultHandler::beginKernelSection(KernelFpuState &state)
+{
+    if(!kernelSectionsAvailable())
+        return false;
+
+    uintptr_t flags, cr0;
+    asm volatile("pushf; pop %0; cli" : "=r" (flags) :: "memory");
+    state.bInterrupts = (flags & EFLAGS_IF) ? 1 : 0;
+
+    // Another thread's #NM would save our registers as its own, so the
+    // scheduler won't switch away until the section ends.
+    Processor::information().setKernelFpuSection(true);
+
+    // With TS set, the registers still hold the state of whichever thread
+    // last owned them. Clearing TS ourselves rather than taking the fault
+    // keeps interrupt() out of it: the owner stays the same, and its state
+    // is back in the registers by the time the section ends.
+    asm volatile("mov %%cr0, %0" : "=r" (cr0));
+    state.bTaskSwitched = (cr0 & CR0_TS) ? 1 : 0;
+    if(state.bTaskSwitched)
+        asm volatile("clts");
+
+    asm volatile("fxsave (%0)" :: "r" (state.registers) : "memory");
+
+    return true;
+}
+
+void NMFaultHandler::endKernelSection(KernelFpuState &state)
+{
+    asm volatile("fxrstor (%0)" :: "r" (state.registers) : "memory");
+
+    if(state.bTaskSwitched)
+    {
+        uintptr_t cr0;
+        asm volatile("mov %%cr0, %0" : "=r" (cr0));
+        cr0 |= CR0_TS;
+        asm volatile("mov %0, %%cr0" :: "r" (cr0));
+    }
+
+    Processor::information().setKernelFpuSection(false);
+
+    if(state.bInterrupts)
+        asm volatile("sti" ::: "memory");
+}
+
+extern "C" int kernel_fpu_available()
+{
+    return NMFaultHandler::kernelSectionsAvailable() ? 1 : 0;
+}
+
+extern "C" int kernel_fpu_begin(KernelFpuState *pState)
+{
+    return NMFaultHandler::beginKernelSection(*pState) ? 1 : 0;
+}
+
+extern "C" void kernel_fpu_end(KernelFpuState *pState)
+{
+    NMFaultHandler::endKernelSection(*pState);
+}
@@ -21,6 +21,7 @@
 #include <panic.h>
 #include <utilities/assert.h>
 #include <utilities/utility.h>
+#include <utilities/StaticString.h>
 #include <processor/MemoryRegion.h>
 #include <processor/Processor.h>
 #include "PhysicalMemoryManager.h"
@@ -56,7 +57,58 @@ PhysicalMemoryManager &PhysicalMemoryManager::instance()
     return X86CommonPhysicalMemoryManager::instance();
 }
 
+#ifdef USE_BITMAP
+static void markPageUsed(physical_uintptr_t page)
+{
+    physical_uintptr_t ptr_bitmap = page / 0x1000;
+    size_t idx = ptr_bitmap / 32;
+    size_t bit = ptr_bitmap % 32;
+    __sync_fetch_and_or(&g_PageBitmap[idx], 1U << bit);
+}
+/** Returns false if the page was already free. */
+static bool markPageFree(physical_uintptr_t page)
+{
+    physical_uintptr_t ptr_bitmap = page / 0x1000;
+    size_t idx = ptr_bitmap / 32;
+    size_t bit = ptr_bitmap % 32;
+    return __sync_fetch_and_and(&g_PageBitmap[idx], ~(1U << bit)) & (1U << bit);
+}
+#endif
+
 physical_uintptr_t X86CommonPhysicalMemoryManager::allocatePage()
+{
+    physical_uintptr_t ptr;
+
+    // The page cache belongs to this CPU; keep the scheduler (and anything
+    // else that might allocate from an interrupt) off it while we use it.
+    bool bInterrupts = Processor::getInterrupts();
+    Processor::setInterrupts(false);
+
+    PageCache *pCache = getPageCache();
+    if (pCache && pCache->count)
+        ptr = pCache->pages[--pCache->count];
+    else
+        ptr = allocatePageSlow(pCache);
+
+    Processor::setInterrupts(bInterrupts);
+
+#ifdef USE_BITMAP
+    markPageUsed(ptr);
+#endif
+
+#if defined(TRACK_PAGE_ALLOCATIONS)             
+    if (Processor::m_Initialised == 2)
+    {
+        if (!g_AllocationCommand.isMallocing())
+        {
+            g_AllocationCommand.allocatePage(ptr);
+        }
+    }
+#endif
+
+    return ptr;
+}
+physical_uintptr_t X86CommonPhysicalMemoryManager::allocatePageSlow(PageCache *pCache)
 {
     static bool bDidHitWatermark = false;
     static bool bHandlingPressure = false;
@@ -69,7 +121,7 @@ physical_uintptr_t X86CommonPhysicalMemoryManager::allocatePage()
     // we need to not end up recursively trying to release the pressure.
     if(!bHandlingPressure)
     {
-        if(m_PageStack.freePages() < MemoryPressureManager::getHighWatermark())
+        if(m_PageStack.freePages() + m_Buddy.freePages() < MemoryPressureManager::getHighWatermark())
         {
             bHandlingPressure = true;
 
@@ -89,35 +141,95 @@ physical_uintptr_t X86CommonPhysicalMemoryManager::allocatePage()
         }
     }
 
-    ptr = m_PageStack.allocate(0);
+    // Refill the cache in one go so the next few allocations on this CPU
+    // don't need the lock at all.
+    if (pCache && !bHandlingPressure)
+    {
+        while (pCache->count < PageCacheBatch)
+        {
+            physical_uintptr_t page = allocateBackingPage();
+            if (!page)
+                break;
+            pCache->pages[pCache->count++] = page;
+        }
+    }
+
+    if (pCache && pCache->count)
+        ptr = pCache->pages[--pCache->count];
+    else
+        ptr = allocateBackingPage();
+
     if(!ptr)
     {
         panic("Out of memory.");
     }
 
-#ifdef USE_BITMAP
-    physical_uintptr_t ptr_bitmap = ptr / 0x1000;
-    size_t idx = ptr_bitmap / 32;
-    size_t bit = ptr_bitmap % 32;
-    g_PageBitmap[idx] |= (1 << bit);
-#endif
-    
     m_Lock.release();
 
-#if defined(TRACK_PAGE_ALLOCATIONS)             
-    if (Processor::m_Initialised == 2)
+    return ptr;
+}
+physical_uintptr_t X86CommonPhysicalMemoryManager::allocateBackingPage()
+{
+    physical_uintptr_t ptr = m_PageStack.allocate(0);
+    if (!ptr && !m_Buddy.allocate(0, ptr))
+        ptr = 0;
+    return ptr;
+}
+void X86CommonPhysicalMemoryManager::releaseBackingPage(physical_uintptr_t page)
+{
+    if (m_Buddy.contains(page))
+        m_Buddy.free(page, 0);
+    else
+        m_PageStack.free(page);
+}
+X86CommonPhysicalMemoryManager::PageCache *X86CommonPhysicalMemoryManager::getPageCache()
+{
+    // Before the processors are enumerated every CPU reports itself as the
+    // BSP, so sharing a cache would not be safe.
+    if (Processor::m_Initialised < 2)
+        return 0;
+
+    size_t id = Processor::id();
+    if (id >= MaxPageCaches)
+        return 0;
+    return &m_PageCaches[id];
+}
+void X86CommonPhysicalMemoryManager::drainPageCache(PageCache *pCache)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    for (size_t i = 0; i < PageCacheBatch && pCache->count; ++i)
+        releaseBackingPage(pCache->pages[--pCache->count]);
+}
+void X86CommonPhysicalMemoryManager::freePage(physical_uintptr_t page)
+{
+    // A pinned page may only be freed once its refcount drops, which needs
+    // the metadata and therefore the lock. Pages that have never been pinned
+    // (nearly all of them) skip it.
+    if (!m_PinFilter[pinBucket(page)])
     {
-        if (!g_AllocationCommand.isMallocing())
+        bool bInterrupts = Processor::getInterrupts();
+        Processor::setInterrupts(false);
+
+        PageCache *pCache = getPageCache();
+        if (pCache)
         {
-            g_AllocationCommand.allocatePage(ptr);
+#ifdef USE_BITMAP
+            if(!markPageFree(page))
+                FATAL_NOLOCK("PhysicalMemoryManager DOUBLE FREE");
+#endif
+
+            if (pCache->count == PageCacheBatch * 2)
+                drainPageCache(pCache);
+            pCache->pages[pCache->count++] = page;
+
+            Processor::setInterrupts(bInterrupts);
+            return;
         }
+
+        Processor::setInterrupts(bInterrupts);
     }
-#endif
 
-    return ptr;
-}
-void X86CommonPhysicalMemoryManager::freePage(physical_uintptr_t page)
-{
     LockGuard<Spinlock> guard(m_Lock);
 
     freePageUnlocked(page);
@@ -140,23 +252,19 @@ void X86CommonPhysicalMemoryManager::freePageUnlocked(physical_uintptr_t page)
             // No longer need this page's metadata, refcount is zero.
             m_PageMetadata.remove(key);
             delete p;
+            __sync_fetch_and_sub(&m_PinFilter[pinBucket(page)], 1);
         }
     }
 
 #ifdef USE_BITMAP
-    physical_uintptr_t ptr_bitmap = page / 0x1000;
-    size_t idx = ptr_bitmap / 32;
-    size_t bit = ptr_bitmap % 32;
-    if(!(g_PageBitmap[idx] & (1 << bit)))
+    if(!markPageFree(page))
     {
         m_Lock.release();
         FATAL_NOLOCK("PhysicalMemoryManager DOUBLE FREE");
     }
-
-    g_PageBitmap[idx] &= ~(1 << bit);
 #endif
 
-    m_PageStack.free(page);
+    releaseBackingPage(page);
 
     // g_AllocationCommand.freePage uses our lock.
     
@@ -180,9 +288,82 @@ void X86CommonPhysicalMemoryManager::pin(physical_uintptr_t page) {
     else {
         p = new struct page;
         p->refcount = 1;
+        // Publish the pin before the metadata, so a racing freePage can't
+        // take the fast path once the page has a refcount.
+        __sync_fetch_and_add(&m_PinFilter[pinBucket(page)], 1);
         m_PageMetadata.insert(key, p);
     }
 }
+physical_uintptr_t X86CommonPhysicalMemoryManager::allocateLargePage()
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    // Leave a good part of the zone for device buffers, which can't be
+    // allocated from anywhere else.
+    if (m_Buddy.freePages() < (BuddyAllocator::ZonePages / 4) + (1UL << BuddyAllocator::LargePageOrder))
+        return 0;
+
+    physical_uintptr_t block = 0;
+    if (!m_Buddy.allocate(BuddyAllocator::LargePageOrder, block))
+        return 0;
+    return block;
+}
+bool X86CommonPhysicalMemoryManager::allocateRegionAddress(size_t size,
+                                                           physical_uintptr_t physicalAddress,
+                                                           uintptr_t &vAddress)
+{
+    size_t largePageSize = VirtualAddressSpace::getKernelAddressSpace().getLargePageSize();
+    if (!largePageSize || size < largePageSize)
+        return m_MemoryRegions.allocate(size, vAddress);
+
+    // Take a large page more than needed, to be able to line the region up
+    // with its physical memory, and give back what's left either side.
+    uintptr_t base;
+    if (m_MemoryRegions.allocate(size + largePageSize, base) == false)
+        return m_MemoryRegions.allocate(size, vAddress);
+
+    vAddress = (base & ~(largePageSize - 1)) + (physicalAddress & (largePageSize - 1));
+    if (vAddress < base)
+        vAddress += largePageSize;
+
+    if (vAddress > base)
+        m_MemoryRegions.free(base, vAddress - base);
+    if (vAddress + size < base + size + largePageSize)
+        m_MemoryRegions.free(vAddress + size, (base + largePageSize) - vAddress);
+    return true;
+}
+bool X86CommonPhysicalMemoryManager::mapContinuousRegion(physical_uintptr_t physicalAddress,
+                                                         uintptr_t vAddress,
+                                                         size_t cPages,
+                                                         size_t Flags)
+{
+    VirtualAddressSpace &virtualAddressSpace = Processor::information().getVirtualAddressSpace();
+    size_t largePageSize = virtualAddressSpace.getLargePageSize();
+
+    size_t i = 0;
+    while (i < cPages)
+    {
+        physical_uintptr_t phys = physicalAddress + i * getPageSize();
+        uintptr_t virt = vAddress + i * getPageSize();
+
+        // allocateRegionAddress lined the two up, so whole large pages in the
+        // middle of the region can be mapped in one go.
+        if (largePageSize &&
+            ((phys | virt) & (largePageSize - 1)) == 0 &&
+            (cPages - i) * getPageSize() >= largePageSize &&
+            virtualAddressSpace.mapLarge(phys, reinterpret_cast<void*>(virt), Flags))
+        {
+            i += largePageSize / getPageSize();
+            continue;
+        }
+
+        if (!virtualAddressSpace.map(phys, reinterpret_cast<void*>(virt), Flags))
+            return false;
+        ++i;
+    }
+
+    return true;
+}
 bool X86CommonPhysicalMemoryManager::allocateRegion(MemoryRegion &Region,
                                                     size_t cPages,
                                                     size_t pageConstraints,
@@ -242,8 +423,9 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(MemoryRegion &Region,
         // Allocate the virtual address space
         uintptr_t vAddress;
 
-        if (m_MemoryRegions.allocate(cPages * PhysicalMemoryManager::getPageSize(),
-                                     vAddress)
+        if (allocateRegionAddress(cPages * PhysicalMemoryManager::getPageSize(),
+                                  start,
+                                  vAddress)
             == false)
         {
             WARNING("AllocateRegion: MemoryRegion allocation failed.");
@@ -251,17 +433,12 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(MemoryRegion &Region,
         }
 
         // Map the physical memory into the allocated space
-        VirtualAddressSpace &virtualAddressSpace =  Processor::information().getVirtualAddressSpace();
-        for (size_t i = 0;i < cPages;i++)
-            if (virtualAddressSpace.map(start + i * PhysicalMemoryManager::getPageSize(),
-                                        reinterpret_cast<void*>(vAddress + i * PhysicalMemoryManager::getPageSize()),
-                                        Flags)
-                == false)
-            {
-                m_MemoryRegions.free(vAddress, cPages * PhysicalMemoryManager::getPageSize());
-                WARNING("AllocateRegion: VirtualAddressSpace::map failed.");
-                return false;
-            }
+        if (!mapContinuousRegion(start, vAddress, cPages, Flags))
+        {
+            m_MemoryRegions.free(vAddress, cPages * PhysicalMemoryManager::getPageSize());
+            WARNING("AllocateRegion: VirtualAddressSpace::map failed.");
+            return false;
+        }
 
         // Set the memory-region's members
         Region.m_VirtualAddress = reinterpret_cast<void*>(vAddress);
@@ -275,25 +452,72 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(MemoryRegion &Region,
     }
     else
     {
-        // If we need continuous memory, switch to below16 if not already
-        if ((pageConstraints & continuous) == continuous)
-            if ((pageConstraints & addressConstraints) != below1MB &&
-                (pageConstraints & addressConstraints) != below16MB)
-                pageConstraints = (pageConstraints & ~addressConstraints) | below16MB;
-
-        // Allocate the virtual address space
+        // The virtual address space is allocated once the physical memory is
+        // known, so that the two can be lined up.
         uintptr_t vAddress;
-        if (m_MemoryRegions.allocate(cPages * PhysicalMemoryManager::getPageSize(),
-                                     vAddress)
-            == false)
+
+        VirtualAddressSpace &virtualAddressSpace = Processor::information().getVirtualAddressSpace();
+
+        // Continuous memory without a low-memory constraint comes from the
+        // buddy zone (which lies below 4 GB) when possible, saving the scarce
+        // memory below 16MB for the devices that really need it.
+        if ((pageConstraints & continuous) == continuous &&
+            (pageConstraints & addressConstraints) != below1MB &&
+            (pageConstraints & addressConstraints) != below16MB)
         {
-            WARNING("AllocateRegion: MemoryRegion allocation failed.");
-            return false;
-        }
+            size_t order = 0;
+            while ((1UL << order) < cPages)
+                ++order;
 
+            physical_uintptr_t block = 0;
+            bool bAllocated = false;
+            if (order <= BuddyAllocator::MaxOrder)
+            {
+                LockGuard<Spinlock> guard(m_Lock);
+                bAllocated = m_Buddy.allocate(order, block);
+
+                // Give back the tail of the block that wasn't asked for; the
+                // rest is returned page by page in unmapRegion.
+                if (bAllocated)
+                    for (size_t i = cPages; i < (1UL << order); i++)
+                        m_Buddy.free(block + i * getPageSize(), 0);
+            }
+
+            if (bAllocated &&
+                allocateRegionAddress(cPages * PhysicalMemoryManager::getPageSize(),
+                                      block,
+                                      vAddress)
+                == false)
+            {
+                LockGuard<Spinlock> guard(m_Lock);
+                for (size_t i = 0; i < cPages; i++)
+                    m_Buddy.free(block + i * getPageSize(), 0);
+
+                WARNING("AllocateRegion: MemoryRegion allocation failed.");
+                return false;
+            }
+
+            if (bAllocated)
+            {
+                if (!mapContinuousRegion(block, vAddress, cPages, Flags))
+                {
+                    WARNING("AllocateRegion: VirtualAddressSpace::map failed.");
+                    return false;
+                }
+
+                Region.m_VirtualAddress = reinterpret_cast<void*>(vAddress);
+                Region.m_PhysicalAddress = block;
+                Region.m_Size = cPages * PhysicalMemoryManager::getPageSize();
+
+                PhysicalMemoryManager::m_MemoryRegions.pushBack(&Region);
+                return true;
+            }
+
+            // Otherwise fall back to memory below 16MB.
+            pageConstraints = (pageConstraints & ~addressConstraints) | below16MB;
+        }
 
         uint32_t start = 0;
-        VirtualAddressSpace &virtualAddressSpace = Processor::information().getVirtualAddressSpace();
 
         if ((pageConstraints & addressConstraints) == below1MB ||
             (pageConstraints & addressConstraints) == below16MB)
@@ -310,19 +534,32 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(MemoryRegion &Region,
                     return false;
             }
 
+            if (allocateRegionAddress(cPages * PhysicalMemoryManager::getPageSize(),
+                                      start,
+                                      vAddress)
+                == false)
+            {
+                WARNING("AllocateRegion: MemoryRegion allocation failed.");
+                return false;
+            }
+
             // Map the physical memory into the allocated space
-            for (size_t i = 0;i < cPages;i++)
-                if (virtualAddressSpace.map(start + i * PhysicalMemoryManager::getPageSize(),
-                                            reinterpret_cast<void*>(vAddress + i * PhysicalMemoryManager::getPageSize()),
-                                            Flags)
-                    == false)
-                {
-                    WARNING("AllocateRegion: VirtualAddressSpace::map failed.");
-                    return false;
-                }
+            if (!mapContinuousRegion(start, vAddress, cPages, Flags))
+            {
+                WARNING("AllocateRegion: VirtualAddressSpace::map failed.");
+                return false;
+            }
         }
         else
         {
+            if (m_MemoryRegions.allocate(cPages * PhysicalMemoryManager::getPageSize(),
+                                         vAddress)
+                == false)
+            {
+                WARNING("AllocateRegion: MemoryRegion allocation failed.");
+                return false;
+            }
+
             // Map the physical memory into the allocated space
             for (size_t i = 0;i < cPages;i++)
             {
@@ -368,6 +605,22 @@ void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
 
         if (Info.getMemoryMapEntryType(MemoryMap) == 1)
         {
+            // Place the buddy zone in the first usable range above 16MB that
+            // can hold all of it, naturally aligned.
+            if (!m_Buddy.isInitialised())
+            {
+                uint64_t blockSize = getPageSize() << BuddyAllocator::MaxOrder;
+                uint64_t zoneStart = Info.getMemoryMapEntryAddress(MemoryMap);
+                uint64_t entryEnd = zoneStart + Info.getMemoryMapEntryLength(MemoryMap);
+                if (zoneStart < 0x1000000)
+                    zoneStart = 0x1000000;
+                zoneStart = (zoneStart + blockSize - 1) & ~(blockSize - 1);
+
+                uint64_t zoneEnd = zoneStart + BuddyAllocator::ZonePages * getPageSize();
+                if (zoneEnd <= entryEnd && zoneEnd <= 0x100000000ULL)
+                    m_Buddy.initialise(zoneStart);
+            }
+
             for (uint64_t i = Info.getMemoryMapEntryAddress(MemoryMap);
                  i < (Info.getMemoryMapEntryAddress(MemoryMap) + Info.getMemoryMapEntryLength(MemoryMap));
                  i += getPageSize())
@@ -379,9 +632,13 @@ void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
                     break;
                 if (i >= 0x1000000)
                 {
-                    m_PageStack.free(i);
                     if (i >= top)
                         top = i + 0x1000;
+
+                    // Pages in the buddy zone are already free there.
+                    if (m_Buddy.contains(i))
+                        continue;
+                    m_PageStack.free(i);
                 }
             }
         }
@@ -389,6 +646,11 @@ void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
         MemoryMap = Info.nextMemoryMapEntry(MemoryMap);
     }
 
+    if (m_Buddy.isInitialised())
+        NOTICE("buddy zone: " << Hex << m_Buddy.base() << " - " << (m_Buddy.base() + BuddyAllocator::ZonePages * getPageSize()));
+    else
+        WARNING("PhysicalMemoryManager: no room for the buddy zone, continuous allocations will use memory below 16MB");
+
     /// \todo do this in initialise64 too.
     m_PageMetadata.initialise(PageHashable(top).hash());
 
@@ -589,16 +851,58 @@ void X86CommonPhysicalMemoryManager::initialisationDone()
     m_RangeBelow16MB.free(reinterpret_cast<uintptr_t>(&init) - reinterpret_cast<uintptr_t>(KERNEL_VIRTUAL_ADDRESS), count * getPageSize());
 
     NOTICE("PhysicalMemoryManager: cleaned up " << Dec << (count * 4) << Hex << "KB of init-only code.");
+
+    dumpStatistics();
+}
+
+size_t X86CommonPhysicalMemoryManager::getFreePageCount()
+{
+    size_t count = m_PageStack.freePages() + m_Buddy.freePages();
+    for (size_t i = 0; i < MaxPageCaches; ++i)
+        count += m_PageCaches[i].count;
+    return count;
+}
+
+size_t X86CommonPhysicalMemoryManager::getFreeBlockCount(size_t order)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    return m_Buddy.freeBlocks(order);
+}
+
+void X86CommonPhysicalMemoryManager::dumpStatistics()
+{
+    size_t cached = 0;
+    for (size_t i = 0; i < MaxPageCaches; ++i)
+        cached += m_PageCaches[i].count;
+
+    NOTICE("PhysicalMemoryManager: " << Dec << m_PageStack.freePages() << " pages free on the stack, "
+           << m_Buddy.freePages() << " in the buddy zone, " << cached << " in per-CPU caches" << Hex);
+
+    if (!m_Buddy.isInitialised())
+        return;
+
+    // Fragmentation: how the buddy zone's free memory is split across
+    // block sizes. A healthy zone has most of it in the high orders.
+    NormalStaticString str;
+    for (size_t order = 0; order <= BuddyAllocator::MaxOrder; ++order)
+    {
+        str += " ";
+        str.append(getFreeBlockCount(order));
+    }
+    NOTICE("PhysicalMemoryManager: free buddy blocks by order (0-" << Dec << BuddyAllocator::MaxOrder << Hex << "):" << str);
 }
 
 X86CommonPhysicalMemoryManager::X86CommonPhysicalMemoryManager()
-    : m_PageStack(), m_RangeBelow1MB(), m_RangeBelow16MB(), m_PhysicalRanges(),
+    : m_PageStack(), m_Buddy(), m_PinFilter(), m_RangeBelow1MB(),
+      m_RangeBelow16MB(), m_PhysicalRanges(),
 #if defined(ACPI)                               
       m_AcpiRanges(),
 #endif                                              
       m_MemoryRegions(), m_Lock(false, true), m_RegionLock(false, true),
       m_PageMetadata()
 {
+    for (size_t i = 0; i < MaxPageCaches; ++i)
+        m_PageCaches[i].count = 0;
 }
 X86CommonPhysicalMemoryManager::~X86CommonPhysicalMemoryManager()
 {
@@ -655,10 +959,15 @@ void X86CommonPhysicalMemoryManager::unmapRegion(MemoryRegion *pRegion)
                 size_t flags;
                 virtualAddressSpace.getMapping(vAddr, pAddr, flags);
 
-                if (!pRegion->getNonRamMemory() && pAddr > 0x1000000)
-                    m_PageStack.free(pAddr);
-                
                 virtualAddressSpace.unmap(vAddr);
+
+                // Pages from 16MB up came from the page stack or the buddy
+                // zone, which may start right at 16MB.
+                if (!pRegion->getNonRamMemory() && pAddr >= 0x1000000)
+                {
+                    LockGuard<Spinlock> guard(m_Lock);
+                    releaseBackingPage(pAddr);
+                }
             }
 //            NOTICE("MR: Freed " << Hex << start << ", size " << (cPages*4096));
             m_MemoryRegions.free(start, pRegion->size());
@@ -801,3 +1110,82 @@ void X86CommonPhysicalMemoryManager::PageStack::free(uint64_t physicalAddress)
 
         m_FreePages = 0;
     }
+
+X86CommonPhysicalMemoryManager::BuddyAllocator::BuddyAllocator() :
+    m_Base(0), m_FreePages(0), m_bInitialised(false)
+{
+    memset(m_Bitmap, 0, sizeof(m_Bitmap));
+}
+void X86CommonPhysicalMemoryManager::BuddyAllocator::initialise(physical_uintptr_t base)
+{
+    m_Base = base;
+    m_bInitialised = true;
+
+    // Everything starts out as free top-order blocks.
+    for (size_t idx = 0; idx < (ZonePages >> MaxOrder); ++idx)
+        set(MaxOrder, idx);
+    m_FreePages = ZonePages;
+}
+bool X86CommonPhysicalMemoryManager::BuddyAllocator::allocate(size_t order, physical_uintptr_t &physicalAddress)
+{
+    if (!m_bInitialised || order > MaxOrder)
+        return false;
+
+    // Find the smallest free block that is big enough.
+    size_t k = order, idx = 0;
+    bool bFound = false;
+    for (; k <= MaxOrder && !bFound; ++k)
+    {
+        size_t nBlocks = ZonePages >> k;
+        for (size_t word = 0; word < (nBlocks + 31) / 32; ++word)
+        {
+            if (m_Bitmap[k][word])
+            {
+                idx = word * 32 + __builtin_ctz(m_Bitmap[k][word]);
+                bFound = true;
+                break;
+            }
+        }
+    }
+    if (!bFound)
+        return false;
+    --k;
+
+    // Split it down to size, freeing the upper half at each step.
+    clear(k, idx);
+    while (k > order)
+    {
+        --k;
+        idx <<= 1;
+        set(k, idx + 1);
+    }
+
+    m_FreePages -= 1UL << order;
+    physicalAddress = m_Base + ((idx << order) * getPageSize());
+    return true;
+}
+void X86CommonPhysicalMemoryManager::BuddyAllocator::free(physical_uintptr_t physicalAddress, size_t order)
+{
+    size_t idx = ((physicalAddress - m_Base) / getPageSize()) >> order;
+    m_FreePages += 1UL << order;
+
+    // Merge with the buddy for as long as it is free too.
+    while (order < MaxOrder && test(order, idx ^ 1))
+    {
+        clear(order, idx ^ 1);
+        idx >>= 1;
+        ++order;
+    }
+    set(order, idx);
+}
+size_t X86CommonPhysicalMemoryManager::BuddyAllocator::freeBlocks(size_t order) const
+{
+    if (order > MaxOrder)
+        return 0;
+
+    size_t count = 0;
+    size_t nBlocks = ZonePages >> order;
+    for (size_t word = 0; word < (nBlocks + 31) / 32; ++word)
+        count += __builtin_popcount(m_Bitmap[order][word]);
+    return count;
+}
@@ -54,6 +54,8 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
 
     virtual void pin(physical_uintptr_t page);
 
+    virtual physical_uintptr_t allocateLargePage();
+
     /** Initialise the page stack
      *\param[in] Info reference to the multiboot information structure */
     void initialise(const BootstrapStruct_t &Info) INITIALISATION_ONLY;
@@ -73,6 +75,14 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
           {return m_AcpiRanges;}
     #endif
 
+    /** Get the number of free pages, including those held in per-CPU caches. */
+    size_t getFreePageCount();
+    /** Get the number of free blocks of (1 << order) contiguous pages in the
+     *  buddy zone. */
+    size_t getFreeBlockCount(size_t order);
+    /** Log free page counts and the buddy zone's fragmentation. */
+    void dumpStatistics();
+
   protected:
     /** The constructor */
     X86CommonPhysicalMemoryManager() INITIALISATION_ONLY;
@@ -88,11 +98,66 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
     X86CommonPhysicalMemoryManager &operator = (const X86CommonPhysicalMemoryManager &);
 
     void unmapRegion(MemoryRegion *pRegion);
+
+    /** Allocate virtual address space for a MemoryRegion. Regions of at least a
+     *  large page are placed at the same offset into a large page as their physical
+     *  memory, so the VirtualAddressSpace can map them with large pages.
+     *\param[in] size size of the region in bytes
+     *\param[in] physicalAddress physical address of the region, if continuous
+     *\param[out] vAddress the virtual address of the region
+     *\return true, if successfull, false otherwise */
+    bool allocateRegionAddress(size_t size, physical_uintptr_t physicalAddress, uintptr_t &vAddress);
+    /** Maps physically continuous memory for a MemoryRegion, with large pages
+     *  wherever the addresses allow.
+     *\param[in] physicalAddress physical address of the memory
+     *\param[in] vAddress virtual address to map it at
+     *\param[in] cPages number of pages
+     *\param[in] Flags flags for the mapping
+     *\return true, if successfull, false otherwise */
+    bool mapContinuousRegion(physical_uintptr_t physicalAddress, uintptr_t vAddress, size_t cPages, size_t Flags);
     
     /** Same as freePage, but without the lock. Will panic if the lock is unlocked.
       * \note Use in the wrong place and you die. */
     virtual void freePageUnlocked(physical_uintptr_t page);
 
+    /** Number of pages moved between a PageCache and the global allocators
+     *  at once. */
+    static const size_t PageCacheBatch = 32;
+    /** Number of CPUs that get a PageCache; any others use the global lock. */
+    static const size_t MaxPageCaches = 16;
+
+    /** Number of buckets in the pin filter. */
+    static const size_t PinFilterSize = 4096;
+
+    /** Pin filter bucket for a page. */
+    inline static size_t pinBucket(physical_uintptr_t page)
+    {
+        return (page / getPageSize()) & (PinFilterSize - 1);
+    }
+
+    /** A per-CPU cache of free pages. Only ever touched by its own CPU with
+     *  interrupts disabled, so needs no lock; it is refilled from and drained
+     *  to the global allocators in batches. */
+    struct PageCache
+    {
+        physical_uintptr_t pages[PageCacheBatch * 2];
+        size_t count;
+    };
+
+    /** Get the current CPU's page cache, or null if it has none (or it is too
+     *  early in boot to know which CPU this is). Interrupts must be disabled. */
+    PageCache *getPageCache();
+    /** Allocate a page without the per-CPU cache, refilling pCache (if given)
+     *  on the way. Interrupts must be disabled. */
+    physical_uintptr_t allocatePageSlow(PageCache *pCache);
+    /** Return a batch of pages from pCache to the global allocators. */
+    void drainPageCache(PageCache *pCache);
+    /** Take one page from the global allocators. m_Lock must be held. */
+    physical_uintptr_t allocateBackingPage();
+    /** Return one page to the global allocator it belongs to. m_Lock must be
+     *  held. */
+    void releaseBackingPage(physical_uintptr_t page);
+
     /** The actual page stack contains is a Stack of the pages with the constraints
      *  below4GB and below64GB and those pages without address size constraints.
      *\brief The Stack of pages (below4GB, below64GB, no constraint). */
@@ -138,9 +203,81 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
         size_t m_FreePages;
     };
 
+    /** A binary buddy allocator over a fixed, naturally aligned zone of
+     *  physical memory below 4 GB. It provides physically contiguous blocks
+     *  of up to (1 << MaxOrder) pages, and backs single-page allocation once
+     *  the page stack is empty. Free blocks are tracked with one bitmap per
+     *  order, so no memory outside the class is needed. */
+    class BuddyAllocator
+    {
+      public:
+        /** The largest order of block that can be allocated (4 MB). */
+        static const size_t MaxOrder = 10;
+        /** The order of a block the size of a 2 MB page. */
+        static const size_t LargePageOrder = 9;
+        /** Number of pages in the zone (32 MB). */
+        static const size_t ZonePages = 8192;
+
+        BuddyAllocator() INITIALISATION_ONLY;
+        inline ~BuddyAllocator(){}
+
+        /** Place the zone at the given physical address, which must be
+         *  aligned to a block of MaxOrder, and mark all of it free. */
+        void initialise(physical_uintptr_t base) INITIALISATION_ONLY;
+
+        /** Allocate a block of (1 << order) contiguous pages.
+         *\return true if a block was available */
+        bool allocate(size_t order, physical_uintptr_t &physicalAddress);
+        /** Free a block of (1 << order) pages, coalescing with its buddies. */
+        void free(physical_uintptr_t physicalAddress, size_t order);
+
+        /** Whether the zone has been placed. */
+        inline bool isInitialised() const { return m_bInitialised; }
+        /** Whether the given page lies within the zone. */
+        inline bool contains(physical_uintptr_t physicalAddress) const
+        {
+            return m_bInitialised && physicalAddress >= m_Base &&
+                   physicalAddress < m_Base + ZonePages * getPageSize();
+        }
+        inline physical_uintptr_t base() const { return m_Base; }
+
+        inline size_t freePages() const { return m_FreePages; }
+        /** Number of free blocks of the given order. */
+        size_t freeBlocks(size_t order) const;
+
+      private:
+        BuddyAllocator(const BuddyAllocator &);
+        BuddyAllocator &operator = (const BuddyAllocator &);
+
+        inline bool test(size_t order, size_t idx) const
+            { return m_Bitmap[order][idx / 32] & (1U << (idx % 32)); }
+        inline void set(size_t order, size_t idx)
+            { m_Bitmap[order][idx / 32] |= (1U << (idx % 32)); }
+        inline void clear(size_t order, size_t idx)
+            { m_Bitmap[order][idx / 32] &= ~(1U << (idx % 32)); }
+
+        /** One bit per block of each order, set if that block is free. */
+        uint32_t m_Bitmap[MaxOrder + 1][ZonePages / 32];
+        physical_uintptr_t m_Base;
+        size_t m_FreePages;
+        bool m_bInitialised;
+    };
+
     /** The page stack */
     PageStack m_PageStack;
 
+    /** The buddy zone for contiguous allocations */
+    BuddyAllocator m_Buddy;
+
+    /** Per-CPU page caches, indexed by ProcessorId */
+    PageCache m_PageCaches[MaxPageCaches];
+
+    /** Number of pages with pin metadata, per bucket of page numbers. A
+     *  page whose bucket is zero has no metadata, so freePage can put it
+     *  straight into a page cache; otherwise the metadata has to be checked
+     *  under the lock. Only changed with m_Lock held. */
+    volatile uint32_t m_PinFilter[PinFilterSize];
+
     /** RangeList for the usable memory below 1MB */
     RangeList<uint32_t> m_RangeBelow1MB;
     /** RangeList for the usable memory below 16MB */
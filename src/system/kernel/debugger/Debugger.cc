@@ -45,6 +45,8 @@
 #include <HelpCommand.h>
 #include <LocksCommand.h>
 #include <MappingCommand.h>
+#include <ProfileCommand.h>
+#include <LockStatCommand.h>
 #include <process/Thread.h>
 #include <process/initialiseMultitasking.h>
 #include <machine/Machine.h>
@@ -104,7 +106,8 @@ void Debugger::initialise()
 /// \todo OZMFGBARBIE, this needs major cleanup. Look at the state of it!! :O
 void Debugger::start(InterruptState &state, LargeStaticString &description)
 {
-  Log::instance() << " << Flushing log content >>" << Flush;
+  NOTICE_NOLOCK(" << Flushing log content >>");
+  Log::instance().flush(false);
   static String graphicsService("graphics");
   
   // Drop out of whatever graphics mode we were in
@@ -193,6 +196,8 @@ void Debugger::start(InterruptState &state, LargeStaticString &description)
   static LookupCommand lookup;
   static HelpCommand help;
   static MappingCommand mapping;
+  static ProfileCommand profile;
+  static LockStatCommand lockStat;
 
 #if defined(THREADS)
   static ThreadsCommand threads;
@@ -201,9 +206,9 @@ void Debugger::start(InterruptState &state, LargeStaticString &description)
 #endif
 
 #if defined(THREADS)
-  size_t nCommands = 21;
+  size_t nCommands = 23;
 #else
-  size_t nCommands = 20;
+  size_t nCommands = 22;
 #endif
   DebuggerCommand *pCommands[] = {&syscallTracer,
                                   &disassembler,
@@ -227,7 +232,9 @@ void Debugger::start(InterruptState &state, LargeStaticString &description)
                                   &lookup,
                                   &help,
                                   &g_LocksCommand,
-                                  &mapping};
+                                  &mapping,
+                                  &profile,
+                                  &lockStat};
 
   // Are we going to jump directly into the tracer? In which case bypass device detection.
   int n = g_Trace.execTrace();
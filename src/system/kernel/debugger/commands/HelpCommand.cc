@@ -51,10 +51,12 @@ bool HelpCommand::execute(const HugeStaticString &input, HugeStaticString &outpu
     output += "panic            - Cause a system panic.\n";
     output += "quit             - Leave and continue execution.\n";
     output += "step             - Single step and reenter the debugger.\n";
-    output += "syscall          - Trace syscall execution times (stubbed).\n";
+    output += "syscall          - Show syscall counts and latencies.\n";
     output += "threads          - Inspect what each thread is doing.\n";
     output += "trace            - Graphical execution tracer.\n";
     output += "locks            - Show spinlock information.\n";
     output += "mapping          - Show V->P information for an effective addr.\n";
+    output += "profile          - Show where the sampling profiler found the CPUs.\n";
+    output += "lockstat         - Show lock contention statistics.\n";
     return true;
 }
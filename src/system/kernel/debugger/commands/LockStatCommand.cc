@@ -0,0 +1,272 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <LockStatCommand.h>
+#include <DebuggerIO.h>
+#include <linker/KernelElf.h>
+#include <utilities/demangle.h>
+#include <processor/Processor.h>
+#include <processor/VirtualAddressSpace.h>
+
+/** Where the figures start on each line. */
+#define LOCKSTAT_COLUMN 36
+
+/** Marks a line as being a lock rather than one of its call sites. */
+#define LOCKSTAT_LOCK_LINE 0xFF
+
+LockStatCommand::LockStatCommand() :
+  m_nLines(0)
+{
+}
+
+LockStatCommand::~LockStatCommand()
+{
+}
+
+void LockStatCommand::autocomplete(const HugeStaticString &input, HugeStaticString &output)
+{
+}
+
+bool LockStatCommand::execute(const HugeStaticString &input, HugeStaticString &output, InterruptState &state, DebuggerIO *pScreen)
+{
+#ifdef LOCK_STATS
+  if (input == "reset")
+  {
+    LockStats::reset();
+    output += "Lock statistics reset.\n";
+    return true;
+  }
+
+  // Order the locks by the time spent waiting for them (a selection sort,
+  // as nothing here may allocate).
+  static size_t entries[LockStats::MaxLocks];
+  size_t nEntries = 0;
+  for (size_t i = 0; i < LockStats::MaxLocks; i++)
+  {
+    if (LockStats::getEntry(i))
+      entries[nEntries++] = i;
+  }
+  for (size_t i = 0; i < nEntries; i++)
+  {
+    size_t best = i;
+    for (size_t j = i + 1; j < nEntries; j++)
+    {
+      if (LockStats::getEntry(entries[j])->waitTicks > LockStats::getEntry(entries[best])->waitTicks)
+        best = j;
+    }
+    size_t tmp = entries[i];
+    entries[i] = entries[best];
+    entries[best] = tmp;
+  }
+
+  m_nLines = 0;
+  for (size_t i = 0; i < nEntries; i++)
+  {
+    const LockStats::Entry *pEntry = LockStats::getEntry(entries[i]);
+    if (!pEntry)
+      continue;
+
+    m_Lines[m_nLines++] = (entries[i] << 8) | LOCKSTAT_LOCK_LINE;
+    for (size_t site = 0; site < LockStats::MaxCallSites; site++)
+    {
+      if (pEntry->sites[site].ra)
+        m_Lines[m_nLines++] = (entries[i] << 8) | site;
+    }
+  }
+
+  // Let's enter 'raw' screen mode.
+  pScreen->disableCli();
+
+  // Initialise the Scrollable class
+  move(0, 1);
+  resize(pScreen->getWidth(), pScreen->getHeight() - 2);
+  setScrollKeys('j', 'k');
+
+  // Clear the top status lines.
+  pScreen->drawHorizontalLine(' ',
+                             0,
+                             0,
+                             pScreen->getWidth() - 1,
+                             DebuggerIO::White,
+                             DebuggerIO::Green);
+
+  NormalStaticString title("Pedigree debugger - Lock Statistics (");
+  title.append(LockStats::getOverflow());
+  title += " untracked)";
+  pScreen->drawString(title, 0, 0, DebuggerIO::White, DebuggerIO::Green);
+
+  // Clear the bottom status lines.
+  pScreen->drawHorizontalLine(' ',
+                              pScreen->getHeight() - 1,
+                              0,
+                              pScreen->getWidth() - 1,
+                              DebuggerIO::White,
+                              DebuggerIO::Green);
+
+  // Explain the columns in the lower status line.
+  pScreen->drawString("calls, contended, mean/max wait, mean/max hold (ticks). q: Quit",
+                      pScreen->getHeight()-1, 0, DebuggerIO::White, DebuggerIO::Green);
+
+  // Main loop.
+  bool bStop = false;
+  while(!bStop)
+  {
+    refresh(pScreen);
+
+    // Wait for input.
+    char c = 0;
+    while( !(c=pScreen->getChar()) )
+      ;
+
+    if (c == 'j')
+      scroll(-1);
+    else if (c == 'k')
+      scroll(1);
+    else if (c == ' ')
+      scroll(static_cast<ssize_t>(height()));
+    else if (c == 0x08)
+      scroll(-static_cast<ssize_t>(height()));
+    else if (c == 'q')
+      bStop = true;
+  }
+
+  // HACK:: Serial connections will fill the screen with the last background colour used.
+  //        Here we write a space with black background so the CLI screen doesn't get filled
+  //        by some random colour!
+  pScreen->drawString(" ", 1, 0, DebuggerIO::White, DebuggerIO::Black);
+  pScreen->enableCli();
+#else
+  output += "Lock statistics aren't built in (build with lock_stats=1).\n";
+#endif
+
+  return true;
+}
+
+const char *LockStatCommand::getLine1(size_t index, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour)
+{
+  static LargeStaticString Line;
+  Line.clear();
+
+#ifdef LOCK_STATS
+  if (index >= m_nLines)
+    return Line;
+
+  const LockStats::Entry *pEntry = LockStats::getEntry(m_Lines[index] >> 8);
+  if (!pEntry)
+    return Line;
+
+  size_t site = m_Lines[index] & 0xFF;
+  if (site == LOCKSTAT_LOCK_LINE)
+  {
+    switch (pEntry->type)
+    {
+      case LockStats::SpinlockType:     Line += "Spinlock "; break;
+      case LockStats::MutexType:        Line += "Mutex "; break;
+      case LockStats::UnlikelyLockType: Line += "UnlikelyLock "; break;
+      default:                          Line += "Lock "; break;
+    }
+    Line += "0x";
+    Line.append(pEntry->lock, 16, sizeof(uintptr_t) * 2, '0');
+    colour = DebuggerIO::Yellow;
+    return Line;
+  }
+
+  // Call sites are named by function where they're in the kernel.
+  uintptr_t ra = pEntry->sites[site].ra;
+  const char *pSym = 0;
+  uintptr_t symStart = 0;
+  if (ra >= Processor::information().getVirtualAddressSpace().getKernelStart())
+    pSym = KernelElf::instance().globalLookupSymbol(ra, &symStart);
+
+  Line += "  ";
+  if (pSym)
+  {
+    static symbol_t symbol;
+    demangle(LargeStaticString(pSym), &symbol);
+    Line += static_cast<const char*>(symbol.name);
+    Line += "+0x";
+    Line.append(ra - symStart, 16);
+  }
+  else
+  {
+    Line += "0x";
+    Line.append(ra, 16);
+  }
+
+  // Leave room for the figures.
+  if (Line.length() > LOCKSTAT_COLUMN - 1)
+    Line.truncate(LOCKSTAT_COLUMN - 1);
+#endif
+
+  colour = DebuggerIO::White;
+  return Line;
+}
+
+const char *LockStatCommand::getLine2(size_t index, size_t &colOffset, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour)
+{
+  static LargeStaticString Line;
+  Line.clear();
+
+#ifdef LOCK_STATS
+  if (index >= m_nLines)
+    return Line;
+
+  const LockStats::Entry *pEntry = LockStats::getEntry(m_Lines[index] >> 8);
+  if (!pEntry)
+    return Line;
+
+  size_t site = m_Lines[index] & 0xFF;
+  if (site == LOCKSTAT_LOCK_LINE)
+  {
+    Line.append(pEntry->acquisitions);
+    Line += ", ";
+    Line.append(pEntry->contended);
+    Line += ", ";
+    Line.append(pEntry->contended ? pEntry->waitTicks / pEntry->contended : 0);
+    Line += "/";
+    Line.append(pEntry->maxWaitTicks);
+    Line += ", ";
+    Line.append(pEntry->acquisitions ? pEntry->holdTicks / pEntry->acquisitions : 0);
+    Line += "/";
+    Line.append(pEntry->maxHoldTicks);
+    colour = DebuggerIO::Yellow;
+  }
+  else
+  {
+    const LockStats::CallSite &callSite = pEntry->sites[site];
+    Line.append(callSite.acquisitions);
+    Line += ", ";
+    Line.append(callSite.contended);
+    Line += ", ";
+    Line.append(callSite.contended ? callSite.waitTicks / callSite.contended : 0);
+    Line += ", ";
+    Line.append(callSite.acquisitions ? callSite.holdTicks / callSite.acquisitions : 0);
+    colour = DebuggerIO::White;
+  }
+#endif
+
+  colOffset = LOCKSTAT_COLUMN;
+  return Line;
+}
+
+size_t LockStatCommand::getLineCount()
+{
+  return m_nLines;
+}
@@ -0,0 +1,79 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LOCKSTAT_COMMAND_H
+#define LOCKSTAT_COMMAND_H
+
+#include <DebuggerCommand.h>
+#include <Scrollable.h>
+#include <utilities/LockStats.h>
+
+/** @addtogroup kerneldebuggercommands
+ * @{ */
+
+/**
+ * Debugger command that lists the locks recorded by the LockStats, those
+ * waited for longest first, each followed by the call sites that acquired it
+ * most. "lockstat reset" clears the statistics.
+ */
+class LockStatCommand : public DebuggerCommand,
+                        public Scrollable
+{
+public:
+  LockStatCommand();
+  ~LockStatCommand();
+
+  /**
+   * Return an autocomplete string, given an input string.
+   */
+  void autocomplete(const HugeStaticString &input, HugeStaticString &output);
+
+  /**
+   * Execute the command with the given screen.
+   */
+  bool execute(const HugeStaticString &input, HugeStaticString &output, InterruptState &state, DebuggerIO *pScreen);
+
+  /**
+   * Returns the string representation of this command.
+   */
+  const NormalStaticString getString()
+  {
+    return NormalStaticString("lockstat");
+  }
+
+  //
+  // Scrollable interface
+  //
+  virtual const char *getLine1(size_t index, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour);
+  virtual const char *getLine2(size_t index, size_t &colOffset, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour);
+  virtual size_t getLineCount();
+
+private:
+#ifdef LOCK_STATS
+  /** Each line is a lock, as (entry << 8) | 0xFF, or one of its call sites,
+   *  as (entry << 8) | site. */
+  uint32_t m_Lines[LockStats::MaxLocks * (LockStats::MaxCallSites + 1)];
+#endif
+  size_t m_nLines;
+};
+
+/** @} */
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <ProfileCommand.h>
+#include <DebuggerIO.h>
+#include <linker/KernelElf.h>
+#include <utilities/demangle.h>
+#include <process/Profiler.h>
+#include <processor/Processor.h>
+#include <processor/VirtualAddressSpace.h>
+
+/** Number of functions shown. */
+#define PROFILE_TOP_FUNCTIONS 16
+
+ProfileCommand::ProfileCommand()
+{
+}
+
+ProfileCommand::~ProfileCommand()
+{
+}
+
+void ProfileCommand::autocomplete(const HugeStaticString &input, HugeStaticString &output)
+{
+}
+
+bool ProfileCommand::execute(const HugeStaticString &input, HugeStaticString &output, InterruptState &state, DebuggerIO *screen)
+{
+#if defined(THREADS)
+  Profiler &profiler = Profiler::instance();
+
+  size_t nSamples, nDropped;
+  profiler.getCounts(nSamples, nDropped);
+
+  output += "Profiler ";
+  output += profiler.isRunning() ? "running" : "stopped";
+  output += ": ";
+  output.append(nSamples);
+  output += " samples, ";
+  output.append(nDropped);
+  output += " dropped.\n";
+
+  uintptr_t functions[PROFILE_TOP_FUNCTIONS];
+  size_t counts[PROFILE_TOP_FUNCTIONS];
+  size_t n = profiler.topFunctions(functions, counts, PROFILE_TOP_FUNCTIONS);
+  for (size_t i = 0; i < n; ++i)
+  {
+    output.append(counts[i], 10, 6, ' ');
+    output += "  [";
+    output.append(functions[i], 16, sizeof(uintptr_t) * 2, '0');
+    output += "] ";
+
+    // User functions are only known by page.
+    const char *pSym = 0;
+    if (functions[i] >= Processor::information().getVirtualAddressSpace().getKernelStart())
+      pSym = KernelElf::instance().globalLookupSymbol(functions[i]);
+    if (pSym)
+    {
+      static symbol_t symbol;
+      demangle(LargeStaticString(pSym), &symbol);
+      output += static_cast<const char*>(symbol.name);
+    }
+    else
+      output += "(user)";
+    output += "\n";
+  }
+#else
+  output += "No profiler without threads.\n";
+#endif
+
+  return true;
+}
+
+const NormalStaticString ProfileCommand::getString()
+{
+  return NormalStaticString("profile");
+}
@@ -18,14 +18,42 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <processor/Processor.h>
+#ifndef PROFILE_COMMAND_H
+#define PROFILE_COMMAND_H
 
-class SyscallTracer
+#include <DebuggerCommand.h>
+
+/** @addtogroup kerneldebuggercommands
+ * @{ */
+
+class DebuggerIO;
+
+/**
+ * Debugger command that shows the functions the profiler caught the CPUs
+ * in most often. The full stacks are available from /dev/profile.
+ */
+class ProfileCommand : public DebuggerCommand
 {
 public:
+  ProfileCommand();
+  ~ProfileCommand();
+
   /**
-   * Creates a new SyscallTracer object.
+   * Return an autocomplete string, given an input string.
    */
-  SyscallTracer(const char* pfileName, const char* pFnName, int line);
-  ~SyscallTracer();
+  void autocomplete(const HugeStaticString &input, HugeStaticString &output);
+
+  /**
+   * Execute the command with the given screen.
+   */
+  bool execute(const HugeStaticString &input, HugeStaticString &output, InterruptState &state, DebuggerIO *screen);
+
+  /**
+   * Returns the string representation of this command.
+   */
+  const NormalStaticString getString();
 };
+
+/** @} */
+
+#endif
@@ -20,7 +20,8 @@
 
 #include "SyscallTracerCommand.h"
 
-SyscallTracerCommand::SyscallTracerCommand()
+SyscallTracerCommand::SyscallTracerCommand() :
+  m_nSyscalls(0)
 {
 
 }
@@ -37,6 +38,19 @@ void SyscallTracerCommand::autocomplete(const HugeStaticString &input, HugeStati
 
 bool SyscallTracerCommand::execute(const HugeStaticString &input, HugeStaticString &output, InterruptState &state, DebuggerIO *pScreen)
 {
+  // Find the syscalls that have been made.
+  m_nSyscalls = 0;
+  for (size_t service = 0; service < serviceEnd; service++)
+  {
+    for (size_t number = 0; number < SYSCALL_TRACER_MAX_SYSCALLS; number++)
+    {
+      SyscallStatistics stats;
+      SyscallTracer::instance().getStatistics(service, number, stats);
+      if (stats.count)
+        m_Syscalls[m_nSyscalls++] = (service << 16) | number;
+    }
+  }
+
   // Let's enter 'raw' screen mode.
   pScreen->disableCli();
 
@@ -54,12 +68,26 @@ bool SyscallTracerCommand::execute(const HugeStaticString &input, HugeStaticStri
                              DebuggerIO::Green);
 
   // Write the correct text in the upper status line.
-  pScreen->drawString("Pedigree debugger - System Call Tracer",
+  pScreen->drawString(SyscallTracer::instance().isEnabled() ?
+                        "Pedigree debugger - System Call Tracer (enabled)" :
+                        "Pedigree debugger - System Call Tracer (disabled: write 'enable' to /dev/syscalls)",
                      0,
                      0,
                      DebuggerIO::White,
                      DebuggerIO::Green);
 
+  // Clear the bottom status lines.
+  pScreen->drawHorizontalLine(' ',
+                              pScreen->getHeight() - 1,
+                              0,
+                              pScreen->getWidth() - 1,
+                              DebuggerIO::White,
+                              DebuggerIO::Green);
+
+  // Explain the columns in the lower status line.
+  pScreen->drawString("service number: calls, mean ticks, log2(ticks):calls... q: Quit",
+                      pScreen->getHeight()-1, 0, DebuggerIO::White, DebuggerIO::Green);
+
   // Main loop.
   bool bStop = false;
   while(!bStop)
@@ -71,25 +99,78 @@ bool SyscallTracerCommand::execute(const HugeStaticString &input, HugeStaticStri
     while( !(c=pScreen->getChar()) )
       ;
 
-    if (c == 'q')
-          bStop = true;
+    if (c == 'j')
+      scroll(-1);
+    else if (c == 'k')
+      scroll(1);
+    else if (c == ' ')
+      scroll(static_cast<ssize_t>(height()));
+    else if (c == 0x08)
+      scroll(-static_cast<ssize_t>(height()));
+    else if (c == 'q')
+      bStop = true;
   }
 
+  // HACK:: Serial connections will fill the screen with the last background colour used.
+  //        Here we write a space with black background so the CLI screen doesn't get filled
+  //        by some random colour!
+  pScreen->drawString(" ", 1, 0, DebuggerIO::White, DebuggerIO::Black);
+  pScreen->enableCli();
+
   //  Return to the debugger
   return(true);
 }
 
 const char *SyscallTracerCommand::getLine1(size_t index, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour)
 {
-  return(0);
+  static NormalStaticString Line;
+  Line.clear();
+
+  if (index >= m_nSyscalls)
+    return Line;
+
+  Line += SyscallTracer::serviceName(m_Syscalls[index] >> 16);
+  Line += " ";
+  Line.append(m_Syscalls[index] & 0xFFFF);
+  Line += ":";
+
+  colour = DebuggerIO::Yellow;
+  return Line;
 }
 
 const char *SyscallTracerCommand::getLine2(size_t index, size_t &colOffset, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour)
 {
-  return(0);
+  static LargeStaticString Line;
+  Line.clear();
+
+  if (index >= m_nSyscalls)
+    return Line;
+
+  SyscallStatistics stats;
+  SyscallTracer::instance().getStatistics(m_Syscalls[index] >> 16, m_Syscalls[index] & 0xFFFF, stats);
+  if (!stats.count)
+    return Line;
+
+  Line.append(stats.count);
+  Line += ", ";
+  Line.append(stats.ticks / stats.count);
+  Line += ",";
+  for (size_t b = 0; b < SYSCALL_TRACER_BUCKETS; b++)
+  {
+    if (!stats.histogram[b])
+      continue;
+    Line += " ";
+    Line.append(b);
+    Line += ":";
+    Line.append(stats.histogram[b]);
+  }
+
+  colour = DebuggerIO::White;
+  colOffset = 16;
+  return Line;
 }
 
 size_t SyscallTracerCommand::getLineCount()
 {
-  return(0);
+  return m_nSyscalls;
 }
@@ -19,6 +19,7 @@
  */
 
 #include <processor/Processor.h>
+#include <processor/SyscallTracer.h>
 #include <DebuggerCommand.h>
 #include <Scrollable.h>
 #include <Log.h>
@@ -28,7 +29,7 @@ class SyscallTracerCommand :  public DebuggerCommand,
 {
 public:
   /**
-   * Creates a new SyscallTracer object.
+   * Shows the system-wide statistics collected by the SyscallTracer.
    */
   SyscallTracerCommand();
   ~SyscallTracerCommand();
@@ -61,4 +62,9 @@ public:
   virtual const char *getLine1(size_t index, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour);
   virtual const char *getLine2(size_t index, size_t &colOffset, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour);
   virtual size_t getLineCount();
+
+private:
+  /** The syscalls with statistics, as (service << 16) | number. */
+  uint32_t m_Syscalls[serviceEnd * SYSCALL_TRACER_MAX_SYSCALLS];
+  size_t m_nSyscalls;
 };
@@ -23,8 +23,19 @@
 #include <processor/VirtualAddressSpace.h>
 #include <processor/PhysicalMemoryManager.h>
 #include <utilities/MemoryTracing.h>
+#include <machine/Machine.h>
+#include <machine/Timer.h>
+#include <process/Thread.h>
+#include <process/Semaphore.h>
+#include <LockGuard.h>
+#include <utilities/Tree.h>
 #include <Log.h>
 
+/// Number of threads executing module entry points during executeModules().
+/// Most module initialisation time is spent sleeping on hardware, so this
+/// needn't match the number of processors.
+#define MODULE_WORKER_THREADS   4
+
 KernelElf KernelElf::m_Instance;
 
 /**
@@ -235,6 +246,9 @@ KernelElf::KernelElf() :
     m_AdditionalSectionHeaders(0),
 #endif
     m_Modules(), m_LoadedModules(), m_FailedModules(), m_PendingModules(), m_ModuleAllocator(),
+#ifdef THREADS
+    m_ModuleLock(false),
+#endif
     m_pSectionHeaders(0), m_pSymbolTable(0)
 {
 }
@@ -255,6 +269,23 @@ KernelElf::~KernelElf()
 #define MOD_LEN 0x400000
 
 Module *KernelElf::loadModule(uint8_t *pModule, size_t len, bool silent)
+{
+    Module *module = createModule(pModule, len, silent);
+    if (!module)
+        return 0;
+
+    return runOrDeferModule(module, silent);
+}
+
+Module *KernelElf::preloadModule(uint8_t *pModule, size_t len, bool silent)
+{
+    Module *module = createModule(pModule, len, silent);
+    if (module)
+        m_PendingModules.pushBack(module);
+    return module;
+}
+
+Module *KernelElf::createModule(uint8_t *pModule, size_t len, bool silent)
 {
     // The module memory allocator requires dynamic memory - this isn't initialised until after our constructor
     // is called, so check here if we've loaded any modules yet. If not, we can initialise our memory allocator.
@@ -326,10 +357,16 @@ Module *KernelElf::loadModule(uint8_t *pModule, size_t len, bool silent)
 
     m_Modules.pushBack(module);
 
+    return module;
+}
+
+Module *KernelElf::runOrDeferModule(Module *module, bool silent)
+{
     // Can we load this module yet?
     if (moduleDependenciesSatisfied(module))
     {
-        executeModule(module);
+        if(!executeModule(module))
+            module = 0;
 
         g_BootProgressCurrent ++;
         if (g_BootProgressUpdate && !silent)
@@ -346,8 +383,7 @@ Module *KernelElf::loadModule(uint8_t *pModule, size_t len, bool silent)
             {
                 if (moduleDependenciesSatisfied(*it))
                 {
-                    if(!executeModule(*it))
-                        module = 0;
+                    executeModule(*it);
 
                     g_BootProgressCurrent ++;
                     if (g_BootProgressUpdate && !silent)
@@ -370,6 +406,18 @@ Module *KernelElf::loadModule(uint8_t *pModule, size_t len, bool silent)
 
 #ifdef STATIC_DRIVERS
 Module *KernelElf::loadModule(struct ModuleInfo *info, bool silent)
+{
+    return runOrDeferModule(createModule(info, silent), silent);
+}
+
+Module *KernelElf::preloadModule(struct ModuleInfo *info, bool silent)
+{
+    Module *module = createModule(info, silent);
+    m_PendingModules.pushBack(module);
+    return module;
+}
+
+Module *KernelElf::createModule(struct ModuleInfo *info, bool silent)
 {
     Module *module = new Module;
 
@@ -388,67 +436,33 @@ Module *KernelElf::loadModule(struct ModuleInfo *info, bool silent)
 
     m_Modules.pushBack(module);
 
-    // Can we load this module yet?
-    if (moduleDependenciesSatisfied(module))
-    {
-        executeModule(module);
-
-        g_BootProgressCurrent ++;
-        if (g_BootProgressUpdate && !silent)
-            g_BootProgressUpdate("moduleexec");
-
-        // Now check if we've allowed any currently pending modules to load.
-        bool somethingLoaded = true;
-        while (somethingLoaded)
-        {
-            somethingLoaded = false;
-            for (Vector<Module*>::Iterator it = m_PendingModules.begin();
-                it != m_PendingModules.end();
-                )
-            {
-                if (moduleDependenciesSatisfied(*it))
-                {
-                    executeModule(*it);
-                    g_BootProgressCurrent ++;
-                    if (g_BootProgressUpdate && !silent)
-                        g_BootProgressUpdate("moduleexec");
-
-                    it = m_PendingModules.erase(it);
-                    somethingLoaded = true;
-                    break;
-                }
-                else
-                    ++it;
-            }
-        }
-    }
-    else
-    {
-        m_PendingModules.pushBack(module);
-    }
-
     return module;
 }
 #endif
 
 void KernelElf::unloadModule(const char *name, bool silent, bool progress)
 {
-    for (Vector<Module*>::Iterator it = m_LoadedModules.begin();
-        it != m_LoadedModules.end();
-        it++)
-    {
-        if(!strcmp((*it)->name, name))
-        {
-            unloadModule(it, silent, progress);
-            return;
-        }
-    }
-    ERROR("KERNELELF: Module " << name << " not found");
+#ifdef THREADS
+    m_ModuleLock.acquire();
+#endif
+    Module *module = findModule(m_LoadedModules, name);
+#ifdef THREADS
+    m_ModuleLock.release();
+#endif
+
+    if (module)
+        unloadModule(module, silent, progress);
+    else
+        ERROR("KERNELELF: Module " << name << " not found");
 }
 
 void KernelElf::unloadModule(Vector<Module*>::Iterator it, bool silent, bool progress)
 {
-    Module *module = *it;
+    unloadModule(*it, silent, progress);
+}
+
+void KernelElf::unloadModule(Module *module, bool silent, bool progress)
+{
     NOTICE("KERNELELF: Unloading module " << module->name);
 
     if(progress)
@@ -476,8 +490,6 @@ void KernelElf::unloadModule(Vector<Module*>::Iterator it, bool silent, bool pro
         }
     }
 
-    m_SymbolTable.eraseByElf(&module->elf);
-
     if(progress)
     {
         g_BootProgressCurrent --;
@@ -485,7 +497,24 @@ void KernelElf::unloadModule(Vector<Module*>::Iterator it, bool silent, bool pro
             g_BootProgressUpdate("moduleunloaded");
     }
 
-    m_LoadedModules.erase(it);
+#ifdef THREADS
+    m_ModuleLock.acquire();
+#endif
+
+    m_SymbolTable.eraseByElf(&module->elf);
+
+    // Other modules may have been added to the list while this one's exit
+    // function ran, so find it again.
+    for (Vector<Module*>::Iterator it = m_LoadedModules.begin();
+        it != m_LoadedModules.end();
+        it++)
+    {
+        if (*it == module)
+        {
+            m_LoadedModules.erase(it);
+            break;
+        }
+    }
     //m_Modules.erase(it);
 
     NOTICE("KERNELELF: Module " << module->name << " unloaded.");
@@ -513,6 +542,10 @@ void KernelElf::unloadModule(Vector<Module*>::Iterator it, bool silent, bool pro
 
     m_ModuleAllocator.free(module->loadBase, module->loadSize);
 
+#ifdef THREADS
+    m_ModuleLock.release();
+#endif
+
     delete module;
 }
 
@@ -625,12 +658,19 @@ bool KernelElf::moduleDependenciesSatisfied(Module *module)
 
 bool KernelElf::executeModule(Module *module)
 {
+#ifdef THREADS
+    m_ModuleLock.acquire();
+#endif
+
     m_LoadedModules.pushBack(module);
 
     if(module->buffer)
     {
         if (!module->elf.finaliseModule(module->buffer, module->buflen))
         {
+#ifdef THREADS
+            m_ModuleLock.release();
+#endif
             FATAL ("KERNELELF: Module relocation failed");
             return false;
         }
@@ -651,23 +691,285 @@ bool KernelElf::executeModule(Module *module)
         }
     }
 
+#ifdef THREADS
+    // The entry point itself may run alongside other modules' entry points.
+    m_ModuleLock.release();
+#endif
+
     NOTICE("KERNELELF: Executing module " << module->name);
 
+    Timer *pTimer = Machine::instance().getTimer();
+    uint64_t startTime = pTimer ? pTimer->getTickCount() : 0;
+
     bool bSuccess = true;
     if (module->entry)
+        bSuccess = module->entry();
+
+    module->initTime = pTimer ? pTimer->getTickCount() - startTime : 0;
+
+    if(!bSuccess)
     {
-        if(!(bSuccess = module->entry()))
+        NOTICE("KERNELELF: Module " << module->name << " failed, unloading.");
+
+#ifdef THREADS
+        m_ModuleLock.acquire();
+#endif
+        m_FailedModules.pushBack(new String(module->name));
+#ifdef THREADS
+        m_ModuleLock.release();
+#endif
+        unloadModule(module, true, false);
+    }
+    else
+        NOTICE("KERNELELF: Module " << module->name << " finished executing (" << Dec << module->initTime << Hex << " ms)");
+
+    return bSuccess;
+}
+
+Module *KernelElf::findModule(Vector<Module*> &list, const char *name)
+{
+    for (Vector<Module*>::Iterator it = list.begin(); it != list.end(); it++)
+    {
+        if (!strcmp((*it)->name, name))
+            return *it;
+    }
+    return 0;
+}
+
+/** State shared between the threads executing one batch of modules. */
+struct KernelElf::ModuleBatch
+{
+    ModuleBatch() :
+#ifdef THREADS
+        lock(false), work(0), done(0),
+#endif
+        ready(), executed(), nRunning(0), silent(false)
+    {}
+
+    /** Takes the batch lock. */
+    void acquire()
+    {
+#ifdef THREADS
+        lock.acquire();
+#endif
+    }
+
+    /** Releases the batch lock. */
+    void release()
+    {
+#ifdef THREADS
+        lock.release();
+#endif
+    }
+
+#ifdef THREADS
+    /** Protects everything else in the batch. */
+    Mutex lock;
+    /** One unit per ready module, plus one per worker once the batch ends. */
+    Semaphore work;
+    /** Released by each worker as it exits. */
+    Semaphore done;
+#endif
+
+    /** Modules whose in-batch dependencies have all been executed. */
+    List<Module*> ready;
+    /** Modules that have been handed to a worker (and may since be freed). */
+    Tree<Module*, Module*> executed;
+    /** Number of modules currently executing. */
+    size_t nRunning;
+
+    bool silent;
+};
+
+int KernelElf::moduleWorker(void *p)
+{
+    ModuleBatch *pBatch = reinterpret_cast<ModuleBatch*>(p);
+    KernelElf &kernelElf = KernelElf::instance();
+
+    while (true)
+    {
+#ifdef THREADS
+        pBatch->work.acquire();
+#endif
+
+        pBatch->acquire();
+        if (!pBatch->ready.count())
         {
-            NOTICE("KERNELELF: Module " << module->name << " failed, unloading.");
-            m_FailedModules.pushBack(new String(module->name));
-            unloadModule(module->name, true, false);
+            // Nothing left that can ever become ready.
+            pBatch->release();
+            break;
         }
+
+        Module *module = pBatch->ready.popFront();
+        pBatch->executed.insert(module, module);
+        ++pBatch->nRunning;
+
+        // A module that fails is unloaded and freed by executeModule, so
+        // take what we need from it first.
+        String name(module->name);
+        Vector<Module*> dependents = module->dependents;
+        pBatch->release();
+
+        bool bSuccess = kernelElf.executeModule(module);
+
+        pBatch->acquire();
+        --pBatch->nRunning;
+        kernelElf.moduleFinished(pBatch, name, dependents, bSuccess);
+        pBatch->release();
     }
 
-    if(bSuccess)
-        NOTICE("KERNELELF: Module " << module->name << " finished executing");
+#ifdef THREADS
+    pBatch->done.release();
+#endif
+    return 0;
+}
+
+void KernelElf::moduleFinished(ModuleBatch *pBatch, const String &name, Vector<Module*> &dependents, bool bSuccess)
+{
+    g_BootProgressCurrent ++;
+    if (g_BootProgressUpdate && !pBatch->silent)
+        g_BootProgressUpdate("moduleexec");
 
-    return bSuccess;
+    for (Vector<Module*>::Iterator it = dependents.begin();
+         it != dependents.end();
+         it++)
+    {
+        Module *pDependent = *it;
+
+        // A failed mandatory dependency leaves the dependent blocked; a failed
+        // optional dependency still counts as having been attempted.
+        if (!bSuccess && dependsOn(pDependent, name))
+            continue;
+
+        if (--pDependent->nPendingDepends == 0)
+        {
+            pBatch->ready.pushBack(pDependent);
+#ifdef THREADS
+            pBatch->work.release();
+#endif
+        }
+    }
+
+#ifdef THREADS
+    // Once nothing is ready or running, nothing else can become ready: let
+    // every worker finish.
+    if (!pBatch->ready.count() && !pBatch->nRunning)
+        pBatch->work.release(MODULE_WORKER_THREADS);
+#endif
+}
+
+bool KernelElf::dependsOn(Module *module, const char *name)
+{
+    if (!module->depends)
+        return false;
+
+    for (size_t i = 0; module->depends[i]; ++i)
+    {
+        if (!strcmp(module->depends[i], name))
+            return true;
+    }
+    return false;
+}
+
+void KernelElf::executeModules(bool silent)
+{
+    Timer *pTimer = Machine::instance().getTimer();
+    uint64_t startTime = pTimer ? pTimer->getTickCount() : 0;
+
+    // Take the whole set of preloaded modules as this batch.
+    Vector<Module*> batch;
+    for (Vector<Module*>::Iterator it = m_PendingModules.begin();
+         it != m_PendingModules.end();
+         it++)
+    {
+        (*it)->nPendingDepends = 0;
+        (*it)->dependents.clear();
+        batch.pushBack(*it);
+    }
+    m_PendingModules.clear();
+
+    // Build the dependency graph. Edges only exist between modules in the
+    // batch; anything already loaded is satisfied, and mandatory dependencies
+    // that are nowhere to be found leave the module blocked.
+    ModuleBatch state;
+    state.silent = silent;
+    Module *pLastUndeclared = 0;
+    for (Vector<Module*>::Iterator it = batch.begin(); it != batch.end(); it++)
+    {
+        Module *module = *it;
+
+        // A module that declares no dependencies at all may still rely on
+        // the ones preloaded before it having run, as they always used to.
+        // Chain these together so they keep running one at a time, in order;
+        // like an optional dependency, one failing doesn't block the next.
+        if ((!module->depends || !module->depends[0]) &&
+            (!module->depends_opt || !module->depends_opt[0]))
+        {
+            if (pLastUndeclared)
+            {
+                pLastUndeclared->dependents.pushBack(module);
+                ++module->nPendingDepends;
+            }
+            pLastUndeclared = module;
+        }
+
+        for (size_t i = 0; module->depends && module->depends[i]; ++i)
+        {
+            if (findModule(m_LoadedModules, module->depends[i]))
+                continue;
+
+            Module *pDependency = findModule(batch, module->depends[i]);
+            if (pDependency)
+                pDependency->dependents.pushBack(module);
+            else
+                WARNING("KERNELELF: Module " << module->name << " depends on missing module " << module->depends[i]);
+
+            ++module->nPendingDepends;
+        }
+
+        // Optional dependencies only order the batch - if they aren't part of
+        // it, they're not waited for.
+        for (size_t i = 0; module->depends_opt && module->depends_opt[i]; ++i)
+        {
+            Module *pDependency = findModule(batch, module->depends_opt[i]);
+            if (pDependency && pDependency != module)
+            {
+                pDependency->dependents.pushBack(module);
+                ++module->nPendingDepends;
+            }
+        }
+
+        if (!module->nPendingDepends)
+            state.ready.pushBack(module);
+    }
+
+#ifdef THREADS
+    state.work.release(state.ready.count() ? state.ready.count() : MODULE_WORKER_THREADS);
+
+    Process *pProcess = Processor::information().getCurrentThread()->getParent();
+    for (size_t i = 0; i < MODULE_WORKER_THREADS; ++i)
+    {
+        Thread *pThread = new Thread(pProcess, &moduleWorker, reinterpret_cast<void*>(&state));
+        pThread->detach();
+    }
+
+    state.done.acquire(MODULE_WORKER_THREADS);
+#else
+    moduleWorker(&state);
+#endif
+
+    // Anything still blocked waits for its dependencies as before.
+    for (Vector<Module*>::Iterator it = batch.begin(); it != batch.end(); it++)
+    {
+        if (!state.executed.lookup(*it))
+        {
+            WARNING("KERNELELF: Module " << (*it)->name << " could not be executed - dependencies not met.");
+            m_PendingModules.pushBack(*it);
+        }
+    }
+
+    uint64_t totalTime = pTimer ? pTimer->getTickCount() - startTime : 0;
+    NOTICE("KERNELELF: Executed " << Dec << batch.count() << " modules in " << totalTime << Hex << " ms");
 }
 
 uintptr_t KernelElf::globalLookupSymbol(const char *pName)
@@ -27,6 +27,7 @@
 #include <processor/PhysicalMemoryManager.h>
 #include <machine/Machine.h>
 #include <processor/InterruptManager.h>
+#include <process/Profiler.h>
 
 #define LAPIC_REG_ID                                    0x0020
 #define LAPIC_REG_VERSION                               0x0030
@@ -179,8 +180,20 @@ void LocalApic::interrupt(size_t nInterruptNumber, InterruptState &state)
 {
   if (nInterruptNumber == TIMER_VECTOR)
   {
+    bool bSchedulerTick = true;
+
+#if defined(THREADS)
+    // While the profiler is running the timer goes getRate() times as fast,
+    // and only every getRate()'th tick goes on to the scheduler.
+    Profiler &profiler = Profiler::instance();
+    uint32_t initialCount = INITIAL_COUNT_VALUE / profiler.getRate();
+    if (UNLIKELY(m_IoSpace.read32(LAPIC_REG_INITIAL_COUNT) != initialCount))
+      m_IoSpace.write32(initialCount, LAPIC_REG_INITIAL_COUNT);
+    bSchedulerTick = profiler.oversample(state);
+#endif
+
     // TODO: Delta is wrong.
-    if (LIKELY(m_Handler != 0))
+    if (LIKELY(m_Handler != 0) && bSchedulerTick)
     {
       // NOTICE("Timer " << Processor::id());
       m_Handler->timer (0, state);
@@ -30,6 +30,7 @@
 #include <processor/state.h>
 #include <processor/InterruptHandler.h>
 
+#define IPI_TLB_VECTOR                                  0xFA
 #define IPI_HALT_VECTOR                                 0xFB
 #define ERROR_VECTOR                                    0xFC
 #define SPURIOUS_VECTOR                                 0xFD
@@ -26,7 +26,6 @@
 #include <machine/Machine.h>
 
 MemoryAllocator Cache::m_Allocator;
-Spinlock Cache::m_AllocatorLock;
 static bool g_AllocatorInited = false;
 
 CacheManager CacheManager::m_Instance;
@@ -142,6 +141,8 @@ Cache::Cache() :
 #else
         #error Implement your architecture memory map area for caches into Cache::Cache
 #endif
+        // Nearly everything in the cache is a single page.
+        m_Allocator.enableQuantumCache(4096);
         g_AllocatorInited = true;
     }
 
@@ -197,10 +198,8 @@ uintptr_t Cache::insert (uintptr_t key)
         return pPage->location;
     }
 
-    m_AllocatorLock.acquire();
     uintptr_t location;
     bool succeeded = m_Allocator.allocate(4096, location);
-    m_AllocatorLock.release();
 
     if (!succeeded)
     {
@@ -249,10 +248,8 @@ uintptr_t Cache::insert (uintptr_t key, size_t size)
     }
 
     // Nope, so let's allocate this block
-    m_AllocatorLock.acquire();
     uintptr_t location;
     bool succeeded = m_Allocator.allocate(size, location);
-    m_AllocatorLock.release();
 
     if (!succeeded)
     {
@@ -0,0 +1,193 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef LOCK_STATS
+
+#include <utilities/LockStats.h>
+#include <utilities/utility.h>
+
+/** Entries looked at for a lock before giving up on it. */
+#define LOCK_STATS_MAX_PROBES 128
+
+/** Entry::lock of an entry whose lock was destroyed. Lookups probe past it,
+ *  as the lock they are after may have been placed after it, but it can be
+ *  claimed again. */
+#define LOCK_STATS_DELETED static_cast<uintptr_t>(~0UL)
+
+LockStats::Entry LockStats::m_Entries[LockStats::MaxLocks];
+volatile size_t LockStats::m_Overflow = 0;
+
+static void atomicMax(uint64_t *pValue, uint64_t value)
+{
+    uint64_t old = *pValue;
+    while (value > old)
+    {
+        if (__sync_bool_compare_and_swap(pValue, old, value))
+            break;
+        old = *pValue;
+    }
+}
+
+/** Claims an entry for a lock, unless another CPU just claimed it for
+ *  another one. */
+static bool claim(LockStats::Entry *pEntry, uintptr_t from, uintptr_t key)
+{
+    return __sync_bool_compare_and_swap(&pEntry->lock, from, key) || (pEntry->lock == key);
+}
+
+LockStats::Entry *LockStats::lookup(const void *pLock, bool bClaim)
+{
+    uintptr_t key = reinterpret_cast<uintptr_t>(pLock);
+    size_t i = ((key >> 3) * 0x9E3779B1UL) % MaxLocks;
+
+    Entry *pDeleted = 0;
+    for (size_t n = 0; n < LOCK_STATS_MAX_PROBES; ++n, i = (i + 1) % MaxLocks)
+    {
+        Entry *pEntry = &m_Entries[i];
+        uintptr_t current = pEntry->lock;
+        if (current == key)
+            return pEntry;
+        if (current == LOCK_STATS_DELETED)
+        {
+            if (!pDeleted)
+                pDeleted = pEntry;
+            continue;
+        }
+        if (current)
+            continue;
+
+        // Free, so the lock has no entry: claim one.
+        if (!bClaim)
+            return 0;
+        if (pDeleted && claim(pDeleted, LOCK_STATS_DELETED, key))
+            return pDeleted;
+        if (claim(pEntry, 0, key))
+            return pEntry;
+    }
+
+    if (bClaim && pDeleted && claim(pDeleted, LOCK_STATS_DELETED, key))
+        return pDeleted;
+
+    return 0;
+}
+
+LockStats::CallSite *LockStats::lookupSite(Entry *pEntry, uintptr_t ra)
+{
+    for (size_t i = 0; i < MaxCallSites; ++i)
+    {
+        if (pEntry->sites[i].ra == ra)
+            return &pEntry->sites[i];
+    }
+
+    for (size_t i = 0; i < MaxCallSites; ++i)
+    {
+        if (!pEntry->sites[i].ra &&
+            (__sync_bool_compare_and_swap(&pEntry->sites[i].ra, 0, ra) || (pEntry->sites[i].ra == ra)))
+            return &pEntry->sites[i];
+    }
+
+    // All taken: the new call site replaces the least used one and inherits
+    // its figures (the "space-saving" method), so a busy call site will
+    // overtake the others however late it first appears.
+    CallSite *pMin = &pEntry->sites[0];
+    for (size_t i = 1; i < MaxCallSites; ++i)
+    {
+        if (pEntry->sites[i].acquisitions < pMin->acquisitions)
+            pMin = &pEntry->sites[i];
+    }
+    pMin->ra = ra;
+    return pMin;
+}
+
+void LockStats::acquired(const void *pLock, LockType type, uintptr_t ra,
+                         bool bContended, uint64_t waitTicks)
+{
+    Entry *pEntry = lookup(pLock, true);
+    if (!pEntry)
+    {
+        __sync_fetch_and_add(&m_Overflow, 1);
+        return;
+    }
+
+    pEntry->type = type;
+    __sync_fetch_and_add(&pEntry->acquisitions, 1);
+    if (bContended)
+    {
+        __sync_fetch_and_add(&pEntry->contended, 1);
+        __sync_fetch_and_add(&pEntry->waitTicks, waitTicks);
+        atomicMax(&pEntry->maxWaitTicks, waitTicks);
+    }
+
+    CallSite *pSite = lookupSite(pEntry, ra);
+    __sync_fetch_and_add(&pSite->acquisitions, 1);
+    if (bContended)
+    {
+        __sync_fetch_and_add(&pSite->contended, 1);
+        __sync_fetch_and_add(&pSite->waitTicks, waitTicks);
+    }
+}
+
+void LockStats::released(const void *pLock, uintptr_t ra, uint64_t holdTicks)
+{
+    Entry *pEntry = lookup(pLock, false);
+    if (!pEntry)
+        return;
+
+    __sync_fetch_and_add(&pEntry->holdTicks, holdTicks);
+    atomicMax(&pEntry->maxHoldTicks, holdTicks);
+
+    CallSite *pSite = lookupSite(pEntry, ra);
+    __sync_fetch_and_add(&pSite->holdTicks, holdTicks);
+}
+
+void LockStats::destroyed(const void *pLock)
+{
+    Entry *pEntry = lookup(pLock, false);
+    if (!pEntry)
+        return;
+
+    // Nothing else uses a lock being destroyed, so its figures can be
+    // cleared before the entry is given up for another lock to claim.
+    pEntry->type = NotALock;
+    pEntry->acquisitions = 0;
+    pEntry->contended = 0;
+    pEntry->waitTicks = 0;
+    pEntry->holdTicks = 0;
+    pEntry->maxWaitTicks = 0;
+    pEntry->maxHoldTicks = 0;
+    memset(pEntry->sites, 0, sizeof(pEntry->sites));
+    __sync_synchronize();
+    pEntry->lock = LOCK_STATS_DELETED;
+}
+
+const LockStats::Entry *LockStats::getEntry(size_t i)
+{
+    if ((i >= MaxLocks) || !m_Entries[i].lock || (m_Entries[i].lock == LOCK_STATS_DELETED))
+        return 0;
+    return &m_Entries[i];
+}
+
+void LockStats::reset()
+{
+    memset(m_Entries, 0, sizeof(m_Entries));
+    m_Overflow = 0;
+}
+
+#endif
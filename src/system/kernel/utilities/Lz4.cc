@@ -0,0 +1,223 @@
+/*
+ * 
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <utilities/Lz4.h>
+#include <utilities/utility.h>
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline size_t hash(uint32_t sequence)
+{
+    // Knuth's multiplicative hash, keeping the top 12 bits.
+    return (sequence * 2654435761U) >> 20;
+}
+
+uint8_t *Lz4::putLength(uint8_t *pOut, size_t length)
+{
+    length -= 15;
+    while (length >= 255)
+    {
+        *pOut++ = 255;
+        length -= 255;
+    }
+    *pOut++ = length;
+    return pOut;
+}
+
+uint8_t *Lz4::putSequence(uint8_t *pOut, uint8_t *pEnd,
+                          const uint8_t *pLiterals, size_t nLiterals,
+                          size_t offset, size_t matchLength)
+{
+    // Token, literal length, literals, offset and match length, at most.
+    size_t worst = 1 + (nLiterals / 255 + 1) + nLiterals;
+    if (matchLength)
+        worst += 2 + (matchLength / 255 + 1);
+    if (worst > static_cast<size_t>(pEnd - pOut))
+        return 0;
+
+    uint8_t *pToken = pOut++;
+    *pToken = ((nLiterals < 15) ? nLiterals : 15) << 4;
+    if (nLiterals >= 15)
+        pOut = putLength(pOut, nLiterals);
+    memcpy(pOut, pLiterals, nLiterals);
+    pOut += nLiterals;
+
+    if (!matchLength)
+        return pOut;
+
+    *pOut++ = offset & 0xFF;
+    *pOut++ = offset >> 8;
+
+    matchLength -= MinMatch;
+    *pToken |= (matchLength < 15) ? matchLength : 15;
+    if (matchLength >= 15)
+        pOut = putLength(pOut, matchLength);
+
+    return pOut;
+}
+
+size_t Lz4::compress(const void *pSource, size_t length,
+                     void *pDest, size_t destLength,
+                     uint16_t *pHashTable)
+{
+    if (length > MaxInputLength)
+        return 0;
+
+    const uint8_t *pBase = reinterpret_cast<const uint8_t*>(pSource);
+    const uint8_t *pEnd = pBase + length;
+    const uint8_t *pIn = pBase;
+    const uint8_t *pAnchor = pBase;
+    uint8_t *pOut = reinterpret_cast<uint8_t*>(pDest);
+    uint8_t *pOutEnd = pOut + destLength;
+
+    if (length > MatchFindLimit)
+    {
+        // Stale entries are harmless (every candidate is compared before
+        // use), but must lie within this block.
+        memset(pHashTable, 0, HashTableEntries * sizeof(uint16_t));
+
+        const uint8_t *pMatchLimit = pEnd - LastLiterals;
+        const uint8_t *pFindLimit = pEnd - MatchFindLimit;
+        while (pIn <= pFindLimit)
+        {
+            uint32_t sequence = read32(pIn);
+            size_t h = hash(sequence);
+            const uint8_t *pRef = pBase + pHashTable[h];
+            pHashTable[h] = pIn - pBase;
+
+            if (pRef >= pIn || read32(pRef) != sequence)
+            {
+                // Step further the longer nothing has matched, so data that
+                // won't compress doesn't cost a lookup per byte.
+                pIn += 1 + ((pIn - pAnchor) >> 6);
+                continue;
+            }
+
+            // Grow the match backwards over literals, then forwards.
+            while (pIn > pAnchor && pRef > pBase && pIn[-1] == pRef[-1])
+            {
+                --pIn;
+                --pRef;
+            }
+            const uint8_t *pMatchEnd = pIn + MinMatch;
+            const uint8_t *pRefEnd = pRef + MinMatch;
+            while (pMatchEnd < pMatchLimit && *pMatchEnd == *pRefEnd)
+            {
+                ++pMatchEnd;
+                ++pRefEnd;
+            }
+
+            pOut = putSequence(pOut, pOutEnd, pAnchor, pIn - pAnchor,
+                               pIn - pRef, pMatchEnd - pIn);
+            if (!pOut)
+                return 0;
+
+            pIn = pAnchor = pMatchEnd;
+        }
+    }
+
+    pOut = putSequence(pOut, pOutEnd, pAnchor, pEnd - pAnchor, 0, 0);
+    if (!pOut)
+        return 0;
+
+    return pOut - reinterpret_cast<uint8_t*>(pDest);
+}
+
+size_t Lz4::decompress(const void *pSource, size_t length,
+                       void *pDest, size_t destLength)
+{
+    const uint8_t *pIn = reinterpret_cast<const uint8_t*>(pSource);
+    const uint8_t *pInEnd = pIn + length;
+    uint8_t *pBase = reinterpret_cast<uint8_t*>(pDest);
+    uint8_t *pOut = pBase;
+    uint8_t *pOutEnd = pBase + destLength;
+
+    while (pIn < pInEnd)
+    {
+        uint8_t token = *pIn++;
+
+        size_t nLiterals = token >> 4;
+        if (nLiterals == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (pIn >= pInEnd)
+                    return 0;
+                b = *pIn++;
+                nLiterals += b;
+            } while (b == 255);
+        }
+        if (nLiterals > static_cast<size_t>(pInEnd - pIn) ||
+            nLiterals > static_cast<size_t>(pOutEnd - pOut))
+            return 0;
+        memcpy(pOut, pIn, nLiterals);
+        pIn += nLiterals;
+        pOut += nLiterals;
+
+        // The last sequence has no match.
+        if (pIn == pInEnd)
+            break;
+
+        if (pInEnd - pIn < 2)
+            return 0;
+        size_t offset = pIn[0] | (pIn[1] << 8);
+        pIn += 2;
+        if (!offset || offset > static_cast<size_t>(pOut - pBase))
+            return 0;
+
+        size_t matchLength = token & 0xF;
+        if (matchLength == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (pIn >= pInEnd)
+                    return 0;
+                b = *pIn++;
+                matchLength += b;
+            } while (b == 255);
+        }
+        matchLength += MinMatch;
+        if (matchLength > static_cast<size_t>(pOutEnd - pOut))
+            return 0;
+
+        // Matches may overlap their own output (that's how runs are
+        // encoded), which memcpy can't do.
+        const uint8_t *pMatch = pOut - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(pOut, pMatch, matchLength);
+            pOut += matchLength;
+        }
+        else
+        {
+            while (matchLength--)
+                *pOut++ = *pMatch++;
+        }
+    }
+
+    return pOut - pBase;
+}
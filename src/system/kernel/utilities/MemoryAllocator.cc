@@ -0,0 +1,611 @@
+/*
+ *
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <utilities/MemoryAllocator.h>
+#include <processor/Processor.h>
+#include <LockGuard.h>
+#include <Log.h>
+
+// Segments are never new'd or deleted with m_Lock held: the heap can run
+// into memory pressure, which makes the caches give back their pages, which
+// ends up in Cache's allocator again. Every operation that might need a
+// segment allocates it up front, and segments that fall out of the arena are
+// handed back to be deleted once the lock is dropped.
+
+MemoryAllocator::MemoryAllocator() :
+    m_pRoot(0), m_FreeLists(), m_nSegments(0), m_bReverse(false),
+    m_Quantum(0), m_pQuantumCaches(0), m_Lock()
+{
+}
+
+MemoryAllocator::MemoryAllocator(bool bReverse) :
+    m_pRoot(0), m_FreeLists(), m_nSegments(0), m_bReverse(bReverse),
+    m_Quantum(0), m_pQuantumCaches(0), m_Lock()
+{
+}
+
+MemoryAllocator::MemoryAllocator(uintptr_t address, uintptr_t length, bool bReverse) :
+    m_pRoot(0), m_FreeLists(), m_nSegments(0), m_bReverse(bReverse),
+    m_Quantum(0), m_pQuantumCaches(0), m_Lock()
+{
+    free(address, length);
+}
+
+MemoryAllocator::MemoryAllocator(const MemoryAllocator &other) :
+    m_pRoot(0), m_FreeLists(), m_nSegments(0), m_bReverse(other.m_bReverse),
+    m_Quantum(0), m_pQuantumCaches(0), m_Lock()
+{
+    copyTree(other.m_pRoot);
+
+    if (other.m_pQuantumCaches)
+    {
+        for (size_t i = 0; i < MaxQuantumCaches; ++i)
+        {
+            const QuantumCache &cache = other.m_pQuantumCaches[i];
+            for (size_t j = 0; j < cache.count; ++j)
+                free(cache.quanta[j], other.m_Quantum);
+        }
+    }
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    destroyTree(m_pRoot);
+    delete [] m_pQuantumCaches;
+}
+
+void MemoryAllocator::free(uintptr_t address, uintptr_t length)
+{
+    if (!length)
+        return;
+
+    if (m_pQuantumCaches && length == m_Quantum)
+    {
+        uintptr_t spill[QuantumCacheBatch];
+        size_t nSpill = 0;
+
+        bool bInterrupts = Processor::getInterrupts();
+        Processor::setInterrupts(false);
+
+        QuantumCache *pCache = getQuantumCache();
+        if (pCache)
+        {
+            // Keep the newest quanta (they're the likeliest to be handed out
+            // again soon) and give the oldest batch back to the arena.
+            if (pCache->count == QuantumCacheBatch * 2)
+            {
+                for (; nSpill < QuantumCacheBatch; ++nSpill)
+                    spill[nSpill] = pCache->quanta[nSpill];
+                for (size_t i = 0; i < QuantumCacheBatch; ++i)
+                    pCache->quanta[i] = pCache->quanta[i + QuantumCacheBatch];
+                pCache->count -= QuantumCacheBatch;
+            }
+            pCache->quanta[pCache->count++] = address;
+        }
+
+        Processor::setInterrupts(bInterrupts);
+
+        if (pCache)
+        {
+            // Quanta that were handed out together usually come back
+            // together, so sort the batch and free whole runs at once.
+            for (size_t i = 1; i < nSpill; ++i)
+            {
+                uintptr_t q = spill[i];
+                size_t j = i;
+                for (; j && spill[j - 1] > q; --j)
+                    spill[j] = spill[j - 1];
+                spill[j] = q;
+            }
+
+            for (size_t i = 0; i < nSpill;)
+            {
+                size_t j = i + 1;
+                while (j < nSpill && spill[j] == spill[j - 1] + m_Quantum)
+                    ++j;
+                freeToArena(spill[i], (j - i) * m_Quantum);
+                i = j;
+            }
+
+            return;
+        }
+    }
+
+    freeToArena(address, length);
+}
+
+void MemoryAllocator::freeToArena(uintptr_t address, uintptr_t length)
+{
+    Segment *pSpare = new Segment;
+    Segment *pDead = 0;
+
+    m_Lock.acquire();
+    doFree(address, length, pSpare, pDead);
+    m_Lock.release();
+
+    delete pSpare;
+    delete pDead;
+}
+
+bool MemoryAllocator::allocate(uintptr_t length, uintptr_t &address)
+{
+    if (!length)
+        return false;
+
+    Segment *pDead = 0;
+    bool bResult;
+
+    if (m_pQuantumCaches && length == m_Quantum)
+    {
+        bool bInterrupts = Processor::getInterrupts();
+        Processor::setInterrupts(false);
+
+        QuantumCache *pCache = getQuantumCache();
+        if (pCache)
+        {
+            if (!pCache->count)
+                refillQuantumCache(pCache, pDead);
+
+            bResult = pCache->count != 0;
+            if (bResult)
+                address = pCache->quanta[--pCache->count];
+
+            Processor::setInterrupts(bInterrupts);
+
+            delete pDead;
+            return bResult;
+        }
+
+        Processor::setInterrupts(bInterrupts);
+    }
+
+    m_Lock.acquire();
+    bResult = doAllocate(length, address, pDead);
+    m_Lock.release();
+
+    delete pDead;
+
+    return bResult;
+}
+
+bool MemoryAllocator::allocateSpecific(uintptr_t address, uintptr_t length)
+{
+    if (!length)
+        return false;
+
+    Segment *pSpare = new Segment;
+    Segment *pDead = 0;
+
+    m_Lock.acquire();
+    bool bResult = doAllocateSpecific(address, length, pSpare, pDead);
+    m_Lock.release();
+
+    delete pSpare;
+    delete pDead;
+
+    return bResult;
+}
+
+void MemoryAllocator::clear()
+{
+    m_Lock.acquire();
+
+    Segment *pRoot = m_pRoot;
+    m_pRoot = 0;
+    for (size_t i = 0; i < NumFreeLists; ++i)
+        m_FreeLists[i] = 0;
+    m_nSegments = 0;
+
+    if (m_pQuantumCaches)
+    {
+        for (size_t i = 0; i < MaxQuantumCaches; ++i)
+            m_pQuantumCaches[i].count = 0;
+    }
+
+    m_Lock.release();
+
+    destroyTree(pRoot);
+}
+
+void MemoryAllocator::enableQuantumCache(uintptr_t quantum)
+{
+    if (m_pQuantumCaches || !quantum)
+        return;
+
+    QuantumCache *pCaches = new QuantumCache[MaxQuantumCaches];
+    for (size_t i = 0; i < MaxQuantumCaches; ++i)
+        pCaches[i].count = 0;
+
+    m_Quantum = quantum;
+    m_pQuantumCaches = pCaches;
+}
+
+MemoryAllocator::QuantumCache *MemoryAllocator::getQuantumCache()
+{
+    // Before the processors are enumerated every CPU reports itself as the
+    // BSP, so sharing a cache would not be safe.
+    if (Processor::isInitialised() < 2)
+        return 0;
+
+    size_t id = Processor::id();
+    if (id >= MaxQuantumCaches)
+        return 0;
+    return &m_pQuantumCaches[id];
+}
+
+void MemoryAllocator::refillQuantumCache(QuantumCache *pCache, Segment *&pDead)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    // A whole batch in one piece keeps the segment count down; if the arena
+    // is too fragmented for that, settle for whatever single quanta are left.
+    uintptr_t base;
+    if (doAllocate(QuantumCacheBatch * m_Quantum, base, pDead))
+    {
+        // Hand out the lowest quantum first.
+        for (size_t i = QuantumCacheBatch; i > 0; --i)
+            pCache->quanta[pCache->count++] = base + ((i - 1) * m_Quantum);
+    }
+    else
+    {
+        // Stop once a segment has been used up, as there's only room to
+        // hand back one.
+        while (pCache->count < QuantumCacheBatch && !pDead)
+        {
+            if (!doAllocate(m_Quantum, base, pDead))
+                break;
+            pCache->quanta[pCache->count++] = base;
+        }
+    }
+}
+
+void MemoryAllocator::doFree(uintptr_t address, uintptr_t length, Segment *&pSpare, Segment *&pDead)
+{
+    Segment *pBelow = findAtOrBelow(address);
+    Segment *pAbove = findAbove(address);
+
+    if ((pBelow && (pBelow->base + pBelow->length > address)) ||
+        (pAbove && (pAbove->base < address + length)))
+    {
+        ERROR_NOLOCK("MemoryAllocator: free of " << Hex << address << " - " << (address + length) << " overlaps a free range");
+        return;
+    }
+
+    bool bMergeBelow = pBelow && (pBelow->base + pBelow->length == address);
+    bool bMergeAbove = pAbove && (address + length == pAbove->base);
+
+    if (bMergeBelow && bMergeAbove)
+    {
+        uintptr_t newLength = pBelow->length + length + pAbove->length;
+        removeSegment(pAbove);
+        resizeSegment(pBelow, pBelow->base, newLength);
+        pDead = pAbove;
+    }
+    else if (bMergeBelow)
+        resizeSegment(pBelow, pBelow->base, pBelow->length + length);
+    else if (bMergeAbove)
+        // Moving the base down doesn't change its place in the tree, as
+        // nothing lies between pBelow and pAbove.
+        resizeSegment(pAbove, address, length + pAbove->length);
+    else
+    {
+        pSpare->base = address;
+        pSpare->length = length;
+        insertSegment(pSpare);
+        pSpare = 0;
+    }
+}
+
+bool MemoryAllocator::doAllocate(uintptr_t length, uintptr_t &address, Segment *&pDead)
+{
+    Segment *pSeg = findFit(length);
+    if (!pSeg)
+        return false;
+
+    if (pSeg->length == length)
+    {
+        address = pSeg->base;
+        removeSegment(pSeg);
+        pDead = pSeg;
+    }
+    else if (m_bReverse)
+    {
+        address = pSeg->base + pSeg->length - length;
+        resizeSegment(pSeg, pSeg->base, pSeg->length - length);
+    }
+    else
+    {
+        address = pSeg->base;
+        resizeSegment(pSeg, pSeg->base + length, pSeg->length - length);
+    }
+
+    return true;
+}
+
+bool MemoryAllocator::doAllocateSpecific(uintptr_t address, uintptr_t length, Segment *&pSpare, Segment *&pDead)
+{
+    Segment *pSeg = findAtOrBelow(address);
+    if (!pSeg)
+        return false;
+
+    uintptr_t end = address + length;
+    uintptr_t segEnd = pSeg->base + pSeg->length;
+    if (end > segEnd || end < address)
+        return false;
+
+    if (pSeg->base == address && segEnd == end)
+    {
+        removeSegment(pSeg);
+        pDead = pSeg;
+    }
+    else if (pSeg->base == address)
+        resizeSegment(pSeg, end, segEnd - end);
+    else if (segEnd == end)
+        resizeSegment(pSeg, pSeg->base, address - pSeg->base);
+    else
+    {
+        resizeSegment(pSeg, pSeg->base, address - pSeg->base);
+        pSpare->base = end;
+        pSpare->length = segEnd - end;
+        insertSegment(pSpare);
+        pSpare = 0;
+    }
+
+    return true;
+}
+
+MemoryAllocator::Segment *MemoryAllocator::findFit(uintptr_t length) const
+{
+    // Every segment in a class above floor(log2(length)) is big enough (as
+    // is every segment in that class, if length is a power of two), so the
+    // head of the first non-empty list will do.
+    size_t cls = sizeClass(length);
+    size_t first = (length & (length - 1)) ? cls + 1 : cls;
+    for (size_t i = first; i < NumFreeLists; ++i)
+    {
+        if (m_FreeLists[i])
+            return m_FreeLists[i];
+    }
+
+    // Otherwise there may still be something in the class itself.
+    if (first != cls)
+    {
+        for (Segment *pSeg = m_FreeLists[cls]; pSeg; pSeg = pSeg->pNext)
+        {
+            if (pSeg->length >= length)
+                return pSeg;
+        }
+    }
+
+    return 0;
+}
+
+size_t MemoryAllocator::sizeClass(uintptr_t length)
+{
+    return (sizeof(unsigned long long) * 8 - 1) - __builtin_clzll(length);
+}
+
+void MemoryAllocator::listInsert(Segment *pSeg)
+{
+    Segment *&pHead = m_FreeLists[sizeClass(pSeg->length)];
+    pSeg->pPrev = 0;
+    pSeg->pNext = pHead;
+    if (pHead)
+        pHead->pPrev = pSeg;
+    pHead = pSeg;
+}
+
+void MemoryAllocator::listRemove(Segment *pSeg)
+{
+    if (pSeg->pPrev)
+        pSeg->pPrev->pNext = pSeg->pNext;
+    else
+        m_FreeLists[sizeClass(pSeg->length)] = pSeg->pNext;
+    if (pSeg->pNext)
+        pSeg->pNext->pPrev = pSeg->pPrev;
+    pSeg->pPrev = pSeg->pNext = 0;
+}
+
+void MemoryAllocator::insertSegment(Segment *pSeg)
+{
+    pSeg->pLeft = pSeg->pRight = 0;
+    pSeg->height = 1;
+    m_pRoot = treeInsert(m_pRoot, pSeg);
+    listInsert(pSeg);
+    ++m_nSegments;
+}
+
+void MemoryAllocator::removeSegment(Segment *pSeg)
+{
+    listRemove(pSeg);
+    m_pRoot = treeRemove(m_pRoot, pSeg->base);
+    --m_nSegments;
+}
+
+void MemoryAllocator::resizeSegment(Segment *pSeg, uintptr_t base, uintptr_t length)
+{
+    bool bMove = sizeClass(pSeg->length) != sizeClass(length);
+    if (bMove)
+        listRemove(pSeg);
+    pSeg->base = base;
+    pSeg->length = length;
+    if (bMove)
+        listInsert(pSeg);
+}
+
+MemoryAllocator::Segment *MemoryAllocator::findAtOrBelow(uintptr_t address) const
+{
+    Segment *pResult = 0;
+    for (Segment *pNode = m_pRoot; pNode;)
+    {
+        if (pNode->base <= address)
+        {
+            pResult = pNode;
+            pNode = pNode->pRight;
+        }
+        else
+            pNode = pNode->pLeft;
+    }
+    return pResult;
+}
+
+MemoryAllocator::Segment *MemoryAllocator::findAbove(uintptr_t address) const
+{
+    Segment *pResult = 0;
+    for (Segment *pNode = m_pRoot; pNode;)
+    {
+        if (pNode->base > address)
+        {
+            pResult = pNode;
+            pNode = pNode->pLeft;
+        }
+        else
+            pNode = pNode->pRight;
+    }
+    return pResult;
+}
+
+int MemoryAllocator::height(Segment *pNode)
+{
+    return pNode ? pNode->height : 0;
+}
+
+void MemoryAllocator::updateHeight(Segment *pNode)
+{
+    int l = height(pNode->pLeft), r = height(pNode->pRight);
+    pNode->height = ((l > r) ? l : r) + 1;
+}
+
+MemoryAllocator::Segment *MemoryAllocator::rotateLeft(Segment *pNode)
+{
+    Segment *pRight = pNode->pRight;
+    pNode->pRight = pRight->pLeft;
+    pRight->pLeft = pNode;
+    updateHeight(pNode);
+    updateHeight(pRight);
+    return pRight;
+}
+
+MemoryAllocator::Segment *MemoryAllocator::rotateRight(Segment *pNode)
+{
+    Segment *pLeft = pNode->pLeft;
+    pNode->pLeft = pLeft->pRight;
+    pLeft->pRight = pNode;
+    updateHeight(pNode);
+    updateHeight(pLeft);
+    return pLeft;
+}
+
+MemoryAllocator::Segment *MemoryAllocator::rebalance(Segment *pNode)
+{
+    updateHeight(pNode);
+
+    int balance = height(pNode->pLeft) - height(pNode->pRight);
+    if (balance > 1)
+    {
+        if (height(pNode->pLeft->pLeft) < height(pNode->pLeft->pRight))
+            pNode->pLeft = rotateLeft(pNode->pLeft);
+        return rotateRight(pNode);
+    }
+    else if (balance < -1)
+    {
+        if (height(pNode->pRight->pRight) < height(pNode->pRight->pLeft))
+            pNode->pRight = rotateRight(pNode->pRight);
+        return rotateLeft(pNode);
+    }
+
+    return pNode;
+}
+
+MemoryAllocator::Segment *MemoryAllocator::treeInsert(Segment *pRoot, Segment *pNode)
+{
+    if (!pRoot)
+        return pNode;
+
+    if (pNode->base < pRoot->base)
+        pRoot->pLeft = treeInsert(pRoot->pLeft, pNode);
+    else
+        pRoot->pRight = treeInsert(pRoot->pRight, pNode);
+
+    return rebalance(pRoot);
+}
+
+MemoryAllocator::Segment *MemoryAllocator::treeRemoveMin(Segment *pRoot, Segment *&pMin)
+{
+    if (!pRoot->pLeft)
+    {
+        pMin = pRoot;
+        return pRoot->pRight;
+    }
+
+    pRoot->pLeft = treeRemoveMin(pRoot->pLeft, pMin);
+    return rebalance(pRoot);
+}
+
+MemoryAllocator::Segment *MemoryAllocator::treeRemove(Segment *pRoot, uintptr_t base)
+{
+    if (!pRoot)
+        return 0;
+
+    if (base < pRoot->base)
+        pRoot->pLeft = treeRemove(pRoot->pLeft, base);
+    else if (base > pRoot->base)
+        pRoot->pRight = treeRemove(pRoot->pRight, base);
+    else
+    {
+        Segment *pLeft = pRoot->pLeft, *pRight = pRoot->pRight;
+        if (!pRight)
+            return pLeft;
+
+        Segment *pMin = 0;
+        pRight = treeRemoveMin(pRight, pMin);
+        pMin->pLeft = pLeft;
+        pMin->pRight = pRight;
+        pRoot = pMin;
+    }
+
+    return rebalance(pRoot);
+}
+
+void MemoryAllocator::destroyTree(Segment *pNode)
+{
+    if (!pNode)
+        return;
+
+    destroyTree(pNode->pLeft);
+    destroyTree(pNode->pRight);
+    delete pNode;
+}
+
+void MemoryAllocator::copyTree(Segment *pNode)
+{
+    if (!pNode)
+        return;
+
+    // The other allocator's segments are already disjoint and don't touch,
+    // so they go straight in.
+    Segment *pSeg = new Segment;
+    pSeg->base = pNode->base;
+    pSeg->length = pNode->length;
+    insertSegment(pSeg);
+
+    copyTree(pNode->pLeft);
+    copyTree(pNode->pRight);
+}
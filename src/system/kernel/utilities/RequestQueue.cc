@@ -336,6 +336,53 @@ int RequestQueue::work()
   return 0;
 }
 
+RequestQueue::Request *RequestQueue::takeRequest(uint64_t p1, uint64_t p2, uint64_t p3)
+{
+#ifdef THREADS
+  LockGuard<Mutex> guard(m_RequestQueueMutex);
+
+  for (size_t priority = 0; priority < REQUEST_QUEUE_NUM_PRIORITIES; ++priority)
+  {
+    Request *pPrev = 0;
+    for (Request *pReq = m_pRequestQueue[priority]; pReq; pPrev = pReq, pReq = pReq->next)
+    {
+      if (pReq->bReject || pReq->p1 != p1 || pReq->p2 != p2 || pReq->p3 != p3)
+        continue;
+
+      if (pPrev)
+        pPrev->next = pReq->next;
+      else
+        m_pRequestQueue[priority] = pReq->next;
+      pReq->next = 0;
+
+      // The worker won't find this request in the queue any more. If the count
+      // hasn't been posted yet, work() copes with waking to an empty queue.
+      m_RequestQueueSize.tryAcquire();
+      return pReq;
+    }
+  }
+#endif
+  return 0;
+}
+
+void RequestQueue::completeRequest(Request *pReq, uint64_t ret)
+{
+  pReq->ret = ret;
+#ifdef THREADS
+  if (pReq->mutex.tryAcquire())
+  {
+    // The calling thread was interrupted, as in work().
+    NOTICE("RequestQueue::completeRequest - caller interrupted");
+    if(pReq->pThread)
+      pReq->pThread->removeRequest(pReq);
+    return;
+  }
+
+  pReq->bCompleted = true;
+  pReq->mutex.release();
+#endif
+}
+
 bool RequestQueue::isRequestValid(const Request *r)
 {
   // Halted RequestQueue already has the RequestQueue mutex held.
@@ -61,6 +61,28 @@ void String::assign(const char *s)
             m_Data[0] = '\0';
     }
 }
+void String::assign(const char *s, size_t len)
+{
+    if(!s)
+        len = 0;
+    m_Length = len;
+
+    char *dst = m_Static;
+    if (m_Length < StaticSize)
+    {
+        delete [] m_Data;
+        m_Data = 0;
+    }
+    else
+    {
+        reserve(m_Length + 1);
+        dst = m_Data;
+    }
+
+    if (m_Length)
+        memcpy(dst, s, m_Length);
+    dst[m_Length] = '\0';
+}
 void String::reserve(size_t size)
 {
     // Don't reserve if we're a static string.
@@ -21,11 +21,17 @@
 
 UnlikelyLock::UnlikelyLock() :
     m_Semaphore(UNLIKELY_LOCK_MAX_READERS + 1)
+#ifdef LOCK_STATS
+    , m_AcquiredAt(0), m_AcquiredRa(0)
+#endif
 {
 }
 
 UnlikelyLock::~UnlikelyLock()
 {
+#ifdef LOCK_STATS
+    LockStats::destroyed(this);
+#endif
 }
 
 bool UnlikelyLock::enter()
@@ -40,16 +46,34 @@ void UnlikelyLock::leave()
 
 bool UnlikelyLock::acquire()
 {
+#ifdef LOCK_STATS
+    // Recorded here rather than by m_Semaphore so the call site is our
+    // caller. Readers in the critical section count as contention.
+    uint64_t start = readTimestamp();
+    bool bContended = m_Semaphore.getValue() != (UNLIKELY_LOCK_MAX_READERS + 1);
+#endif
+
     // acquire() is defined to not return until all other threads have left
     // the critical section, so we simply loop in case the Semaphore fails to
     // acquire after blocking (eg, interrupted).
     while(!m_Semaphore.acquire(UNLIKELY_LOCK_MAX_READERS + 1))
         Scheduler::instance().yield();
 
+#ifdef LOCK_STATS
+    m_AcquiredAt = readTimestamp();
+    m_AcquiredRa = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+    LockStats::acquired(this, LockStats::UnlikelyLockType, m_AcquiredRa,
+                        bContended, bContended ? m_AcquiredAt - start : 0);
+#endif
+
     return true;
 }
 
 void UnlikelyLock::release()
 {
+#ifdef LOCK_STATS
+    LockStats::released(this, m_AcquiredRa, readTimestamp() - m_AcquiredAt);
+#endif
+
     m_Semaphore.release(UNLIKELY_LOCK_MAX_READERS + 1);
 }
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "testsuite.h"
+
+#define PAGE_SIZE   4096
+#define CHUNK_SIZE  (4 * 1024 * 1024)
+#define MAX_CHUNKS  128
+#define TEST_CHUNKS 8
+
+#define STORE_STATS "/dev/compressed"
+
+/** Reads one of the compressed page store's statistics. */
+static unsigned long store_stat(const char *name)
+{
+    char buf[256];
+    int fd = open(STORE_STATS, O_RDONLY);
+    if(fd < 0)
+    {
+        printf("couldn't open %s\n", STORE_STATS);
+        fail();
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if(n <= 0)
+    {
+        printf("couldn't read %s\n", STORE_STATS);
+        fail();
+    }
+    buf[n] = 0;
+
+    size_t len = strlen(name);
+    for(char *line = buf; line && *line; line = strchr(line, '\n'))
+    {
+        if(*line == '\n')
+            ++line;
+        if(!strncmp(line, name, len) && line[len] == ' ')
+            return strtoul(line + len + 1, 0, 10);
+    }
+
+    printf("%s has no '%s'\n", STORE_STATS, name);
+    fail();
+    return 0;
+}
+
+/** Asks the kernel to compress what it can of our memory right now. */
+static void force_compact()
+{
+    int fd = open(STORE_STATS, O_WRONLY);
+    if(fd < 0 || write(fd, "compact", 7) != 7)
+    {
+        printf("couldn't compact through %s\n", STORE_STATS);
+        fail();
+    }
+    close(fd);
+}
+
+/** Fills a page with something that compresses well but is still different
+ *  on every page, so a page coming back wrong is caught. */
+static void fill(char *p, size_t id)
+{
+    memset(p, 'a' + (id % 23), PAGE_SIZE);
+    memcpy(p, &id, sizeof(id));
+    memcpy(p + PAGE_SIZE - sizeof(id), &id, sizeof(id));
+}
+
+static int check(const char *p, size_t id)
+{
+    size_t head, tail;
+    memcpy(&head, p, sizeof(head));
+    memcpy(&tail, p + PAGE_SIZE - sizeof(tail), sizeof(tail));
+    return head == id && tail == id && p[PAGE_SIZE / 2] == 'a' + (id % 23);
+}
+
+/** Checks every page, timing each (which faults it in if it was
+ *  compressed). */
+static void check_all(char **chunks, size_t nChunks, uint64_t *total, uint64_t *worst)
+{
+    size_t i, j;
+
+    for(i = 0; i < nChunks; ++i)
+    {
+        for(j = 0; j < CHUNK_SIZE; j += PAGE_SIZE)
+        {
+            size_t id = (i * CHUNK_SIZE + j) / PAGE_SIZE;
+
+            uint64_t before = usecs();
+            int bOk = check(chunks[i] + j, id);
+            uint64_t elapsed = usecs() - before;
+
+            if(!bOk)
+            {
+                printf("page %lu came back wrong\n", (unsigned long) id);
+                fail();
+            }
+
+            *total += elapsed;
+            if(elapsed > *worst)
+                *worst = elapsed;
+        }
+    }
+}
+
+/** Writes anonymous memory, has the kernel compress it, and checks it all
+ *  comes back, in a forked child (which shares the pages, compressed or not,
+ *  until it writes) and then in the parent after the child has overwritten
+ *  its copies. With -b, writes far more than is likely free, so that the
+ *  first pages have been compressed under real memory pressure by the time
+ *  the last are written, and times the read back. */
+void test_compress()
+{
+    static char *chunks[MAX_CHUNKS];
+    size_t maxChunks = benchmarks ? MAX_CHUNKS : TEST_CHUNKS;
+    size_t nChunks, i, j;
+
+    uint64_t start = usecs();
+    for(nChunks = 0; nChunks < maxChunks; ++nChunks)
+    {
+        char *p = (char *) mmap(0, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if(p == MAP_FAILED)
+            break;
+        chunks[nChunks] = p;
+
+        for(j = 0; j < CHUNK_SIZE; j += PAGE_SIZE)
+            fill(p + j, (nChunks * CHUNK_SIZE + j) / PAGE_SIZE);
+    }
+    uint64_t fillTime = usecs() - start;
+
+    if(!nChunks)
+    {
+        printf("mmap() failed\n");
+        fail();
+    }
+
+    // Don't rely on running out of memory: compress now, and make sure the
+    // store really took pages (the fill compresses to a fraction of a page).
+    unsigned long storedBefore = store_stat("pages");
+    force_compact();
+    if(store_stat("pages") <= storedBefore)
+    {
+        printf("compacting stored no pages\n");
+        fail();
+    }
+    unsigned long loadsBefore = store_stat("loads");
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        uint64_t total = 0, worst = 0;
+        check_all(chunks, nChunks, &total, &worst);
+        for(i = 0; i < nChunks; ++i)
+        {
+            for(j = 0; j < CHUNK_SIZE; j += PAGE_SIZE)
+                fill(chunks[i] + j, ~((i * CHUNK_SIZE + j) / PAGE_SIZE));
+        }
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        printf("anonymous memory came back wrong in a forked child\n");
+        fail();
+    }
+
+    uint64_t total = 0, worst = 0;
+    check_all(chunks, nChunks, &total, &worst);
+
+    if(store_stat("loads") <= loadsBefore)
+    {
+        printf("no compressed pages were loaded back\n");
+        fail();
+    }
+
+    for(i = 0; i < nChunks; ++i)
+        munmap(chunks[i], CHUNK_SIZE);
+
+    if(benchmarks)
+    {
+        size_t nPages = (nChunks * CHUNK_SIZE) / PAGE_SIZE;
+        printf("compressed memory: %lu MB written in %llu ms\n",
+            (unsigned long) ((nChunks * CHUNK_SIZE) / (1024 * 1024)),
+            (unsigned long long) (fillTime / 1000));
+        printf("compressed memory: read back at %llu ns/page, worst %llu us\n",
+            (unsigned long long) ((total * 1000ULL) / nPages),
+            (unsigned long long) worst);
+    }
+
+    printf("anonymous memory survives fork and compression.\n");
+}
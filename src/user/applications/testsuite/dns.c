@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include <pedigree_config.h>
+
+#include "testsuite.h"
+
+#define DNS_HOST        "cached.pedigree.test"
+#define DNS_MISSING     "missing.pedigree.test"
+#define DNS_ANSWER      "10.1.2.3"
+#define DNS_TTL         2
+#define DNS_LOOKERS     8
+
+/** Sends a control message to the stand-in server and returns its reply. */
+static uint32_t server_control(const char *msg)
+{
+    struct sockaddr_in sin;
+    uint32_t reply = 0;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0)
+        return 0;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(53);
+    sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    sendto(sock, msg, strlen(msg), 0, (struct sockaddr *) &sin, sizeof(sin));
+    if(strcmp(msg, "quit"))
+        recv(sock, &reply, sizeof(reply), 0);
+    close(sock);
+    return reply;
+}
+
+static size_t put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+    return 2;
+}
+
+static size_t put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v >> 16);
+    put16(p + 2, v & 0xFFFF);
+    return 4;
+}
+
+/** A tiny DNS server on 127.0.0.1:53. It answers DNS_HOST with DNS_ANSWER,
+ *  and everything else with NXDOMAIN, after a short delay so concurrent
+ *  lookups overlap. "count" returns the number of queries seen. */
+static void dns_server(int ready)
+{
+    struct sockaddr_in sin, from;
+    socklen_t fromlen;
+    uint8_t buf[512];
+    uint32_t queries = 0;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(53);
+    sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(sock < 0 || bind(sock, (struct sockaddr *) &sin, sizeof(sin)) < 0)
+        _exit(1);
+
+    write(ready, "", 1);
+
+    while(1)
+    {
+        fromlen = sizeof(from);
+        ssize_t n = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *) &from, &fromlen);
+        if(n <= 0)
+            continue;
+
+        if(n == 4 && !memcmp(buf, "quit", 4))
+            _exit(0);
+        if(n == 5 && !memcmp(buf, "count", 5))
+        {
+            sendto(sock, &queries, sizeof(queries), 0, (struct sockaddr *) &from, fromlen);
+            continue;
+        }
+        if(n < 12)
+            continue;
+
+        ++queries;
+
+        // Decode the question name.
+        char name[256];
+        size_t off = 12, len = 0;
+        while(off < (size_t) n && buf[off] && len < sizeof(name) - 64)
+        {
+            size_t label = buf[off++];
+            if(len)
+                name[len++] = '.';
+            memcpy(name + len, buf + off, label);
+            len += label;
+            off += label;
+        }
+        name[len] = 0;
+        off += 1 + 4; // terminator, type and class
+
+        int found = !strcmp(name, DNS_HOST);
+
+        // Header: response, recursion desired/available, NXDOMAIN if missing.
+        put16(buf + 2, found ? 0x8180 : 0x8183);
+        put16(buf + 4, 1);
+        put16(buf + 6, found ? 1 : 0);
+        put16(buf + 8, found ? 0 : 1);
+        put16(buf + 10, 0);
+
+        // Answer (or SOA in the authority section), named by a pointer to
+        // the question.
+        off += put16(buf + off, 0xC00C);
+        off += put16(buf + off, found ? 1 : 6);
+        off += put16(buf + off, 1);
+        off += put32(buf + off, DNS_TTL);
+        if(found)
+        {
+            off += put16(buf + off, 4);
+            in_addr_t addr = inet_addr(DNS_ANSWER);
+            memcpy(buf + off, &addr, 4);
+            off += 4;
+        }
+        else
+        {
+            off += put16(buf + off, 22);
+            buf[off++] = 0; // MNAME
+            buf[off++] = 0; // RNAME
+            off += put32(buf + off, 1); // serial
+            off += put32(buf + off, 60); // refresh
+            off += put32(buf + off, 60); // retry
+            off += put32(buf + off, 60); // expire
+            off += put32(buf + off, DNS_TTL); // minimum
+        }
+
+        usleep(200000);
+        sendto(sock, buf, off, 0, (struct sockaddr *) &from, fromlen);
+    }
+}
+
+/** Resolves name in DNS_LOOKERS processes at once; returns how many got
+ *  DNS_ANSWER back. */
+static int concurrent_lookups(const char *name)
+{
+    pid_t pids[DNS_LOOKERS];
+    int i, ok = 0;
+
+    for(i = 0; i < DNS_LOOKERS; ++i)
+    {
+        pids[i] = fork();
+        if(pids[i] == 0)
+        {
+            struct hostent *h = gethostbyname(name);
+            if(h && h->h_addr_list[0] &&
+               ((struct in_addr *) h->h_addr_list[0])->s_addr == inet_addr(DNS_ANSWER))
+                _exit(0);
+            _exit(1);
+        }
+    }
+
+    for(i = 0; i < DNS_LOOKERS; ++i)
+    {
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            ++ok;
+    }
+
+    return ok;
+}
+
+static void expect_queries(uint32_t expected, const char *what)
+{
+    uint32_t queries = server_control("count");
+    if(queries != expected)
+    {
+        printf("DNS: %s: server saw %u queries, expected %u\n", what, queries, expected);
+        server_control("quit");
+        fail();
+    }
+}
+
+void test_dns()
+{
+    int ready[2];
+    char c;
+
+    // Point the resolver at our stand-in server.
+    int result = pedigree_config_query("delete from 'network_generic' where key='nameserver';");
+    if(result != -1)
+        pedigree_config_freeresult(result);
+    result = pedigree_config_query("insert into 'network_generic' values (NULL, 'nameserver', '127.0.0.1');");
+    if(result == -1 || pedigree_config_was_successful(result) == -1)
+    {
+        printf("DNS: couldn't configure the nameserver\n");
+        fail();
+    }
+    pedigree_config_freeresult(result);
+
+    pipe(ready);
+    pid_t server = fork();
+    if(server == 0)
+        dns_server(ready[1]);
+    read(ready[0], &c, 1);
+
+    // Many lookups of one name at once must share a single query...
+    if(concurrent_lookups(DNS_HOST) != DNS_LOOKERS)
+    {
+        printf("DNS: concurrent lookups failed\n");
+        server_control("quit");
+        fail();
+    }
+    expect_queries(1, "concurrent lookups");
+
+    // ... and later ones must come from the cache, until the TTL runs out.
+    if(!gethostbyname(DNS_HOST))
+    {
+        printf("DNS: cached lookup failed\n");
+        server_control("quit");
+        fail();
+    }
+    expect_queries(1, "cached lookup");
+
+    sleep(DNS_TTL + 1);
+    if(!gethostbyname(DNS_HOST))
+    {
+        printf("DNS: lookup after expiry failed\n");
+        server_control("quit");
+        fail();
+    }
+    expect_queries(2, "lookup after expiry");
+
+    // Names that don't exist are cached too.
+    if(gethostbyname(DNS_MISSING) || gethostbyname(DNS_MISSING))
+    {
+        printf("DNS: lookup of a missing name succeeded\n");
+        server_control("quit");
+        fail();
+    }
+    expect_queries(3, "negative lookup");
+
+    server_control("quit");
+    waitpid(server, 0, 0);
+    close(ready[0]);
+    close(ready[1]);
+
+    result = pedigree_config_query("delete from 'network_generic' where key='nameserver';");
+    if(result != -1)
+        pedigree_config_freeresult(result);
+
+    printf("DNS lookups are cached and coalesced.\n");
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "testsuite.h"
+
+#define IOV_PORT_A      5301
+#define IOV_PORT_B      5302
+#define IOV_OFFSET      1000
+
+/** Fills buf with the pattern, starting at pattern offset start. */
+static void fill(char *buf, size_t len, size_t start)
+{
+    for(size_t i = 0; i < len; ++i)
+        buf[i] = pattern(start + i);
+}
+
+/** Checks buf holds the pattern from pattern offset start. */
+static void check(const char *what, const char *buf, size_t len, size_t start)
+{
+    for(size_t i = 0; i < len; ++i)
+    {
+        if(buf[i] != pattern(start + i))
+        {
+            printf("%s: wrong data at byte %lu\n", what, (unsigned long) (start + i));
+            fail();
+        }
+    }
+}
+
+static void expect(const char *what, ssize_t got, ssize_t want)
+{
+    if(got != want)
+    {
+        printf("%s returned %ld, expected %ld\n", what, (long) got, (long) want);
+        fail();
+    }
+}
+
+/** readv, writev, preadv and pwritev on a file, with an empty iovec in the
+ *  middle and reads that only partly fill the last one. */
+static void test_file()
+{
+    const char *path = "/tmp/testsuite-iovec";
+    char a[5], b[300], c[100], d[400];
+    struct iovec iov[3];
+
+    unlink(path);
+    int fd = open(path, O_CREAT | O_RDWR, 0644);
+    if(fd < 0)
+    {
+        printf("couldn't create %s\n", path);
+        fail();
+    }
+
+    fill(a, sizeof(a), 0);
+    fill(b, sizeof(b), sizeof(a));
+    iov[0].iov_base = a;
+    iov[0].iov_len = sizeof(a);
+    iov[1].iov_base = 0;
+    iov[1].iov_len = 0;
+    iov[2].iov_base = b;
+    iov[2].iov_len = sizeof(b);
+    expect("writev", writev(fd, iov, 3), sizeof(a) + sizeof(b));
+    expect("writev with no iovecs", writev(fd, iov, 0), 0);
+    expect("offset after writev", lseek(fd, 0, SEEK_CUR), sizeof(a) + sizeof(b));
+
+    // 305 bytes into 100 + 0 + 400: the last buffer is only part filled.
+    lseek(fd, 0, SEEK_SET);
+    memset(d, 0, sizeof(d));
+    iov[0].iov_base = c;
+    iov[0].iov_len = sizeof(c);
+    iov[2].iov_base = d;
+    iov[2].iov_len = sizeof(d);
+    expect("readv", readv(fd, iov, 3), sizeof(a) + sizeof(b));
+    check("readv", c, sizeof(c), 0);
+    check("readv", d, sizeof(a) + sizeof(b) - sizeof(c), sizeof(c));
+    if(d[sizeof(a) + sizeof(b) - sizeof(c)])
+    {
+        printf("readv wrote past the end of the file's data\n");
+        fail();
+    }
+    expect("readv with no iovecs", readv(fd, iov, 0), 0);
+
+    // The positional calls leave the descriptor's offset alone.
+    fill(a, sizeof(a), IOV_OFFSET);
+    fill(b, sizeof(b), IOV_OFFSET + sizeof(a));
+    iov[0].iov_base = a;
+    iov[0].iov_len = sizeof(a);
+    iov[1].iov_base = b;
+    iov[1].iov_len = sizeof(b);
+    expect("pwritev", pwritev(fd, iov, 2, IOV_OFFSET), sizeof(a) + sizeof(b));
+    expect("offset after pwritev", lseek(fd, 0, SEEK_CUR), sizeof(a) + sizeof(b));
+
+    memset(d, 0, sizeof(d));
+    iov[0].iov_base = c;
+    iov[0].iov_len = 3;
+    iov[1].iov_base = d;
+    iov[1].iov_len = sizeof(d);
+    expect("preadv", preadv(fd, iov, 2, IOV_OFFSET), sizeof(a) + sizeof(b));
+    check("preadv", c, 3, IOV_OFFSET);
+    check("preadv", d, sizeof(a) + sizeof(b) - 3, IOV_OFFSET + 3);
+    expect("offset after preadv", lseek(fd, 0, SEEK_CUR), sizeof(a) + sizeof(b));
+
+    close(fd);
+    unlink(path);
+}
+
+/** writev through a pipe comes out as one run of data, readable by readv. */
+static void test_pipe_iovec()
+{
+    char a[7], b[64], c[40], d[40];
+    struct iovec iov[2];
+    int fds[2];
+
+    if(pipe(fds) < 0)
+    {
+        printf("pipe() failed\n");
+        fail();
+    }
+
+    fill(a, sizeof(a), 0);
+    fill(b, sizeof(b), sizeof(a));
+    iov[0].iov_base = a;
+    iov[0].iov_len = sizeof(a);
+    iov[1].iov_base = b;
+    iov[1].iov_len = sizeof(b);
+    expect("writev to a pipe", writev(fds[1], iov, 2), sizeof(a) + sizeof(b));
+
+    // An empty read must not block on the pipe.
+    expect("readv from a pipe with no iovecs", readv(fds[0], iov, 0), 0);
+
+    iov[0].iov_base = c;
+    iov[0].iov_len = sizeof(c);
+    iov[1].iov_base = d;
+    iov[1].iov_len = sizeof(d);
+    expect("readv from a pipe", readv(fds[0], iov, 2), sizeof(a) + sizeof(b));
+    check("readv from a pipe", c, sizeof(c), 0);
+    check("readv from a pipe", d, sizeof(a) + sizeof(b) - sizeof(c), sizeof(c));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static int udp_socket(uint16_t port, struct sockaddr_in *sin)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    sin->sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(sock < 0 || bind(sock, (struct sockaddr *) sin, sizeof(*sin)) < 0)
+    {
+        printf("couldn't bind a UDP socket to port %u\n", port);
+        fail();
+    }
+
+    return sock;
+}
+
+/** Sends len bytes of pattern from tx to rx as one datagram, in three
+ *  iovecs. */
+static void send_datagram(int tx, struct sockaddr_in *to, size_t len)
+{
+    char buf[64];
+    struct iovec iov[3];
+    struct msghdr msg;
+
+    fill(buf, len, 0);
+    iov[0].iov_base = buf;
+    iov[0].iov_len = 1;
+    iov[1].iov_base = buf + 1;
+    iov[1].iov_len = len / 2 - 1;
+    iov[2].iov_base = buf + len / 2;
+    iov[2].iov_len = len - len / 2;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = to;
+    msg.msg_namelen = sizeof(*to);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    expect("sendmsg", sendmsg(tx, &msg, 0), len);
+}
+
+/** Receives one datagram into buffers of the given sizes, and checks it
+ *  comes back with want bytes and the expected truncation flag. */
+static void recv_datagram(int rx, size_t first, size_t second, size_t want, int bTrunc)
+{
+    char a[64], b[64];
+    struct iovec iov[2];
+    struct msghdr msg;
+    struct sockaddr_in from;
+
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    iov[0].iov_base = a;
+    iov[0].iov_len = first;
+    iov[1].iov_base = b;
+    iov[1].iov_len = second;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (first || second) ? 2 : 0;
+    expect("recvmsg", recvmsg(rx, &msg, 0), want);
+
+    if(!!(msg.msg_flags & MSG_TRUNC) != !!bTrunc)
+    {
+        printf("recvmsg of %lu bytes into %lu: MSG_TRUNC %s\n", (unsigned long) want,
+            (unsigned long) (first + second), bTrunc ? "not set" : "set");
+        fail();
+    }
+
+    if(from.sin_port != htons(IOV_PORT_A))
+    {
+        printf("recvmsg gave the wrong sender port\n");
+        fail();
+    }
+
+    size_t inFirst = want < first ? want : first;
+    check("recvmsg", a, inFirst, 0);
+    check("recvmsg", b, want - inFirst, inFirst);
+}
+
+/** sendmsg and recvmsg with datagrams that fit, part-fill and overflow the
+ *  receiver's iovecs. */
+static void test_msg()
+{
+    struct sockaddr_in sinA, sinB;
+    int sockA = udp_socket(IOV_PORT_A, &sinA);
+    int sockB = udp_socket(IOV_PORT_B, &sinB);
+
+    // Exactly fills both buffers.
+    send_datagram(sockA, &sinB, 30);
+    recv_datagram(sockB, 10, 20, 30, 0);
+
+    // Only reaches part way into the second.
+    send_datagram(sockA, &sinB, 25);
+    recv_datagram(sockB, 10, 20, 25, 0);
+
+    // Too big: the rest of the datagram is dropped and MSG_TRUNC says so.
+    send_datagram(sockA, &sinB, 40);
+    recv_datagram(sockB, 10, 20, 30, 1);
+
+    // With no buffers at all the whole datagram is truncated away.
+    send_datagram(sockA, &sinB, 16);
+    recv_datagram(sockB, 0, 0, 0, 1);
+
+    // Nothing of the dropped datagrams was left behind for the next one.
+    send_datagram(sockA, &sinB, 12);
+    recv_datagram(sockB, 12, 12, 12, 0);
+
+    close(sockA);
+    close(sockB);
+}
+
+void test_iovec()
+{
+    test_file();
+    test_pipe_iovec();
+    test_msg();
+
+    printf("vectored I/O and sendmsg/recvmsg work.\n");
+}
@@ -18,13 +18,26 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <setjmp.h>
 
+#include "testsuite.h"
+
 extern void test_mprotect();
+extern void test_stat();
+extern void test_dns();
+extern void test_pipe();
+extern void test_sendfile();
+extern void test_tlb();
+extern void test_memory();
+extern void test_compress();
+extern void test_iovec();
 
 static jmp_buf buf;
 
+int benchmarks = 0;
+
 void fail()
 {
     longjmp(buf, 1);
@@ -38,10 +51,29 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    printf("Running tests...\n");
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-b"))
+            benchmarks = 1;
+        else
+        {
+            printf("usage: %s [-b]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("Running tests%s...\n", benchmarks ? " and benchmarks" : "");
 
     // Add calls to test functions here...
     test_mprotect();
+    test_stat();
+    test_dns();
+    test_pipe();
+    test_sendfile();
+    test_tlb();
+    test_memory();
+    test_compress();
+    test_iovec();
 
     printf("Tests complete!\n");
     return 0;
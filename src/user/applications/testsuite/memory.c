@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "testsuite.h"
+
+#define MIN_SIZE        16
+#define MAX_SIZE        (4 * 1024 * 1024)
+#define BYTES_PER_SIZE  (64 * 1024 * 1024)
+
+/** Checks memcpy, memmove and memset around each size, at a few alignments,
+ *  making sure none of them write outside the bytes they were given. */
+static void check(char *a, char *b, size_t n)
+{
+    size_t align, i;
+
+    for(align = 0; align < 16; align += 5)
+    {
+        for(i = 0; i < n + 64; ++i)
+        {
+            a[i] = pattern(i);
+            b[i] = 0;
+        }
+
+        memcpy(b + align, a + 3, n);
+        for(i = 0; i < n + 64; ++i)
+        {
+            char expect = ((i >= align) && (i < align + n)) ? pattern(i - align + 3) : 0;
+            if(b[i] != expect)
+            {
+                printf("memcpy of %lu bytes to +%lu went wrong at %lu\n",
+                    (unsigned long) n, (unsigned long) align, (unsigned long) i);
+                fail();
+            }
+        }
+
+        // Shift up by a few bytes, over itself.
+        memmove(b + align + 7, b + align, n);
+        for(i = 0; i < n; ++i)
+        {
+            if(b[align + 7 + i] != pattern(i + 3))
+            {
+                printf("memmove of %lu bytes went wrong at %lu\n",
+                    (unsigned long) n, (unsigned long) i);
+                fail();
+            }
+        }
+
+        memset(b + align, 'z', n);
+        for(i = 0; i < n; ++i)
+        {
+            if(b[align + i] != 'z')
+            {
+                printf("memset of %lu bytes went wrong at %lu\n",
+                    (unsigned long) n, (unsigned long) i);
+                fail();
+            }
+        }
+        if(align && (b[align - 1] != 0))
+        {
+            printf("memset of %lu bytes wrote before the buffer\n", (unsigned long) n);
+            fail();
+        }
+    }
+}
+
+/** Prints MB/s for the mem* functions at each power-of-two size, so the
+ *  thresholds between the copy strategies can be tuned. */
+static void sweep(char *a, char *b)
+{
+    size_t n, i;
+
+    printf("   size  memcpy  memmove  memset   (MB/s)\n");
+    for(n = MIN_SIZE; n <= MAX_SIZE; n <<= 1)
+    {
+        size_t rounds = BYTES_PER_SIZE / n;
+        uint64_t t0, t1, t2, t3;
+
+        t0 = usecs();
+        for(i = 0; i < rounds; ++i)
+            memcpy(b, a, n);
+        t1 = usecs();
+        for(i = 0; i < rounds; ++i)
+            memmove(a + 1, a, n);
+        t2 = usecs();
+        for(i = 0; i < rounds; ++i)
+            memset(b, (int) i, n);
+        t3 = usecs();
+
+        printf("%7lu  %6llu  %7llu  %6llu\n", (unsigned long) n,
+            (unsigned long long) (BYTES_PER_SIZE / ((t1 - t0) + 1)),
+            (unsigned long long) (BYTES_PER_SIZE / ((t2 - t1) + 1)),
+            (unsigned long long) (BYTES_PER_SIZE / ((t3 - t2) + 1)));
+    }
+}
+
+/** Reading a cached file is mostly the kernel's memcpy, so this checks the
+ *  kernel's copy strategies at each size and offset and (with -b) shows how
+ *  they do. */
+static void kernel_sweep(char *buf)
+{
+    const char *path = "/tmp/testsuite-memory";
+    size_t n, i;
+
+    unlink(path);
+    int fd = open(path, O_CREAT | O_RDWR, 0644);
+    if(fd < 0)
+    {
+        printf("couldn't create %s\n", path);
+        fail();
+    }
+    for(i = 0; i < MAX_SIZE; ++i)
+        buf[i] = pattern(i);
+    if(write(fd, buf, MAX_SIZE) != MAX_SIZE)
+    {
+        printf("couldn't fill %s\n", path);
+        fail();
+    }
+
+    for(n = 1; n <= MAX_SIZE / 2; n <<= 1)
+    {
+        size_t len = n + (n & 1);
+        memset(buf, 0, len + 1);
+        if(pread(fd, buf, len, 3) != (ssize_t) len)
+        {
+            printf("pread() of %lu bytes failed\n", (unsigned long) len);
+            fail();
+        }
+        for(i = 0; i < len; ++i)
+        {
+            if(buf[i] != pattern(i + 3))
+            {
+                printf("kernel copy of %lu bytes went wrong at %lu\n",
+                    (unsigned long) len, (unsigned long) i);
+                fail();
+            }
+        }
+        if(buf[len])
+        {
+            printf("kernel copy of %lu bytes wrote past the end\n", (unsigned long) len);
+            fail();
+        }
+    }
+
+    if(benchmarks)
+    {
+        printf("   size  kernel copy (MB/s)\n");
+        for(n = 512; n <= MAX_SIZE; n <<= 1)
+        {
+            size_t rounds = (BYTES_PER_SIZE / 4) / n;
+
+            uint64_t start = usecs();
+            for(i = 0; i < rounds; ++i)
+            {
+                if(pread(fd, buf, n, 0) != (ssize_t) n)
+                {
+                    printf("pread() of %lu bytes failed\n", (unsigned long) n);
+                    fail();
+                }
+            }
+            uint64_t elapsed = usecs() - start;
+
+            printf("%7lu  %6llu\n", (unsigned long) n,
+                (unsigned long long) ((BYTES_PER_SIZE / 4) / (elapsed + 1)));
+        }
+    }
+
+    close(fd);
+    unlink(path);
+}
+
+void test_memory()
+{
+    size_t n;
+
+    char *a = (char *) malloc(MAX_SIZE + 128);
+    char *b = (char *) malloc(MAX_SIZE + 128);
+    if(!a || !b)
+    {
+        printf("couldn't allocate buffers\n");
+        fail();
+    }
+
+    for(n = 1; n <= MAX_SIZE; n <<= 1)
+    {
+        check(a, b, n - 1);
+        check(a, b, n);
+        check(a, b, n + 1);
+    }
+
+    if(benchmarks)
+        sweep(a, b);
+    kernel_sweep(a);
+
+    free(a);
+    free(b);
+}
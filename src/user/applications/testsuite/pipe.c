@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "testsuite.h"
+
+#ifndef PIPE_BUF
+#define PIPE_BUF        512
+#endif
+
+#define DD_TOTAL        (32 * 1024 * 1024)
+#define RECORD_WRITERS  4
+#define RECORD_COUNT    2000
+
+/** Equivalent of "dd bs=N | dd of=/dev/null bs=N": pushes DD_TOTAL bytes
+ *  through a pipe in blocks of bs, checks they all arrive intact and (with
+ *  -b) reports MB/s. */
+static void dd_rate(size_t bs)
+{
+    static char buf[65536];
+    int fds[2];
+    if(pipe(fds) < 0)
+    {
+        printf("pipe() failed\n");
+        fail();
+    }
+
+    uint64_t start = usecs();
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        close(fds[0]);
+        for(size_t k = 0; k < bs; ++k)
+            buf[k] = pattern(k);
+        for(size_t done = 0; done < DD_TOTAL; done += bs)
+        {
+            if(write(fds[1], buf, bs) != (ssize_t) bs)
+                _exit(1);
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    size_t total = 0;
+    ssize_t n;
+    while((n = read(fds[0], buf, bs)) > 0)
+    {
+        // Only the ends of each read, to keep the rate honest.
+        if(buf[0] != pattern(total % bs) || buf[n - 1] != pattern((total + n - 1) % bs))
+        {
+            printf("dd through a pipe corrupted data near %lu\n", (unsigned long) total);
+            fail();
+        }
+        total += n;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    uint64_t elapsed = usecs() - start;
+    if(!elapsed)
+        elapsed = 1;
+
+    if(total != DD_TOTAL || !WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        printf("dd through a pipe moved %lu of %u bytes\n", (unsigned long) total, DD_TOTAL);
+        fail();
+    }
+
+    if(benchmarks)
+        printf("dd through a pipe, bs=%lu: %llu MB/s\n", (unsigned long) bs,
+            (unsigned long long) ((DD_TOTAL * 1000000ULL) / elapsed / (1024 * 1024)));
+}
+
+void test_pipe()
+{
+    int fds[2];
+    char rec[PIPE_BUF];
+    int i;
+
+    dd_rate(512);
+    dd_rate(4096);
+    dd_rate(65536);
+
+    // Several writers at once: each PIPE_BUF-sized record must come out in
+    // one piece.
+    if(pipe(fds) < 0)
+    {
+        printf("pipe() failed\n");
+        fail();
+    }
+
+    pid_t pids[RECORD_WRITERS];
+    for(i = 0; i < RECORD_WRITERS; ++i)
+    {
+        pids[i] = fork();
+        if(pids[i] == 0)
+        {
+            close(fds[0]);
+            memset(rec, 'a' + i, sizeof(rec));
+            for(int j = 0; j < RECORD_COUNT; ++j)
+                write(fds[1], rec, sizeof(rec));
+            _exit(0);
+        }
+    }
+    close(fds[1]);
+
+    size_t have = 0, records = 0;
+    ssize_t n;
+    while((n = read(fds[0], rec + have, sizeof(rec) - have)) > 0)
+    {
+        have += n;
+        if(have < sizeof(rec))
+            continue;
+
+        for(size_t k = 1; k < sizeof(rec); ++k)
+        {
+            if(rec[k] != rec[0])
+            {
+                printf("pipe writes of PIPE_BUF bytes were interleaved\n");
+                fail();
+            }
+        }
+        ++records;
+        have = 0;
+    }
+    close(fds[0]);
+
+    for(i = 0; i < RECORD_WRITERS; ++i)
+        waitpid(pids[i], 0, 0);
+
+    if(records != RECORD_WRITERS * RECORD_COUNT)
+    {
+        printf("pipe delivered %lu of %u records\n", (unsigned long) records, RECORD_WRITERS * RECORD_COUNT);
+        fail();
+    }
+
+    printf("pipe writes of PIPE_BUF bytes are atomic.\n");
+}
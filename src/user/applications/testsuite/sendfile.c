@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/sendfile.h>
+
+#include "testsuite.h"
+
+#define SENDFILE_SIZE   (256 * 1024)
+#define SENDFILE_SKIP   1000
+
+void test_sendfile()
+{
+    const char *src = "/tmp/testsuite-sendfile-src";
+    const char *dst = "/tmp/testsuite-sendfile-dst";
+    static char buf[4096];
+    size_t i, n;
+    int fds[2];
+
+    unlink(src);
+    unlink(dst);
+
+    int in = open(src, O_CREAT | O_RDWR, 0644);
+    if(in < 0)
+    {
+        printf("couldn't create %s\n", src);
+        fail();
+    }
+    for(i = 0; i < SENDFILE_SIZE; i += sizeof(buf))
+    {
+        for(n = 0; n < sizeof(buf); ++n)
+            buf[n] = pattern(i + n);
+        write(in, buf, sizeof(buf));
+    }
+
+    if(pipe(fds) < 0)
+    {
+        printf("pipe() failed\n");
+        fail();
+    }
+
+    // A child splices everything that comes down the pipe into dst...
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        close(fds[1]);
+        int out = open(dst, O_CREAT | O_RDWR, 0644);
+        if(out < 0)
+            _exit(1);
+        ssize_t r;
+        while((r = splice(fds[0], 0, out, 0, 65536, 0)) > 0)
+            ;
+        _exit(r < 0 ? 1 : 0);
+    }
+    close(fds[0]);
+
+    // ... while we sendfile() the source into it, skipping the first few
+    // bytes. An explicit offset must leave the descriptor's own alone.
+    off_t offset = SENDFILE_SKIP;
+    off_t before = lseek(in, 0, SEEK_CUR);
+    size_t total = 0;
+    ssize_t r;
+    while(total < SENDFILE_SIZE - SENDFILE_SKIP &&
+          (r = sendfile(fds[1], in, &offset, SENDFILE_SIZE)) > 0)
+        total += r;
+    close(fds[1]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    if(total != SENDFILE_SIZE - SENDFILE_SKIP || offset != SENDFILE_SIZE)
+    {
+        printf("sendfile moved %lu bytes, expected %u\n", (unsigned long) total, SENDFILE_SIZE - SENDFILE_SKIP);
+        fail();
+    }
+    if(lseek(in, 0, SEEK_CUR) != before)
+    {
+        printf("sendfile with an offset moved the file offset\n");
+        fail();
+    }
+    if(!WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        printf("splice from a pipe to a file failed\n");
+        fail();
+    }
+    close(in);
+
+    // Check what arrived.
+    int out = open(dst, O_RDONLY);
+    size_t got = 0;
+    while(out >= 0 && (r = read(out, buf, sizeof(buf))) > 0)
+    {
+        for(n = 0; n < (size_t) r; ++n)
+        {
+            if(buf[n] != pattern(SENDFILE_SKIP + got + n))
+            {
+                printf("sendfile/splice corrupted data at offset %lu\n", (unsigned long) (got + n));
+                fail();
+            }
+        }
+        got += r;
+    }
+    close(out);
+
+    if(got != SENDFILE_SIZE - SENDFILE_SKIP)
+    {
+        printf("splice wrote %lu bytes, expected %u\n", (unsigned long) got, SENDFILE_SIZE - SENDFILE_SKIP);
+        fail();
+    }
+
+    unlink(src);
+    unlink(dst);
+
+    printf("sendfile() and splice() move data intact.\n");
+}
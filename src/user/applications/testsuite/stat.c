@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "testsuite.h"
+
+#define STAT_ITERATIONS 10000
+
+static void stat_rate(const char *path, const char *what)
+{
+    struct stat st;
+    uint64_t start = usecs();
+    for(int n = 0; n < STAT_ITERATIONS; ++n)
+        stat(path, &st);
+    uint64_t elapsed = usecs() - start;
+    if(!elapsed)
+        elapsed = 1;
+
+    printf("stat() on %s: %llu calls/sec\n", what,
+        (unsigned long long) ((STAT_ITERATIONS * 1000000ULL) / elapsed));
+}
+
+void test_stat()
+{
+    const char *path = "/tmp/testsuite-stat";
+    struct stat st;
+
+    unlink(path);
+
+    // A negative lookup must not survive creation of the file...
+    if(stat(path, &st) == 0)
+    {
+        printf("stat succeeded on a file that doesn't exist\n");
+        fail();
+    }
+
+    int fd = open(path, O_CREAT | O_RDWR, 0644);
+    if(fd < 0)
+    {
+        printf("couldn't create %s\n", path);
+        fail();
+    }
+    close(fd);
+
+    if(stat(path, &st) != 0)
+    {
+        printf("stat failed on a newly created file\n");
+        fail();
+    }
+
+    if(benchmarks)
+    {
+        stat_rate(path, "an existing file");
+        stat_rate("/applications/does-not-exist", "a missing file");
+        stat_rate("/applications/nope/nope/nope", "a missing directory");
+    }
+
+    // ... and a positive one must not survive its removal.
+    unlink(path);
+    if(stat(path, &st) == 0)
+    {
+        printf("stat succeeded on a removed file\n");
+        fail();
+    }
+
+    printf("stat() lookups are consistent.\n");
+}
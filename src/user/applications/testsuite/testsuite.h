@@ -17,15 +17,33 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
+#ifndef TESTSUITE_H
+#define TESTSUITE_H
 
-#include "SyscallTracer.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
 
-SyscallTracer::SyscallTracer(const char* pfileName, const char* pFnName, int line)
-{
+/** Aborts the test run. */
+extern void fail();
 
-}
+/** Set by -b: run the benchmarks (and the tests that need a lot of memory)
+ *  as well as the checks. */
+extern int benchmarks;
 
-SyscallTracer::~SyscallTracer()
+/** Microseconds since the epoch, for timing benchmarks. */
+static inline uint64_t usecs()
 {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return ((uint64_t) tv.tv_sec * 1000000ULL) + tv.tv_usec;
+}
 
+/** A byte of a pattern that doesn't line up with any power of two, so data
+ *  that ends up at the wrong offset is caught. */
+static inline char pattern(size_t i)
+{
+    return 'a' + (i % 23);
 }
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "testsuite.h"
+
+#define PAGE_SIZE       4096
+#define MUNMAP_ROUNDS   32
+#define PINGPONG_ROUNDS 10000
+
+/** Maps and touches nPages, checks munmap() leaves nothing behind and (with
+ *  -b) reports how long it takes. */
+static void munmap_latency(size_t nPages)
+{
+    size_t len = nPages * PAGE_SIZE;
+    uint64_t total = 0;
+
+    for(int round = 0; round < MUNMAP_ROUNDS; ++round)
+    {
+        char *p = (char *) mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if(p == MAP_FAILED)
+        {
+            printf("mmap() of %lu pages failed\n", (unsigned long) nPages);
+            fail();
+        }
+
+        for(size_t i = 0; i < len; i += PAGE_SIZE)
+            p[i] = 'x';
+
+        uint64_t start = usecs();
+        munmap(p, len);
+        total += usecs() - start;
+
+        // The same range, mapped again, must not show the old pages through
+        // a stale TLB entry.
+        p = (char *) mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0);
+        if(p == MAP_FAILED)
+        {
+            printf("mmap() of %lu pages failed\n", (unsigned long) nPages);
+            fail();
+        }
+        for(size_t i = 0; i < len; i += PAGE_SIZE)
+        {
+            if(p[i])
+            {
+                printf("munmap() left a stale mapping behind\n");
+                fail();
+            }
+        }
+        munmap(p, len);
+    }
+
+    if(benchmarks)
+        printf("munmap of %lu touched pages: %llu us\n", (unsigned long) nPages,
+            (unsigned long long) (total / MUNMAP_ROUNDS));
+}
+
+/** Bounces a byte between two processes over pipes, which costs two
+ *  context switches (and address space switches) per round trip. The byte
+ *  is counted up on each side so a lost or stale switch shows. */
+static void context_switch_cost()
+{
+    int ping[2], pong[2];
+    char c = 0;
+
+    if(pipe(ping) < 0 || pipe(pong) < 0)
+    {
+        printf("pipe() failed\n");
+        fail();
+    }
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        close(ping[1]);
+        close(pong[0]);
+        while(read(ping[0], &c, 1) == 1)
+        {
+            ++c;
+            write(pong[1], &c, 1);
+        }
+        _exit(0);
+    }
+
+    close(ping[0]);
+    close(pong[1]);
+
+    uint64_t start = usecs();
+    for(int i = 0; i < PINGPONG_ROUNDS; ++i)
+    {
+        char sent = c;
+        if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1)
+        {
+            printf("pipe ping-pong broke off after %d rounds\n", i);
+            fail();
+        }
+        if(c != (char) (sent + 1))
+        {
+            printf("pipe ping-pong got a stale reply after %d rounds\n", i);
+            fail();
+        }
+    }
+    uint64_t elapsed = usecs() - start;
+
+    close(ping[1]);
+    close(pong[0]);
+    waitpid(pid, 0, 0);
+
+    if(benchmarks)
+        printf("context switch via pipe ping-pong: %llu ns\n",
+            (unsigned long long) ((elapsed * 1000ULL) / (PINGPONG_ROUNDS * 2)));
+}
+
+void test_tlb()
+{
+    munmap_latency(1);
+    munmap_latency(16);
+    munmap_latency(256);
+
+    context_switch_cost();
+}